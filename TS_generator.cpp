@@ -0,0 +1,87 @@
+#include "tsCommon.h"
+#include "tsStreamGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+//=============================================================================================================================================================================
+
+static void PrintUsage(const char* AppName)
+{
+    printf("Usage: %s [options] output.ts | -\n", AppName);
+    printf("  -d <seconds>        length of the multiplex (default: 10)\n");
+    printf("  -n <packets>        length in packets, overrides -d\n");
+    printf("  -s <seed>           random seed, the same seed and options give the same bytes (default: 1)\n");
+    printf("  -V <N>              video streams (default: 1, at most 16), PIDs from 256, the first one carries the PCR\n");
+    printf("  -A <N>              audio streams (default: 2), PIDs after the video ones\n");
+    printf("  -b <bps>            video bitrate per stream (default: 8000000)\n");
+    printf("  -B <bps>            audio bitrate per stream (default: 192000)\n");
+    printf("  -P <bytes>          average video PES size (default: 40000)\n");
+    printf("  -Q <bytes>          average audio PES size (default: 2304)\n");
+    printf("  -g <N>              video PES per IDR (default: 25)\n");
+    printf("  -m <bps>            mux bitrate, filled with null packets (default: 10%% above the streams)\n");
+    printf("  -f <ratio>          share of payload packets with an adaptation field (default: 0.05)\n");
+    printf("  -L <ratio>          packet loss probability\n");
+    printf("  -U <ratio>          duplicate packet probability\n");
+    printf("  -C <ratio>          payload corruption probability\n");
+    printf("  -T <ratio>          transport_error_indicator probability\n");
+    printf("  -Y <ratio>          sync loss probability (1-187 garbage bytes before a packet)\n");
+    printf("  -H <bytes>          PES header bytes in a PES start packet (1-13), the rest continues in the next packet\n");
+    printf("  -h                  print this help\n");
+}
+
+int main(int argc, char *argv[])
+{
+    xTS_StreamGenerator::xConfig Config;
+    const char* OutputFileName = nullptr;
+    double      Seconds        = 10;
+    int64_t     NumPackets     = -1;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const bool HasValue = i + 1 < argc;
+        if     (!std::strcmp(argv[i], "-d") && HasValue) { Seconds               = std::atof(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-n") && HasValue) { NumPackets            = std::atoll(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-s") && HasValue) { Config.Seed           = (uint32_t)std::strtoul(argv[++i], nullptr, 0); }
+        else if(!std::strcmp(argv[i], "-V") && HasValue) { Config.NumVideo       = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-A") && HasValue) { Config.NumAudio       = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-b") && HasValue) { Config.VideoBitrate   = std::atoll(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-B") && HasValue) { Config.AudioBitrate   = std::atoll(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-P") && HasValue) { Config.VideoPESSize   = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-Q") && HasValue) { Config.AudioPESSize   = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-g") && HasValue) { Config.GOPLength      = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-m") && HasValue) { Config.MuxBitrate     = std::atoll(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-f") && HasValue) { Config.AFDensity      = std::atof(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-L") && HasValue) { Config.LossRate       = std::atof(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-U") && HasValue) { Config.DuplicateRate  = std::atof(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-C") && HasValue) { Config.CorruptRate    = std::atof(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-T") && HasValue) { Config.TEIRate        = std::atof(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-Y") && HasValue) { Config.SyncLossRate   = std::atof(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-H") && HasValue) { Config.SplitPESHeader = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-h")) { PrintUsage(argv[0]); return EXIT_SUCCESS; }
+        else if(argv[i][0] == '-' && argv[i][1] != '\0') { PrintUsage(argv[0]); return EXIT_FAILURE; }
+        else { OutputFileName = argv[i]; }
+    }
+    if(!OutputFileName || Config.SplitPESHeader < 0 || Config.SplitPESHeader > 13) { PrintUsage(argv[0]); return EXIT_FAILURE; }
+
+    xTS_StreamGenerator Generator(Config);
+    if(NumPackets < 0) { NumPackets = Generator.DurationToPackets(Seconds); }
+    if(!Generator.WriteFile(OutputFileName, NumPackets))
+    {
+        fprintf(stderr, "Cannot write %s\n", OutputFileName);
+        return EXIT_FAILURE;
+    }
+
+    // the file may be stdout - the summary goes to stderr
+    const xTS_StreamGenerator::xStats& Stats = Generator.getStats();
+    fprintf(stderr, "%" PRId64 " packets at %" PRId64 " bit/s, PCR on PID %d, PMT on PID %d\n", NumPackets, Generator.getMuxBitrate(), Generator.getPCR_PID(), xTS_StreamGenerator::PMT_PID);
+    for(int32_t i = 0; i < Generator.getNumStreams(); i++) { fprintf(stderr, "PID %4d: stream_type 0x%02X\n", Generator.getStreamPID(i), Generator.getStreamType(i)); }
+    fprintf(stderr, "%" PRIu64 " PES, %" PRIu64 " PCR, %" PRIu64 " PSI, %" PRIu64 " null packets\n", Stats.NumPES, Stats.NumPCR, Stats.NumPSI, Stats.NumNull);
+    if(Stats.NumLost || Stats.NumDuplicated || Stats.NumCorrupted || Stats.NumTEI || Stats.NumGarbage)
+    {
+        fprintf(stderr, "impairments: %" PRIu64 " lost, %" PRIu64 " duplicated, %" PRIu64 " corrupted, %" PRIu64 " TEI, %" PRIu64 " garbage bytes\n",
+                Stats.NumLost, Stats.NumDuplicated, Stats.NumCorrupted, Stats.NumTEI, Stats.NumGarbage);
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,100 +1,716 @@
-#include "tsCommon.h"
-#include "tsTransportStream.h"
-#include <iostream>
-#include <cstdio>
-
-//=============================================================================================================================================================================
-
-int main(int argc, char *argv[], char *envp[])
-{
-    // Opening the input file
-    FILE* fp = std::fopen("example_new.ts", "rb");
-    if (!fp)
-    {
-        std::perror("File opening failed");
-        return EXIT_FAILURE;
-    }
-
-    // Opening the output file
-    FILE* fp_out = std::fopen("PID136.mp2", "wb");
-    if (!fp_out)
-    {
-        std::perror("Output file opening failed");
-        std::fclose(fp);
-        return EXIT_FAILURE;
-    }
-
-    xTS_PacketHeader TS_PacketHeader;
-    xTS_AdaptationField TS_AdaptationField;
-    xPES_Assembler PES_Assembler;
-    PES_Assembler.Init(136);
-
-    const uint8_t BUFFER_SIZE = 188;
-    uint8_t TS_PacketBuffer[BUFFER_SIZE];
-    int32_t TS_PacketId = 0;
-
-    // Looping through all packets until the end of the file
-    while (true) {
-        if (std::feof(fp)) {
-            std::puts("End of file reached.");
-            break;
-        }
-
-        size_t readBytes = fread(TS_PacketBuffer, 1, BUFFER_SIZE, fp);
-        if (readBytes < BUFFER_SIZE) {
-            std::puts("Error or end of file reached while reading a packet");
-            break;
-        }
-
-        TS_PacketHeader.Reset();
-        TS_PacketHeader.Parse(TS_PacketBuffer);
-        printf("%010d ", TS_PacketId++);
-        TS_PacketHeader.Print();
-
-        if (TS_PacketHeader.getAFC() == 2 || TS_PacketHeader.getAFC() == 3) {
-            TS_AdaptationField.Reset();
-            TS_AdaptationField.Parse(TS_PacketBuffer + xTS::TS_HeaderLength, TS_PacketHeader.getAFC());
-            TS_AdaptationField.Print();
-        }
-
-        if (TS_PacketHeader.getPID() == 136) {
-            xPES_Assembler::eResult Result = PES_Assembler.AbsorbPacket(TS_PacketBuffer, &TS_PacketHeader, &TS_AdaptationField);
-            switch(Result)
-            {
-                case xPES_Assembler::eResult::StreamPacketLost:
-                    printf(" Packet lost\n");
-                    break;
-                case xPES_Assembler::eResult::AssemblingStarted:
-                    printf(" Assembling started\n");
-                    PES_Assembler.PrintPESH();
-                    break;
-                case xPES_Assembler::eResult::AssemblingContinue:
-                    printf(" Assembling continues\n");
-                    break;
-                case xPES_Assembler::eResult::AssemblingFinished:
-                    printf(" Assembling finished\n");
-                    PES_Assembler.PrintPESH();
-                    // Writing the assembled PES packet to file
-                    fwrite(PES_Assembler.getPacket(), 1, PES_Assembler.getNumPacketBytes(), fp_out);
-                    break;
-                default:
-                    break;
-            }
-        }
-
-        printf("\n");
-    }
-
-    // Check for I/O errors and close the files
-    if (std::ferror(fp))
-        std::puts("I/O error when reading");
-    else if (std::feof(fp))
-        std::puts("End of file reached successfully");
-
-    fclose(fp);  // Closing the input file
-    fclose(fp_out);  // Closing the output file
-
-    return EXIT_SUCCESS;
-}
-
-//=============================================================================================================================================================================
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketSource.h"
+#include "tsDemuxer.h"
+#include "tsPipeline.h"
+#include "tsAsyncWriter.h"
+#include "tsChunkedParser.h"
+#include "tsEventWriter.h"
+#include "tsPCRAnalyzer.h"
+#include "tsPTSIndex.h"
+#include "tsPacketIndex.h"
+#include "tsStats.h"
+#include "tsAUIndex.h"
+#include "tsRemux.h"
+#include "tsBatchRunner.h"
+#include "tsPlayout.h"
+#include "tsCheckpoint.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+//=============================================================================================================================================================================
+
+enum class eOutputLevel { Silent, Summary, Packets };
+
+static void PrintUsage(const char* AppName)
+{
+    printf("Usage: %s [options] [input.ts | - | udp://[address]:port]\n", AppName);
+    printf("  -s <source>         packet source backend: mmap (default), buffered or stream (pipe, read as data arrives)\n");
+    printf("                      input '-' reads stdin, udp:// and rtp:// receive from a local socket\n");
+    printf("  -w <ms>             end of a UDP input (or of -F) after <ms> without data (default: wait forever)\n");
+    printf("  -p <PID>            extract PES of PID to PID<PID>.<ext>, may be repeated (default: 136)\n");
+    printf("  -a                  extract all PES streams found in the input\n");
+    printf("  -m                  extract all PES streams announced in the PMTs (PAT/PMT discovery)\n");
+    printf("  -c                  PCR analysis: bitrate, PCR interval and accuracy per program\n");
+    printf("  -i                  write the PTS index <input>.ptsidx (PES starts of all PIDs) for fast time window extraction\n");
+    printf("  -u                  write an access unit index PID<PID>.<ext>.auidx next to every extracted stream\n");
+    printf("                      (frame/GOP offsets, picture types and PTS in the elementary stream)\n");
+    printf("  -S <time>           extract only PES with PTS from <time> on ([[hh:]mm:]ss[.fff] since the first PTS of the input)\n");
+    printf("  -D <time>           length of the time window (default: to the end), seeks via <input>.ptsidx if present\n");
+    printf("  -x                  build or update the packet index <input>.tsidx; with -p, -s mmap and -v summary/silent\n");
+    printf("                      only the packets of the PIDs are read, using the index\n");
+    printf("  -l                  list the streams from the packet index (built or updated first) and exit\n");
+    printf("  -O <offset>         with -x extraction: start each PID at its last random access point before byte <offset>\n");
+    printf("  -R <output.ts|->    remux: write whole packets of the -p PIDs and -P programs (with PAT, PMT and PCR PIDs) to a new\n");
+    printf("                      transport stream instead of extracting PES; without -p and -P every packet is passed through\n");
+    printf("  -P <program>        with -R: keep program_number <program> with all its streams, may be repeated\n");
+    printf("  -T                  with -R: rewrite PAT and PMTs to list only the kept programs and streams\n");
+    printf("  -N                  with -R: strip null packets (PID 8191)\n");
+    printf("  -K <copy>           with -R: auto (default: splice for a pipe, copy_file_range otherwise), copy_file_range, splice\n");
+    printf("                      or write (from the input mapping)\n");
+    printf("  -U <udp://a:port>   real-time playout of the input to a UDP address (unicast or multicast), paced by its PCR:\n");
+    printf("                      7 packets per datagram; may be repeated with several inputs (one address per input, or\n");
+    printf("                      one address with consecutive ports); with -p the PCR is taken from <PID>\n");
+    printf("  -L <N>              with -U: play the inputs N times (default: 1, 0 = endless)\n");
+    printf("  -X <speed>          with -U: playout speed (default: 1 = real time, 0 = unpaced, as fast as possible)\n");
+    printf("                      with -U, -D <time> stops the playout after <time>\n");
+    printf("  -F                  follow a growing file (recording in progress): after its end wait for appended data\n");
+    printf("                      (inotify) and parse it; resumes from and keeps saving the checkpoint <input>.tsckpt\n");
+    printf("  -C                  incremental run: resume from the checkpoint <input>.tsckpt, parse to the end of the file\n");
+    printf("                      and save the checkpoint again - only data appended since the last run is parsed\n");
+    printf("  -e <policy>         PES with lost packets: drop (default), zero (lost packets zero-filled) or pass (emitted without them)\n");
+    printf("  -z                  zero-copy PES assembly (scatter-gather from the input mapping, requires -s mmap)\n");
+    printf("  -M <file>           write statistics (per-PID counters, time per stage) to <file>: Prometheus text for\n");
+    printf("                      .prom/.txt, JSON otherwise; rewritten periodically and at the end\n");
+    printf("  -I <ms>             statistics snapshot interval (default: 1000, 0 = only at the end)\n");
+    printf("  -W <writer>         output writer: sync (default, fwrite in the parse loop), async (io_uring, else a writer thread),\n");
+    printf("                      uring or thread\n");
+    printf("  -B                  with an asynchronous writer: O_DIRECT output, bypassing the page cache\n");
+    printf("  -t <N>              threaded pipeline with N assembler/writer workers (no per-packet trace)\n");
+    printf("  -j <N>              parse the file in N parallel chunks (0 = one per hardware thread, no per-packet trace)\n");
+    printf("  -b <files>          batch: parse many files on a work-stealing pool of -j workers (default: one per hardware\n");
+    printf("                      thread), large files split into chunks; <files> is a glob pattern, a name or @<list file>,\n");
+    printf("                      may be repeated, further input names are added; outputs are <input>.PID<PID>.<ext>\n");
+    printf("  -o <dir>            with -b: write the outputs to <dir> instead of next to the inputs\n");
+    printf("  -v <level>          output level: silent, summary or packets (per-packet trace, default)\n");
+    printf("  -f <format>         per-packet trace format: text (default), ndjson or binary\n");
+    printf("  -h                  print this help\n");
+}
+
+static void PrintSourceSummary(FILE* Out, const xTS_PacketSource& Source, int32_t Status)
+{
+    if (Status < 0)
+        fprintf(Out, "I/O error when reading\n");
+    else if (Status > 0)
+        fprintf(Out, "End of the time window reached\n");
+    else if (Source.getTrailingBytes())
+        fprintf(Out, "End of file reached, %u trailing bytes ignored\n", (uint32_t)Source.getTrailingBytes());
+    else
+        fprintf(Out, "End of file reached successfully\n");
+
+    if (Source.getFormat().PacketSize != (int32_t)xTS::TS_PacketLength)
+        fprintf(Out, "Packet size: %d bytes\n", Source.getFormat().PacketSize);
+    if (Source.getNumSyncLosses() || Source.getNumSkippedBytes())
+        fprintf(Out, "Sync lost %" PRIu64 " times, %" PRIu64 " bytes skipped\n", Source.getNumSyncLosses(), Source.getNumSkippedBytes());
+    if (const xTS_UDPSource* UDP = dynamic_cast<const xTS_UDPSource*>(&Source))
+        fprintf(Out, "%" PRIu64 " datagrams, %" PRIu64 " RTP, %" PRIu64 " lost\n", UDP->getNumDatagrams(), UDP->getNumRTPDatagrams(), UDP->getNumRTPLost());
+}
+
+static int32_t ReadSpan(xTS_PacketSource& Source, xTS_PacketSpan& Span, xTS_Stats* Stats)
+{
+    xTS_Stats::xStageTimer Timer(Stats, xTS_Stats::eStage::Read);
+    const int32_t NumPackets = Source.ReadSpan(Span);
+    if (Stats && NumPackets > 0) { Stats->setPacketSize(Span.PacketSize); } // known after the first read on stream inputs
+    return NumPackets;
+}
+
+static void PrintStageSummary(FILE* Out, const xTS_Stats& Stats)
+{
+    fprintf(Out, "Stages:");
+    for (int32_t s = 0; s < (int32_t)xTS_Stats::eStage::NumStages; s++)
+        fprintf(Out, "%s %s %.3f s", s ? "," : "", xTS_Stats::StageToString((xTS_Stats::eStage)s), Stats.getSeconds((xTS_Stats::eStage)s));
+    fprintf(Out, "\n");
+}
+
+// Cuts Span at StopOffset, the input past it lies behind the time window. Returns the packets left.
+static int32_t ClipSpan(xTS_PacketSpan& Span, uint64_t StopOffset)
+{
+    if (Span.Offset >= StopOffset)
+        Span.NumPackets = 0;
+    else
+        Span.NumPackets = (int32_t)std::min<uint64_t>((uint64_t)Span.NumPackets, (StopOffset - Span.Offset - 1) / Span.PacketSize + 1);
+    return Span.NumPackets;
+}
+
+static void PrintStreamSummary(FILE* Out, const xTS_Demuxer::xStream& Stream)
+{
+    const xPES_Assembler::xStats& Stats = Stream.Assembler.getStats();
+    fprintf(Out, "PID %4d: %10" PRIu64 " packets %8" PRIu64 " PES %12" PRIu64 " bytes %6" PRIu64 " lost\n",
+            Stream.PID, Stream.NumPackets, Stream.NumPES, Stream.NumBytes, Stats.NumLost);
+    if (Stats.NumLost || Stats.NumDuplicates || Stats.NumTEI || Stats.NumDiscontinuities)
+        fprintf(Out, "  continuity: %" PRIu64 " duplicates, %" PRIu64 " TEI, %" PRIu64 " discontinuities; PES %" PRIu64 " dropped, %" PRIu64 " damaged\n",
+                Stats.NumDuplicates, Stats.NumTEI, Stats.NumDiscontinuities, Stats.NumDroppedPES, Stream.NumDamagedPES);
+}
+
+static void PrintAUIndexSummary(FILE* Out, const xTS_Demuxer& Demuxer, const xTS_AUIndex& AUIndex)
+{
+    for (const xTS_Demuxer::xStream& Stream : Demuxer.getStreams()) {
+        const xES_AUIndexer* Indexer = AUIndex.getIndexer(Stream.PID);
+        if (!Indexer) { continue; }
+        fprintf(Out, "PID %4d: %-15s %8zu access units %6" PRIu64 " key %6" PRIu64 " GOPs\n",
+                Stream.PID, xES_AUIndexer::CodecToString(Indexer->getCodec()), Indexer->getEntries().size(), Indexer->getNumKey(), Indexer->getNumGOP());
+    }
+}
+
+static void PrintProgramSummary(FILE* Out, const xPSI_Parser& PSI)
+{
+    if (!PSI.hasPAT()) { return; }
+    fprintf(Out, "Transport stream %u, %" PRIu64 " PSI sections (%" PRIu64 " repeats, %" PRIu64 " CRC errors)\n",
+            PSI.getPAT().TransportStreamId, PSI.getStats().NumSections, PSI.getStats().NumRepeats, PSI.getStats().NumCRCErrors);
+    for (const xPSI_PMT& PMT : PSI.getPMTs()) {
+        fprintf(Out, "Program %u: PMT PID %u, PCR PID %u\n", PMT.ProgramNumber, PMT.PID, PMT.PCR_PID);
+        for (const xPSI_PMT::xStream& Stream : PMT.Streams)
+            fprintf(Out, "  PID %4u: stream type 0x%02X (%s)\n", Stream.PID, Stream.StreamType, xPSI_Parser::StreamTypeToString(Stream.StreamType));
+    }
+    if (PSI.hasSDT()) {
+        for (const xPSI_SDT::xService& Service : PSI.getSDT().Services)
+            fprintf(Out, "Service %u: %s (%s)\n", Service.ServiceId, Service.Name.c_str(), Service.Provider.c_str());
+    }
+}
+
+static void PrintPCRSummary(FILE* Out, const xTS_PCRAnalyzer& Analyzer)
+{
+    for (const xTS_PCRAnalyzer::xStats& Stats : Analyzer.getStats()) {
+        fprintf(Out, "PCR PID %4d (program %u): %" PRIu64 " PCRs, interval %.1f/%.1f/%.1f ms, TS %.3f Mbit/s, program %.3f Mbit/s\n",
+                Stats.PCR_PID, Stats.ProgramNumber, Stats.NumPCRs, Stats.MinInterval_ms, Stats.AvgInterval_ms, Stats.MaxInterval_ms,
+                Stats.TSBitrate / 1e6, Stats.ProgramBitrate / 1e6);
+        fprintf(Out, "  accuracy max %.0f ns, RMS %.0f ns; errors: %" PRIu64 " repetition, %" PRIu64 " accuracy, %" PRIu64 " discontinuity (%" PRIu64 " signalled)\n",
+                Stats.MaxJitter_ns, Stats.RMSJitter_ns, Stats.NumRepetitionErrors, Stats.NumAccuracyErrors, Stats.NumDiscontinuityErrors, Stats.NumDiscontinuities);
+    }
+}
+
+static void PrintPacketIndex(FILE* Out, const xTS_PacketIndex& Index)
+{
+    const xTS_PacketIndex::xFileHeader& Header = Index.getHeader();
+    fprintf(Out, "%" PRIu64 " packets of %u bytes, %" PRIu64 " bytes indexed, %" PRIu64 " segment(s)\n",
+            Header.NumPackets, Header.PacketSize, Header.IndexedBytes, Header.NumSegments);
+    for (uint64_t i = 0; i < Index.getNumPIDs(); i++) {
+        const xTS_PacketIndex::xPIDInfo& Info = Index.getPIDs()[i];
+        fprintf(Out, "PID %4u: %10" PRIu64 " packets %8" PRIu64 " PUSI %8" PRIu64 " random access %6" PRIu64 " discontinuities %6" PRIu64 " CC errors\n",
+                Info.PID, Info.NumPackets, Info.NumPUSI, Info.NumRandomAccess, Info.NumDiscontinuities, Info.NumCCErrors);
+    }
+}
+
+static void PrintChunkedSummary(FILE* Out, const xTS_ChunkedParser& Parser)
+{
+    if (Parser.getTrailingBytes())
+        fprintf(Out, "End of file reached, %u trailing bytes ignored\n", (uint32_t)Parser.getTrailingBytes());
+    else
+        fprintf(Out, "End of file reached successfully\n");
+    if (Parser.getFormat().PacketSize != (int32_t)xTS::TS_PacketLength)
+        fprintf(Out, "Packet size: %d bytes\n", Parser.getFormat().PacketSize);
+    if (Parser.getNumSyncLosses() || Parser.getNumSkippedBytes())
+        fprintf(Out, "Sync lost %" PRIu64 " times, %" PRIu64 " bytes skipped\n", Parser.getNumSyncLosses(), Parser.getNumSkippedBytes());
+
+    fprintf(Out, "%d chunks, %" PRIu64 " packets\n", Parser.getNumChunks(), Parser.getNumPackets());
+    for (const xTS_ChunkedParser::xPIDStats& Stats : Parser.getStats()) {
+        fprintf(Out, "PID %4d: %10" PRIu64 " packets %6" PRIu64 " CC errors", Stats.PID, Stats.NumPackets, Stats.NumCCErrors);
+        if (Stats.Extracted) { fprintf(Out, " %8" PRIu64 " PES %12" PRIu64 " bytes", Stats.NumPES, Stats.NumBytes); }
+        fprintf(Out, "\n");
+    }
+}
+
+int main(int argc, char *argv[], char *envp[])
+{
+    (void)envp;
+
+    const char* InputFileName = "example_new.ts";
+    xTS_PacketSource::eType SourceType = xTS_PacketSource::eType::Mapped;
+    std::vector<int32_t> PIDs;
+    bool ExtractAll = false;
+    bool ExtractFromPMT = false;
+    bool AnalyzePCR = false;
+    bool ZeroCopy = false;
+    bool BuildIndex = false;
+    int64_t WindowBeg = -1;
+    int64_t WindowLength = -1;
+    bool UsePacketIndex = false;
+    bool ListStreams = false;
+    uint64_t StartOffset = 0;
+    int32_t NumWorkers = 0;
+    int32_t NumChunks = -1;
+    int32_t TimeoutMs = 0;
+    eOutputLevel Level = eOutputLevel::Packets;
+    xTS_EventWriter::eFormat TraceFormat = xTS_EventWriter::eFormat::Text;
+    xPES_Assembler::eLossPolicy LossPolicy = xPES_Assembler::eLossPolicy::Drop;
+    const char* StatsFileName = nullptr;
+    int32_t StatsInterval_ms = 1000;
+    bool AsyncWrite = false;
+    xTS_AsyncWriter::xConfig WriterConfig;
+    bool BuildAUIndex = false;
+    std::vector<std::string> Inputs;
+    std::vector<std::string> BatchInputs;
+    const char* BatchOutputDir = nullptr;
+    const char* RemuxFileName = nullptr;
+    std::vector<std::string> PlayoutAddresses;
+    xTS_Playout::xConfig PlayoutConfig;
+    xTS_Remuxer::xConfig RemuxConfig;
+    bool Follow = false;
+    bool Checkpointed = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!std::strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            const char* Type = argv[++i];
+            if     (!std::strcmp(Type, "mmap"    )) { SourceType = xTS_PacketSource::eType::Mapped;   }
+            else if(!std::strcmp(Type, "buffered")) { SourceType = xTS_PacketSource::eType::Buffered; }
+            else if(!std::strcmp(Type, "stream"  )) { SourceType = xTS_PacketSource::eType::Stream;   }
+            else { PrintUsage(argv[0]); return EXIT_FAILURE; }
+        }
+        else if(!std::strcmp(argv[i], "-e") && i + 1 < argc)
+        {
+            const char* Policy = argv[++i];
+            if     (!std::strcmp(Policy, "drop")) { LossPolicy = xPES_Assembler::eLossPolicy::Drop;        }
+            else if(!std::strcmp(Policy, "zero")) { LossPolicy = xPES_Assembler::eLossPolicy::ZeroFill;    }
+            else if(!std::strcmp(Policy, "pass")) { LossPolicy = xPES_Assembler::eLossPolicy::PassThrough; }
+            else { PrintUsage(argv[0]); return EXIT_FAILURE; }
+        }
+        else if(!std::strcmp(argv[i], "-p") && i + 1 < argc) { PIDs.push_back(std::atoi(argv[++i])); }
+        else if(!std::strcmp(argv[i], "-a")) { ExtractAll = true; }
+        else if(!std::strcmp(argv[i], "-m")) { ExtractFromPMT = true; }
+        else if(!std::strcmp(argv[i], "-c")) { AnalyzePCR = true; }
+        else if(!std::strcmp(argv[i], "-z")) { ZeroCopy = true; }
+        else if(!std::strcmp(argv[i], "-i")) { BuildIndex = true; }
+        else if(!std::strcmp(argv[i], "-u")) { BuildAUIndex = true; }
+        else if(!std::strcmp(argv[i], "-b") && i + 1 < argc) { BatchInputs.push_back(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-o") && i + 1 < argc) { BatchOutputDir = argv[++i]; }
+        else if(!std::strcmp(argv[i], "-R") && i + 1 < argc) { RemuxFileName = argv[++i]; }
+        else if(!std::strcmp(argv[i], "-P") && i + 1 < argc) { RemuxConfig.Programs.push_back(std::atoi(argv[++i])); }
+        else if(!std::strcmp(argv[i], "-T")) { RemuxConfig.RewritePSI = true; }
+        else if(!std::strcmp(argv[i], "-N")) { RemuxConfig.StripNull = true; }
+        else if(!std::strcmp(argv[i], "-K") && i + 1 < argc) { if(!xTS_Remuxer::StringToCopy(argv[++i], RemuxConfig.Copy)) { PrintUsage(argv[0]); return EXIT_FAILURE; } }
+        else if(!std::strcmp(argv[i], "-U") && i + 1 < argc) { PlayoutAddresses.push_back(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-L") && i + 1 < argc) { PlayoutConfig.NumLoops = std::max(0, std::atoi(argv[++i])); }
+        else if(!std::strcmp(argv[i], "-X") && i + 1 < argc) { PlayoutConfig.Speed = std::max(0.0, std::atof(argv[++i])); }
+        else if(!std::strcmp(argv[i], "-F")) { Follow = true; Checkpointed = true; }
+        else if(!std::strcmp(argv[i], "-C")) { Checkpointed = true; }
+        else if(!std::strcmp(argv[i], "-x")) { UsePacketIndex = true; }
+        else if(!std::strcmp(argv[i], "-l")) { UsePacketIndex = true; ListStreams = true; }
+        else if(!std::strcmp(argv[i], "-O") && i + 1 < argc) { StartOffset = std::strtoull(argv[++i], nullptr, 0); }
+        else if(!std::strcmp(argv[i], "-S") && i + 1 < argc) { if(!xTS_PTSIndex::ParseTime(argv[++i], WindowBeg   )) { PrintUsage(argv[0]); return EXIT_FAILURE; } }
+        else if(!std::strcmp(argv[i], "-D") && i + 1 < argc) { if(!xTS_PTSIndex::ParseTime(argv[++i], WindowLength)) { PrintUsage(argv[0]); return EXIT_FAILURE; } }
+        else if(!std::strcmp(argv[i], "-t") && i + 1 < argc) { NumWorkers = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-j") && i + 1 < argc) { NumChunks = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-w") && i + 1 < argc) { TimeoutMs = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-M") && i + 1 < argc) { StatsFileName = argv[++i]; }
+        else if(!std::strcmp(argv[i], "-I") && i + 1 < argc) { StatsInterval_ms = std::max(0, std::atoi(argv[++i])); }
+        else if(!std::strcmp(argv[i], "-W") && i + 1 < argc)
+        {
+            const char* Writer = argv[++i];
+            if     (!std::strcmp(Writer, "sync")) { AsyncWrite = false; }
+            else if(xTS_AsyncWriter::StringToBackend(Writer, WriterConfig.Backend)) { AsyncWrite = true; }
+            else { PrintUsage(argv[0]); return EXIT_FAILURE; }
+        }
+        else if(!std::strcmp(argv[i], "-B")) { WriterConfig.Direct = true; }
+        else if(!std::strcmp(argv[i], "-v") && i + 1 < argc)
+        {
+            const char* Name = argv[++i];
+            if     (!std::strcmp(Name, "silent" )) { Level = eOutputLevel::Silent;  }
+            else if(!std::strcmp(Name, "summary")) { Level = eOutputLevel::Summary; }
+            else if(!std::strcmp(Name, "packets")) { Level = eOutputLevel::Packets; }
+            else { PrintUsage(argv[0]); return EXIT_FAILURE; }
+        }
+        else if(!std::strcmp(argv[i], "-f") && i + 1 < argc) { if(!xTS_EventWriter::StringToFormat(argv[++i], TraceFormat)) { PrintUsage(argv[0]); return EXIT_FAILURE; } }
+        else if(!std::strcmp(argv[i], "-h")) { PrintUsage(argv[0]); return EXIT_SUCCESS; }
+        else if(argv[i][0] == '-' && argv[i][1]) { PrintUsage(argv[0]); return EXIT_FAILURE; }
+        else                                 { InputFileName = argv[i]; Inputs.push_back(argv[i]); }
+    }
+
+    SourceType = xTS_PacketSource::TypeForInput(InputFileName, SourceType);
+    const bool Live = xTS_PacketSource::isLive(SourceType) || Follow;
+    const bool Windowed = WindowBeg >= 0 || WindowLength >= 0;
+
+    if (ZeroCopy && SourceType != xTS_PacketSource::eType::Mapped) {
+        std::puts("Zero-copy assembly requires the mmap packet source");
+        return EXIT_FAILURE;
+    }
+    // incremental parsing - only the demuxer state is checkpointed, so nothing else may need the earlier packets
+    if (Checkpointed && (AnalyzePCR || BuildIndex || BuildAUIndex || Windowed || UsePacketIndex || ZeroCopy || AsyncWrite || NumWorkers > 0 || NumChunks >= 0 ||
+                         !BatchInputs.empty() || RemuxFileName || !PlayoutAddresses.empty() || SourceType != xTS_PacketSource::eType::Mapped)) {
+        std::puts("-F and -C work on a file with the default source and cannot be combined with -c, -i, -u, -S, -D, -x, -z, -W, -t, -j, -b, -R and -U");
+        return EXIT_FAILURE;
+    }
+
+    // remux - packets are selected by PID, never de-packetized, so none of the extraction options apply
+    if (RemuxFileName) {
+        if (ExtractAll || ExtractFromPMT || AnalyzePCR || BuildIndex || BuildAUIndex || Windowed || UsePacketIndex || StartOffset || ZeroCopy ||
+            StatsFileName || AsyncWrite || NumWorkers > 0 || NumChunks >= 0 || SourceType != xTS_PacketSource::eType::Mapped) {
+            std::puts("-R works on the mmap source only and cannot be combined with -a, -m, -c, -i, -u, -S, -D, -x, -O, -z, -M, -W, -t and -j");
+            return EXIT_FAILURE;
+        }
+        RemuxConfig.PIDs = PIDs;
+        xTS_Remuxer Remuxer;
+        const bool Ok = Remuxer.Run(InputFileName, RemuxFileName, RemuxConfig);
+        if (!Ok && Remuxer.getStats().NumPackets == 0 && !Remuxer.getSource().getNumBytesRead()) { std::perror("File opening failed"); return EXIT_FAILURE; }
+        if (Level != eOutputLevel::Silent) {
+            FILE* Out = std::strcmp(RemuxFileName, "-") ? stdout : stderr; // the stream owns stdout
+            const xTS_Remuxer::xStats& Stats = Remuxer.getStats();
+            PrintSourceSummary(Out, Remuxer.getSource(), Ok ? 0 : -1);
+            fprintf(Out, "%" PRIu64 " of %" PRIu64 " packets kept in %" PRIu64 " runs, %" PRIu64 " output calls (%s), %" PRIu64 " null packets stripped, %" PRIu64 " PAT/PMT packets rewritten\n",
+                    Stats.NumKept, Stats.NumPackets, Stats.NumRuns, Stats.NumCalls, xTS_Remuxer::CopyToString(Remuxer.getCopy()), Stats.NumNull, Stats.NumPSIPackets);
+            fprintf(Out, "%.3f MB written\n", Stats.NumBytesOut / 1e6);
+        }
+        return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // playout - packets are paced by the PCR and sent whole, nothing is extracted
+    if (!PlayoutAddresses.empty()) {
+        if (ExtractAll || ExtractFromPMT || AnalyzePCR || BuildIndex || BuildAUIndex || WindowBeg >= 0 || UsePacketIndex || StartOffset || ZeroCopy ||
+            StatsFileName || AsyncWrite || NumWorkers > 0 || NumChunks >= 0 || !BatchInputs.empty() || PIDs.size() > 1 || SourceType != xTS_PacketSource::eType::Mapped) {
+            std::puts("-U works on the mmap source only and cannot be combined with -a, -m, -c, -i, -u, -S, -x, -O, -z, -M, -W, -t, -j and -b");
+            return EXIT_FAILURE;
+        }
+        if (Inputs.empty()) { Inputs.push_back(InputFileName); }
+        std::vector<xTS_Playout::xChannel> Channels;
+        for (size_t c = 0; c < Inputs.size(); c++) {
+            std::string Address = PlayoutAddresses.size() == Inputs.size() ? PlayoutAddresses[c] : PlayoutAddresses[0];
+            std::string Host;
+            uint16_t    Port = 0;
+            if (PlayoutAddresses.size() != Inputs.size() && (PlayoutAddresses.size() != 1 || !xTS_UDPSource::ParseAddress(Address.c_str(), Host, Port) || Port + c > 65535)) {
+                std::puts("-U needs one address per input, or one address to count the ports up from");
+                return EXIT_FAILURE;
+            }
+            if (c > 0 && PlayoutAddresses.size() == 1) { Address = "udp://" + Host + ":" + std::to_string(Port + c); }
+            Channels.push_back({ Inputs[c], Address });
+        }
+        if (!PIDs.empty()) { PlayoutConfig.PCR_PID = PIDs[0]; }
+        if (WindowLength >= 0) { PlayoutConfig.Duration_ms = std::max<int64_t>(1, WindowLength / xTS::BaseClockFrequency_kHz); }
+        xTS_Playout Playout;
+        const bool Ok = Playout.Run(Channels, PlayoutConfig);
+        if (!Ok && Playout.getStats().NumDatagrams == 0) { return EXIT_FAILURE; } // the reason has been printed
+        if (Level != eOutputLevel::Silent) {
+            const xTS_Playout::xStats& Stats = Playout.getStats();
+            for (size_t c = 0; c < Playout.getChannelStats().size(); c++) {
+                const xTS_Playout::xChannelStats& Channel = Playout.getChannelStats()[c];
+                fprintf(stdout, "%s -> %s: %10" PRIu64 " packets %8" PRIu64 " datagrams, PCR PID %d, %" PRIu64 " PCRs (%" PRIu64 " discontinuities), %.3f Mbit/s, %.3f s\n",
+                        Channels[c].InputFileName.c_str(), Channels[c].Address.c_str(), Channel.NumPackets, Channel.NumDatagrams, Channel.PCR_PID,
+                        Channel.NumPCRs, Channel.NumDiscontinuities, Channel.Bitrate / 1e6, Channel.StreamSeconds);
+            }
+            fprintf(stdout, "%" PRIu64 " datagrams in %" PRIu64 " send calls, %" PRIu64 " refused, %.3f s, %.3f Mbit/s\n",
+                    Stats.NumDatagrams, Stats.NumCalls, Stats.NumSendErrors, Stats.Seconds, Stats.NumPackets * xTS::TS_PacketLength * 8 / std::max(Stats.Seconds, 1e-9) / 1e6);
+            if (PlayoutConfig.Speed > 0 && Stats.NumDatagrams) {
+                fprintf(stdout, "Send error: min %.1f us, avg %.1f us, max %.1f us, RMS %.1f us;", Stats.MinLate_ns / 1e3, Stats.AvgLate_ns / 1e3, Stats.MaxLate_ns / 1e3, Stats.RMSLate_ns / 1e3);
+                for (int32_t b = 0; b < xTS_Playout::NumLateBuckets; b++) {
+                    if (b < xTS_Playout::NumLateBuckets - 1) { fprintf(stdout, " <=%" PRId64 " us %" PRIu64 ",", xTS_Playout::LateBounds_ns[b] / 1000, Stats.NumLate[b]); }
+                    else                                     { fprintf(stdout, " above %" PRIu64 "\n", Stats.NumLate[b]); }
+                }
+            }
+        }
+        return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (PIDs.empty() && !ExtractAll && !ExtractFromPMT) { PIDs.push_back(136); }
+    // batch - whole files (and chunks of large ones) are the tasks, so only chunked parsing options apply
+    if (!BatchInputs.empty()) {
+        if (ExtractFromPMT || AnalyzePCR || BuildIndex || BuildAUIndex || Windowed || UsePacketIndex || StartOffset || ZeroCopy ||
+            StatsFileName || AsyncWrite || NumWorkers > 0 || SourceType != xTS_PacketSource::eType::Mapped) {
+            std::puts("-b works on the mmap source only and cannot be combined with -m, -c, -i, -u, -S, -D, -x, -O, -z, -M, -W and -t");
+            return EXIT_FAILURE;
+        }
+        std::vector<std::string> FileNames;
+        BatchInputs.insert(BatchInputs.end(), Inputs.begin(), Inputs.end());
+        if (!xTS_BatchRunner::ExpandInputs(BatchInputs, FileNames) || FileNames.empty()) { std::puts("No input files"); return EXIT_FAILURE; }
+        xTS_BatchRunner::xConfig Config;
+        Config.NumWorkers = std::max(0, NumChunks);
+        Config.PIDs       = PIDs;
+        Config.AutoAddPES = ExtractAll;
+        Config.LossPolicy = LossPolicy;
+        if (BatchOutputDir) { Config.OutputDir = BatchOutputDir; }
+        xTS_BatchRunner Runner;
+        const bool Ok = Runner.Run(FileNames, Config);
+        if (Level != eOutputLevel::Silent) {
+            uint64_t NumPackets = 0, NumBytes = 0, NumInputBytes = 0;
+            int32_t  NumFailed  = 0;
+            for (const xTS_BatchRunner::xFileResult& Result : Runner.getResults()) {
+                fprintf(stdout, "%s: %10" PRIu64 " packets %8" PRIu64 " PES %12" PRIu64 " bytes %6" PRIu64 " CC errors, %d chunk(s), %.3f s%s\n",
+                        Result.FileName.c_str(), Result.NumPackets, Result.NumPES, Result.NumBytes, Result.NumCCErrors, Result.NumChunks, Result.Seconds, Result.Ok ? "" : " FAILED");
+                NumPackets    += Result.NumPackets;
+                NumBytes      += Result.NumBytes;
+                NumInputBytes += Result.FileSize;
+                NumFailed     += !Result.Ok;
+            }
+            fprintf(stdout, "%zu files (%d failed), %" PRIu64 " packets, %" PRIu64 " PES bytes, %.1f MB in %.3f s (%.1f MB/s)\n",
+                    Runner.getResults().size(), NumFailed, NumPackets, NumBytes, NumInputBytes / 1e6, Runner.getSeconds(), NumInputBytes / 1e6 / std::max(Runner.getSeconds(), 1e-9));
+            fprintf(stdout, "%d workers, %" PRIu64 " tasks (%" PRIu64 " stolen), %" PRIu64 " PES buffers allocated\n",
+                    Runner.getNumWorkers(), Runner.getPoolStats().NumTasks, Runner.getPoolStats().NumSteals, Runner.getNumHeapAllocs());
+        }
+        return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if ((ExtractFromPMT || AnalyzePCR || BuildIndex || BuildAUIndex || Windowed || StatsFileName) && (NumChunks >= 0 || NumWorkers > 0)) {
+        std::puts("PMT discovery, PCR analysis, PTS and access unit indexes, time windows and statistics are available in sequential mode only");
+        return EXIT_FAILURE;
+    }
+    if ((BuildIndex || UsePacketIndex) && Live) {
+        std::puts("The PTS and packet indexes can be built for file inputs only");
+        return EXIT_FAILURE;
+    }
+    // packet index extraction - only explicitly given PIDs, read in place from the mapping, nothing else needs all packets
+    const bool IndexedExtraction = UsePacketIndex && !PIDs.empty() && !ExtractAll && !ExtractFromPMT && !AnalyzePCR && !BuildIndex && !Windowed &&
+                                   SourceType == xTS_PacketSource::eType::Mapped && Level != eOutputLevel::Packets && NumChunks < 0 && NumWorkers <= 0;
+    if (StartOffset && !IndexedExtraction) {
+        std::puts("-O requires -x extraction: -p PIDs, -s mmap, -v summary or silent, without -a, -m, -c, -i, -S, -D, -t and -j");
+        return EXIT_FAILURE;
+    }
+
+    xTS_PacketIndex PacketIndex;
+    const std::string PacketIndexFileName = xTS_PacketIndex::SidecarName(InputFileName);
+    uint64_t NumIndexedBytes = 0;
+    if (UsePacketIndex) {
+        if (!PacketIndex.Update(PacketIndexFileName, InputFileName, &NumIndexedBytes)) { std::perror(PacketIndexFileName.c_str()); return EXIT_FAILURE; }
+        if (ListStreams) { PrintPacketIndex(stdout, PacketIndex); return EXIT_SUCCESS; }
+    }
+
+    // machine readable traces own stdout - the summary goes to stderr then
+    FILE* SummaryOut = (Level == eOutputLevel::Packets && TraceFormat != xTS_EventWriter::eFormat::Text) ? stderr : stdout;
+    const bool PrintSummary = Level != eOutputLevel::Silent;
+
+    if (NumChunks >= 0) {
+        if (ZeroCopy || NumWorkers > 0 || AsyncWrite || SourceType != xTS_PacketSource::eType::Mapped) {
+            std::puts("Chunked parsing works on the mmap source only and cannot be combined with -z, -t or -W");
+            return EXIT_FAILURE;
+        }
+        xTS_ChunkedParser::xConfig Config;
+        Config.NumChunks  = NumChunks;
+        Config.PIDs       = PIDs;
+        Config.AutoAddPES = ExtractAll;
+        Config.LossPolicy = LossPolicy;
+        xTS_ChunkedParser Parser;
+        const bool Ok = Parser.Run(InputFileName, Config);
+        if (!Ok && Parser.getNumChunks() == 0) { std::perror("File opening failed"); return EXIT_FAILURE; }
+        if (PrintSummary) { PrintChunkedSummary(stdout, Parser); }
+        return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Opening the input file
+    std::unique_ptr<xTS_PacketSource> Source = Follow ? std::make_unique<xTS_FollowSource>() : xTS_PacketSource::Create(SourceType);
+    if (!Source->Open(InputFileName))
+    {
+        std::perror("File opening failed");
+        return EXIT_FAILURE;
+    }
+    if (SourceType == xTS_PacketSource::eType::UDP) { static_cast<xTS_UDPSource*>(Source.get())->setTimeout(TimeoutMs); }
+
+    // asynchronous sinks write through it - declared before the demuxers, so it outlives their sinks
+    std::unique_ptr<xTS_AsyncWriter> Writer;
+    if (AsyncWrite) { Writer = std::make_unique<xTS_AsyncWriter>(WriterConfig); }
+    const xTS_Demuxer::tSinkFactory SinkFactory = Writer ? Writer->getSinkFactory() : xTS_Demuxer::tSinkFactory(xTS_Demuxer::DefaultSinkFactory);
+
+    if (NumWorkers > 0) {
+        if (ZeroCopy) { std::puts("Zero-copy assembly is not available in pipeline mode"); return EXIT_FAILURE; }
+        xTS_Pipeline::xConfig Config;
+        Config.NumWorkers = NumWorkers;
+        Config.PIDs       = PIDs;
+        Config.AutoAddPES = ExtractAll;
+        Config.LossPolicy = LossPolicy;
+        if (Writer) { Config.SinkFactory = SinkFactory; }
+        xTS_Pipeline Pipeline;
+        const bool Ok = Pipeline.Run(*Source, Config);
+        if (PrintSummary) {
+            PrintSourceSummary(stdout, *Source, Ok ? 0 : -1);
+            for (const xTS_Demuxer::xStream* Stream : Pipeline.getStreams()) { PrintStreamSummary(stdout, *Stream); }
+        }
+        Source->Close();
+        return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::unique_ptr<xTS_Stats> StatsOwner;
+    if (StatsFileName) {
+        StatsOwner = std::make_unique<xTS_Stats>();
+        StatsOwner->setOutput(StatsFileName, StatsInterval_ms);
+    }
+    xTS_Stats* Stats = StatsOwner.get(); // null - counters and timers off
+
+    xTS_PacketHeader TS_PacketHeader;
+    xTS_AdaptationField TS_AdaptationField;
+    xTS_Demuxer Demuxer;
+    Demuxer.setSinkFactory(Stats ? Stats->WrapSinkFactory(SinkFactory) : SinkFactory);
+    Demuxer.setScatterGather(ZeroCopy);
+    Demuxer.setLossPolicy(LossPolicy);
+    for (int32_t PID : PIDs) {
+        if (!Demuxer.AddPID(PID)) { printf("Invalid PID %d\n", PID); return EXIT_FAILURE; }
+    }
+    Demuxer.setAutoAddPES(ExtractAll);
+    Demuxer.setPSI(true, ExtractFromPMT);
+    xTS_PCRAnalyzer PCRAnalyzer;
+    if (AnalyzePCR) { Demuxer.setOnPMT([&PCRAnalyzer](const xPSI_PMT& PMT) { PCRAnalyzer.AddProgram(PMT); }); }
+
+    xTS_PTSIndex Index;
+    if (BuildIndex) {
+        // every PID goes into the index, not only the extracted ones - a later -S/-D run may select others
+        Demuxer.setOnPESStart([&Index](int32_t PID, const xPES_PacketHeader& PESH, bool RandomAccess, uint64_t Offset) { Index.Add(PID, PESH, RandomAccess, Offset); }, true);
+    }
+    xTS_AUIndex AUIndex;
+    if (BuildAUIndex) { AUIndex.Attach(Demuxer); }
+    // Incremental parsing - the demuxer continues from the checkpoint and the input at the offset saved with it
+    xTS_Checkpoint Checkpoint;
+    const std::string CheckpointFileName = xTS_Checkpoint::SidecarName(InputFileName);
+    xTS_Checkpoint::eState CheckpointState = xTS_Checkpoint::eState::Missing;
+    uint64_t ParsedBytes = 0; // end of the last packet handed to the demuxer
+    if (Checkpointed) {
+        xTS_Checkpoint::xExtraction Extraction;
+        Extraction.PIDs       = PIDs;
+        Extraction.AutoAddPES = ExtractAll;
+        Extraction.FromPMT    = ExtractFromPMT;
+        Extraction.LossPolicy = LossPolicy;
+        Checkpoint.setExtraction(Extraction);
+        CheckpointState = Checkpoint.Load(CheckpointFileName, InputFileName, Demuxer);
+        if (CheckpointState == xTS_Checkpoint::eState::Corrupt) {
+            printf("Checkpoint %s is corrupt - delete it to parse from the start\n", CheckpointFileName.c_str());
+            return EXIT_FAILURE;
+        }
+        if (CheckpointState == xTS_Checkpoint::eState::Orphan) {
+            printf("Checkpoint %s: outputs written before it are missing or truncated - delete it to parse from the start\n", CheckpointFileName.c_str());
+            return EXIT_FAILURE;
+        }
+        if (CheckpointState == xTS_Checkpoint::eState::Loaded) {
+            ParsedBytes = Checkpoint.getParsedBytes();
+            const bool Seeked = Follow ? static_cast<xTS_FollowSource*>(Source.get())->Seek(ParsedBytes) : static_cast<xTS_MappedFileSource*>(Source.get())->Seek(ParsedBytes);
+            if (!Seeked) { std::perror(InputFileName); return EXIT_FAILURE; }
+        }
+    }
+    const uint64_t ResumedAt = ParsedBytes;
+    const auto SaveCheckpoint = [&]() {
+        Demuxer.Flush(); // the outputs reach the sizes recorded in the checkpoint
+        const bool Ok = Checkpoint.Save(CheckpointFileName, InputFileName, ParsedBytes, Source->getFormat(), Demuxer);
+        if (!Ok) { std::perror(CheckpointFileName.c_str()); }
+        return Ok;
+    };
+    if (Follow) {
+        xTS_FollowSource* FollowSource = static_cast<xTS_FollowSource*>(Source.get());
+        FollowSource->setTimeout(TimeoutMs);
+        // caught up with the recorder - saved once a second at most, so a restart parses that much again at most
+        FollowSource->setOnIdle([&SaveCheckpoint, &Checkpoint, &ParsedBytes, LastSave = std::chrono::steady_clock::time_point()]() mutable {
+            const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+            if (ParsedBytes == Checkpoint.getParsedBytes() || Now - LastSave < std::chrono::seconds(1)) { return; }
+            LastSave = Now;
+            SaveCheckpoint();
+        });
+    }
+    // Time window - with a valid PTS index the mmap source seeks straight to the window, otherwise the input is scanned
+    // until every stream has passed the window end
+    uint64_t StopOffset = UINT64_MAX;
+    bool Seeked = false;
+    if (Windowed) {
+        const int64_t Beg = std::max<int64_t>(WindowBeg, 0);
+        const int64_t End = WindowLength >= 0 && WindowLength < INT64_MAX - Beg ? Beg + WindowLength : INT64_MAX;
+        uint64_t FirstPTS = xTS_Demuxer::NoPTS;
+        xTS_PTSIndex WindowIndex;
+        if (SourceType == xTS_PacketSource::eType::Mapped && !BuildIndex && WindowIndex.Load(xTS_PTSIndex::SidecarName(InputFileName), InputFileName)) {
+            xTS_MappedFileSource* Mapped = static_cast<xTS_MappedFileSource*>(Source.get());
+            uint64_t RangeBeg = 0;
+            FirstPTS = WindowIndex.getFirstPTS();
+            const std::vector<int32_t> RangePIDs = (ExtractAll || ExtractFromPMT) ? std::vector<int32_t>() : PIDs;
+            if (WindowIndex.FindRange(Beg, End, Mapped->getSize(), RangeBeg, StopOffset, RangePIDs)) { Mapped->Seek(RangeBeg); }
+            else                                                                                      { StopOffset = 0; } // nothing in the window
+            Seeked = true;
+        }
+        Demuxer.setTimeWindow(Beg, End, FirstPTS);
+    }
+
+    xTS_PacketSpan Span;
+    int32_t NumPackets = 0;
+    bool WindowDone = false;
+
+    if (IndexedExtraction) {
+        // Only the packets of the extracted PIDs are parsed, located through the packet index in the input mapping
+        const uint8_t* Data = static_cast<xTS_MappedFileSource*>(Source.get())->getData();
+        const uint32_t SyncOffset = PacketIndex.getHeader().SyncOffset;
+        xTS_Stats::xStageTimer Timer(Stats, xTS_Stats::eStage::Parse); // reading, parsing and assembly are one step here
+        PacketIndex.ForEachPacket(PIDs, StartOffset, [&](int32_t, uint64_t Offset) {
+            const uint8_t* TS_PacketBuffer = Data + Offset + SyncOffset;
+            TS_PacketHeader.Parse(TS_PacketBuffer);
+            if (Stats) { Stats->AddPacket(TS_PacketHeader); }
+            if (TS_PacketHeader.hasAdaptationField()) { TS_AdaptationField.Parse(TS_PacketBuffer + xTS::TS_HeaderLength, TS_PacketHeader.getAFC()); }
+            Demuxer.ProcessPacket(TS_PacketBuffer, TS_PacketHeader, TS_AdaptationField, Offset);
+        });
+    }
+    else if (Level == eOutputLevel::Packets) {
+        // Looping through all packet batches until the end of the file - packets are parsed in place and traced
+        xTS_EventWriter Trace(stdout, TraceFormat);
+        uint64_t TS_PacketId = 0;
+        while ((NumPackets = ReadSpan(*Source, Span, Stats)) > 0) {
+            if (Windowed && (NumPackets = ClipSpan(Span, StopOffset)) == 0) { WindowDone = true; break; }
+            xTS_Stats::xStageTimer Timer(Stats, xTS_Stats::eStage::Parse); // with the trace, parsing, assembly and trace output are one step
+            for (int32_t PacketIdx = 0; PacketIdx < NumPackets; PacketIdx++) {
+                const uint8_t* TS_PacketBuffer = Span.getPacket(PacketIdx);
+
+                TS_PacketHeader.Reset();
+                TS_PacketHeader.Parse(TS_PacketBuffer);
+                if (Stats) { Stats->AddPacket(TS_PacketHeader); }
+                const bool HasAdaptationField = TS_PacketHeader.hasAdaptationField();
+                if (HasAdaptationField) {
+                    TS_AdaptationField.Reset();
+                    TS_AdaptationField.Parse(TS_PacketBuffer + xTS::TS_HeaderLength, TS_PacketHeader.getAFC());
+                }
+
+                // Each PID has its own assembler and output sink - all streams are extracted in this single pass
+                const xPES_Assembler::eResult Result = Demuxer.ProcessPacket(TS_PacketBuffer, TS_PacketHeader, TS_AdaptationField, Span.getPacketOffset(PacketIdx));
+                const xTS_Demuxer::xStream* Stream = Demuxer.getStream(TS_PacketHeader.getPID());
+                if (AnalyzePCR) { PCRAnalyzer.ProcessPacket(TS_PacketHeader, HasAdaptationField ? &TS_AdaptationField : nullptr); }
+                Trace.WritePacket(TS_PacketId++, Span.getPacketOffset(PacketIdx), TS_PacketHeader, HasAdaptationField ? &TS_AdaptationField : nullptr,
+                                  Result, Stream ? &Stream->Assembler.getPESH() : nullptr);
+            }
+            ParsedBytes = Span.getPacketOffset(NumPackets);
+            // live input - everything parsed so far leaves before blocking on the next read
+            if (Live) { Trace.Flush(); Demuxer.Flush(); }
+            if (Stats) { Stats->Tick(&Demuxer); }
+            if (Windowed && Demuxer.isPastWindow()) { WindowDone = true; break; }
+        }
+    }
+    else {
+        // No trace - headers are decoded batch-wise and only packets of extracted PIDs are touched
+        std::unique_ptr<xTS_PacketBatch> Headers = std::make_unique<xTS_PacketBatch>();
+        while ((NumPackets = ReadSpan(*Source, Span, Stats)) > 0) {
+            if (Windowed && ClipSpan(Span, StopOffset) == 0) { WindowDone = true; break; }
+            {
+                xTS_Stats::xStageTimer Timer(Stats, xTS_Stats::eStage::Parse);
+                Headers->Decode(Span);
+                if (Stats) { Stats->AddBatch(*Headers); }
+            }
+            {
+                xTS_Stats::xStageTimer Timer(Stats, xTS_Stats::eStage::Assemble);
+                Demuxer.ProcessBatch(*Headers);
+                if (AnalyzePCR) { PCRAnalyzer.ProcessBatch(*Headers); }
+            }
+            ParsedBytes = Span.getPacketOffset(Span.NumPackets);
+            if (Live) { Demuxer.Flush(); }
+            if (Stats) { Stats->Tick(&Demuxer); }
+            if (Windowed && Demuxer.isPastWindow()) { WindowDone = true; break; }
+        }
+    }
+
+    // the checkpoint keeps the PES still in progress - Finish() writes them out, a resumed run cuts them off again
+    const bool CheckpointSaved = !Checkpointed || SaveCheckpoint();
+    {
+        xTS_Stats::xStageTimer Timer(Stats, xTS_Stats::eStage::Assemble);
+        Demuxer.Finish(); // the last unbounded PES of every stream ends with the input
+    }
+    const bool OutputsWritten = Demuxer.CloseSinks(); // a failed output was reported by its sink
+    const bool StatsSaved = !Stats || Stats->WriteSnapshot(&Demuxer);
+    if (!StatsSaved) { std::perror(StatsFileName); }
+
+    const std::string IndexFileName = xTS_PTSIndex::SidecarName(InputFileName);
+    const bool IndexSaved = BuildIndex && NumPackets >= 0 && Index.Save(IndexFileName, InputFileName);
+    if (BuildIndex && !IndexSaved) { std::perror(IndexFileName.c_str()); }
+    if (BuildAUIndex) { AUIndex.Finish(); }
+    const bool AUIndexSaved = !BuildAUIndex || AUIndex.Save();
+
+    // Check for I/O errors and close the files
+    if (PrintSummary) {
+        PrintSourceSummary(SummaryOut, *Source, WindowDone ? 1 : NumPackets);
+        if (Seeked) { fprintf(SummaryOut, "Time window located with %s\n", IndexFileName.c_str()); }
+        if (UsePacketIndex) { fprintf(SummaryOut, "Packet index %s: %" PRIu64 " bytes scanned%s\n", PacketIndexFileName.c_str(), NumIndexedBytes, IndexedExtraction ? ", used for extraction" : ""); }
+        if (IndexSaved) { fprintf(SummaryOut, "PTS index: %zu entries written to %s\n", Index.getEntries().size(), IndexFileName.c_str()); }
+        if (Checkpointed) {
+            fprintf(SummaryOut, "Checkpoint %s: %s, bytes %" PRIu64 " to %" PRIu64 " parsed%s\n", CheckpointFileName.c_str(), xTS_Checkpoint::StateToString(CheckpointState),
+                    ResumedAt, ParsedBytes, CheckpointSaved ? "" : ", not saved");
+        }
+        PrintProgramSummary(SummaryOut, *Demuxer.getPSI());
+        if (AnalyzePCR) { PrintPCRSummary(SummaryOut, PCRAnalyzer); }
+        for (const xTS_Demuxer::xStream& Stream : Demuxer.getStreams()) { PrintStreamSummary(SummaryOut, Stream); }
+        if (BuildAUIndex) { PrintAUIndexSummary(SummaryOut, Demuxer, AUIndex); }
+        if (Stats) { PrintStageSummary(SummaryOut, *Stats); }
+    }
+
+    Source->Close(); // Closing the input file
+
+    return ((BuildIndex && !IndexSaved) || !StatsSaved || !AUIndexSaved || !CheckpointSaved || !OutputsWritten) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//=============================================================================================================================================================================
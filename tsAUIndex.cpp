@@ -0,0 +1,646 @@
+#include "tsAUIndex.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#define X_ES_SCANNER_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define X_TARGET_AVX2 __attribute__((target("avx2")))
+#define X_CTZ32(x) __builtin_ctz(x)
+#else
+#define X_TARGET_AVX2
+static inline uint32_t X_CTZ32(uint32_t x) { unsigned long Idx; _BitScanForward(&Idx, x); return Idx; }
+#endif
+
+//=============================================================================================================================================================================
+// xES_Scanner
+//=============================================================================================================================================================================
+
+int32_t xES_Scanner::FindStartCode(const uint8_t* Data, int32_t Size)
+{
+    if(Size < 3) { return -1; }
+    switch(xTS_SyncScanner::getISA())
+    {
+        case eISA::AVX2: return xFindStartCode_AVX2  (Data, Size);
+        case eISA::SSE2: return xFindStartCode_SSE2  (Data, Size);
+        default        : return xFindStartCode_Scalar(Data, Size);
+    }
+}
+
+int32_t xES_Scanner::FindFrameSync(const uint8_t* Data, int32_t Size)
+{
+    if(Size < 2) { return -1; }
+    switch(xTS_SyncScanner::getISA())
+    {
+        case eISA::AVX2: return xFindFrameSync_AVX2  (Data, Size);
+        case eISA::SSE2: return xFindFrameSync_SSE2  (Data, Size);
+        default        : return xFindFrameSync_Scalar(Data, Size);
+    }
+}
+
+int32_t xES_Scanner::xFindStartCode_Scalar(const uint8_t* Data, int32_t Size)
+{
+    // the byte two ahead decides the step: anything above 1 cannot be the 01 of a start code ending there or earlier
+    for(int32_t Pos = 0; Pos + 2 < Size; )
+    {
+        if     (Data[Pos + 2] >  1) { Pos += 3; }
+        else if(Data[Pos + 2] == 1 && Data[Pos + 1] == 0 && Data[Pos] == 0) { return Pos; }
+        else   { Pos++; }
+    }
+    return -1;
+}
+
+int32_t xES_Scanner::xFindFrameSync_Scalar(const uint8_t* Data, int32_t Size)
+{
+    for(int32_t Pos = 0; Pos + 1 < Size; Pos++)
+    {
+        if(Data[Pos] == 0xFF && (Data[Pos + 1] & 0xE0) == 0xE0) { return Pos; }
+    }
+    return -1;
+}
+
+int32_t xES_Scanner::xFindStartCode_SSE2(const uint8_t* Data, int32_t Size)
+{
+#if defined(X_ES_SCANNER_X86)
+    const __m128i Zero = _mm_setzero_si128();
+    const __m128i One  = _mm_set1_epi8(1);
+    int32_t Pos = 0;
+    for(; Pos < Size - 2; Pos += 16)
+    {
+        if(Pos + 18 > Size) { if(Size < 18) { break; } Pos = Size - 18; } // the last block overlaps positions already checked
+        const __m128i B0 = _mm_loadu_si128((const __m128i*)(Data + Pos    ));
+        const __m128i B1 = _mm_loadu_si128((const __m128i*)(Data + Pos + 1));
+        const __m128i B2 = _mm_loadu_si128((const __m128i*)(Data + Pos + 2));
+        const __m128i Match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(B0, Zero), _mm_cmpeq_epi8(B1, Zero)), _mm_cmpeq_epi8(B2, One));
+        const uint32_t Mask = (uint32_t)_mm_movemask_epi8(Match);
+        if(Mask) { return Pos + (int32_t)X_CTZ32(Mask); }
+    }
+    const int32_t Tail = xFindStartCode_Scalar(Data + Pos, Size - Pos);
+    return Tail < 0 ? -1 : Pos + Tail;
+#else
+    return xFindStartCode_Scalar(Data, Size);
+#endif
+}
+
+int32_t xES_Scanner::xFindFrameSync_SSE2(const uint8_t* Data, int32_t Size)
+{
+#if defined(X_ES_SCANNER_X86)
+    const __m128i FF   = _mm_set1_epi8((char)0xFF);
+    const __m128i Low5 = _mm_set1_epi8(0x1F);
+    int32_t Pos = 0;
+    for(; Pos < Size - 1; Pos += 16)
+    {
+        if(Pos + 17 > Size) { if(Size < 17) { break; } Pos = Size - 17; }
+        const __m128i B0 = _mm_loadu_si128((const __m128i*)(Data + Pos    ));
+        const __m128i B1 = _mm_loadu_si128((const __m128i*)(Data + Pos + 1));
+        const __m128i Match = _mm_and_si128(_mm_cmpeq_epi8(B0, FF), _mm_cmpeq_epi8(_mm_or_si128(B1, Low5), FF));
+        const uint32_t Mask = (uint32_t)_mm_movemask_epi8(Match);
+        if(Mask) { return Pos + (int32_t)X_CTZ32(Mask); }
+    }
+    const int32_t Tail = xFindFrameSync_Scalar(Data + Pos, Size - Pos);
+    return Tail < 0 ? -1 : Pos + Tail;
+#else
+    return xFindFrameSync_Scalar(Data, Size);
+#endif
+}
+
+#if defined(X_ES_SCANNER_X86)
+X_TARGET_AVX2 static int32_t xFindStartCode_AVX2_Impl(const uint8_t* Data, int32_t Size, int32_t& Pos)
+{
+    const __m256i Zero = _mm256_setzero_si256();
+    const __m256i One  = _mm256_set1_epi8(1);
+    for(Pos = 0; Pos < Size - 2; Pos += 32)
+    {
+        if(Pos + 34 > Size) { if(Size < 34) { break; } Pos = Size - 34; }
+        const __m256i B0 = _mm256_loadu_si256((const __m256i*)(Data + Pos    ));
+        const __m256i B1 = _mm256_loadu_si256((const __m256i*)(Data + Pos + 1));
+        const __m256i B2 = _mm256_loadu_si256((const __m256i*)(Data + Pos + 2));
+        const __m256i Match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(B0, Zero), _mm256_cmpeq_epi8(B1, Zero)), _mm256_cmpeq_epi8(B2, One));
+        const uint32_t Mask = (uint32_t)_mm256_movemask_epi8(Match);
+        if(Mask) { return Pos + (int32_t)X_CTZ32(Mask); }
+    }
+    return -1;
+}
+
+X_TARGET_AVX2 static int32_t xFindFrameSync_AVX2_Impl(const uint8_t* Data, int32_t Size, int32_t& Pos)
+{
+    const __m256i FF   = _mm256_set1_epi8((char)0xFF);
+    const __m256i Low5 = _mm256_set1_epi8(0x1F);
+    for(Pos = 0; Pos < Size - 1; Pos += 32)
+    {
+        if(Pos + 33 > Size) { if(Size < 33) { break; } Pos = Size - 33; }
+        const __m256i B0 = _mm256_loadu_si256((const __m256i*)(Data + Pos    ));
+        const __m256i B1 = _mm256_loadu_si256((const __m256i*)(Data + Pos + 1));
+        const __m256i Match = _mm256_and_si256(_mm256_cmpeq_epi8(B0, FF), _mm256_cmpeq_epi8(_mm256_or_si256(B1, Low5), FF));
+        const uint32_t Mask = (uint32_t)_mm256_movemask_epi8(Match);
+        if(Mask) { return Pos + (int32_t)X_CTZ32(Mask); }
+    }
+    return -1;
+}
+#endif
+
+int32_t xES_Scanner::xFindStartCode_AVX2(const uint8_t* Data, int32_t Size)
+{
+#if defined(X_ES_SCANNER_X86)
+    int32_t Pos = 0;
+    const int32_t Found = xFindStartCode_AVX2_Impl(Data, Size, Pos);
+    if(Found >= 0) { return Found; }
+    const int32_t Tail = xFindStartCode_SSE2(Data + Pos, Size - Pos);
+    return Tail < 0 ? -1 : Pos + Tail;
+#else
+    return xFindStartCode_Scalar(Data, Size);
+#endif
+}
+
+int32_t xES_Scanner::xFindFrameSync_AVX2(const uint8_t* Data, int32_t Size)
+{
+#if defined(X_ES_SCANNER_X86)
+    int32_t Pos = 0;
+    const int32_t Found = xFindFrameSync_AVX2_Impl(Data, Size, Pos);
+    if(Found >= 0) { return Found; }
+    const int32_t Tail = xFindFrameSync_SSE2(Data + Pos, Size - Pos);
+    return Tail < 0 ? -1 : Pos + Tail;
+#else
+    return xFindFrameSync_Scalar(Data, Size);
+#endif
+}
+
+//=============================================================================================================================================================================
+// xES_AUIndexer
+//=============================================================================================================================================================================
+
+// Exp-Golomb ue(v) from a short byte buffer, -1 when it runs past Size (or is longer than 31 bits).
+static int32_t xReadUE(const uint8_t* Data, int32_t Size, int32_t& BitPos)
+{
+    auto getBit = [&](int32_t& Bit) -> bool { if(BitPos >= Size * 8) { return false; } Bit = (Data[BitPos >> 3] >> (7 - (BitPos & 7))) & 1; BitPos++; return true; };
+    int32_t NumZeros = 0;
+    int32_t Bit = 0;
+    for(;;)
+    {
+        if(!getBit(Bit)) { return -1; }
+        if(Bit) { break; }
+        if(++NumZeros > 30) { return -1; }
+    }
+    int32_t Value = 0;
+    for(int32_t i = 0; i < NumZeros; i++)
+    {
+        if(!getBit(Bit)) { return -1; }
+        Value = (Value << 1) | Bit;
+    }
+    return (1 << NumZeros) - 1 + Value;
+}
+
+void xES_AUIndexer::Init(int32_t PID, uint8_t StreamType, uint8_t StreamId)
+{
+    m_PID      = PID;
+    m_StreamId = StreamId;
+    switch(StreamType)
+    {
+        case 0x01: case 0x02: m_Codec = eCodec::MPEG2Video; break; // MPEG-1 / MPEG-2 video
+        case 0x1B:            m_Codec = eCodec::H264;       break;
+        case 0x24:            m_Codec = eCodec::HEVC;       break;
+        case 0x03: case 0x04: case 0x0F: m_Codec = eCodec::Audio; break; // MPEG-1 / MPEG-2 audio, ADTS AAC
+        default:
+            if     (StreamId >= 0xC0 && StreamId <= 0xDF) { m_Codec = eCodec::Audio; }
+            else if(StreamId >= 0xE0 && StreamId <= 0xEF) { m_ProbeVideo = true; }
+            break;
+    }
+}
+
+void xES_AUIndexer::BeginPES(uint64_t Offset, uint64_t PTS)
+{
+    if(Offset != m_Pos)
+    {
+        // not the continuation of the data seen so far - nothing carries over
+        xCloseAU(m_Pos);
+        m_Pos      = Offset;
+        m_ScanFrom = Offset;
+        m_NumCarry     = 0;
+        m_Locked       = false;
+        m_HasCandidate = false;
+    }
+    m_PESOffset     = Offset;
+    m_PESPTS        = PTS;
+    m_CheckPESStart = m_Codec == eCodec::Audio;
+}
+
+void xES_AUIndexer::AddData(const uint8_t* Data, int32_t Size)
+{
+    if(Size <= 0) { return; }
+    m_Data = Data;
+    m_Size = Size;
+    if     (m_Codec == eCodec::Audio)                     { xScanAudio(); }
+    else if(m_Codec != eCodec::Unknown || m_ProbeVideo) { xScanVideo(); }
+
+    // the tail of carry + data becomes the new carry
+    if(Size >= CarrySize)
+    {
+        std::memcpy(m_Carry, Data + Size - CarrySize, CarrySize);
+        m_NumCarry = CarrySize;
+    }
+    else
+    {
+        const int32_t Keep = std::min(m_NumCarry, CarrySize - Size);
+        std::memmove(m_Carry, m_Carry + m_NumCarry - Keep, (size_t)Keep);
+        std::memcpy(m_Carry + Keep, Data, (size_t)Size);
+        m_NumCarry = Keep + Size;
+    }
+    m_Pos += (uint64_t)Size;
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
+void xES_AUIndexer::Finish()
+{
+    // start codes at the very end, with less header than usual
+    if(m_Codec != eCodec::Audio)
+    {
+        for(uint64_t Pos = std::max(m_ScanFrom, m_Pos - (uint64_t)m_NumCarry); Pos + 3 <= m_Pos; Pos++)
+        {
+            const uint8_t* Code = xPeek(Pos, 3);
+            if(Code && Code[0] == 0 && Code[1] == 0 && Code[2] == 1) { xOnStartCode(Pos, xPeek(Pos + 3, (int32_t)(m_Pos - Pos - 3)), (int32_t)(m_Pos - Pos - 3)); }
+        }
+    }
+    // the last frame of the stream has no successor to confirm it
+    if(m_HasCandidate) { xAddFrame(m_CandidateOffset, m_Candidate, m_CandidatePTS); m_HasCandidate = false; }
+    m_ScanFrom = m_Pos;
+    xCloseAU(m_Pos);
+    m_NumKey = (uint64_t)std::count_if(m_Entries.begin(), m_Entries.end(), [](const xEntry& Entry) { return (Entry.Flags & Key     ) != 0; });
+    m_NumGOP = (uint64_t)std::count_if(m_Entries.begin(), m_Entries.end(), [](const xEntry& Entry) { return (Entry.Flags & GOPStart) != 0; });
+}
+
+const uint8_t* xES_AUIndexer::xPeek(uint64_t Offset, int32_t Size)
+{
+    const uint64_t CarryBeg = m_Pos - (uint64_t)m_NumCarry;
+    if(Offset < CarryBeg || Offset + (uint64_t)Size > m_Pos + (uint64_t)m_Size || Size > NumHeaderBytes) { return nullptr; }
+    if(Offset >= m_Pos) { return m_Data + (Offset - m_Pos); }
+    if(Offset + (uint64_t)Size <= m_Pos) { return m_Carry + (Offset - CarryBeg); }
+    // straddling - copied, so only such a peek replaces the bytes of the previous one
+    for(int32_t i = 0; i < Size; i++)
+    {
+        const uint64_t Pos = Offset + (uint64_t)i;
+        m_Temp[i] = Pos < m_Pos ? m_Carry[Pos - CarryBeg] : m_Data[Pos - m_Pos];
+    }
+    return m_Temp;
+}
+
+uint64_t xES_AUIndexer::xTakePTS(uint64_t Offset)
+{
+    // a unit split from the previous PES does not get the PTS of this one
+    if(Offset < m_PESOffset) { return NoPTS; }
+    const uint64_t PTS = m_PESPTS;
+    m_PESPTS = NoPTS;
+    return PTS;
+}
+
+void xES_AUIndexer::xBeginAU(uint64_t Offset, uint8_t Type, uint8_t Flags, uint32_t Size)
+{
+    xCloseAU(Offset);
+    xEntry Entry;
+    Entry.Offset   = Offset;
+    Entry.Size     = Size;
+    Entry.Type     = Type;
+    Entry.Flags    = Flags;
+    Entry.Reserved = 0;
+    Entry.PTS      = m_Codec == eCodec::Audio ? NoPTS : xTakePTS(Offset);
+    m_Entries.push_back(Entry);
+    m_HasPicture = false;
+}
+
+void xES_AUIndexer::xCloseAU(uint64_t End)
+{
+    if(m_Entries.empty()) { return; }
+    xEntry& Last = m_Entries.back();
+    if(Last.Size == 0 && End > Last.Offset) { Last.Size = (uint32_t)std::min<uint64_t>(End - Last.Offset, UINT32_MAX); }
+}
+
+/**
+ * @brief Video: start codes beginning in the carried bytes first, then the SIMD search through the new data
+ * A start code is handled only once NumHeaderBytes - 3 bytes behind it are available, otherwise it stays in the carry
+ * for the next call.
+ */
+void xES_AUIndexer::xScanVideo()
+{
+    constexpr int32_t NumAfter = NumHeaderBytes - 3;
+    const uint64_t Beg = m_Pos;
+    const uint64_t End = m_Pos + (uint64_t)m_Size;
+
+    // a start code beginning in the last two carried bytes has the last of them zero - the common case is decided here
+    const uint64_t CarryFrom = std::max(m_ScanFrom, Beg - (uint64_t)m_NumCarry);
+    const bool     CarryDone = CarryFrom + 2 >= Beg && m_NumCarry > 0 && m_Carry[m_NumCarry - 1] != 0;
+    for(uint64_t Pos = CarryFrom; !CarryDone && Pos < Beg; Pos++)
+    {
+        const uint8_t* Code = xPeek(Pos, 3);
+        if(!Code) { m_ScanFrom = Pos; return; } // data shorter than a start code
+        if(Code[0] || Code[1] || Code[2] != 1) { continue; }
+        const uint8_t* Header = xPeek(Pos + 3, NumAfter);
+        if(!Header) { m_ScanFrom = Pos; return; }
+        xOnStartCode(Pos, Header, NumAfter);
+    }
+    m_ScanFrom = std::max(m_ScanFrom, Beg);
+
+    for(;;)
+    {
+        const int32_t From  = (int32_t)(m_ScanFrom - Beg);
+        const int32_t Found = xES_Scanner::FindStartCode(m_Data + From, m_Size - From);
+        if(Found < 0) { m_ScanFrom = std::max(m_ScanFrom, End - std::min<uint64_t>(2, End - Beg)); return; } // a start code may begin in the last two bytes
+        const uint64_t Pos = m_ScanFrom + (uint64_t)Found;
+        if(Pos + 3 + NumAfter > End) { m_ScanFrom = Pos; return; }
+        xOnStartCode(Pos, m_Data + (Pos - Beg) + 3, NumAfter);
+        m_ScanFrom = Pos + 3;
+    }
+}
+
+/**
+ * @brief Classify the NAL unit / MPEG-2 start code at Offset, Header are the Size bytes behind 00 00 01
+ */
+void xES_AUIndexer::xOnStartCode(uint64_t Offset, const uint8_t* Header, int32_t Size)
+{
+    if(Size < 1 || !Header) { return; }
+    if(m_ProbeVideo && m_Codec == eCodec::Unknown)
+    {
+        // forbidden_zero_bit is set in most MPEG-2 start codes (sequence, GOP, ...), picture_start_code is 00
+        m_Codec = (Header[0] & 0x80) || Header[0] == 0x00 ? eCodec::MPEG2Video : eCodec::H264;
+    }
+    // a 4-byte start code (zero_byte) belongs to the unit it starts
+    const uint8_t* Before = Offset > 0 ? xPeek(Offset - 1, 1) : nullptr;
+    const uint64_t Start  = Before && *Before == 0 ? Offset - 1 : Offset;
+    const bool     First  = m_Entries.empty();
+
+    if(m_Codec == eCodec::H264)
+    {
+        const int32_t Type = Header[0] & 0x1F;
+        if(Type == 9) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); return; } // access unit delimiter
+        if(Type == 6 || Type == 7 || Type == 8 || (Type >= 13 && Type <= 18))
+        {
+            if(m_HasPicture || First) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); }
+            if(Type == 7) { m_Entries.back().Flags |= GOPStart; }
+            return;
+        }
+        if(Type != 1 && Type != 5) { return; }
+        int32_t BitPos = 0;
+        const int32_t FirstMB   = xReadUE(Header + 1, Size - 1, BitPos);
+        const int32_t SliceType = xReadUE(Header + 1, Size - 1, BitPos);
+        if(First || (m_HasPicture && FirstMB == 0)) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); }
+        xEntry& AU = m_Entries.back();
+        if(!m_HasPicture && SliceType >= 0)
+        {
+            static const eType SliceTypes[5] = { eType::P, eType::B, eType::I, eType::P, eType::I }; // P, B, I, SP, SI
+            AU.Type = (uint8_t)SliceTypes[SliceType % 5];
+        }
+        if(Type == 5) { AU.Flags |= Key | GOPStart; AU.Type = (uint8_t)eType::I; }
+        m_HasPicture = true;
+        return;
+    }
+
+    if(m_Codec == eCodec::HEVC)
+    {
+        const int32_t Type = (Header[0] >> 1) & 0x3F;
+        if(Type == 35) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); return; } // access unit delimiter
+        if((Type >= 32 && Type <= 34) || Type == 39 || (Type >= 41 && Type <= 44) || (Type >= 48 && Type <= 55))
+        {
+            if(m_HasPicture || First) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); }
+            if(Type == 32 || Type == 33) { m_Entries.back().Flags |= GOPStart; }
+            return;
+        }
+        if(Type > 31) { return; }
+        const bool FirstSlice = Size >= 3 && (Header[2] & 0x80);
+        if(First || (m_HasPicture && FirstSlice)) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); }
+        if(Type >= 16 && Type <= 23) { m_Entries.back().Flags |= Key | GOPStart; m_Entries.back().Type = (uint8_t)eType::I; } // IRAP
+        m_HasPicture = true;
+        return;
+    }
+
+    if(m_Codec == eCodec::MPEG2Video)
+    {
+        const uint8_t Code = Header[0];
+        if(Code == 0xB3 || Code == 0xB8) // sequence header, group of pictures
+        {
+            if(m_HasPicture || First) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); }
+            m_Entries.back().Flags |= GOPStart;
+            return;
+        }
+        if(Code != 0x00) { return; } // slices, extensions, user data
+        if(m_HasPicture || First) { xBeginAU(Start, (uint8_t)eType::Unknown, 0); }
+        if(Size >= 3)
+        {
+            static const eType CodingTypes[8] = { eType::Unknown, eType::I, eType::P, eType::B, eType::Unknown, eType::Unknown, eType::Unknown, eType::Unknown };
+            const eType Type = CodingTypes[(Header[2] >> 3) & 0x7];
+            m_Entries.back().Type = (uint8_t)Type;
+            if(Type == eType::I) { m_Entries.back().Flags |= Key; }
+        }
+        m_HasPicture = true;
+    }
+}
+
+// Frame length, duration and the header bits that stay the same from frame to frame of one stream, false for a header
+// with reserved or unsupported (free format) values.
+static bool xParseFrameHeader(const uint8_t* Header, xES_AUIndexer::xFrame& Frame)
+{
+    if(Header[0] != 0xFF || (Header[1] & 0xE0) != 0xE0) { return false; }
+    const int32_t Layer = (Header[1] >> 1) & 0x3;
+    if(Layer == 0)
+    {
+        // ADTS: 12-bit sync, frame length includes the header
+        static const int32_t SampleRates[13] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+        if((Header[1] & 0xF0) != 0xF0) { return false; }
+        const int32_t RateIdx = (Header[2] >> 2) & 0xF;
+        if(RateIdx >= 13) { return false; }
+        Frame.SampleRate = SampleRates[RateIdx];
+        Frame.Size       = ((Header[3] & 0x3) << 11) | (Header[4] << 3) | (Header[5] >> 5);
+        Frame.NumSamples = 1024 * ((Header[6] & 0x3) + 1);
+        Frame.FixedBits  = ((uint32_t)Header[1] << 8) | (Header[2] & 0xFC); // profile, sampling rate
+        return Frame.Size >= 7;
+    }
+
+    static const int16_t Bitrates[2][3][15] =
+    {
+        { // MPEG-1: layer I, II, III
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+            { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+            { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 },
+        },
+        { // MPEG-2 / 2.5: layer I, II, III
+            { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256 },
+            { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 },
+            { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 },
+        },
+    };
+    static const int32_t SampleRates[3] = { 44100, 48000, 32000 };
+    const int32_t Version    = (Header[1] >> 3) & 0x3; // 0: MPEG-2.5, 1: reserved, 2: MPEG-2, 3: MPEG-1
+    const int32_t BitrateIdx = Header[2] >> 4;
+    const int32_t RateIdx    = (Header[2] >> 2) & 0x3;
+    const int32_t Padding    = (Header[2] >> 1) & 0x1;
+    if(Version == 1 || BitrateIdx == 0 || BitrateIdx == 15 || RateIdx == 3) { return false; }
+    const bool    MPEG1    = Version == 3;
+    const int32_t LayerIdx = 3 - Layer; // 0: layer I
+    const int32_t Bitrate  = Bitrates[MPEG1 ? 0 : 1][LayerIdx][BitrateIdx] * 1000;
+    Frame.SampleRate = SampleRates[RateIdx] >> (MPEG1 ? 0 : Version == 2 ? 1 : 2);
+    if     (LayerIdx == 0) { Frame.NumSamples = 384;                Frame.Size = (12 * Bitrate / Frame.SampleRate + Padding) * 4; }
+    else if(LayerIdx == 1) { Frame.NumSamples = 1152;               Frame.Size = 144 * Bitrate / Frame.SampleRate + Padding;      }
+    else                   { Frame.NumSamples = MPEG1 ? 1152 : 576; Frame.Size = (MPEG1 ? 144 : 72) * Bitrate / Frame.SampleRate + Padding; }
+    Frame.FixedBits = ((uint32_t)Header[1] << 8) | (Header[2] & 0x0C); // version, layer, protection, sampling rate
+    return true;
+}
+
+/**
+ * @brief Audio: follow the frame chain while locked, search the next frame sync otherwise
+ * A sync found by the search is only a candidate until the header at its end matches it - payload bytes can look like
+ * a frame header, two in a row at the right distance practically never do.
+ */
+void xES_AUIndexer::xScanAudio()
+{
+    const uint64_t Beg   = m_Pos;
+    const uint64_t End   = m_Pos + (uint64_t)m_Size;
+    for(;;)
+    {
+        if(m_CheckPESStart && m_ScanFrom >= m_PESOffset)
+        {
+            // the frame or candidate runs into the new PES while the PES starts with a header: the frame was cut short
+            // (data aligned audio PES after a loss or from a truncating muxer) - the chain restarts at the PES
+            const uint8_t* Header = m_ScanFrom > m_PESOffset ? xPeek(m_PESOffset, NumHeaderBytes) : nullptr;
+            if(Header || m_ScanFrom == m_PESOffset) { m_CheckPESStart = false; }
+            xFrame Frame;
+            if(Header && xParseFrameHeader(Header, Frame) && (!m_Locked || Frame.FixedBits == m_FixedBits))
+            {
+                if(m_Locked && !m_Entries.empty() && m_Entries.back().Offset < m_PESOffset) { m_Entries.back().Size = (uint32_t)(m_PESOffset - m_Entries.back().Offset); }
+                m_HasCandidate = false;
+                m_ScanFrom     = m_PESOffset;
+            }
+        }
+        if(m_ScanFrom >= End) { return; }
+        if(m_Locked || m_HasCandidate)
+        {
+            const uint8_t* Header = xPeek(m_ScanFrom, NumHeaderBytes);
+            if(!Header) { return; } // split from the next PES
+            xFrame Frame;
+            if(xParseFrameHeader(Header, Frame) && Frame.FixedBits == m_FixedBits)
+            {
+                if(m_HasCandidate)
+                {
+                    xAddFrame(m_CandidateOffset, m_Candidate, m_CandidatePTS);
+                    if(m_CandidatePTS != NoPTS && m_PESPTS == m_CandidatePTS) { m_PESPTS = NoPTS; }
+                    m_HasCandidate = false;
+                    m_Locked       = true;
+                }
+                xAddFrame(m_ScanFrom, Frame, xTakePTS(m_ScanFrom));
+                m_ScanFrom += (uint64_t)Frame.Size;
+                continue;
+            }
+            // lock lost or candidate rejected - the search goes on from here, not from the candidate, as the bytes behind
+            // it may be gone already (so the result does not depend on how the payload is split)
+            m_ScanFrom++;
+            m_HasCandidate = false;
+            m_Locked       = false;
+            continue;
+        }
+        // sync bytes split between the carry and the new data
+        uint64_t Sync = m_ScanFrom;
+        if(m_ScanFrom < Beg)
+        {
+            const uint8_t* Bytes = xPeek(m_ScanFrom, 2);
+            if(!Bytes) { return; }
+            if(Bytes[0] != 0xFF || (Bytes[1] & 0xE0) != 0xE0) { m_ScanFrom++; continue; }
+        }
+        else
+        {
+            const int32_t From  = (int32_t)(m_ScanFrom - Beg);
+            const int32_t Found = xES_Scanner::FindFrameSync(m_Data + From, m_Size - From);
+            if(Found < 0) { m_ScanFrom = End - 1; return; } // 0xFF in the last byte may start a sync
+            Sync = m_ScanFrom + (uint64_t)Found;
+        }
+        const uint8_t* Header = xPeek(Sync, NumHeaderBytes);
+        if(!Header) { m_ScanFrom = Sync; return; }
+        if(!xParseFrameHeader(Header, m_Candidate)) { m_ScanFrom = Sync + 1; continue; }
+        m_HasCandidate    = true;
+        m_CandidateOffset = Sync;
+        m_CandidatePTS    = Sync >= m_PESOffset ? m_PESPTS : NoPTS; // taken only once confirmed
+        m_FixedBits       = m_Candidate.FixedBits;
+        m_ScanFrom        = Sync + (uint64_t)m_Candidate.Size;
+    }
+}
+
+/**
+ * @brief Index one audio frame, PTS is the PES PTS for the first frame starting in a PES, extrapolated otherwise
+ */
+void xES_AUIndexer::xAddFrame(uint64_t Offset, const xFrame& Frame, uint64_t PTS)
+{
+    if(PTS == NoPTS) { PTS = m_NextPTS; }
+    m_NextPTS = PTS == NoPTS ? NoPTS : (PTS + (uint64_t)Frame.NumSamples * xTS::BaseClockFrequency_Hz / (uint64_t)Frame.SampleRate) & 0x1FFFFFFFFULL;
+    xBeginAU(Offset, (uint8_t)eType::AudioFrame, Key | GOPStart, (uint32_t)Frame.Size);
+    m_Entries.back().PTS = PTS;
+}
+
+bool xES_AUIndexer::Save(const std::string& FileName) const
+{
+    FILE* File = std::fopen(FileName.c_str(), "wb");
+    if(!File) { return false; }
+    xFileHeader Header;
+    Header.PID        = (uint16_t)m_PID;
+    Header.StreamId   = m_StreamId;
+    Header.Codec      = (uint8_t)m_Codec;
+    Header.NumEntries = m_Entries.size();
+    bool Ok = std::fwrite(&Header, sizeof(Header), 1, File) == 1;
+    if(Ok && !m_Entries.empty()) { Ok = std::fwrite(m_Entries.data(), sizeof(xEntry), m_Entries.size(), File) == m_Entries.size(); }
+    return std::fclose(File) == 0 && Ok;
+}
+
+const char* xES_AUIndexer::CodecToString(eCodec Codec)
+{
+    switch(Codec)
+    {
+        case eCodec::H264      : return "H.264";
+        case eCodec::HEVC      : return "HEVC";
+        case eCodec::MPEG2Video: return "MPEG-2 video";
+        case eCodec::Audio     : return "MPEG audio/ADTS";
+        default                : return "unknown";
+    }
+}
+
+//=============================================================================================================================================================================
+// xTS_AUIndex
+//=============================================================================================================================================================================
+
+void xTS_AUIndex::AddPES(const xTS_Demuxer::xStream& Stream)
+{
+    int16_t& Idx = m_PIDToIndexer[Stream.PID];
+    const xPES_PacketHeader& PESH = Stream.Assembler.getPESH();
+    if(Idx < 0)
+    {
+        Idx = (int16_t)m_Indexers.size();
+        m_Indexers.push_back(std::make_unique<xES_AUIndexer>());
+        m_Indexers.back()->Init(Stream.PID, Stream.StreamType, PESH.getStreamId());
+        m_FileNames.push_back(xTS_Demuxer::DefaultFileName(Stream.PID, PESH.getStreamId(), Stream.SinkStreamType));
+    }
+    xES_AUIndexer& Indexer = *m_Indexers[Idx];
+    Indexer.BeginPES(Stream.NumBytes, PESH.hasPTS() ? PESH.getPTS() : xES_AUIndexer::NoPTS);
+    if(Stream.Assembler.isScatterGather())
+    {
+        for(const xPES_Slice& Slice : Stream.Assembler.getSlices()) { Indexer.AddData(Slice.Data, Slice.Size); }
+    }
+    else
+    {
+        Indexer.AddData(Stream.Assembler.getPacket(), Stream.Assembler.getNumPacketBytes());
+    }
+}
+
+void xTS_AUIndex::Finish()
+{
+    for(std::unique_ptr<xES_AUIndexer>& Indexer : m_Indexers) { Indexer->Finish(); }
+}
+
+bool xTS_AUIndex::Save() const
+{
+    bool Ok = true;
+    for(size_t i = 0; i < m_Indexers.size(); i++)
+    {
+        const std::string FileName = xES_AUIndexer::SidecarName(m_FileNames[i]);
+        if(!m_Indexers[i]->Save(FileName)) { std::perror(FileName.c_str()); Ok = false; }
+    }
+    return Ok;
+}
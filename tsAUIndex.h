@@ -0,0 +1,183 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsDemuxer.h"
+#include "tsSyncScanner.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xES_Scanner
+//=============================================================================================================================================================================
+
+// Vectorized search for elementary stream sync patterns in PES payloads: the 00 00 01 start code prefix of H.264,
+// HEVC and MPEG-2 video and the 0xFFF frame sync of MPEG audio and ADTS. Blocks of 16 (SSE2) or 32 (AVX2) positions
+// are tested at once by comparing three shifted loads, so clean payload is skipped at close to memcpy speed. The ISA
+// follows xTS_SyncScanner::getISA() (and its forceISA()).
+class xES_Scanner
+{
+public:
+  using eISA = xTS_SyncScanner::eISA;
+
+  // Offset of the first 00 00 01 in [Data, Data+Size), -1 if none.
+  static int32_t FindStartCode(const uint8_t* Data, int32_t Size);
+  // Offset of the first 0xFF followed by a byte with the top three bits set (11-bit frame sync), -1 if none.
+  static int32_t FindFrameSync(const uint8_t* Data, int32_t Size);
+
+protected:
+  static int32_t xFindStartCode_Scalar(const uint8_t* Data, int32_t Size);
+  static int32_t xFindStartCode_SSE2  (const uint8_t* Data, int32_t Size);
+  static int32_t xFindStartCode_AVX2  (const uint8_t* Data, int32_t Size);
+  static int32_t xFindFrameSync_Scalar(const uint8_t* Data, int32_t Size);
+  static int32_t xFindFrameSync_SSE2  (const uint8_t* Data, int32_t Size);
+  static int32_t xFindFrameSync_AVX2  (const uint8_t* Data, int32_t Size);
+};
+
+//=============================================================================================================================================================================
+// xES_AUIndexer
+//=============================================================================================================================================================================
+
+// Access unit index of one elementary stream, built in-line from the PES payloads as they are emitted. Offsets are
+// positions in the extracted elementary stream (the PID<PID>.<ext> output), so a frame or a GOP can be cut out of it
+// without a second pass.
+//  - H.264 / HEVC: an access unit starts at an access unit delimiter, at a parameter set or SEI following the slices
+//    of the previous picture, or at the first slice of a new picture. IDR/IRAP pictures are key frames, access units
+//    with SPS (H.264) or VPS/SPS (HEVC) or a key picture open a GOP. The H.264 picture type comes from slice_type.
+//  - MPEG-2 video: a sequence header, GOP header or picture start code after a picture starts an access unit, the
+//    picture type comes from picture_coding_type, sequence and GOP headers open a GOP.
+//  - MPEG audio and ADTS: every frame is an access unit, key frame and GOP start. Frames are chained by their length,
+//    the sync search only runs to regain lock and a sync it finds counts once the header behind its frame matches. A
+//    header of the stream at a PES start cuts a frame running into that PES short.
+// A PES PTS belongs to the first access unit starting in that PES; following audio frames get it extrapolated by
+// the frame duration, video access units without a PES PTS get NoPTS. Start codes and frame headers split between
+// PES packets (or scatter-gather slices) are found through a short carry of the previous payload bytes.
+class xES_AUIndexer
+{
+public:
+  static constexpr uint64_t NoPTS = UINT64_MAX;
+
+  enum class eCodec : uint8_t { Unknown, H264, HEVC, MPEG2Video, Audio };
+
+  enum class eType : uint8_t { Unknown, I, P, B, AudioFrame };
+
+  struct xFrame // audio frame header
+  {
+    int32_t  Size       = 0;
+    int32_t  NumSamples = 0;
+    int32_t  SampleRate = 0;
+    uint32_t FixedBits  = 0; // header fields equal in all frames of a stream
+  };
+
+  enum eFlags : uint8_t
+  {
+    Key      = 0x01, // IDR / IRAP picture, I picture of MPEG-2 video, every audio frame
+    GOPStart = 0x02, // sequence parameters or GOP header - decoding can start here
+  };
+
+#pragma pack(push, 1)
+  struct xFileHeader
+  {
+    char     Magic[4]   = { 'T', 'S', 'A', 'U' };
+    uint16_t Version    = 1;
+    uint16_t EntrySize  = 24;
+    uint16_t PID        = 0;
+    uint8_t  StreamId   = 0;
+    uint8_t  Codec      = 0; // eCodec
+    uint32_t Reserved   = 0;
+    uint64_t NumEntries = 0;
+  };
+
+  struct xEntry
+  {
+    uint64_t Offset; // in the elementary stream, including the zero_byte of a 4-byte start code
+    uint32_t Size;
+    uint8_t  Type;   // eType
+    uint8_t  Flags;  // eFlags
+    uint16_t Reserved;
+    uint64_t PTS;    // 90 kHz, NoPTS if none
+  };
+#pragma pack(pop)
+  static_assert(sizeof(xEntry) == 24, "access unit index entry layout");
+
+public:
+  // Codec from the PMT stream_type, 0 / unknown types fall back to the PES stream_id (video is told apart by its first start code).
+  void Init(int32_t PID, uint8_t StreamType, uint8_t StreamId);
+
+  // Starts a PES payload at ES offset Offset, its data follows in one or more AddData() calls (scatter-gather slices).
+  void BeginPES(uint64_t Offset, uint64_t PTS);
+  void AddData (const uint8_t* Data, int32_t Size);
+  // End of the elementary stream - closes the last access unit and counts key frames / GOPs.
+  void Finish();
+
+  bool Save(const std::string& FileName) const;
+
+  eCodec                     getCodec  () const { return m_Codec; }
+  const std::vector<xEntry>& getEntries() const { return m_Entries; }
+  uint64_t                   getNumKey () const { return m_NumKey; }
+  uint64_t                   getNumGOP () const { return m_NumGOP; }
+
+  static const char* CodecToString(eCodec Codec);
+  static std::string SidecarName  (const std::string& ESFileName) { return ESFileName + ".auidx"; }
+
+protected:
+  static constexpr int32_t NumHeaderBytes = 7; // looked at from a start code (00 00 01 + 4) or frame sync (ADTS header)
+  static constexpr int32_t CarrySize      = 8; // tail of the previous data kept for patterns split between PES packets
+
+  void           xScanVideo  ();
+  void           xScanAudio  ();
+  void           xOnStartCode(uint64_t Offset, const uint8_t* Header, int32_t Size);
+  void           xAddFrame   (uint64_t Offset, const xFrame& Frame, uint64_t PTS);
+  void           xBeginAU    (uint64_t Offset, uint8_t Type, uint8_t Flags, uint32_t Size = 0);
+  void           xCloseAU    (uint64_t End);
+  uint64_t       xTakePTS    (uint64_t Offset);
+  const uint8_t* xPeek       (uint64_t Offset, int32_t Size); // bytes at an ES offset from the carry and the current data, nullptr if not there (yet)
+
+  std::vector<xEntry> m_Entries;
+  eCodec              m_Codec           = eCodec::Unknown;
+  bool                m_ProbeVideo      = false; // video stream_id without a known stream_type - decided by the first start code
+  int32_t             m_PID             = -1;
+  uint8_t             m_StreamId        = 0;
+  uint64_t            m_Pos             = 0;     // ES offset of m_Data[0], of the next data outside AddData()
+  const uint8_t*      m_Data            = nullptr;
+  int32_t             m_Size            = 0;
+  uint64_t            m_ScanFrom        = 0;     // next ES offset a start code / frame sync may begin at
+  uint64_t            m_PESOffset       = 0;
+  uint64_t            m_PESPTS          = NoPTS; // not yet given to an access unit
+  bool                m_HasPicture      = false; // slices / picture data seen in the access unit being built
+  bool                m_Locked          = false; // audio: m_ScanFrom is the next frame header
+  bool                m_CheckPESStart   = false; // audio: a header at the start of the current PES may cut the last frame short
+  bool                m_HasCandidate    = false; // audio: sync found by the search, its frame is added once the next header matches
+  xFrame              m_Candidate;
+  uint64_t            m_CandidateOffset = 0;
+  uint64_t            m_CandidatePTS    = NoPTS;
+  uint32_t            m_FixedBits       = 0;     // audio: xFrame::FixedBits of the stream locked to
+  uint64_t            m_NextPTS         = NoPTS; // audio: PTS extrapolated for the next frame
+  uint8_t             m_Carry[CarrySize]     = {};
+  int32_t             m_NumCarry        = 0;
+  uint8_t             m_Temp[NumHeaderBytes] = {};
+  uint64_t            m_NumKey          = 0;
+  uint64_t            m_NumGOP          = 0;
+};
+
+//=============================================================================================================================================================================
+// xTS_AUIndex
+//=============================================================================================================================================================================
+
+// Access unit indexes of every stream a demuxer extracts, fed from its PES callback (see xTS_Demuxer::setOnPES()).
+class xTS_AUIndex
+{
+public:
+  void Attach(xTS_Demuxer& Demuxer) { Demuxer.setOnPES([this](const xTS_Demuxer::xStream& Stream) { AddPES(Stream); }); }
+  void AddPES(const xTS_Demuxer::xStream& Stream);
+  void Finish();
+
+  // Writes <output>.auidx next to the output of every indexed stream, named as by xTS_Demuxer::DefaultFileName().
+  bool Save() const;
+
+  const xES_AUIndexer* getIndexer(int32_t PID) const { return PID >= 0 && PID < xTS_Demuxer::NumPIDs && m_PIDToIndexer[PID] >= 0 ? m_Indexers[m_PIDToIndexer[PID]].get() : nullptr; }
+
+protected:
+  std::vector<std::unique_ptr<xES_AUIndexer>> m_Indexers;
+  std::vector<std::string>                    m_FileNames;
+  std::vector<int16_t>                        m_PIDToIndexer = std::vector<int16_t>(xTS_Demuxer::NumPIDs, -1);
+};
@@ -0,0 +1,477 @@
+#include "tsAsyncWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define TS_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+//=============================================================================================================================================================================
+// xTS_AsyncWriter::xRing
+//=============================================================================================================================================================================
+
+#if defined(TS_HAS_IO_URING)
+// Bare io_uring through the raw system calls (no liburing dependency). Submissions come from the sinks under the writer
+// mutex, completions are reaped by a single thread - the two sides of the ring are never touched concurrently.
+class xTS_AsyncWriter::xRing
+{
+public:
+  ~xRing();
+  bool     Init(uint32_t Entries);
+  bool     Submit(uint8_t Opcode, xRequest* Request); // null Request: user_data 0
+  template <typename tCallback> bool Reap(tCallback&& Callback);
+  uint32_t getEntries() const { return m_Entries; }
+
+protected:
+  int32_t       m_FD         = -1;
+  uint32_t      m_Entries    = 0;
+  void*         m_SQRing     = MAP_FAILED;
+  size_t        m_SQRingSize = 0;
+  void*         m_CQRing     = MAP_FAILED;
+  size_t        m_CQRingSize = 0;
+  void*         m_SQEs       = MAP_FAILED;
+  size_t        m_SQEsSize   = 0;
+  uint32_t*     m_SQTail     = nullptr;
+  uint32_t*     m_SQMask     = nullptr;
+  uint32_t*     m_SQArray    = nullptr;
+  uint32_t*     m_CQHead     = nullptr;
+  uint32_t*     m_CQTail     = nullptr;
+  uint32_t*     m_CQMask     = nullptr;
+  io_uring_cqe* m_CQEs       = nullptr;
+};
+
+xTS_AsyncWriter::xRing::~xRing()
+{
+    if(m_SQEs   != MAP_FAILED) { munmap(m_SQEs, m_SQEsSize); }
+    if(m_CQRing != MAP_FAILED && m_CQRing != m_SQRing) { munmap(m_CQRing, m_CQRingSize); }
+    if(m_SQRing != MAP_FAILED) { munmap(m_SQRing, m_SQRingSize); }
+    if(m_FD >= 0) { close(m_FD); }
+}
+
+bool xTS_AsyncWriter::xRing::Init(uint32_t Entries)
+{
+    io_uring_params Params;
+    std::memset(&Params, 0, sizeof(Params));
+    m_FD = (int32_t)syscall(__NR_io_uring_setup, Entries, &Params);
+    if(m_FD < 0) { return false; } // no io_uring in this kernel, or forbidden by a seccomp profile
+    m_Entries = Params.sq_entries;
+
+    m_SQRingSize = Params.sq_off.array + Params.sq_entries * sizeof(uint32_t);
+    m_CQRingSize = Params.cq_off.cqes  + Params.cq_entries * sizeof(io_uring_cqe);
+    const bool SingleMap = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(SingleMap) { m_SQRingSize = m_CQRingSize = std::max(m_SQRingSize, m_CQRingSize); }
+    m_SQRing = mmap(nullptr, m_SQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_FD, IORING_OFF_SQ_RING);
+    if(m_SQRing == MAP_FAILED) { return false; }
+    m_CQRing = SingleMap ? m_SQRing : mmap(nullptr, m_CQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_FD, IORING_OFF_CQ_RING);
+    if(m_CQRing == MAP_FAILED) { return false; }
+    m_SQEsSize = Params.sq_entries * sizeof(io_uring_sqe);
+    m_SQEs = mmap(nullptr, m_SQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_FD, IORING_OFF_SQES);
+    if(m_SQEs == MAP_FAILED) { return false; }
+
+    uint8_t* SQ = (uint8_t*)m_SQRing;
+    uint8_t* CQ = (uint8_t*)m_CQRing;
+    m_SQTail  = (uint32_t*)(SQ + Params.sq_off.tail);
+    m_SQMask  = (uint32_t*)(SQ + Params.sq_off.ring_mask);
+    m_SQArray = (uint32_t*)(SQ + Params.sq_off.array);
+    m_CQHead  = (uint32_t*)(CQ + Params.cq_off.head);
+    m_CQTail  = (uint32_t*)(CQ + Params.cq_off.tail);
+    m_CQMask  = (uint32_t*)(CQ + Params.cq_off.ring_mask);
+    m_CQEs    = (io_uring_cqe*)(CQ + Params.cq_off.cqes);
+    return true;
+}
+
+bool xTS_AsyncWriter::xRing::Submit(uint8_t Opcode, xRequest* Request)
+{
+    const uint32_t Tail = *m_SQTail; // only written here
+    const uint32_t Idx  = Tail & *m_SQMask;
+    io_uring_sqe&  SQE  = ((io_uring_sqe*)m_SQEs)[Idx];
+    std::memset(&SQE, 0, sizeof(SQE));
+    SQE.opcode    = Opcode;
+    SQE.fd        = Request ? Request->FD : -1;
+    SQE.addr      = Request ? (uint64_t)(uintptr_t)Request->Data : 0;
+    SQE.len       = Request ? (uint32_t)Request->Size : 0;
+    SQE.off       = Request ? Request->Offset : 0;
+    SQE.user_data = (uint64_t)(uintptr_t)Request;
+    m_SQArray[Idx] = Idx;
+    __atomic_store_n(m_SQTail, Tail + 1, __ATOMIC_RELEASE);
+
+    long Result;
+    do { Result = syscall(__NR_io_uring_enter, m_FD, 1, 0, 0, nullptr, 0); } while(Result < 0 && errno == EINTR);
+    if(Result == 1) { return true; }
+    __atomic_store_n(m_SQTail, Tail, __ATOMIC_RELEASE); // not consumed by the kernel (EAGAIN, EBUSY) - take it back
+    return false;
+}
+
+template <typename tCallback> bool xTS_AsyncWriter::xRing::Reap(tCallback&& Callback)
+{
+    long Result;
+    do { Result = syscall(__NR_io_uring_enter, m_FD, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0); } while(Result < 0 && errno == EINTR);
+    if(Result < 0) { return false; }
+    uint32_t       Head = *m_CQHead;
+    const uint32_t Tail = __atomic_load_n(m_CQTail, __ATOMIC_ACQUIRE);
+    for(; Head != Tail; Head++)
+    {
+        const io_uring_cqe& CQE = m_CQEs[Head & *m_CQMask];
+        Callback((xRequest*)(uintptr_t)CQE.user_data, CQE.res);
+    }
+    __atomic_store_n(m_CQHead, Head, __ATOMIC_RELEASE);
+    return true;
+}
+#else
+class xTS_AsyncWriter::xRing {};
+#endif
+
+//=============================================================================================================================================================================
+// xTS_AsyncWriter::xFileSink
+//=============================================================================================================================================================================
+
+class xTS_AsyncWriter::xFileSink : public xES_Sink
+{
+public:
+  xFileSink(xTS_AsyncWriter& Writer, std::string FileName) : m_Writer(Writer), m_FileName(std::move(FileName)) {}
+  ~xFileSink() override { xClose(); }
+
+  void Write(const uint8_t* Data, int32_t Size) override;
+  void Flush() override;
+  bool Close() override { xClose(); return !hasFailed(); }
+  bool hasFailed() const override;
+
+protected:
+  struct xChunk
+  {
+    std::vector<uint8_t> Storage;
+    uint8_t*             Data = nullptr; // Storage aligned to Alignment
+    xRequest             Request;
+  };
+
+  bool xOpen   ();
+  void xHandOff(int32_t Size);
+  void xClose  ();
+
+  xTS_AsyncWriter&    m_Writer;
+  std::string         m_FileName;
+  std::vector<xChunk> m_Chunks;
+  int32_t             m_ChunkSize = 0;
+  int32_t             m_Curr      = 0; // chunk being filled
+  int32_t             m_Fill      = 0;
+  uint64_t            m_Offset    = 0; // file offset of the chunk being filled
+  int32_t             m_FD        = -1;
+  int32_t             m_Error     = 0; // set by the writer under its mutex
+  bool                m_Direct    = false;
+  bool                m_Failed    = false; // open failed, or m_Error reported by xClose()
+};
+
+bool xTS_AsyncWriter::xFileSink::xOpen()
+{
+#if defined(_WIN32)
+    m_FD = _open(m_FileName.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    const int Flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_DIRECT)
+    if(m_Writer.m_Config.Direct)
+    {
+        m_FD     = open(m_FileName.c_str(), Flags | O_DIRECT, 0644);
+        m_Direct = m_FD >= 0;
+    }
+#endif
+    if(m_FD < 0) { m_FD = open(m_FileName.c_str(), Flags, 0644); } // file systems without O_DIRECT (tmpfs) refuse it
+#endif
+    if(m_FD < 0)
+    {
+        std::perror(m_FileName.c_str());
+        m_Failed = true;
+        return false;
+    }
+
+    m_ChunkSize = m_Writer.m_Config.ChunkSize;
+    m_Chunks.resize((size_t)m_Writer.m_Config.ChunksPerSink);
+    for(xChunk& Chunk : m_Chunks)
+    {
+        Chunk.Storage.resize((size_t)m_ChunkSize + Alignment);
+        Chunk.Data = Chunk.Storage.data() + ((Alignment - ((uintptr_t)Chunk.Storage.data() & (Alignment - 1))) & (Alignment - 1));
+        Chunk.Request.FD    = m_FD;
+        Chunk.Request.Data  = Chunk.Data;
+        Chunk.Request.Error = &m_Error;
+    }
+    return true;
+}
+
+void xTS_AsyncWriter::xFileSink::Write(const uint8_t* Data, int32_t Size)
+{
+    if(m_Failed || Size <= 0) { return; }
+    if(m_FD < 0 && !xOpen()) { return; }
+    while(Size > 0)
+    {
+        const int32_t Part = std::min(Size, m_ChunkSize - m_Fill);
+        std::memcpy(m_Chunks[m_Curr].Data + m_Fill, Data, (size_t)Part);
+        m_Fill += Part;
+        Data   += Part;
+        Size   -= Part;
+        if(m_Fill == m_ChunkSize) { xHandOff(m_Fill); }
+    }
+}
+
+/**
+ * @brief Hand the first Size bytes of the current chunk to the writer and continue in the next chunk
+ * Blocks only while the next chunk is still being written. The bytes past Size (the unaligned rest of an O_DIRECT
+ * flush) move to the start of the next chunk.
+ */
+void xTS_AsyncWriter::xFileSink::xHandOff(int32_t Size)
+{
+    xChunk&       Curr = m_Chunks[m_Curr];
+    const int32_t Next = (m_Curr + 1) % (int32_t)m_Chunks.size();
+    m_Writer.xWaitIdle(&m_Chunks[Next].Request);
+    const int32_t Rest = m_Fill - Size;
+    if(Rest) { std::memcpy(m_Chunks[Next].Data, Curr.Data + Size, (size_t)Rest); }
+
+    Curr.Request.Offset = m_Offset;
+    Curr.Request.Size   = Size;
+    m_Writer.xSubmit(&Curr.Request);
+    m_Offset += (uint64_t)Size;
+    m_Curr    = Next;
+    m_Fill    = Rest;
+}
+
+void xTS_AsyncWriter::xFileSink::Flush()
+{
+    if(m_FD < 0 || !m_Fill) { return; }
+    const int32_t Size = m_Direct ? (m_Fill & ~(Alignment - 1)) : m_Fill;
+    if(Size) { xHandOff(Size); }
+}
+
+void xTS_AsyncWriter::xFileSink::xClose()
+{
+    if(m_FD < 0) { return; }
+    Flush();
+    for(const xChunk& Chunk : m_Chunks) { m_Writer.xWaitIdle(&Chunk.Request); }
+    if(m_Fill)
+    {
+        // O_DIRECT tail shorter than Alignment - written through the page cache
+#if defined(O_DIRECT) && !defined(_WIN32)
+        fcntl(m_FD, F_SETFL, fcntl(m_FD, F_GETFL) & ~O_DIRECT);
+#endif
+        xRequest& Tail = m_Chunks[m_Curr].Request;
+        Tail.Offset = m_Offset;
+        Tail.Size   = m_Fill;
+        const int32_t Result = xWriteAt(&Tail, 0);
+        if(Result < 0) { m_Error = -Result; }
+    }
+#if defined(_WIN32)
+    const int32_t Closed = _close(m_FD);
+#else
+    const int32_t Closed = close(m_FD);
+#endif
+    if(Closed != 0 && !m_Error) { m_Error = errno; }
+    m_FD = -1;
+    if(m_Error)
+    {
+        errno = m_Error;
+        std::perror(m_FileName.c_str());
+        m_Failed = true;
+    }
+}
+
+bool xTS_AsyncWriter::xFileSink::hasFailed() const
+{
+    if(m_Failed) { return true; }
+    std::lock_guard<std::mutex> Lock(m_Writer.m_Mutex); // chunks may still be in flight
+    return m_Error != 0;
+}
+
+//=============================================================================================================================================================================
+// xTS_AsyncWriter
+//=============================================================================================================================================================================
+
+xTS_AsyncWriter::xTS_AsyncWriter(const xConfig& Config) : m_Config(Config)
+{
+    m_Config.ChunkSize     = std::max(Alignment, (m_Config.ChunkSize + Alignment - 1) & ~(Alignment - 1));
+    m_Config.ChunksPerSink = std::max(2, m_Config.ChunksPerSink); // a chunk is filled while the other one is written
+    m_Config.NumThreads    = std::max(1, m_Config.NumThreads);
+    m_Config.QueueDepth    = std::max(1, m_Config.QueueDepth);
+#if defined(_WIN32)
+    m_Config.NumThreads    = 1; // positioned writes are seek + write there - one thread keeps them in order
+#endif
+
+#if defined(TS_HAS_IO_URING)
+    if(m_Config.Backend != eBackend::Threads)
+    {
+        std::unique_ptr<xRing> Ring = std::make_unique<xRing>();
+        if(Ring->Init((uint32_t)m_Config.QueueDepth)) { m_Ring = std::move(Ring); }
+    }
+#endif
+    if(m_Ring)
+    {
+        m_Backend = eBackend::IOUring;
+        m_Threads.emplace_back(&xTS_AsyncWriter::xReaperThread, this);
+        return;
+    }
+    m_Backend = eBackend::Threads;
+    for(int32_t i = 0; i < m_Config.NumThreads; i++) { m_Threads.emplace_back(&xTS_AsyncWriter::xWriterThread, this); }
+}
+
+xTS_AsyncWriter::~xTS_AsyncWriter()
+{
+    {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        m_Stop = true;
+#if defined(TS_HAS_IO_URING)
+        // A no-op with user_data 0 wakes the reaper up and tells it to leave. With no request in flight the ring is empty,
+        // so a refused submission (EAGAIN, EBUSY) is transient and tried again. A reaper whose wait fails instead sees
+        // m_Stop by itself.
+        if(m_Ring)
+        {
+            m_Finished.wait(Lock, [this]() { return m_NumInFlight == 0; });
+            while(!m_ReaperDone && !m_Ring->Submit(IORING_OP_NOP, nullptr)) { m_Finished.wait_for(Lock, std::chrono::milliseconds(1)); }
+        }
+#endif
+    }
+    m_Queued.notify_all();
+    for(std::thread& Thread : m_Threads) { Thread.join(); }
+}
+
+std::unique_ptr<xES_Sink> xTS_AsyncWriter::CreateSink(std::string FileName)
+{
+    return std::make_unique<xFileSink>(*this, std::move(FileName));
+}
+
+xTS_Demuxer::tSinkFactory xTS_AsyncWriter::getSinkFactory()
+{
+    return [this](int32_t PID, uint8_t StreamId, uint8_t StreamType) { return CreateSink(xTS_Demuxer::DefaultFileName(PID, StreamId, StreamType)); };
+}
+
+void xTS_AsyncWriter::xSubmit(xRequest* Request)
+{
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    Request->InFlight = true;
+#if defined(TS_HAS_IO_URING)
+    if(m_Ring)
+    {
+        // the completion queue holds twice the submission queue - keeping below the latter never overflows it
+        m_Finished.wait(Lock, [this]() { return m_NumInFlight < (int32_t)m_Ring->getEntries(); });
+        m_NumInFlight++;
+        if(m_Ring->Submit(IORING_OP_WRITE, Request)) { return; }
+        Lock.unlock();
+        xComplete(Request, xWriteAt(Request, 0));
+        return;
+    }
+#endif
+    m_NumInFlight++;
+    m_Queue.push_back(Request);
+    Lock.unlock();
+    m_Queued.notify_one();
+}
+
+void xTS_AsyncWriter::xWaitIdle(const xRequest* Request)
+{
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    m_Finished.wait(Lock, [Request]() { return !Request->InFlight; });
+}
+
+void xTS_AsyncWriter::xComplete(xRequest* Request, int32_t Result)
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        if(Result < 0) { *Request->Error = -Result; }
+        Request->InFlight = false;
+        m_NumInFlight--;
+    }
+    m_Finished.notify_all();
+}
+
+void xTS_AsyncWriter::xWriterThread()
+{
+    for(;;)
+    {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        m_Queued.wait(Lock, [this]() { return m_Stop || !m_Queue.empty(); });
+        if(m_Queue.empty()) { return; }
+        xRequest* Request = m_Queue.front();
+        m_Queue.pop_front();
+        Lock.unlock();
+        xComplete(Request, xWriteAt(Request, 0));
+    }
+}
+
+void xTS_AsyncWriter::xReaperThread()
+{
+#if defined(TS_HAS_IO_URING)
+    bool Stop = false;
+    while(!Stop)
+    {
+        const bool Reaped = m_Ring->Reap([this, &Stop](xRequest* Request, int32_t Result)
+        {
+            if(!Request) { Stop = true; return; }
+            // short write, or a kernel without IORING_OP_WRITE (-EINVAL) - the rest goes through pwrite
+            if(Result < Request->Size) { Result = xWriteAt(Request, std::max(Result, 0)); }
+            xComplete(Request, Result);
+        });
+        if(Reaped) { continue; }
+        // the wait itself failed - leave once the writer is being destroyed and nothing is in flight, else try again
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        if(m_Stop && m_NumInFlight == 0) { Stop = true; }
+        else                             { m_Finished.wait_for(Lock, std::chrono::milliseconds(1)); }
+    }
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_ReaperDone = true;
+    }
+    m_Finished.notify_all();
+#endif
+}
+
+/**
+ * @brief Synchronous positioned write of the request from byte Done on
+ * @return request size, or -errno
+ */
+int32_t xTS_AsyncWriter::xWriteAt(const xRequest* Request, int32_t Done)
+{
+    while(Done < Request->Size)
+    {
+#if defined(_WIN32)
+        const int Written = _lseeki64(Request->FD, (__int64)(Request->Offset + Done), SEEK_SET) < 0 ? -1 : _write(Request->FD, Request->Data + Done, (unsigned)(Request->Size - Done));
+#else
+        const ssize_t Written = pwrite(Request->FD, Request->Data + Done, (size_t)(Request->Size - Done), (off_t)(Request->Offset + (uint64_t)Done));
+#endif
+        if(Written < 0 && errno == EINTR) { continue; }
+        if(Written <= 0) { return -(Written < 0 ? errno : EIO); }
+        Done += (int32_t)Written;
+    }
+    return Request->Size;
+}
+
+const char* xTS_AsyncWriter::BackendToString(eBackend Backend)
+{
+    switch(Backend)
+    {
+        case eBackend::Auto   : return "async";
+        case eBackend::IOUring: return "uring";
+        case eBackend::Threads: return "thread";
+        default               : return "unknown";
+    }
+}
+
+bool xTS_AsyncWriter::StringToBackend(const char* Name, eBackend& Backend)
+{
+    if     (!std::strcmp(Name, "async" )) { Backend = eBackend::Auto;    }
+    else if(!std::strcmp(Name, "uring" )) { Backend = eBackend::IOUring; }
+    else if(!std::strcmp(Name, "thread")) { Backend = eBackend::Threads; }
+    else { return false; }
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsDemuxer.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_AsyncWriter
+//=============================================================================================================================================================================
+
+// Takes elementary stream file writes off the parse loop. Every sink (one per PID) copies PES data into large aligned
+// chunks and hands a full chunk to the writer, which writes it at its file offset in the background: through an
+// io_uring where the kernel provides one, otherwise on writer threads with pwrite. A sink owns ChunksPerSink chunks
+// (two - double buffering) and waits only when all of them are still in flight, i.e. when the disk is slower than the
+// input. With Direct the files are opened with O_DIRECT and whole chunks bypass the page cache; the unaligned tail is
+// written without it when the sink is closed. Sinks may be used from several threads (-t workers), one sink per thread.
+class xTS_AsyncWriter
+{
+public:
+  static constexpr int32_t Alignment = 4096; // O_DIRECT offset, size and buffer alignment
+
+  enum class eBackend : int32_t { Auto, IOUring, Threads };
+
+  struct xConfig
+  {
+    eBackend Backend       = eBackend::Auto;
+    int32_t  ChunkSize     = 1 << 20; // bytes, rounded up to Alignment
+    int32_t  ChunksPerSink = 2;
+    int32_t  NumThreads    = 1;       // writer threads of the Threads backend
+    int32_t  QueueDepth    = 64;      // io_uring submission queue entries
+    bool     Direct        = false;   // O_DIRECT where the file system supports it
+  };
+
+public:
+  explicit xTS_AsyncWriter(const xConfig& Config);
+  ~xTS_AsyncWriter(); // sinks have to be closed (destroyed) first
+
+  // File sink writing through this writer, opened lazily like xES_FileSink.
+  std::unique_ptr<xES_Sink> CreateSink(std::string FileName);
+  // Factory creating the default PID<PID>.<ext> file sinks through this writer.
+  xTS_Demuxer::tSinkFactory getSinkFactory();
+
+  eBackend getBackend() const { return m_Backend; }
+  static const char* BackendToString(eBackend Backend);
+  static bool        StringToBackend(const char* Name, eBackend& Backend);
+
+protected:
+  class xFileSink;
+  class xRing;
+
+  struct xRequest // one chunk write, lives in its sink
+  {
+    int32_t        FD       = -1;
+    uint64_t       Offset   = 0;
+    const uint8_t* Data     = nullptr;
+    int32_t        Size     = 0;
+    int32_t*       Error    = nullptr; // errno of a failed write goes there
+    bool           InFlight = false;   // guarded by m_Mutex
+  };
+
+  void xSubmit  (xRequest* Request);
+  void xWaitIdle(const xRequest* Request);
+  void xComplete(xRequest* Request, int32_t Result);
+  void xWriterThread();
+  void xReaperThread();
+  static int32_t xWriteAt(const xRequest* Request, int32_t Done);
+
+  xConfig                  m_Config;
+  eBackend                 m_Backend = eBackend::Threads;
+  std::unique_ptr<xRing>   m_Ring;
+  std::mutex               m_Mutex;
+  std::condition_variable  m_Queued;   // Threads backend: requests waiting
+  std::condition_variable  m_Finished; // a request completed
+  std::deque<xRequest*>    m_Queue;
+  int32_t                  m_NumInFlight = 0;
+  bool                     m_Stop        = false;
+  bool                     m_ReaperDone  = false; // io_uring reaper thread left its loop
+  std::vector<std::thread> m_Threads;
+};
@@ -0,0 +1,300 @@
+#include "tsBatchRunner.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+
+#if !defined(_WIN32)
+#include <glob.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_WorkStealingPool
+//=============================================================================================================================================================================
+
+// worker the current thread is, so a task submitting more work queues it on its own deque
+static thread_local const xTS_WorkStealingPool* t_Pool   = nullptr;
+static thread_local int32_t                     t_Worker = -1;
+
+xTS_WorkStealingPool::xTS_WorkStealingPool(int32_t NumWorkers)
+{
+    if(NumWorkers <= 0) { NumWorkers = (int32_t)std::max(1u, std::thread::hardware_concurrency()); }
+    for(int32_t w = 0; w < NumWorkers; w++) { m_Queues.push_back(std::make_unique<xQueue>()); }
+    for(int32_t w = 0; w < NumWorkers; w++) { m_Threads.emplace_back(&xTS_WorkStealingPool::xWorkerThread, this, w); }
+}
+
+xTS_WorkStealingPool::~xTS_WorkStealingPool()
+{
+    Wait();
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Queued.notify_all();
+    for(std::thread& Thread : m_Threads) { Thread.join(); }
+}
+
+void xTS_WorkStealingPool::Submit(tTask Task)
+{
+    {
+        // counted before it can be taken - Wait() must not see the pool drained while a task is on its way
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_NumPending++;
+    }
+    xQueue& Queue = t_Pool == this ? *m_Queues[t_Worker] : m_Injected;
+    {
+        std::lock_guard<std::mutex> Lock(Queue.Mutex);
+        Queue.Tasks.push_back(std::move(Task));
+    }
+    m_NumQueued.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex); // a worker between its check and its wait must not miss the wake-up
+    }
+    m_Queued.notify_one();
+}
+
+void xTS_WorkStealingPool::Wait()
+{
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    m_Idle.wait(Lock, [this]() { return m_NumPending == 0; });
+}
+
+xTS_WorkStealingPool::xStats xTS_WorkStealingPool::getStats() const
+{
+    xStats Stats;
+    for(const std::unique_ptr<xQueue>& Queue : m_Queues)
+    {
+        Stats.NumTasks  += Queue->NumTasks;
+        Stats.NumSteals += Queue->NumSteals;
+    }
+    return Stats;
+}
+
+/**
+ * @brief Takes the next task for Worker - its own newest, the oldest submitted from outside, the oldest of another worker
+ */
+bool xTS_WorkStealingPool::xTake(int32_t Worker, tTask& Task)
+{
+    xQueue& Own = *m_Queues[Worker];
+    {
+        std::lock_guard<std::mutex> Lock(Own.Mutex);
+        if(!Own.Tasks.empty())
+        {
+            Task = std::move(Own.Tasks.back());
+            Own.Tasks.pop_back();
+            m_NumQueued.fetch_sub(1);
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> Lock(m_Injected.Mutex);
+        if(!m_Injected.Tasks.empty())
+        {
+            Task = std::move(m_Injected.Tasks.front());
+            m_Injected.Tasks.pop_front();
+            m_NumQueued.fetch_sub(1);
+            return true;
+        }
+    }
+    const int32_t NumWorkers = (int32_t)m_Queues.size();
+    for(int32_t i = 1; i < NumWorkers; i++)
+    {
+        xQueue& Victim = *m_Queues[(Worker + i) % NumWorkers];
+        std::lock_guard<std::mutex> Lock(Victim.Mutex);
+        if(Victim.Tasks.empty()) { continue; }
+        Task = std::move(Victim.Tasks.front());
+        Victim.Tasks.pop_front();
+        m_NumQueued.fetch_sub(1);
+        Own.NumSteals++;
+        return true;
+    }
+    return false;
+}
+
+void xTS_WorkStealingPool::xWorkerThread(int32_t Worker)
+{
+    t_Pool   = this;
+    t_Worker = Worker;
+    for(;;)
+    {
+        tTask Task;
+        if(xTake(Worker, Task))
+        {
+            Task(Worker);
+            Task = nullptr; // captures go away before the task counts as finished
+            m_Queues[Worker]->NumTasks++;
+            std::lock_guard<std::mutex> Lock(m_Mutex);
+            if(--m_NumPending == 0) { m_Idle.notify_all(); }
+            continue;
+        }
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+        m_Queued.wait(Lock, [this]() { return m_Stop || m_NumQueued.load() > 0; });
+        if(m_Stop && m_NumQueued.load() == 0) { return; }
+    }
+}
+
+//=============================================================================================================================================================================
+// xTS_BatchRunner
+//=============================================================================================================================================================================
+
+bool xTS_BatchRunner::Run(const std::vector<std::string>& FileNames, const xConfig& Config)
+{
+    const std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    m_Config        = Config;
+    m_NumHeapAllocs = 0;
+    m_Files.clear();
+    m_Results.assign(FileNames.size(), xFileResult());
+    // two tasks writing the same outputs would interleave them - refused up front
+    std::map<std::string, size_t> Prefixes;
+    bool Distinct = true;
+    for(size_t f = 0; f < FileNames.size(); f++)
+    {
+        m_Results[f].FileName = FileNames[f];
+        std::error_code Error;
+        const std::filesystem::path Prefix = xOutputPrefix(FileNames[f]);
+        const std::filesystem::path Canonical = std::filesystem::weakly_canonical(Prefix, Error);
+        const auto Inserted = Prefixes.emplace((Error ? Prefix : Canonical).string(), f);
+        if(Inserted.second) { continue; }
+        std::fprintf(stderr, "%s and %s: both write to %sPID<PID>.<ext>\n", FileNames[Inserted.first->second].c_str(), FileNames[f].c_str(), Prefix.string().c_str());
+        Distinct = false;
+    }
+    if(!Distinct) { return false; }
+
+    std::vector<int32_t> Order(FileNames.size());
+    for(size_t f = 0; f < FileNames.size(); f++)
+    {
+        int64_t MTime = 0;
+        xTS_PacketSource::getFileInfo(FileNames[f].c_str(), m_Results[f].FileSize, MTime);
+        m_Files.push_back(std::make_unique<xFile>());
+        Order[f] = (int32_t)f;
+    }
+    // largest first - a long recording started last would leave every other worker idle at the end
+    std::stable_sort(Order.begin(), Order.end(), [this](int32_t a, int32_t b) { return m_Results[a].FileSize > m_Results[b].FileSize; });
+
+    m_NumWorkers = Config.NumWorkers > 0 ? Config.NumWorkers : (int32_t)std::max(1u, std::thread::hardware_concurrency());
+    m_Workers.clear();
+    m_Workers.resize((size_t)m_NumWorkers);
+    m_Pool = std::make_unique<xTS_WorkStealingPool>(m_NumWorkers);
+    for(int32_t FileIdx : Order) { m_Pool->Submit([this, FileIdx](int32_t Worker) { xParseFile(FileIdx, Worker); }); }
+    m_Pool->Wait();
+    m_PoolStats = m_Pool->getStats();
+    m_Pool.reset();
+
+    for(const xWorker& Worker : m_Workers) { m_NumHeapAllocs += Worker.Pool->getStats().NumHeapAllocs; }
+    m_Workers.clear();
+    m_Files.clear();
+    m_Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    return std::all_of(m_Results.begin(), m_Results.end(), [](const xFileResult& Result) { return Result.Ok; });
+}
+
+std::string xTS_BatchRunner::xOutputPrefix(const std::string& FileName) const
+{
+    if(m_Config.OutputDir.empty()) { return FileName + "."; }
+    return (std::filesystem::path(m_Config.OutputDir) / std::filesystem::path(FileName).filename()).string() + ".";
+}
+
+/**
+ * @brief File task - cuts the file into chunks, queues all but the first on this worker and parses the first
+ */
+void xTS_BatchRunner::xParseFile(int32_t FileIdx, int32_t Worker)
+{
+    xFile&       File   = *m_Files[FileIdx];
+    xFileResult& Result = m_Results[FileIdx];
+    File.Start = std::chrono::steady_clock::now();
+
+    xTS_ChunkedParser::xConfig Config;
+    Config.NumChunks  = (int32_t)std::max<uint64_t>(1, (Result.FileSize + ChunkBytes / 2) / ChunkBytes);
+    Config.PIDs       = m_Config.PIDs;
+    Config.AutoAddPES = m_Config.AutoAddPES;
+    Config.WriteFiles = m_Config.WriteFiles;
+    Config.LossPolicy = m_Config.LossPolicy;
+    Config.OutputPrefix = xOutputPrefix(Result.FileName);
+
+    if(!File.Parser->Prepare(Result.FileName.c_str(), Config))
+    {
+        std::perror(Result.FileName.c_str());
+        File.Parser.reset();
+        return;
+    }
+    const int32_t NumChunks = File.Parser->getNumChunks();
+    Result.NumChunks = NumChunks;
+    if(NumChunks == 0) { xFinishFile(FileIdx); return; }
+
+    File.NumLeft.store(NumChunks);
+    // queued last to first: this worker continues with chunk 1, thieves take the far end
+    for(int32_t c = NumChunks - 1; c > 0; c--) { m_Pool->Submit([this, FileIdx, c](int32_t Worker) { xParseChunk(FileIdx, c, Worker); }); }
+    xParseChunk(FileIdx, 0, Worker);
+}
+
+void xTS_BatchRunner::xParseChunk(int32_t FileIdx, int32_t ChunkIdx, int32_t Worker)
+{
+    xFile& File = *m_Files[FileIdx];
+    File.Parser->ParseChunk(ChunkIdx, *m_Workers[Worker].Pool, *m_Workers[Worker].Headers);
+    if(File.NumLeft.fetch_sub(1, std::memory_order_acq_rel) == 1) { xFinishFile(FileIdx); } // the last one merges
+}
+
+void xTS_BatchRunner::xFinishFile(int32_t FileIdx)
+{
+    xFile&             File   = *m_Files[FileIdx];
+    xFileResult&       Result = m_Results[FileIdx];
+    xTS_ChunkedParser& Parser = *File.Parser;
+    Result.Ok            = Parser.Finish();
+    Result.NumPackets    = Parser.getNumPackets();
+    Result.NumSyncLosses = Parser.getNumSyncLosses();
+    for(const xTS_ChunkedParser::xPIDStats& Stats : Parser.getStats())
+    {
+        Result.NumPES      += Stats.NumPES;
+        Result.NumBytes    += Stats.NumBytes;
+        Result.NumCCErrors += Stats.NumCCErrors;
+    }
+    Result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - File.Start).count();
+    File.Parser.reset(); // per-chunk tables of a finished file are not kept around for the rest of the batch
+}
+
+bool xTS_BatchRunner::ExpandInputs(const std::vector<std::string>& Patterns, std::vector<std::string>& FileNames)
+{
+    const size_t NumGiven = FileNames.size();
+    bool Ok = true;
+    for(const std::string& Pattern : Patterns)
+    {
+        if(!Pattern.empty() && Pattern[0] == '@')
+        {
+            std::ifstream List(Pattern.substr(1));
+            if(!List) { std::perror(Pattern.c_str() + 1); Ok = false; continue; }
+            for(std::string Line; std::getline(List, Line); )
+            {
+                while(!Line.empty() && (Line.back() == '\r' || Line.back() == ' ')) { Line.pop_back(); }
+                if(!Line.empty() && Line[0] != '#') { FileNames.push_back(Line); }
+            }
+            continue;
+        }
+#if !defined(_WIN32)
+        if(Pattern.find_first_of("*?[") != std::string::npos)
+        {
+            glob_t Glob;
+            const int Result = glob(Pattern.c_str(), 0, nullptr, &Glob);
+            if(Result == 0) { for(size_t i = 0; i < Glob.gl_pathc; i++) { FileNames.push_back(Glob.gl_pathv[i]); } } // sorted by glob()
+            if(Result != 0 && Result != GLOB_NOMATCH) { Ok = false; }
+            globfree(&Glob);
+            continue;
+        }
+#endif
+        FileNames.push_back(Pattern);
+    }
+
+    // "-b '*.ts' a.ts" names a.ts twice - parsed twice it would write its outputs twice at the same time
+    std::set<std::string> Seen;
+    size_t NumKept = NumGiven;
+    for(size_t f = NumGiven; f < FileNames.size(); f++)
+    {
+        std::error_code Error;
+        const std::filesystem::path Canonical = std::filesystem::weakly_canonical(FileNames[f], Error);
+        if(!Seen.insert(Error ? FileNames[f] : Canonical.string()).second) { continue; }
+        if(NumKept != f) { FileNames[NumKept] = std::move(FileNames[f]); }
+        NumKept++;
+    }
+    FileNames.resize(NumKept);
+    return Ok;
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsChunkedParser.h"
+#include "tsBufferPool.h"
+#include "tsPacketBatch.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_WorkStealingPool
+//=============================================================================================================================================================================
+
+// Fixed set of worker threads with one task deque each. A worker takes its own tasks newest first (the data the task
+// before it prepared is still in its cache), then tasks submitted from outside the pool in submission order, and when
+// both are empty steals the oldest task of another worker - the biggest piece of work left there, as producers queue
+// large work first. Tasks submitted from a worker go to its own deque. Idle workers sleep until something is queued.
+class xTS_WorkStealingPool
+{
+public:
+  using tTask = std::function<void(int32_t Worker)>;
+
+  struct xStats
+  {
+    uint64_t NumTasks  = 0;
+    uint64_t NumSteals = 0; // tasks taken from the deque of another worker
+  };
+
+public:
+  explicit xTS_WorkStealingPool(int32_t NumWorkers); // 0 - one per hardware thread
+  ~xTS_WorkStealingPool();
+  xTS_WorkStealingPool(const xTS_WorkStealingPool&) = delete;
+  xTS_WorkStealingPool& operator=(const xTS_WorkStealingPool&) = delete;
+
+  void Submit(tTask Task);
+  // Returns once every submitted task, and every task those submitted, has finished.
+  void Wait();
+
+  int32_t getNumWorkers() const { return (int32_t)m_Threads.size(); }
+  xStats  getStats     () const; // after Wait()
+
+protected:
+  struct alignas(64) xQueue
+  {
+    std::mutex        Mutex;
+    std::deque<tTask> Tasks;
+    uint64_t          NumTasks  = 0; // run by the worker owning the deque, updated by it only
+    uint64_t          NumSteals = 0;
+  };
+
+  void xWorkerThread(int32_t Worker);
+  bool xTake        (int32_t Worker, tTask& Task);
+
+  std::vector<std::unique_ptr<xQueue>> m_Queues;   // one per worker
+  xQueue                               m_Injected; // submitted from outside the pool
+  std::vector<std::thread>             m_Threads;
+  std::mutex                           m_Mutex;    // sleeping, waking and waiting for the end
+  std::condition_variable              m_Queued;
+  std::condition_variable              m_Idle;
+  std::atomic<int64_t>                 m_NumQueued{0};
+  int64_t                              m_NumPending = 0; // queued or running, guarded by m_Mutex
+  bool                                 m_Stop       = false;
+};
+
+//=============================================================================================================================================================================
+// xTS_BatchRunner
+//=============================================================================================================================================================================
+
+// Parses many files on one work-stealing pool instead of a process per file. Files are queued largest first; a file
+// larger than ChunkBytes is cut into chunks by xTS_ChunkedParser and every chunk is a task of its own, so one long
+// recording spreads over all workers while small files fill the gaps. The worker finishing the last chunk of a file
+// merges its statistics and outputs. Each worker keeps a PES buffer pool and a header batch for all of its tasks, so
+// assembler buffers are reused from file to file instead of being allocated per file. Outputs are written next to
+// each input (or to OutputDir) as <input>.PID<PID>.<ext>; a batch in which two inputs would write the same outputs is
+// refused before anything is parsed.
+class xTS_BatchRunner
+{
+public:
+  static constexpr uint64_t ChunkBytes = 64 << 20; // larger files are split into chunks of about this size
+
+  struct xConfig
+  {
+    int32_t                     NumWorkers = 0;     // 0 - one per hardware thread
+    std::vector<int32_t>        PIDs;               // explicit PIDs to extract
+    bool                        AutoAddPES = false;
+    bool                        WriteFiles = true;  // false - assemble and count only
+    std::string                 OutputDir;          // empty - outputs next to the inputs
+    xPES_Assembler::eLossPolicy LossPolicy = xPES_Assembler::eLossPolicy::Drop;
+  };
+
+  struct xFileResult
+  {
+    std::string FileName;
+    bool        Ok            = false; // mapped, parsed and outputs merged
+    uint64_t    FileSize      = 0;
+    int32_t     NumChunks     = 0;
+    uint64_t    NumPackets    = 0;
+    uint64_t    NumPES        = 0;
+    uint64_t    NumBytes      = 0;     // PES payload
+    uint64_t    NumCCErrors   = 0;
+    uint64_t    NumSyncLosses = 0;
+    double      Seconds       = 0;     // from the file task starting to the merge finishing
+  };
+
+public:
+  // Parses every file, returns false if any of them failed or two of them map to the same output names (nothing is
+  // parsed then).
+  bool Run(const std::vector<std::string>& FileNames, const xConfig& Config);
+
+  const std::vector<xFileResult>&     getResults      () const { return m_Results; }
+  const xTS_WorkStealingPool::xStats& getPoolStats    () const { return m_PoolStats; }
+  int32_t                             getNumWorkers   () const { return m_NumWorkers; }
+  uint64_t                            getNumHeapAllocs() const { return m_NumHeapAllocs; } // PES buffers taken from the heap by all workers
+  double                              getSeconds      () const { return m_Seconds; }
+
+  // Expands glob patterns (literal names are kept as given) and "@list" files with one name per line. A file named
+  // more than once (same canonical path) is kept only at its first place.
+  static bool ExpandInputs(const std::vector<std::string>& Patterns, std::vector<std::string>& FileNames);
+
+protected:
+  struct xWorker
+  {
+    std::unique_ptr<xPES_BufferPool> Pool    = std::make_unique<xPES_BufferPool>();
+    std::unique_ptr<xTS_PacketBatch> Headers = std::make_unique<xTS_PacketBatch>();
+  };
+
+  struct xFile
+  {
+    std::unique_ptr<xTS_ChunkedParser>    Parser = std::make_unique<xTS_ChunkedParser>();
+    std::atomic<int32_t>                  NumLeft{0}; // chunks not parsed yet
+    std::chrono::steady_clock::time_point Start;
+  };
+
+  std::string xOutputPrefix(const std::string& FileName) const;
+  void xParseFile (int32_t FileIdx, int32_t Worker);
+  void xParseChunk(int32_t FileIdx, int32_t ChunkIdx, int32_t Worker);
+  void xFinishFile(int32_t FileIdx);
+
+  xConfig                               m_Config;
+  std::vector<xWorker>                  m_Workers;       // declared before the pool - tasks use them until it is gone
+  std::unique_ptr<xTS_WorkStealingPool> m_Pool;
+  std::vector<std::unique_ptr<xFile>>   m_Files;
+  std::vector<xFileResult>              m_Results;
+  xTS_WorkStealingPool::xStats          m_PoolStats;
+  int32_t                               m_NumWorkers    = 0;
+  uint64_t                              m_NumHeapAllocs = 0;
+  double                                m_Seconds       = 0;
+};
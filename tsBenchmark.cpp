@@ -0,0 +1,1269 @@
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketSource.h"
+#include "tsDemuxer.h"
+#include "tsBufferPool.h"
+#include "tsSyncScanner.h"
+#include "tsPacketBatch.h"
+#include "tsPipeline.h"
+#include "tsChunkedParser.h"
+#include "tsEventWriter.h"
+#include "tsCRC32.h"
+#include "tsPSI.h"
+#include "tsPCRAnalyzer.h"
+#include "tsPTSIndex.h"
+#include "tsPacketIndex.h"
+#include "tsParser.h"
+#include "tsParseKernel.h"
+#include "tsStreamGenerator.h"
+#include "tsAsyncWriter.h"
+#include "tsAUIndex.h"
+#include "tsRemux.h"
+#include "tsBatchRunner.h"
+#include "tsPlayout.h"
+#include "tsCheckpoint.h"
+#include <atomic>
+#include <new>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+//=============================================================================================================================================================================
+// Allocation counting - every operator new in the process plus blocks the PES buffer pools take from the heap
+//=============================================================================================================================================================================
+
+static std::atomic<uint64_t> g_NumOperatorNew{0};
+
+void* operator new(size_t Size)
+{
+    g_NumOperatorNew.fetch_add(1, std::memory_order_relaxed);
+    if(void* Ptr = std::malloc(Size ? Size : 1)) { return Ptr; }
+    throw std::bad_alloc();
+}
+void* operator new[](size_t Size) { return operator new(Size); }
+void  operator delete  (void* Ptr) noexcept { std::free(Ptr); }
+void  operator delete[](void* Ptr) noexcept { std::free(Ptr); }
+void  operator delete  (void* Ptr, size_t) noexcept { std::free(Ptr); }
+void  operator delete[](void* Ptr, size_t) noexcept { std::free(Ptr); }
+
+static uint64_t GetNumAllocations()
+{
+    return g_NumOperatorNew.load(std::memory_order_relaxed) + xPES_BufferPool::getThreadDefault().getStats().NumHeapAllocs;
+}
+
+//=============================================================================================================================================================================
+// Benchmark helpers
+//=============================================================================================================================================================================
+
+struct xBenchResult
+{
+  std::string Name;
+  double      Seconds    = 0;
+  uint64_t    NumBytes   = 0;
+  uint64_t    NumPackets = 0;
+  uint64_t    NumAllocs  = 0;
+  uint64_t    Checksum   = 0; // keeps the optimizer from dropping the work, also a cheap cross-check between cases
+};
+
+static void PrintResult(const xBenchResult& R)
+{
+    const double MBps  = R.Seconds > 0 ? (double)R.NumBytes   / R.Seconds / 1e6 : 0;
+    const double MPkts = R.Seconds > 0 ? (double)R.NumPackets / R.Seconds / 1e6 : 0;
+    const double AllocsPerGB = R.NumBytes ? (double)R.NumAllocs * 1e9 / (double)R.NumBytes : 0;
+    printf("%-28s %9.3f ms %10.1f MB/s %9.2f Mpkt/s %12.1f allocs/GB  chk=%016" PRIx64 "\n", R.Name.c_str(), R.Seconds * 1e3, MBps, MPkts, AllocsPerGB, R.Checksum);
+}
+
+// Runs Func Repeats times and keeps the fastest run.
+static xBenchResult RunBench(const char* Name, int32_t Repeats, const std::function<void(xBenchResult&)>& Func)
+{
+    xBenchResult Best; Best.Name = Name; Best.Seconds = -1;
+    for(int32_t r = 0; r < Repeats; r++)
+    {
+        xBenchResult R; R.Name = Name;
+        const uint64_t AllocsBeg = GetNumAllocations();
+        auto Beg = std::chrono::steady_clock::now();
+        Func(R);
+        auto End = std::chrono::steady_clock::now();
+        R.Seconds   = std::chrono::duration<double>(End - Beg).count();
+        R.NumAllocs = GetNumAllocations() - AllocsBeg;
+        if(Best.Seconds < 0 || R.Seconds < Best.Seconds) { Best = R; }
+    }
+    PrintResult(Best);
+    return Best;
+}
+
+// Per-packet work shared by all ingest cases: header + adaptation field parse, PES assembly of a single PID.
+struct xPacketWork
+{
+  xTS_PacketHeader    Header;
+  xTS_AdaptationField AF;
+  xPES_Assembler      Assembler;
+
+  int32_t             PID;
+
+  explicit xPacketWork(int32_t PID_) : PID(PID_) { Assembler.Init(PID_); }
+
+  void Process(const uint8_t* Packet, xBenchResult& R)
+  {
+    Header.Parse(Packet);
+    if(Header.hasAdaptationField()) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+    if(Header.getPID() == (uint32_t)PID)
+    {
+      if(Assembler.AbsorbPacket(Packet, &Header, &AF) == xPES_Assembler::eResult::AssemblingFinished) { R.Checksum += (uint64_t)Assembler.getNumPacketBytes(); }
+    }
+    R.Checksum += Header.CC;
+    R.NumPackets++;
+  }
+};
+
+//=============================================================================================================================================================================
+// Ingest benchmarks
+//=============================================================================================================================================================================
+
+// Reference - one fread per packet, as the original main() loop did.
+static void BenchFreadPerPacket(const char* FileName, int32_t PID, xBenchResult& R)
+{
+    FILE* fp = std::fopen(FileName, "rb");
+    if(!fp) { return; }
+    xPacketWork Work(PID);
+    uint8_t Buffer[xTS::TS_PacketLength];
+    while(std::fread(Buffer, 1, xTS::TS_PacketLength, fp) == xTS::TS_PacketLength)
+    {
+        Work.Process(Buffer, R);
+        R.NumBytes += xTS::TS_PacketLength;
+    }
+    std::fclose(fp);
+}
+
+static void BenchPacketSource(xTS_PacketSource::eType Type, const char* FileName, int32_t PID, xBenchResult& R)
+{
+    std::unique_ptr<xTS_PacketSource> Source = xTS_PacketSource::Create(Type);
+    if(!Source->Open(FileName)) { return; }
+    xPacketWork Work(PID);
+    xTS_PacketSpan Span;
+    while(Source->ReadSpan(Span) > 0)
+    {
+        for(int32_t i = 0; i < Span.NumPackets; i++) { Work.Process(Span.getPacket(i), R); }
+        R.NumBytes += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+}
+
+//=============================================================================================================================================================================
+// PES assembly benchmarks - all PES PIDs of the input, mmap source
+//=============================================================================================================================================================================
+
+// Reference - per-PID std::vector, assign() on the first payload and insert() on every following one (the original assembler scheme).
+static void BenchAssembleVector(const char* FileName, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    std::vector<std::vector<uint8_t>> Buffers(xTS_Demuxer::NumPIDs);
+    xTS_PacketHeader    Header;
+    xTS_AdaptationField AF;
+    xTS_PacketSpan      Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        for(int32_t i = 0; i < Span.NumPackets; i++)
+        {
+            const uint8_t* Packet = Span.getPacket(i);
+            Header.Parse(Packet);
+            if(!Header.hasPayload()) { continue; }
+            int32_t Offset = xTS::TS_HeaderLength;
+            if(Header.hasAdaptationField()) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); Offset += 1 + AF.AFL; }
+            std::vector<uint8_t>& Buffer = Buffers[Header.getPID()];
+            if(Header.getS())
+            {
+                R.Checksum += Buffer.size();
+                Buffer.clear();
+                Buffer.assign(Packet + Offset, Packet + xTS::TS_PacketLength);
+            }
+            else
+            {
+                Buffer.insert(Buffer.end(), Packet + Offset, Packet + xTS::TS_PacketLength);
+            }
+        }
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+}
+
+class xCountingSink : public xES_Sink
+{
+public:
+  explicit xCountingSink(uint64_t& Counter) : m_Counter(Counter) {}
+  void Write(const uint8_t*, int32_t Size) override { m_Counter += (uint64_t)Size; }
+  bool Resume(uint64_t) override { return true; }
+protected:
+  uint64_t& m_Counter;
+};
+
+static void BenchAssembleDemuxer(const char* FileName, bool ScatterGather, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_Demuxer Demuxer;
+    Demuxer.setAutoAddPES(true);
+    Demuxer.setScatterGather(ScatterGather);
+    Demuxer.setSinkFactory([&R](int32_t, uint8_t, uint8_t) { return std::make_unique<xCountingSink>(R.Checksum); });
+    xTS_PacketHeader    Header;
+    xTS_AdaptationField AF;
+    xTS_PacketSpan      Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        for(int32_t i = 0; i < Span.NumPackets; i++)
+        {
+            const uint8_t* Packet = Span.getPacket(i);
+            Header.Parse(Packet);
+            if(Header.hasAdaptationField()) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+            Demuxer.ProcessPacket(Packet, Header, AF);
+        }
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+}
+
+// Pipeline - all PES PIDs, N workers (sinks run on worker threads, hence the atomic counter)
+class xAtomicCountingSink : public xES_Sink
+{
+public:
+  explicit xAtomicCountingSink(std::atomic<uint64_t>& Counter) : m_Counter(Counter) {}
+  void Write(const uint8_t*, int32_t Size) override { m_Counter.fetch_add((uint64_t)Size, std::memory_order_relaxed); }
+protected:
+  std::atomic<uint64_t>& m_Counter;
+};
+
+static void BenchPipeline(const char* FileName, int32_t NumWorkers, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    std::atomic<uint64_t> NumBytes{0};
+    xTS_Pipeline::xConfig Config;
+    Config.NumWorkers  = NumWorkers;
+    Config.AutoAddPES  = true;
+    Config.SinkFactory = [&NumBytes](int32_t, uint8_t, uint8_t) { return std::make_unique<xAtomicCountingSink>(NumBytes); };
+    xTS_Pipeline Pipeline;
+    Pipeline.Run(Source, Config);
+    R.NumPackets = Pipeline.getNumPackets();
+    R.NumBytes   = Source.getNumBytesRead();
+    R.Checksum   = NumBytes.load();
+}
+
+// Chunked parallel parse - all PES PIDs, statistics only (part files would measure the disk, not the parser)
+static void BenchChunked(const char* FileName, int32_t NumChunks, xBenchResult& R)
+{
+    xTS_ChunkedParser::xConfig Config;
+    Config.NumChunks  = NumChunks;
+    Config.AutoAddPES = true;
+    Config.WriteFiles = false;
+    xTS_ChunkedParser Parser;
+    if(!Parser.Run(FileName, Config)) { return; }
+    R.NumPackets = Parser.getNumPackets();
+    R.NumBytes   = Parser.getNumBytesRead();
+    for(const xTS_ChunkedParser::xPIDStats& Stats : Parser.getStats()) { R.Checksum += Stats.NumBytes; }
+}
+
+// Many files - one after another with a thread each (a process per file) vs all of them on the work-stealing pool
+static void BenchBatch(const std::vector<std::string>& FileNames, bool Pool, xBenchResult& R)
+{
+    if(Pool)
+    {
+        xTS_BatchRunner::xConfig Config;
+        Config.AutoAddPES = true;
+        Config.WriteFiles = false;
+        xTS_BatchRunner Runner;
+        if(!Runner.Run(FileNames, Config)) { return; }
+        for(const xTS_BatchRunner::xFileResult& Result : Runner.getResults())
+        {
+            R.NumPackets += Result.NumPackets;
+            R.NumBytes   += Result.FileSize;
+            R.Checksum   += Result.NumBytes;
+        }
+        return;
+    }
+    for(const std::string& FileName : FileNames)
+    {
+        xTS_ChunkedParser::xConfig Config;
+        Config.NumChunks  = 1;
+        Config.AutoAddPES = true;
+        Config.WriteFiles = false;
+        xTS_ChunkedParser Parser;
+        if(!Parser.Run(FileName.c_str(), Config)) { return; }
+        R.NumPackets += Parser.getNumPackets();
+        R.NumBytes   += Parser.getNumBytesRead();
+        for(const xTS_ChunkedParser::xPIDStats& Stats : Parser.getStats()) { R.Checksum += Stats.NumBytes; }
+    }
+}
+
+//=============================================================================================================================================================================
+// PES output - all PES PIDs written to files, fwrite in the parse loop vs the asynchronous writer
+//=============================================================================================================================================================================
+
+enum class eOutputBench : int32_t { Sync, IOUring, Threads, Direct };
+
+static void BenchOutput(const char* FileName, eOutputBench Mode, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    std::vector<std::string> OutputFileNames;
+    auto getOutputFileName = [&OutputFileNames](int32_t PID) { OutputFileNames.push_back("TS-BENCH_PID" + std::to_string(PID) + ".out"); return OutputFileNames.back(); };
+    {
+        std::unique_ptr<xTS_AsyncWriter> Writer;
+        if(Mode != eOutputBench::Sync)
+        {
+            xTS_AsyncWriter::xConfig Config;
+            Config.Backend = Mode == eOutputBench::Threads ? xTS_AsyncWriter::eBackend::Threads : xTS_AsyncWriter::eBackend::Auto;
+            Config.Direct  = Mode == eOutputBench::Direct;
+            Writer = std::make_unique<xTS_AsyncWriter>(Config);
+        }
+        xTS_Demuxer Demuxer; // files are closed when it goes - inside the measurement
+        Demuxer.setAutoAddPES(true);
+        Demuxer.setSinkFactory([&](int32_t PID, uint8_t, uint8_t) { return Writer ? Writer->CreateSink(getOutputFileName(PID)) : std::make_unique<xES_FileSink>(getOutputFileName(PID)); });
+        static xTS_PacketBatch Batch;
+        xTS_PacketSpan         Span;
+        while(Source.ReadSpan(Span) > 0)
+        {
+            Batch.Decode(Span);
+            Demuxer.ProcessBatch(Batch);
+            R.NumPackets += (uint64_t)Span.NumPackets;
+            R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+        }
+        Demuxer.Finish();
+        for(const xTS_Demuxer::xStream& Stream : Demuxer.getStreams()) { R.Checksum += Stream.NumBytes; }
+    }
+    for(const std::string& OutputFileName : OutputFileNames) { std::remove(OutputFileName.c_str()); }
+}
+
+//=============================================================================================================================================================================
+// Header decoding - per-packet xTS_PacketHeader::Parse vs SoA batch decode
+//=============================================================================================================================================================================
+
+enum class eHeaderBench { Parse, BatchScalar, BatchSIMD, ParseFilter, BatchFilter, ParseCC, BatchCC };
+
+static void BenchHeaders(const char* FileName, eHeaderBench Mode, int32_t PID, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    static xTS_PacketBatch Batch;
+    static int32_t         Indices[xTS_PacketBatch::MaxPackets];
+    int8_t                 LastCC[xTS_Demuxer::NumPIDs];
+    for(int8_t& CC : LastCC) { CC = -1; }
+    xTS_PacketHeader Header;
+    xTS_PacketSpan   Span;
+    while(Source.ReadSpan(Span, xTS_PacketBatch::MaxPackets) > 0)
+    {
+        switch(Mode)
+        {
+            case eHeaderBench::Parse:
+                for(int32_t i = 0; i < Span.NumPackets; i++) { Header.Parse(Span.getPacket(i)); R.Checksum += Header.PID + Header.CC + Header.AFC + Header.S; }
+                break;
+            case eHeaderBench::BatchScalar:
+            case eHeaderBench::BatchSIMD:
+                if(Mode == eHeaderBench::BatchScalar) { Batch.DecodeScalar(Span); } else { Batch.Decode(Span); }
+                for(int32_t i = 0; i < Batch.getNumPackets(); i++) { R.Checksum += Batch.PID[i] + Batch.CC[i] + Batch.AFC[i] + Batch.PUSI[i]; }
+                break;
+            case eHeaderBench::ParseFilter:
+                for(int32_t i = 0; i < Span.NumPackets; i++) { Header.Parse(Span.getPacket(i)); R.Checksum += Header.getPID() == (uint32_t)PID; }
+                break;
+            case eHeaderBench::BatchFilter:
+                Batch.Decode(Span);
+                R.Checksum += (uint64_t)Batch.FilterPID((uint16_t)PID, Indices);
+                break;
+            case eHeaderBench::ParseCC:
+                for(int32_t i = 0; i < Span.NumPackets; i++)
+                {
+                    Header.Parse(Span.getPacket(i));
+                    if(!Header.hasPayload() || Header.PID == (uint32_t)xTS_PacketHeader::ePID::NuLL) { continue; }
+                    const int8_t Last = LastCC[Header.PID];
+                    R.Checksum += (Last >= 0 && (int8_t)Header.CC != Last && (int8_t)Header.CC != ((Last + 1) & 0xF));
+                    LastCC[Header.PID] = (int8_t)Header.CC;
+                }
+                break;
+            case eHeaderBench::BatchCC:
+                Batch.Decode(Span);
+                R.Checksum += Batch.CountCCErrors(LastCC);
+                break;
+        }
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+}
+
+//=============================================================================================================================================================================
+// Per-packet trace - printf per field (as xTS_PacketHeader::Print & co.) vs buffered event writer, into the null device
+//=============================================================================================================================================================================
+
+#if defined(_WIN32)
+static const char* NullDevice = "NUL";
+#else
+static const char* NullDevice = "/dev/null";
+#endif
+
+static void BenchTrace(const char* FileName, bool Printf, xTS_EventWriter::eFormat Format, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    FILE* Null = std::fopen(NullDevice, "wb");
+    if(!Source.Open(FileName) || !Null) { if(Null) { std::fclose(Null); } return; }
+    {
+        xTS_EventWriter     Writer(Null, Format);
+        xTS_PacketHeader    Header;
+        xTS_AdaptationField AF;
+        xTS_PacketSpan      Span;
+        while(Source.ReadSpan(Span) > 0)
+        {
+            for(int32_t i = 0; i < Span.NumPackets; i++)
+            {
+                const uint8_t* Packet = Span.getPacket(i);
+                Header.Parse(Packet);
+                if(Header.hasAdaptationField()) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+                if(Printf)
+                {
+                    std::fprintf(Null, "%010d ", (int32_t)R.NumPackets);
+                    std::fprintf(Null, " SB = %d", Header.SB); std::fprintf(Null, " E = %d", Header.E); std::fprintf(Null, " S = %d", Header.S);
+                    std::fprintf(Null, " T = %d", Header.T); std::fprintf(Null, " PID = %d", Header.PID); std::fprintf(Null, " TSC = %d", Header.TSC);
+                    std::fprintf(Null, " AFC = %d", Header.AFC); std::fprintf(Null, " CC = %d ", Header.CC);
+                    if(Header.hasAdaptationField())
+                    {
+                        std::fprintf(Null, "\nAF: L = %d ", AF.AFL); std::fprintf(Null, "DC = %d ", AF.DC); std::fprintf(Null, "RA = %d ", AF.RA);
+                        std::fprintf(Null, "SP = %d ", AF.SP); std::fprintf(Null, "PR = %d ", AF.PR); std::fprintf(Null, "OR = %d ", AF.OR);
+                        std::fprintf(Null, "SF = %d ", AF.SF); std::fprintf(Null, "TP = %d ", AF.TP); std::fprintf(Null, "EX = %d ", AF.EX);
+                    }
+                    std::fprintf(Null, "\n");
+                }
+                else
+                {
+                    Writer.WritePacket(R.NumPackets, Span.getPacketOffset(i), Header, Header.hasAdaptationField() ? &AF : nullptr, xPES_Assembler::eResult::UnexpectedPID, nullptr);
+                }
+                R.NumPackets++;
+            }
+            R.NumBytes += (uint64_t)Span.NumPackets * Span.PacketSize;
+        }
+    }
+    R.Checksum = R.NumPackets;
+    std::fclose(Null);
+}
+
+//=============================================================================================================================================================================
+// PSI - CRC32 implementations and section parsing with / without the version cache
+//=============================================================================================================================================================================
+
+static void BenchCRC32(const std::vector<uint8_t>& Data, bool SliceBy8, xBenchResult& R)
+{
+    R.Checksum = SliceBy8 ? xTS_CRC32::Calc(Data.data(), Data.size()) : xTS_CRC32::CalcBytewise(Data.data(), Data.size());
+    R.NumBytes = Data.size();
+}
+
+static void BenchPSI(const char* FileName, bool VersionCache, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xPSI_Parser PSI;
+    PSI.setVersionCache(VersionCache);
+    static xTS_PacketBatch Batch;
+    xTS_PacketHeader       Header;
+    xTS_AdaptationField    AF;
+    xTS_PacketSpan         Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        Batch.Decode(Span);
+        for(int32_t i = 0; i < Batch.getNumPackets(); i++)
+        {
+            if(!PSI.isPSIPID(Batch.PID[i])) { continue; }
+            Batch.getHeader(i, Header);
+            if(Header.hasAdaptationField()) { AF.Parse(Batch.getPacket(i) + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+            PSI.ProcessPacket(Batch.getPacket(i), Header, AF);
+        }
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    R.Checksum = PSI.getStats().NumSections + PSI.getPMTs().size();
+}
+
+//=============================================================================================================================================================================
+// Embedding API - xTS_Parser fed from memory
+//=============================================================================================================================================================================
+
+struct xBenchPESSink : public xTS_ParserSink
+{
+  uint64_t NumBytes = 0;
+  void onPESComplete(int32_t, const xPES_PacketHeader&, const uint8_t*, int32_t Size, bool) { NumBytes += (uint64_t)Size; }
+};
+
+// Counts the generated PES that come out wrong: every one has a PTS and its payload starts with an access unit
+// delimiter (video) or an MPEG audio frame header. A PES header split between packets used to lose both.
+struct xBenchPESCheckSink : public xTS_ParserSink
+{
+  uint64_t NumBad = 0;
+  void onPESComplete(int32_t, const xPES_PacketHeader& PESH, const uint8_t* Payload, int32_t Size, bool)
+  {
+    const bool Video = Size >= 5 && Payload[0] == 0 && Payload[1] == 0 && Payload[2] == 0 && Payload[3] == 1 && Payload[4] == 0x09;
+    const bool Audio = Size >= 2 && Payload[0] == 0xFF && (Payload[1] & 0xF0) == 0xF0;
+    NumBad += !PESH.hasPTS() || !(Video || Audio);
+  }
+};
+
+struct xBenchAllSink : public xBenchPESSink
+{
+  uint64_t NumPackets  = 0;
+  uint64_t NumSections = 0;
+  uint64_t NumPCRs     = 0;
+  void onPacket (const uint8_t*, const xTS_PacketHeader&, const xTS_AdaptationField*, uint64_t) { NumPackets++; }
+  void onSection(int32_t, const uint8_t*, int32_t) { NumSections++; }
+  void onPCR    (int32_t, uint64_t, bool, uint64_t) { NumPCRs++; }
+};
+
+// PES of all PMT streams, input handed over in blocks of BlockSize bytes (1316 - 7 packets per UDP datagram, 4096 -
+// packets split between blocks).
+template <class tSink> static void BenchParserAPI(const std::vector<uint8_t>& Input, size_t BlockSize, xBenchResult& R)
+{
+    tSink Sink;
+    xTS_Parser<tSink> Parser(Sink);
+    Parser.setAddFromPMT(true);
+    for(size_t Pos = 0; Pos < Input.size(); Pos += BlockSize) { Parser.Feed(Input.data() + Pos, std::min(BlockSize, Input.size() - Pos)); }
+    Parser.Finish();
+    R.NumPackets = Parser.getNumPackets();
+    R.NumBytes   = Input.size();
+    R.Checksum   = Sink.NumBytes;
+}
+
+// Checksum: PES with a lost PTS or header bytes in the payload, 0 expected.
+static void BenchPESCheck(const std::vector<uint8_t>& Input, xBenchResult& R)
+{
+    xBenchPESCheckSink Sink;
+    xTS_Parser<xBenchPESCheckSink> Parser(Sink);
+    Parser.setAddFromPMT(true);
+    Parser.Feed(Input.data(), Input.size());
+    Parser.Finish();
+    R.NumPackets = Parser.getNumPackets();
+    R.NumBytes   = Input.size();
+    R.Checksum   = Sink.NumBad;
+}
+
+//=============================================================================================================================================================================
+// Specialized parse kernels vs the generic per-packet loop
+//=============================================================================================================================================================================
+
+enum class eKernelCase { Headers, ExtractPID, PCR };
+
+static xTS_Demuxer* SetupKernelCase(eKernelCase Case, int32_t PID, xTS_Demuxer& Demuxer, xTS_PCRAnalyzer& Analyzer, uint64_t& Counter)
+{
+    Demuxer.setSinkFactory([&Counter](int32_t, uint8_t, uint8_t) { return std::make_unique<xCountingSink>(Counter); });
+    if(Case == eKernelCase::ExtractPID) { Demuxer.AddPID(PID); }
+    if(Case == eKernelCase::PCR)
+    {
+        Demuxer.setPSI(true);
+        Demuxer.setOnPMT([&Analyzer](const xPSI_PMT& PMT) { Analyzer.AddProgram(PMT); });
+    }
+    return &Demuxer;
+}
+
+// The loop of the per-packet trace with the trace off - everything parsed, every option tested per packet.
+static void BenchGenericLoop(const char* FileName, eKernelCase Case, int32_t PID, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_Demuxer     Demuxer;
+    xTS_PCRAnalyzer Analyzer;
+    SetupKernelCase(Case, PID, Demuxer, Analyzer, R.Checksum);
+    const bool CountCC = Case == eKernelCase::Headers;
+    const bool Demux   = Case != eKernelCase::Headers;
+    const bool PCR     = Case == eKernelCase::PCR;
+    std::vector<int8_t>   LastCC(8192, -1);
+    std::vector<uint64_t> NumCCErrors(8192, 0);
+    xTS_PacketHeader    Header;
+    xTS_AdaptationField AF;
+    xTS_PacketSpan      Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        for(int32_t i = 0; i < Span.NumPackets; i++)
+        {
+            const uint8_t* Packet = Span.getPacket(i);
+            Header.Reset();
+            Header.Parse(Packet);
+            const bool HasAF = Header.hasAdaptationField();
+            if(HasAF) { AF.Reset(); AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+            if(CountCC && Header.hasPayload())
+            {
+                const int8_t Last = LastCC[Header.PID];
+                NumCCErrors[Header.PID] += Last >= 0 && (int8_t)Header.CC != Last && (int8_t)Header.CC != ((Last + 1) & 0xF);
+                LastCC[Header.PID] = (int8_t)Header.CC;
+            }
+            if(Demux) { Demuxer.ProcessPacket(Packet, Header, AF, Span.getPacketOffset(i)); }
+            if(PCR) { Analyzer.ProcessPacket(Header, HasAF ? &AF : nullptr); }
+        }
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    for(uint64_t Errors : NumCCErrors) { R.Checksum += Errors; }
+    for(const xTS_PCRAnalyzer::xStats& Stats : Analyzer.getStats()) { R.Checksum += Stats.NumPCRs; }
+}
+
+template <class tFeatures, class tPIDFilter> static void BenchKernel(const char* FileName, eKernelCase Case, int32_t PID, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_Demuxer     Demuxer;
+    xTS_PCRAnalyzer Analyzer;
+    SetupKernelCase(Case, PID, Demuxer, Analyzer, R.Checksum);
+    tPIDFilter Filter = [&]() {
+        if constexpr(std::is_same_v<tPIDFilter, xTS_OnePID>)           { return xTS_OnePID(PID); }
+        else if constexpr(std::is_same_v<tPIDFilter, xTS_DemuxerPIDs>) { return xTS_DemuxerPIDs(Demuxer); }
+        else                                                           { return tPIDFilter(); }
+    }();
+    xTS_ParseKernel<tFeatures, tPIDFilter> Kernel(Filter, &Demuxer, &Analyzer);
+    xTS_PacketSpan Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        Kernel.ProcessSpan(Span);
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    if(Case == eKernelCase::Headers) { for(int32_t p = 0; p < 8192; p++) { R.Checksum += Kernel.getCounts(p).NumCCErrors; } }
+    for(const xTS_PCRAnalyzer::xStats& Stats : Analyzer.getStats()) { R.Checksum += Stats.NumPCRs; }
+}
+
+//=============================================================================================================================================================================
+// PCR analysis
+//=============================================================================================================================================================================
+
+// PCR analysis over every packet - per-packet header/AF parse vs batch decode with AF parsed only for PCR packets.
+static void BenchPCR(const char* FileName, bool Batched, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_PCRAnalyzer        Analyzer;
+    static xTS_PacketBatch Batch;
+    xTS_PacketHeader       Header;
+    xTS_AdaptationField    AF;
+    xTS_PacketSpan         Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        if(Batched)
+        {
+            Batch.Decode(Span);
+            Analyzer.ProcessBatch(Batch);
+        }
+        else
+        {
+            for(int32_t i = 0; i < Span.NumPackets; i++)
+            {
+                const uint8_t* Packet = Span.getPacket(i);
+                Header.Parse(Packet);
+                const bool HasAF = Header.hasAdaptationField();
+                if(HasAF) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+                Analyzer.ProcessPacket(Header, HasAF ? &AF : nullptr);
+            }
+        }
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    for(const xTS_PCRAnalyzer::xStats& Stats : Analyzer.getStats()) { R.Checksum += Stats.NumPCRs + (uint64_t)Stats.TSBitrate; }
+}
+
+//=============================================================================================================================================================================
+// PTS index - build pass and time window extraction with and without it
+//=============================================================================================================================================================================
+
+// Extraction of all PES streams with the PES start callback feeding the index (what -i adds to a normal pass).
+static void BenchPTSIndexBuild(const char* FileName, xTS_PTSIndex& Index, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    Index.Reset();
+    uint64_t NumPESBytes = 0;
+    xTS_Demuxer Demuxer;
+    Demuxer.setAutoAddPES(true);
+    Demuxer.setSinkFactory([&NumPESBytes](int32_t, uint8_t, uint8_t) { return std::make_unique<xCountingSink>(NumPESBytes); });
+    Demuxer.setOnPESStart([&Index](int32_t PID, const xPES_PacketHeader& PESH, bool RandomAccess, uint64_t Offset) { Index.Add(PID, PESH, RandomAccess, Offset); }, true);
+    static xTS_PacketBatch Batch;
+    xTS_PacketSpan         Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        Batch.Decode(Span);
+        Demuxer.ProcessBatch(Batch);
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    R.Checksum = Index.getEntries().size();
+}
+
+// Time window [Beg, End) of all PES streams - Index nullptr scans from the start until every stream is past the window.
+static void BenchTimeWindow(const char* FileName, const xTS_PTSIndex* Index, int64_t Beg, int64_t End, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_Demuxer Demuxer;
+    Demuxer.setAutoAddPES(true);
+    Demuxer.setSinkFactory([&R](int32_t, uint8_t, uint8_t) { return std::make_unique<xCountingSink>(R.Checksum); });
+    uint64_t StopOffset = UINT64_MAX;
+    if(Index)
+    {
+        uint64_t RangeBeg = 0;
+        if(!Index->FindRange(Beg, End, Source.getSize(), RangeBeg, StopOffset)) { return; }
+        Source.Seek(RangeBeg);
+        Demuxer.setTimeWindow(Beg, End, Index->getFirstPTS());
+    }
+    else { Demuxer.setTimeWindow(Beg, End); }
+    static xTS_PacketBatch Batch;
+    xTS_PacketSpan         Span;
+    while(Source.ReadSpan(Span) > 0 && Span.Offset < StopOffset && !Demuxer.isPastWindow())
+    {
+        Span.NumPackets = (int32_t)std::min<uint64_t>((uint64_t)Span.NumPackets, (StopOffset - Span.Offset - 1) / Span.PacketSize + 1);
+        Batch.Decode(Span);
+        Demuxer.ProcessBatch(Batch);
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    Demuxer.Finish();
+}
+
+//=============================================================================================================================================================================
+// Packet index - build, reopen and single PID extraction with and without it
+//=============================================================================================================================================================================
+
+static void BenchPacketIndexBuild(const char* FileName, const std::string& IndexFileName, xBenchResult& R)
+{
+    std::remove(IndexFileName.c_str());
+    xTS_PacketIndex Index;
+    if(!Index.Update(IndexFileName, FileName, &R.NumBytes)) { return; }
+    R.NumPackets = Index.getHeader().NumPackets;
+    R.Checksum   = Index.getHeader().NumRecords + Index.getHeader().NumEvents;
+}
+
+static void BenchPacketIndexOpen(const char* FileName, const std::string& IndexFileName, xBenchResult& R)
+{
+    xTS_PacketIndex Index;
+    if(Index.Open(IndexFileName, FileName) != xTS_PacketIndex::eState::Valid) { return; }
+    for(uint64_t i = 0; i < Index.getNumPIDs(); i++) { R.Checksum += Index.getPIDs()[i].NumPackets + Index.getPIDs()[i].NumPUSI; }
+}
+
+// PES of one PID - batch scan of every header vs only the PID's packets looked up in the index.
+static void BenchExtractPID(const char* FileName, const xTS_PacketIndex* Index, int32_t PID, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_Demuxer Demuxer;
+    Demuxer.AddPID(PID);
+    Demuxer.setSinkFactory([&R](int32_t, uint8_t, uint8_t) { return std::make_unique<xCountingSink>(R.Checksum); });
+    if(Index)
+    {
+        const uint8_t* Data       = Source.getData();
+        const uint32_t SyncOffset = Index->getHeader().SyncOffset;
+        xTS_PacketHeader    Header;
+        xTS_AdaptationField AF;
+        Index->ForEachPacket({ PID }, 0, [&](int32_t, uint64_t Offset)
+        {
+            const uint8_t* Packet = Data + Offset + SyncOffset;
+            Header.Parse(Packet);
+            if(Header.hasAdaptationField()) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+            Demuxer.ProcessPacket(Packet, Header, AF, Offset);
+            R.NumPackets++;
+        });
+        R.NumBytes = R.NumPackets * Index->getHeader().PacketSize;
+    }
+    else
+    {
+        static xTS_PacketBatch Batch;
+        xTS_PacketSpan         Span;
+        while(Source.ReadSpan(Span) > 0)
+        {
+            Batch.Decode(Span);
+            Demuxer.ProcessBatch(Batch);
+            R.NumPackets += (uint64_t)Span.NumPackets;
+            R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+        }
+    }
+    Demuxer.Finish();
+}
+
+//=============================================================================================================================================================================
+// Checkpoint - the input parsed up to a checkpoint, the rest standing for data appended since
+//=============================================================================================================================================================================
+
+static void SetupCountingDemuxer(xTS_Demuxer& Demuxer, uint64_t& Counter)
+{
+    Demuxer.setAutoAddPES(true);
+    Demuxer.setSinkFactory([&Counter](int32_t, uint8_t, uint8_t) { return std::make_unique<xCountingSink>(Counter); });
+}
+
+// Parses the input up to the first span past Fraction of it - the state a checkpoint is saved from.
+static uint64_t ParseUpTo(const char* FileName, double Fraction, xTS_Demuxer& Demuxer, xTS_SyncScanner::xFormat& Format)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return 0; }
+    const uint64_t Stop = (uint64_t)((double)Source.getSize() * Fraction);
+    static xTS_PacketBatch Batch;
+    xTS_PacketSpan         Span;
+    uint64_t               ParsedBytes = 0;
+    while(ParsedBytes < Stop && Source.ReadSpan(Span) > 0)
+    {
+        Batch.Decode(Span);
+        Demuxer.ProcessBatch(Batch);
+        ParsedBytes = Span.getPacketOffset(Span.NumPackets);
+    }
+    Format = Source.getFormat();
+    return ParsedBytes;
+}
+
+// All PES streams of the input - from the start, or from the checkpoint on. The checksum counts the output bytes of the
+// streams including those written before the checkpoint, so both cases have to agree.
+static void BenchIncremental(const char* FileName, const std::string* CheckpointFileName, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_Demuxer Demuxer;
+    SetupCountingDemuxer(Demuxer, R.Checksum);
+    if(CheckpointFileName)
+    {
+        xTS_Checkpoint Checkpoint;
+        if(Checkpoint.Load(*CheckpointFileName, FileName, Demuxer) != xTS_Checkpoint::eState::Loaded) { return; }
+        Source.Seek(Checkpoint.getParsedBytes());
+        for(const xTS_Demuxer::xStream& Stream : Demuxer.getStreams()) { R.Checksum += Stream.NumBytes; }
+    }
+    static xTS_PacketBatch Batch;
+    xTS_PacketSpan         Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        Batch.Decode(Span);
+        Demuxer.ProcessBatch(Batch);
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    Demuxer.Finish();
+}
+
+//=============================================================================================================================================================================
+// Micro benchmarks - single parse steps over a generated multiplex in memory, independent of the input file
+//=============================================================================================================================================================================
+
+enum class eMicroBench { HeaderParse, AFParse, Absorb };
+
+static void BenchMicro(const std::vector<uint8_t>& Input, eMicroBench Mode, int32_t PID, xBenchResult& R)
+{
+    xTS_PacketHeader    Header;
+    xTS_AdaptationField AF;
+    xPES_Assembler      Assembler;
+    Assembler.Init(PID);
+    const size_t NumPackets = Input.size() / xTS::TS_PacketLength;
+    for(size_t i = 0; i < NumPackets; i++)
+    {
+        const uint8_t* Packet = Input.data() + i * xTS::TS_PacketLength;
+        switch(Mode)
+        {
+        case eMicroBench::HeaderParse:
+            Header.Parse(Packet);
+            R.Checksum += Header.PID + Header.CC;
+            break;
+        case eMicroBench::AFParse: // packets with an adaptation field only, the AFC bits are read from the raw byte
+            if(Packet[3] & 0x20) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)(Packet[3] >> 4 & 0x3)); R.Checksum += AF.PCR + AF.RA; }
+            break;
+        case eMicroBench::Absorb:
+            Header.Parse(Packet);
+            if(Header.PID != (uint32_t)PID) { break; }
+            if(Header.hasAdaptationField()) { AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)Header.getAFC()); }
+            // video PES are unbounded - the next payload unit start completes them, as in xTS_Demuxer
+            if(Header.getS() && Assembler.isPending() && Assembler.FinishPending(&Header, &AF)) { R.Checksum += (uint64_t)Assembler.getNumPacketBytes(); }
+            if(Assembler.AbsorbPacket(Packet, &Header, &AF) == xPES_Assembler::eResult::AssemblingFinished) { R.Checksum += (uint64_t)Assembler.getNumPacketBytes(); }
+            break;
+        }
+    }
+    R.NumPackets = NumPackets;
+    R.NumBytes   = NumPackets * xTS::TS_PacketLength;
+}
+
+//=============================================================================================================================================================================
+// Sync recovery scan - garbage without lock, i.e. the worst case of a resync
+//=============================================================================================================================================================================
+
+static void BenchSyncScan(const std::vector<uint8_t>& Garbage, xTS_SyncScanner::eISA ISA, xBenchResult& R)
+{
+    xTS_SyncScanner::forceISA(ISA);
+    xTS_SyncScanner::xFormat Format;
+    const int64_t Pos = xTS_SyncScanner::DetectFormat(Garbage.data(), Garbage.size(), xTS_SyncScanner::NumLockPackets, Format);
+    R.Checksum  = (uint64_t)Pos;
+    R.NumBytes  = Garbage.size();
+    xTS_SyncScanner::forceISA(xTS_SyncScanner::eISA::AVX2);
+}
+
+//=============================================================================================================================================================================
+// Elementary stream scan - start codes / frame syncs in PES payloads, access unit index
+//=============================================================================================================================================================================
+
+static void BenchMemcpy(const std::vector<uint8_t>& Src, std::vector<uint8_t>& Dst, xBenchResult& R)
+{
+    std::memcpy(Dst.data(), Src.data(), Src.size());
+    R.Checksum = Dst[Dst.size() / 2];
+    R.NumBytes = Src.size();
+}
+
+static void BenchESScan(const std::vector<uint8_t>& ES, bool StartCode, xTS_SyncScanner::eISA ISA, xBenchResult& R)
+{
+    xTS_SyncScanner::forceISA(ISA);
+    const int32_t Size = (int32_t)ES.size();
+    for(int32_t Pos = 0; Pos < Size; )
+    {
+        const int32_t Found = StartCode ? xES_Scanner::FindStartCode(ES.data() + Pos, Size - Pos) : xES_Scanner::FindFrameSync(ES.data() + Pos, Size - Pos);
+        if(Found < 0) { break; }
+        R.Checksum += (uint64_t)(Pos + Found);
+        Pos += Found + 1;
+    }
+    R.NumBytes = ES.size();
+    xTS_SyncScanner::forceISA(xTS_SyncScanner::eISA::AVX2);
+}
+
+// Demuxing all PIDs (scatter-gather, counting sinks), with or without the access unit index built from the PES
+static void BenchAUIndex(const char* FileName, bool BuildIndex, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    xTS_Demuxer Demuxer;
+    Demuxer.setAutoAddPES(true);
+    Demuxer.setScatterGather(true);
+    Demuxer.setSinkFactory([&R](int32_t, uint8_t, uint8_t) { return std::make_unique<xCountingSink>(R.Checksum); });
+    xTS_AUIndex AUIndex;
+    if(BuildIndex) { AUIndex.Attach(Demuxer); }
+    std::unique_ptr<xTS_PacketBatch> Headers = std::make_unique<xTS_PacketBatch>();
+    xTS_PacketSpan Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        Headers->Decode(Span);
+        Demuxer.ProcessBatch(*Headers);
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    Demuxer.Finish();
+    AUIndex.Finish();
+    for(const xTS_Demuxer::xStream& Stream : Demuxer.getStreams())
+    {
+        if(const xES_AUIndexer* Indexer = AUIndex.getIndexer(Stream.PID)) { R.Checksum += Indexer->getEntries().size(); }
+    }
+}
+
+//=============================================================================================================================================================================
+// Remux - whole packets of the selected PIDs to a new file, kernel copies of coalesced runs vs writes
+//=============================================================================================================================================================================
+
+// Reference: every packet but the null ones fwritten on its own, as a straightforward filter would.
+static void BenchRemuxFwrite(const char* FileName, const char* OutputFileName, xBenchResult& R)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(FileName)) { return; }
+    FILE* Output = std::fopen(OutputFileName, "wb");
+    if(!Output) { return; }
+    std::unique_ptr<xTS_PacketBatch> Headers = std::make_unique<xTS_PacketBatch>();
+    xTS_PacketSpan Span;
+    while(Source.ReadSpan(Span) > 0)
+    {
+        Headers->Decode(Span);
+        for(int32_t i = 0; i < Span.NumPackets; i++)
+        {
+            if(Headers->PID[i] == (uint16_t)xTS_PacketHeader::ePID::NuLL) { continue; }
+            std::fwrite(Span.Data + (size_t)i * Span.PacketSize, 1, (size_t)Span.PacketSize, Output);
+            R.Checksum += (uint64_t)Span.PacketSize;
+        }
+        R.NumPackets += (uint64_t)Span.NumPackets;
+        R.NumBytes   += (uint64_t)Span.NumPackets * Span.PacketSize;
+    }
+    std::fclose(Output);
+}
+
+static void BenchRemux(const char* FileName, const char* OutputFileName, const xTS_Remuxer::xConfig& Config, xBenchResult& R)
+{
+    xTS_Remuxer Remuxer;
+    if(!Remuxer.Run(FileName, OutputFileName, Config)) { return; }
+    R.NumPackets = Remuxer.getStats().NumPackets;
+    R.NumBytes   = Remuxer.getSource().getNumBytesRead();
+    R.Checksum   = Remuxer.getStats().NumBytesOut;
+}
+
+//=============================================================================================================================================================================
+// UDP playout - datagrams per system call unpaced, send error of the sleep-only and the hybrid timer paced
+//=============================================================================================================================================================================
+
+static void BenchPlayout(const char* FileName, const std::string& Address, const xTS_Playout::xConfig& Config, xTS_Playout::xStats& Stats, xBenchResult& R)
+{
+    xTS_Playout Playout;
+    if(!Playout.Run({ { FileName, Address } }, Config)) { return; }
+    Stats        = Playout.getStats();
+    R.NumPackets = Stats.NumPackets;
+    R.NumBytes   = Stats.NumPackets * xTS::TS_PacketLength;
+    R.Checksum   = Stats.NumDatagrams;
+}
+
+static void PrintPlayoutJitter(const xTS_Playout::xStats& Stats)
+{
+    printf("%-28s %" PRIu64 " datagrams in %" PRIu64 " calls, send error avg %.1f us, RMS %.1f us, max %.1f us, %.1f%% within 10 us\n", "", Stats.NumDatagrams, Stats.NumCalls,
+           Stats.AvgLate_ns / 1e3, Stats.RMSLate_ns / 1e3, Stats.MaxLate_ns / 1e3, Stats.NumDatagrams ? 100.0 * (Stats.NumLate[0] + Stats.NumLate[1]) / Stats.NumDatagrams : 0.0);
+}
+
+//=============================================================================================================================================================================
+
+static void PrintUsage(const char* AppName)
+{
+    printf("Usage: %s [options] input.ts\n", AppName);
+    printf("  -p <PID>     PID assembled during ingest benchmarks (default: 136)\n");
+    printf("  -r <N>       repetitions, fastest run is reported (default: 3)\n");
+    printf("  -g <seconds> write a synthetic multiplex of <seconds> to input.ts first (see TS-GEN)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char* InputFileName = nullptr;
+    int32_t     PID           = 136;
+    int32_t     Repeats       = 3;
+    double      GenerateSec   = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if     (!std::strcmp(argv[i], "-p") && i + 1 < argc) { PID     = std::atoi(argv[++i]); }
+        else if(!std::strcmp(argv[i], "-r") && i + 1 < argc) { Repeats = std::max(1, std::atoi(argv[++i])); }
+        else if(!std::strcmp(argv[i], "-g") && i + 1 < argc) { GenerateSec = std::atof(argv[++i]); }
+        else if(argv[i][0] == '-') { PrintUsage(argv[0]); return EXIT_FAILURE; }
+        else                       { InputFileName = argv[i]; }
+    }
+    if(!InputFileName) { PrintUsage(argv[0]); return EXIT_FAILURE; }
+    if(GenerateSec > 0)
+    {
+        xTS_StreamGenerator Generator{xTS_StreamGenerator::xConfig()};
+        if(!Generator.WriteFile(InputFileName, Generator.DurationToPackets(GenerateSec))) { printf("Cannot write %s\n", InputFileName); return EXIT_FAILURE; }
+        printf("generated %s: %.0f s at %" PRId64 " bit/s, PIDs %d-%d\n", InputFileName, GenerateSec, Generator.getMuxBitrate(), Generator.getStreamPID(0), Generator.getStreamPID(Generator.getNumStreams() - 1));
+    }
+
+    printf("=== ingest (%s, PID %d) ===\n", InputFileName, PID);
+    RunBench("fread/packet", Repeats, [&](xBenchResult& R) { BenchFreadPerPacket(InputFileName, PID, R); });
+    RunBench("buffered"    , Repeats, [&](xBenchResult& R) { BenchPacketSource(xTS_PacketSource::eType::Buffered, InputFileName, PID, R); });
+    RunBench("mmap"        , Repeats, [&](xBenchResult& R) { BenchPacketSource(xTS_PacketSource::eType::Mapped  , InputFileName, PID, R); });
+    RunBench("stream/read" , Repeats, [&](xBenchResult& R) { BenchPacketSource(xTS_PacketSource::eType::Stream  , InputFileName, PID, R); });
+
+    printf("=== PES assembly, all PIDs ===\n");
+    RunBench("vector (reference)", Repeats, [&](xBenchResult& R) { BenchAssembleVector (InputFileName, R); });
+    RunBench("pool copy"         , Repeats, [&](xBenchResult& R) { BenchAssembleDemuxer(InputFileName, false, R); });
+    RunBench("scatter-gather"    , Repeats, [&](xBenchResult& R) { BenchAssembleDemuxer(InputFileName, true , R); });
+
+    printf("=== PES output to files, all PIDs ===\n");
+    RunBench("fwrite in the loop"  , Repeats, [&](xBenchResult& R) { BenchOutput(InputFileName, eOutputBench::Sync   , R); });
+    RunBench("async, io_uring"     , Repeats, [&](xBenchResult& R) { BenchOutput(InputFileName, eOutputBench::IOUring, R); });
+    RunBench("async, writer thread", Repeats, [&](xBenchResult& R) { BenchOutput(InputFileName, eOutputBench::Threads, R); });
+    RunBench("async, O_DIRECT"     , Repeats, [&](xBenchResult& R) { BenchOutput(InputFileName, eOutputBench::Direct , R); });
+
+    printf("=== threaded pipeline / chunked parse, all PIDs (%u hardware threads) ===\n", std::thread::hardware_concurrency());
+    for(int32_t NumWorkers : { 1, 2, 4 })
+    {
+        const std::string Name = "pipeline, " + std::to_string(NumWorkers) + " worker(s)";
+        RunBench(Name.c_str(), Repeats, [&](xBenchResult& R) { BenchPipeline(InputFileName, NumWorkers, R); });
+    }
+    for(int32_t NumChunks : { 1, 2, 4 })
+    {
+        const std::string Name = "chunked, " + std::to_string(NumChunks) + " chunk(s)";
+        RunBench(Name.c_str(), Repeats, [&](xBenchResult& R) { BenchChunked(InputFileName, NumChunks, R); });
+    }
+    {
+        const std::vector<std::string> FileNames(8, InputFileName);
+        RunBench("8 files, one at a time"  , Repeats, [&](xBenchResult& R) { BenchBatch(FileNames, false, R); });
+        RunBench("8 files, batch pool"     , Repeats, [&](xBenchResult& R) { BenchBatch(FileNames, true , R); });
+    }
+
+    printf("=== generic loop vs specialized kernels (PID %d) ===\n", PID);
+    RunBench("headers+CC, generic"       , Repeats, [&](xBenchResult& R) { BenchGenericLoop(InputFileName, eKernelCase::Headers, PID, R); });
+    RunBench("headers+CC, kernel"        , Repeats, [&](xBenchResult& R) { BenchKernel<xTS_HeadersOnly, xTS_AnyPID>(InputFileName, eKernelCase::Headers, PID, R); });
+    RunBench("extract PID, generic"      , Repeats, [&](xBenchResult& R) { BenchGenericLoop(InputFileName, eKernelCase::ExtractPID, PID, R); });
+    RunBench("extract PID, kernel"       , Repeats, [&](xBenchResult& R) { BenchKernel<xTS_Demux, xTS_OnePID>(InputFileName, eKernelCase::ExtractPID, PID, R); });
+    RunBench("PCR + PSI, generic"        , Repeats, [&](xBenchResult& R) { BenchGenericLoop(InputFileName, eKernelCase::PCR, PID, R); });
+    RunBench("PCR + PSI, kernel"         , Repeats, [&](xBenchResult& R) { BenchKernel<xTS_DemuxAndPCR, xTS_DemuxerPIDs>(InputFileName, eKernelCase::PCR, PID, R); });
+
+    printf("=== embedding API (xTS_Parser), PES of all PMT streams ===\n");
+    {
+        std::vector<uint8_t> Input;
+        if(FILE* File = std::fopen(InputFileName, "rb"))
+        {
+            uint8_t Block[1 << 16];
+            for(size_t Read; (Read = std::fread(Block, 1, sizeof(Block), File)) > 0; ) { Input.insert(Input.end(), Block, Block + Read); }
+            std::fclose(File);
+        }
+        RunBench("PES sink, 1 MB blocks"     , Repeats, [&](xBenchResult& R) { BenchParserAPI<xBenchPESSink>(Input, 1 << 20, R); });
+        RunBench("PES sink, 1316 B blocks"   , Repeats, [&](xBenchResult& R) { BenchParserAPI<xBenchPESSink>(Input, 1316   , R); });
+        RunBench("PES sink, 4096 B blocks"   , Repeats, [&](xBenchResult& R) { BenchParserAPI<xBenchPESSink>(Input, 4096   , R); });
+        RunBench("all callbacks, 1 MB blocks", Repeats, [&](xBenchResult& R) { BenchParserAPI<xBenchAllSink>(Input, 1 << 20, R); });
+    }
+
+    printf("=== per-packet trace ===\n");
+    RunBench("printf per field", Repeats, [&](xBenchResult& R) { BenchTrace(InputFileName, true , xTS_EventWriter::eFormat::Text  , R); });
+    RunBench("writer, text"    , Repeats, [&](xBenchResult& R) { BenchTrace(InputFileName, false, xTS_EventWriter::eFormat::Text  , R); });
+    RunBench("writer, ndjson"  , Repeats, [&](xBenchResult& R) { BenchTrace(InputFileName, false, xTS_EventWriter::eFormat::NDJSON, R); });
+    RunBench("writer, binary"  , Repeats, [&](xBenchResult& R) { BenchTrace(InputFileName, false, xTS_EventWriter::eFormat::Binary, R); });
+
+    printf("=== header decode ===\n");
+    RunBench("Parse() per packet"  , Repeats, [&](xBenchResult& R) { BenchHeaders(InputFileName, eHeaderBench::Parse      , PID, R); });
+    RunBench("batch scalar"        , Repeats, [&](xBenchResult& R) { BenchHeaders(InputFileName, eHeaderBench::BatchScalar, PID, R); });
+    RunBench("batch SIMD"          , Repeats, [&](xBenchResult& R) { BenchHeaders(InputFileName, eHeaderBench::BatchSIMD  , PID, R); });
+    RunBench("PID filter, Parse()" , Repeats, [&](xBenchResult& R) { BenchHeaders(InputFileName, eHeaderBench::ParseFilter, PID, R); });
+    RunBench("PID filter, batch"   , Repeats, [&](xBenchResult& R) { BenchHeaders(InputFileName, eHeaderBench::BatchFilter, PID, R); });
+    RunBench("CC check, Parse()"   , Repeats, [&](xBenchResult& R) { BenchHeaders(InputFileName, eHeaderBench::ParseCC    , PID, R); });
+    RunBench("CC check, batch"     , Repeats, [&](xBenchResult& R) { BenchHeaders(InputFileName, eHeaderBench::BatchCC    , PID, R); });
+
+    printf("=== PSI ===\n");
+    {
+        std::vector<uint8_t> Sections(16 << 20);
+        uint32_t Seed = 0x9E3779B9;
+        for(uint8_t& Byte : Sections) { Seed = Seed * 1664525u + 1013904223u; Byte = (uint8_t)(Seed >> 24); }
+        RunBench("CRC32 bytewise"        , Repeats, [&](xBenchResult& R) { BenchCRC32(Sections, false, R); });
+        RunBench("CRC32 slice-by-8"      , Repeats, [&](xBenchResult& R) { BenchCRC32(Sections, true , R); });
+    }
+    RunBench("PAT/PMT, no cache"     , Repeats, [&](xBenchResult& R) { BenchPSI(InputFileName, false, R); });
+    RunBench("PAT/PMT, version cache", Repeats, [&](xBenchResult& R) { BenchPSI(InputFileName, true , R); });
+
+    printf("=== PCR analysis, all packets ===\n");
+    RunBench("per-packet AF parse"    , Repeats, [&](xBenchResult& R) { BenchPCR(InputFileName, false, R); });
+    RunBench("batch, PCR packets only", Repeats, [&](xBenchResult& R) { BenchPCR(InputFileName, true , R); });
+
+    printf("=== PTS index, all PES streams (window: 2 s at 90%% of the input) ===\n");
+    {
+        xTS_PTSIndex Index;
+        RunBench("index build pass", Repeats, [&](xBenchResult& R) { BenchPTSIndexBuild(InputFileName, Index, R); });
+        int64_t Duration = 0;
+        for(const xTS_PTSIndex::xEntry& Entry : Index.getEntries()) { Duration = std::max(Duration, Entry.Time); }
+        const int64_t Beg = Duration / 10 * 9;
+        const int64_t End = Beg + 2 * xTS::BaseClockFrequency_Hz;
+        RunBench("window, scan from start", Repeats, [&](xBenchResult& R) { BenchTimeWindow(InputFileName, nullptr, Beg, End, R); });
+        RunBench("window, seek via index" , Repeats, [&](xBenchResult& R) { BenchTimeWindow(InputFileName, &Index , Beg, End, R); });
+    }
+
+    printf("=== packet index (PID %d) ===\n", PID);
+    {
+        const std::string IndexFileName = std::string(InputFileName) + ".bench.tsidx";
+        RunBench("index build"             , Repeats, [&](xBenchResult& R) { BenchPacketIndexBuild(InputFileName, IndexFileName, R); });
+        RunBench("index reopen + list PIDs", Repeats, [&](xBenchResult& R) { BenchPacketIndexOpen (InputFileName, IndexFileName, R); });
+        xTS_PacketIndex Index;
+        Index.Open(IndexFileName, InputFileName);
+        RunBench("extract PID, batch scan" , Repeats, [&](xBenchResult& R) { BenchExtractPID(InputFileName, nullptr, PID, R); });
+        if(Index.isValid()) { RunBench("extract PID via index", Repeats, [&](xBenchResult& R) { BenchExtractPID(InputFileName, &Index, PID, R); }); }
+        Index.Close();
+        std::remove(IndexFileName.c_str());
+    }
+
+    printf("=== incremental parse, all PES streams (checkpoint at 95%% of the input) ===\n");
+    {
+        const std::string CheckpointFileName = std::string(InputFileName) + ".bench.tsckpt";
+        uint64_t                 Counter = 0;
+        xTS_Demuxer              Demuxer;
+        xTS_SyncScanner::xFormat Format;
+        SetupCountingDemuxer(Demuxer, Counter);
+        const uint64_t ParsedBytes = ParseUpTo(InputFileName, 0.95, Demuxer, Format);
+        xTS_Checkpoint Checkpoint;
+        RunBench("checkpoint save"       , Repeats, [&](xBenchResult& R)
+        {
+            if(Checkpoint.Save(CheckpointFileName, InputFileName, ParsedBytes, Format, Demuxer)) { R.NumBytes = Checkpoint.getHeader().StateSize; }
+        });
+        RunBench("parse from the start"  , Repeats, [&](xBenchResult& R) { BenchIncremental(InputFileName, nullptr            , R); });
+        RunBench("resume from checkpoint", Repeats, [&](xBenchResult& R) { BenchIncremental(InputFileName, &CheckpointFileName, R); });
+        std::remove(CheckpointFileName.c_str());
+    }
+
+    printf("=== micro, generated multiplex in memory (3 PIDs, 5%% AF, 200k packets; PES check chk = bad PES) ===\n");
+    {
+        xTS_StreamGenerator::xConfig Config;
+        std::vector<uint8_t> Clean, Impaired, Split;
+        xTS_StreamGenerator(Config).Generate(200000, Clean);
+        Config.SplitPESHeader = 10; // the PTS split after its first byte
+        xTS_StreamGenerator(Config).Generate(200000, Split);
+        Config.SplitPESHeader = 0;
+        Config.LossRate = Config.CorruptRate = Config.DuplicateRate = Config.TEIRate = 1e-3;
+        Config.SyncLossRate = 1e-4;
+        xTS_StreamGenerator(Config).Generate(200000, Impaired);
+        const int32_t VideoPID = Config.FirstPID;
+        RunBench("PacketHeader::Parse"      , Repeats, [&](xBenchResult& R) { BenchMicro(Clean, eMicroBench::HeaderParse, VideoPID, R); });
+        RunBench("AdaptationField::Parse"   , Repeats, [&](xBenchResult& R) { BenchMicro(Clean, eMicroBench::AFParse    , VideoPID, R); });
+        RunBench("AbsorbPacket, video PID"  , Repeats, [&](xBenchResult& R) { BenchMicro(Clean, eMicroBench::Absorb     , VideoPID, R); });
+        RunBench("end-to-end, clean"        , Repeats, [&](xBenchResult& R) { BenchParserAPI<xBenchPESSink>(Clean   , 1 << 20, R); });
+        RunBench("end-to-end, impaired"     , Repeats, [&](xBenchResult& R) { BenchParserAPI<xBenchPESSink>(Impaired, 1 << 20, R); });
+        RunBench("PES check, clean"         , Repeats, [&](xBenchResult& R) { BenchPESCheck(Clean, R); });
+        RunBench("PES check, split header"  , Repeats, [&](xBenchResult& R) { BenchPESCheck(Split, R); });
+    }
+
+    printf("=== sync recovery scan (64 MB, lock at the end, best ISA: %s) ===\n", xTS_SyncScanner::ISAToString(xTS_SyncScanner::getISA()));
+    {
+        // pseudo-random bytes (0x47 every ~256 bytes, no stride pattern), then a valid lock
+        std::vector<uint8_t> Garbage(64 << 20);
+        uint32_t Seed = 0x12345678;
+        for(uint8_t& Byte : Garbage) { Seed = Seed * 1664525u + 1013904223u; Byte = (uint8_t)(Seed >> 24); }
+        const size_t LockPos = Garbage.size() - (xTS_SyncScanner::NumLockPackets + 1) * xTS::TS_PacketLength;
+        for(int32_t k = 0; k <= xTS_SyncScanner::NumLockPackets; k++) { Garbage[LockPos + (size_t)k * xTS::TS_PacketLength] = xTS_SyncScanner::SyncByte; }
+        for(xTS_SyncScanner::eISA ISA : { xTS_SyncScanner::eISA::Scalar, xTS_SyncScanner::eISA::SSE2, xTS_SyncScanner::eISA::AVX2 })
+        {
+            if((int32_t)ISA > (int32_t)xTS_SyncScanner::getISA()) { continue; }
+            RunBench(xTS_SyncScanner::ISAToString(ISA), Repeats, [&](xBenchResult& R) { BenchSyncScan(Garbage, ISA, R); });
+        }
+    }
+
+    printf("=== elementary stream scan (64 MB, start code every ~40 kB, frame sync every 576 B) ===\n");
+    {
+        // pseudo-random payload with the patterns planted: video with a start code per picture, MPEG audio frame headers
+        std::vector<uint8_t> Video(64 << 20), Audio(64 << 20);
+        uint32_t Seed = 0x2545F491;
+        for(uint8_t& Byte : Video) { Seed = Seed * 1664525u + 1013904223u; Byte = (uint8_t)(Seed >> 24); }
+        for(uint8_t& Byte : Audio) { Seed = Seed * 1664525u + 1013904223u; Byte = (uint8_t)(Seed >> 24) & 0xEF; } // no false 0xFFF syncs
+        for(size_t Pos = 0; Pos + 4 <= Video.size(); Pos += 40000) { Video[Pos] = 0; Video[Pos + 1] = 0; Video[Pos + 2] = 1; Video[Pos + 3] = 0x65; }
+        for(size_t Pos = 0; Pos + 4 <= Audio.size(); Pos += 576  ) { Audio[Pos] = 0xFF; Audio[Pos + 1] = 0xFD; Audio[Pos + 2] = 0xA4; Audio[Pos + 3] = 0x04; }
+        std::vector<uint8_t> Copy(Video.size(), 0);
+        RunBench("memcpy (reference)", Repeats, [&](xBenchResult& R) { BenchMemcpy(Video, Copy, R); });
+        for(xTS_SyncScanner::eISA ISA : { xTS_SyncScanner::eISA::Scalar, xTS_SyncScanner::eISA::SSE2, xTS_SyncScanner::eISA::AVX2 })
+        {
+            if((int32_t)ISA > (int32_t)xTS_SyncScanner::getISA()) { continue; }
+            const std::string NameStartCode = std::string("start code, ") + xTS_SyncScanner::ISAToString(ISA);
+            const std::string NameFrameSync = std::string("frame sync, ") + xTS_SyncScanner::ISAToString(ISA);
+            RunBench(NameStartCode.c_str(), Repeats, [&](xBenchResult& R) { BenchESScan(Video, true , ISA, R); });
+            RunBench(NameFrameSync.c_str(), Repeats, [&](xBenchResult& R) { BenchESScan(Audio, false, ISA, R); });
+        }
+    }
+    RunBench("demux all PIDs"           , Repeats, [&](xBenchResult& R) { BenchAUIndex(InputFileName, false, R); });
+    RunBench("demux all PIDs + AU index", Repeats, [&](xBenchResult& R) { BenchAUIndex(InputFileName, true , R); });
+
+    printf("=== remux to a file (PID %d with its program's PSI and PCR / all but null packets) ===\n", PID);
+    {
+        const std::string OutputFileName = std::string(InputFileName) + ".bench.remux.ts";
+        const char*       Output         = OutputFileName.c_str();
+        xTS_Remuxer::xConfig OnePID;
+        OnePID.PIDs = { PID };
+        xTS_Remuxer::xConfig NoNull;
+        NoNull.StripNull = true;
+        RunBench("no null, fwrite per packet", Repeats, [&](xBenchResult& R) { BenchRemuxFwrite(InputFileName, Output, R); });
+        OnePID.Copy = NoNull.Copy = xTS_Remuxer::eCopy::Write;
+        RunBench("PID, runs, write"          , Repeats, [&](xBenchResult& R) { BenchRemux(InputFileName, Output, OnePID, R); });
+        RunBench("no null, runs, write"      , Repeats, [&](xBenchResult& R) { BenchRemux(InputFileName, Output, NoNull, R); });
+        OnePID.Copy = NoNull.Copy = xTS_Remuxer::eCopy::CopyFileRange;
+        RunBench("PID, runs, copy_file_range", Repeats, [&](xBenchResult& R) { BenchRemux(InputFileName, Output, OnePID, R); });
+        RunBench("no null, copy_file_range"  , Repeats, [&](xBenchResult& R) { BenchRemux(InputFileName, Output, NoNull, R); });
+        std::remove(Output);
+    }
+
+    printf("=== UDP playout to loopback (unpaced / paced by the PCR for 2 s) ===\n");
+    {
+        // a socket nobody reads - the kernel drops what does not fit, the sender is what is measured
+        xTS_UDPSource Sink;
+        if(Sink.Open("udp://127.0.0.1:0"))
+        {
+            const std::string    Address = "udp://127.0.0.1:" + std::to_string(Sink.getPort());
+            xTS_Playout::xStats  Stats;
+            xTS_Playout::xConfig Unpaced;
+            Unpaced.Speed     = 0;
+            Unpaced.BatchSize = 1;
+            RunBench("unpaced, sendmsg"         , Repeats, [&](xBenchResult& R) { BenchPlayout(InputFileName, Address, Unpaced, Stats, R); });
+            Unpaced.BatchSize = xTS_Playout::MaxBatch;
+            RunBench("unpaced, sendmmsg"        , Repeats, [&](xBenchResult& R) { BenchPlayout(InputFileName, Address, Unpaced, Stats, R); });
+            xTS_Playout::xConfig Paced;
+            Paced.Duration_ms = 2000;
+            Paced.SpinTime_ns = 0;
+            RunBench("paced, clock_nanosleep"   , 1      , [&](xBenchResult& R) { BenchPlayout(InputFileName, Address, Paced, Stats, R); });
+            PrintPlayoutJitter(Stats);
+            Paced.SpinTime_ns = xTS_Playout::xConfig().SpinTime_ns;
+            RunBench("paced, sleep + busy-poll" , 1      , [&](xBenchResult& R) { BenchPlayout(InputFileName, Address, Paced, Stats, R); });
+            PrintPlayoutJitter(Stats);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#include "tsBufferPool.h"
+#include <cstdlib>
+
+//=============================================================================================================================================================================
+// xPES_BufferPool
+//=============================================================================================================================================================================
+
+// Returns size class index for Size or -1 if Size exceeds the largest pooled class.
+int32_t xPES_BufferPool::xSizeToClass(uint32_t Size)
+{
+    for(uint32_t Class = 0; Class < NumClasses; Class++)
+    {
+        if(Size <= (1u << (MinClassLog2 + Class))) { return (int32_t)Class; }
+    }
+    return -1;
+}
+
+xPES_BufferPool::xBlock xPES_BufferPool::Acquire(uint32_t MinCapacity)
+{
+    m_Stats.NumAcquires++;
+    xBlock Block;
+    const int32_t Class = xSizeToClass(MinCapacity);
+    if(Class >= 0)
+    {
+        Block.Capacity = 1u << (MinClassLog2 + Class);
+        std::vector<uint8_t*>& FreeList = m_FreeLists[Class];
+        if(!FreeList.empty())
+        {
+            Block.Data = FreeList.back();
+            FreeList.pop_back();
+            return Block;
+        }
+    }
+    else
+    {
+        Block.Capacity = MinCapacity;
+    }
+    Block.Data = (uint8_t*)std::malloc(Block.Capacity);
+    if(!Block.Data) { Block.Capacity = 0; return Block; }
+    m_Stats.NumHeapAllocs++;
+    m_Stats.NumBytesAllocated += Block.Capacity;
+    return Block;
+}
+
+void xPES_BufferPool::Release(xBlock& Block)
+{
+    if(!Block.Data) { return; }
+    const int32_t Class = xSizeToClass(Block.Capacity);
+    if(Class >= 0 && Block.Capacity == (1u << (MinClassLog2 + Class)) && m_FreeLists[Class].size() < m_MaxCachedPerClass)
+    {
+        m_FreeLists[Class].push_back(Block.Data);
+    }
+    else
+    {
+        std::free(Block.Data);
+        m_Stats.NumHeapFrees++;
+    }
+    Block = xBlock();
+}
+
+void xPES_BufferPool::Trim()
+{
+    for(std::vector<uint8_t*>& FreeList : m_FreeLists)
+    {
+        for(uint8_t* Data : FreeList) { std::free(Data); m_Stats.NumHeapFrees++; }
+        FreeList.clear();
+    }
+}
+
+xPES_BufferPool& xPES_BufferPool::getThreadDefault()
+{
+    static thread_local xPES_BufferPool Pool;
+    return Pool;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "tsCommon.h"
+#include <vector>
+
+//=============================================================================================================================================================================
+// xPES_BufferPool
+//=============================================================================================================================================================================
+
+// Recycling allocator for PES assembly buffers. Blocks are grouped in power-of-two size classes
+// (4 KiB .. 16 MiB) and returned blocks are kept on per-class free lists, so in steady state assembling
+// a PES packet does not touch the heap at all. Larger requests are served directly and not cached.
+// Not thread-safe - use one pool per thread (getThreadDefault()). A pool must outlive every assembler holding its blocks,
+// so objects that outlive the thread that fills them should be given an explicitly owned pool.
+class xPES_BufferPool
+{
+public:
+  static constexpr uint32_t MinClassLog2 = 12;
+  static constexpr uint32_t MaxClassLog2 = 24;
+  static constexpr uint32_t NumClasses   = MaxClassLog2 - MinClassLog2 + 1;
+
+  struct xBlock
+  {
+    uint8_t* Data     = nullptr;
+    uint32_t Capacity = 0;
+  };
+
+  struct xStats
+  {
+    uint64_t NumAcquires       = 0;
+    uint64_t NumHeapAllocs     = 0; // blocks which had to be taken from the heap
+    uint64_t NumHeapFrees      = 0;
+    uint64_t NumBytesAllocated = 0;
+  };
+
+public:
+  explicit xPES_BufferPool(uint32_t MaxCachedPerClass = 64) : m_MaxCachedPerClass(MaxCachedPerClass) {}
+  ~xPES_BufferPool() { Trim(); }
+  xPES_BufferPool(const xPES_BufferPool&) = delete;
+  xPES_BufferPool& operator=(const xPES_BufferPool&) = delete;
+
+  xBlock Acquire(uint32_t MinCapacity);
+  void   Release(xBlock& Block);
+  void   Trim   (); // returns all cached blocks to the heap
+
+  const xStats& getStats  () const { return m_Stats; }
+  void          resetStats()       { m_Stats = xStats(); }
+
+  static xPES_BufferPool& getThreadDefault();
+
+protected:
+  static int32_t xSizeToClass(uint32_t Size);
+
+  std::vector<uint8_t*> m_FreeLists[NumClasses];
+  uint32_t              m_MaxCachedPerClass;
+  xStats                m_Stats;
+};
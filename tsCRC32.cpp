@@ -0,0 +1,53 @@
+#include "tsCRC32.h"
+#include <cstring>
+
+//=============================================================================================================================================================================
+// xTS_CRC32
+//=============================================================================================================================================================================
+
+xTS_CRC32::xTables::xTables()
+{
+    for(uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t C = n << 24;
+        for(int32_t k = 0; k < 8; k++) { C = (C & 0x80000000) ? (C << 1) ^ Polynomial : (C << 1); }
+        T[0][n] = C;
+    }
+    // T[k][n] - CRC of byte n followed by k zero bytes
+    for(uint32_t n = 0; n < 256; n++)
+    {
+        for(int32_t k = 1; k < 8; k++) { T[k][n] = (T[k - 1][n] << 8) ^ T[0][T[k - 1][n] >> 24]; }
+    }
+}
+
+const xTS_CRC32::xTables& xTS_CRC32::xGetTables()
+{
+    static const xTables Tables;
+    return Tables;
+}
+
+uint32_t xTS_CRC32::Calc(const uint8_t* Data, size_t Size, uint32_t CRC)
+{
+    const xTables& Tab = xGetTables();
+    while(Size >= 8)
+    {
+        uint32_t One, Two;
+        std::memcpy(&One, Data    , sizeof(One));
+        std::memcpy(&Two, Data + 4, sizeof(Two));
+        One = xSwapBytes32(One) ^ CRC;
+        Two = xSwapBytes32(Two);
+        CRC = Tab.T[7][ One >> 24        ] ^ Tab.T[6][(One >> 16) & 0xFF] ^ Tab.T[5][(One >> 8) & 0xFF] ^ Tab.T[4][One & 0xFF] ^
+              Tab.T[3][ Two >> 24        ] ^ Tab.T[2][(Two >> 16) & 0xFF] ^ Tab.T[1][(Two >> 8) & 0xFF] ^ Tab.T[0][Two & 0xFF];
+        Data += 8;
+        Size -= 8;
+    }
+    while(Size--) { CRC = (CRC << 8) ^ Tab.T[0][(CRC >> 24) ^ *Data++]; }
+    return CRC;
+}
+
+uint32_t xTS_CRC32::CalcBytewise(const uint8_t* Data, size_t Size, uint32_t CRC)
+{
+    const xTables& Tab = xGetTables();
+    while(Size--) { CRC = (CRC << 8) ^ Tab.T[0][(CRC >> 24) ^ *Data++]; }
+    return CRC;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "tsCommon.h"
+
+//=============================================================================================================================================================================
+// xTS_CRC32
+//=============================================================================================================================================================================
+
+// CRC-32/MPEG-2 used by PSI/SI sections (polynomial 0x04C11DB7, MSB first, initial value 0xFFFFFFFF, no final xor).
+// Running it over a whole section including its CRC_32 field yields 0 for an intact section.
+// Calc() is slice-by-8: eight 256-entry tables consume 8 bytes per step with independent lookups. The x86 CRC32
+// instruction implements the Castagnoli polynomial and cannot be used here.
+class xTS_CRC32
+{
+public:
+  static constexpr uint32_t Polynomial = 0x04C11DB7;
+  static constexpr uint32_t InitValue  = 0xFFFFFFFF;
+
+  static uint32_t Calc        (const uint8_t* Data, size_t Size, uint32_t CRC = InitValue);
+  static uint32_t CalcBytewise(const uint8_t* Data, size_t Size, uint32_t CRC = InitValue); // reference - one table lookup per byte
+
+protected:
+  struct xTables { uint32_t T[8][256]; xTables(); };
+  static const xTables& xGetTables();
+};
@@ -0,0 +1,124 @@
+#include "tsCheckpoint.h"
+#include "tsCRC32.h"
+#include "tsPacketSource.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+//=============================================================================================================================================================================
+// xTS_Checkpoint
+//=============================================================================================================================================================================
+
+const char* xTS_Checkpoint::StateToString(eState State)
+{
+    switch(State)
+    {
+        case eState::Missing: return "missing";
+        case eState::Loaded : return "loaded";
+        case eState::Stale  : return "stale";
+        case eState::Corrupt: return "corrupt";
+        case eState::Orphan : return "outputs lost";
+        default             : return "unknown";
+    }
+}
+
+uint32_t xTS_Checkpoint::xLayout()
+{
+    return (uint32_t)sizeof(xPES_PacketHeader) | (uint32_t)sizeof(xPES_Assembler::xStats) << 16;
+}
+
+// CRC32 of the packet ending at ParsedBytes, read in place from a mapping of the input.
+bool xTS_Checkpoint::xTailCRC(const char* InputFileName, uint64_t ParsedBytes, int32_t PacketSize, uint32_t& CRC)
+{
+    CRC = 0;
+    if(ParsedBytes == 0) { return true; }
+    xTS_MappedFileSource Input;
+    if(!Input.Open(InputFileName) || Input.getSize() < ParsedBytes || ParsedBytes < (uint64_t)PacketSize) { return false; }
+    CRC = xTS_CRC32::Calc(Input.getData() + ParsedBytes - PacketSize, (size_t)PacketSize);
+    return true;
+}
+
+void xTS_Checkpoint::setExtraction(const xExtraction& Extraction)
+{
+    std::vector<int32_t> PIDs = Extraction.PIDs;
+    std::sort(PIDs.begin(), PIDs.end());
+    PIDs.erase(std::unique(PIDs.begin(), PIDs.end()), PIDs.end());
+    m_Extraction.Clear();
+    m_Extraction.Put(Extraction.AutoAddPES, Extraction.FromPMT, Extraction.LossPolicy, (uint32_t)PIDs.size());
+    for(int32_t PID : PIDs) { m_Extraction.Put(PID); }
+}
+
+/**
+ * @brief Restore Demuxer from the sidecar
+ * Header, extraction options, image size and image CRC are checked and the last parsed packet is compared with the
+ * input before the demuxer is touched, so only an image that passes all checks and still does not parse yields Corrupt.
+ * The demuxer should be configured (sink factory, loss policy) as for the run that saved the checkpoint - its sinks are
+ * opened here to continue the outputs written so far.
+ */
+xTS_Checkpoint::eState xTS_Checkpoint::Load(const std::string& FileName, const char* InputFileName, xTS_Demuxer& Demuxer)
+{
+    m_Header = xFileHeader();
+    FILE* File = std::fopen(FileName.c_str(), "rb");
+    if(!File) { return eState::Missing; }
+    xFileHeader       Header;
+    const xFileHeader Expected;
+    const std::vector<uint8_t>& Extraction = m_Extraction.getData();
+    std::vector<uint8_t> State;
+    bool Ok = std::fread(&Header, sizeof(Header), 1, File) == 1 && !std::memcmp(Header.Magic, Expected.Magic, sizeof(Header.Magic)) &&
+              Header.Version == Expected.Version && Header.Layout == xLayout() && Header.StateSize <= (1u << 30) &&
+              Header.ExtractionSize == Extraction.size();
+    if(Ok && !Extraction.empty())
+    {
+        std::vector<uint8_t> Saved(Extraction.size());
+        Ok = std::fread(Saved.data(), 1, Saved.size(), File) == Saved.size() && Saved == Extraction;
+    }
+    if(Ok)
+    {
+        State.resize((size_t)Header.StateSize);
+        Ok = State.empty() || std::fread(State.data(), 1, State.size(), File) == State.size();
+    }
+    std::fclose(File);
+    if(!Ok || xTS_CRC32::Calc(State.data(), State.size()) != Header.StateCRC) { return eState::Stale; }
+
+    uint32_t TailCRC = 0;
+    if(!xTailCRC(InputFileName, Header.ParsedBytes, Header.PacketSize, TailCRC) || TailCRC != Header.TailCRC) { return eState::Stale; }
+
+    xTS_StateReader Reader(State.data(), State.size());
+    if(!Demuxer.LoadState(Reader) || !Reader.isAtEnd()) { return eState::Corrupt; }
+    if(!Demuxer.ResumeSinks()) { return eState::Orphan; }
+    m_Header = Header;
+    return eState::Loaded;
+}
+
+bool xTS_Checkpoint::Save(const std::string& FileName, const char* InputFileName, uint64_t ParsedBytes, const xTS_SyncScanner::xFormat& Format, const xTS_Demuxer& Demuxer)
+{
+    xFileHeader Header;
+    Header.PacketSize  = (uint16_t)Format.PacketSize;
+    Header.SyncOffset  = (uint32_t)Format.SyncOffset;
+    Header.ParsedBytes = ParsedBytes;
+    Header.Layout      = xLayout();
+    if(Demuxer.hasFailedSinks()) { return false; } // the outputs do not hold the sizes that would be recorded
+    const std::vector<uint8_t>& Extraction = m_Extraction.getData();
+    Header.ExtractionSize = (uint32_t)Extraction.size();
+    if(!xTailCRC(InputFileName, ParsedBytes, Format.PacketSize, Header.TailCRC)) { return false; }
+
+    m_Writer.Clear();
+    Demuxer.SaveState(m_Writer);
+    const std::vector<uint8_t>& State = m_Writer.getData();
+    Header.StateSize = State.size();
+    Header.StateCRC  = xTS_CRC32::Calc(State.data(), State.size());
+
+    const std::string TempFileName = FileName + ".tmp";
+    FILE* File = std::fopen(TempFileName.c_str(), "wb");
+    if(!File) { return false; }
+    bool Ok = std::fwrite(&Header, sizeof(Header), 1, File) == 1;
+    if(Ok && !Extraction.empty()) { Ok = std::fwrite(Extraction.data(), 1, Extraction.size(), File) == Extraction.size(); }
+    if(Ok && !State.empty()) { Ok = std::fwrite(State.data(), 1, State.size(), File) == State.size(); }
+    Ok = std::fclose(File) == 0 && Ok;
+    std::error_code Error;
+    if(Ok) { std::filesystem::rename(TempFileName, FileName, Error); }
+    if(!Ok || Error) { std::remove(TempFileName.c_str()); return false; }
+    m_Header = Header;
+    m_NumSaves++;
+    return true;
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsSyncScanner.h"
+#include "tsDemuxer.h"
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_StateWriter / xTS_StateReader
+//=============================================================================================================================================================================
+
+// Flat image of parser state in host byte order - values are appended and read back in the same order by the same
+// build, so it is no exchange format. Only trivially copyable values go in as they are; classes write their members
+// one by one (SaveState() / LoadState()).
+class xTS_StateWriter
+{
+public:
+  void Clear() { m_Data.clear(); }
+
+  template<class... tArgs> void Put(const tArgs&... Values)
+  {
+    static_assert((std::is_trivially_copyable<tArgs>::value && ...), "state values are copied byte-wise");
+    (PutBytes(&Values, sizeof(Values)), ...);
+  }
+  void PutBytes(const void* Data, size_t Size) { m_Data.insert(m_Data.end(), (const uint8_t*)Data, (const uint8_t*)Data + Size); }
+
+  const std::vector<uint8_t>& getData() const { return m_Data; }
+
+protected:
+  std::vector<uint8_t> m_Data;
+};
+
+class xTS_StateReader
+{
+public:
+  xTS_StateReader(const uint8_t* Data, size_t Size) : m_Pos(Data), m_End(Data + Size) {}
+
+  // False once the image ended early - every value read from then on is left unchanged.
+  template<class... tArgs> bool Get(tArgs&... Values)
+  {
+    static_assert((std::is_trivially_copyable<tArgs>::value && ...), "state values are copied byte-wise");
+    return (xGet(&Values, sizeof(Values)) && ...);
+  }
+  // Size bytes in place, nullptr if the image ended early.
+  const uint8_t* GetBytes(size_t Size)
+  {
+    if(Size > (size_t)(m_End - m_Pos)) { m_Pos = m_End; return nullptr; }
+    const uint8_t* Data = m_Pos;
+    m_Pos += Size;
+    return Data;
+  }
+  bool isAtEnd() const { return m_Pos == m_End; }
+
+protected:
+  bool xGet(void* Value, size_t Size)
+  {
+    const uint8_t* Data = GetBytes(Size);
+    if(Data) { std::memcpy(Value, Data, Size); }
+    return Data != nullptr;
+  }
+
+  const uint8_t* m_Pos;
+  const uint8_t* m_End;
+};
+
+//=============================================================================================================================================================================
+// xTS_Checkpoint
+//=============================================================================================================================================================================
+
+// Sidecar <input>.tsckpt for incremental parsing of a growing recording: the input offset up to which packets have
+// been parsed and the demuxer state at that point - per stream the counters and the PES assembler with its buffered
+// payload, continuity counter and PES header. A later run loads it, seeks to the offset and parses only the bytes
+// appended since, which gives the same output as parsing the whole input again. The offset is the end of the last
+// packet handed to the demuxer, so a partial packet at the end of the input is read again. PSI tables are not part of
+// the state; they are collected again from their next repetition. The checkpoint is valid while its last parsed packet
+// is unchanged in the input (as the packet index, xTS_PacketIndex) - a replaced or truncated input starts over - and
+// the extraction options (setExtraction()) are those it was saved with.
+class xTS_Checkpoint
+{
+public:
+  enum class eState : int32_t
+  {
+    Missing, // no sidecar - parsing starts from the beginning
+    Loaded,  // demuxer restored, continue at getParsedBytes()
+    Stale,   // input replaced or truncated, other extraction options or another build - the demuxer is untouched
+    Corrupt, // state image unreadable - the demuxer is restored in part and has to be discarded
+    Orphan,  // an output written before the checkpoint is missing or shorter now - the demuxer has to be discarded
+  };
+
+  // Options the demuxer state depends on. Another PID set would keep extracting the saved PIDs and start the new ones in
+  // the middle of the input, so a checkpoint saved with other options is stale and the input is parsed from the start.
+  struct xExtraction
+  {
+    std::vector<int32_t>        PIDs;               // registered explicitly (-p)
+    bool                        AutoAddPES = false; // every PES stream found (-a)
+    bool                        FromPMT    = false; // every PES stream announced in a PMT (-m)
+    xPES_Assembler::eLossPolicy LossPolicy = xPES_Assembler::eLossPolicy::Drop;
+  };
+
+#pragma pack(push, 1)
+  struct xFileHeader // followed by the extraction options (ExtractionSize bytes) and the demuxer state (StateSize bytes)
+  {
+    char     Magic[4]    = { 'T', 'S', 'C', 'K' };
+    uint16_t Version     = 5;
+    uint16_t PacketSize  = 0;
+    uint32_t SyncOffset  = 0;
+    uint32_t TailCRC     = 0; // CRC32 of the last parsed packet - detects a rewritten input
+    uint64_t ParsedBytes = 0; // input bytes parsed, up to the end of the last packet handed to the demuxer
+    uint64_t StateSize   = 0;
+    uint32_t StateCRC    = 0;
+    uint32_t Layout      = 0; // sizes of the state values copied byte-wise - a checkpoint of another build is stale
+    uint32_t ExtractionSize = 0;
+  };
+#pragma pack(pop)
+
+public:
+  // Options of this run, compared with those of the checkpoint by Load() and recorded by Save().
+  void   setExtraction(const xExtraction& Extraction);
+  eState Load(const std::string& FileName, const char* InputFileName, xTS_Demuxer& Demuxer);
+  // Records Demuxer after the packets up to ParsedBytes. Written next to the old sidecar and renamed over it, so a
+  // process killed while saving leaves the previous checkpoint. Sinks should be flushed first; with a failed sink
+  // nothing is saved.
+  bool   Save(const std::string& FileName, const char* InputFileName, uint64_t ParsedBytes, const xTS_SyncScanner::xFormat& Format, const xTS_Demuxer& Demuxer);
+
+  const xFileHeader& getHeader     () const { return m_Header; }
+  uint64_t           getParsedBytes() const { return m_Header.ParsedBytes; }
+  uint64_t           getNumSaves   () const { return m_NumSaves; }
+
+  static std::string SidecarName  (const char* InputFileName) { return std::string(InputFileName) + ".tsckpt"; }
+  static const char* StateToString(eState State);
+
+protected:
+  static uint32_t xLayout();
+  static bool     xTailCRC(const char* InputFileName, uint64_t ParsedBytes, int32_t PacketSize, uint32_t& CRC);
+
+  xFileHeader     m_Header;
+  xTS_StateWriter m_Extraction;   // image of the options set with setExtraction()
+  xTS_StateWriter m_Writer;       // kept between saves, its buffer is reused
+  uint64_t        m_NumSaves = 0;
+};
@@ -0,0 +1,345 @@
+#include "tsChunkedParser.h"
+#include "tsPacketBatch.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+//=============================================================================================================================================================================
+// xTS_ChunkedParser
+//=============================================================================================================================================================================
+
+bool xTS_ChunkedParser::Run(const char* FileName, const xConfig& Config)
+{
+    if(!Prepare(FileName, Config)) { return false; }
+    if(m_Chunks.empty()) { return true; }
+
+    std::vector<std::thread> Threads;
+    for(int32_t c = 0; c < (int32_t)m_Chunks.size(); c++)
+    {
+        Threads.emplace_back([this, c]()
+        {
+            // pools are not thread-safe - one per chunk thread
+            xPES_BufferPool                  Pool;
+            std::unique_ptr<xTS_PacketBatch> Headers = std::make_unique<xTS_PacketBatch>();
+            ParseChunk(c, Pool, *Headers);
+        });
+    }
+    for(std::thread& Thread : Threads) { Thread.join(); }
+    return Finish();
+}
+
+bool xTS_ChunkedParser::Prepare(const char* FileName, const xConfig& Config)
+{
+    m_Config   = Config;
+    m_FileName = FileName;
+    m_Chunks.clear();
+    m_Stats.clear();
+    m_StreamTypes.assign(xTS_Demuxer::NumPIDs, 0);
+    m_Format          = xTS_SyncScanner::xFormat();
+    m_NumPackets      = 0;
+    m_NumBytesRead    = 0;
+    m_TrailingBytes   = 0;
+    m_NumSkippedBytes = 0;
+    m_NumSyncLosses   = 0;
+    m_FileSize        = 0;
+
+    // the first lock gives the packet size and the grid chunk boundaries are placed on
+    xTS_MappedFileSource Probe;
+    if(!Probe.Open(FileName)) { return false; }
+    xTS_PacketSpan Span;
+    if(Probe.ReadSpan(Span, 1) <= 0)
+    {
+        m_NumBytesRead    = Probe.getSize();
+        m_TrailingBytes   = Probe.getTrailingBytes();
+        m_NumSkippedBytes = Probe.getNumSkippedBytes();
+        return true;
+    }
+    m_Format   = Probe.getFormat();
+    m_FileSize = Probe.getSize();
+    const uint64_t FirstPacket = Span.Offset;
+    const uint64_t PacketSize  = (uint64_t)m_Format.PacketSize;
+    if(Config.WriteFiles) { xProbeStreamTypes(Probe); }
+    Probe.Close();
+
+    int32_t NumChunks = Config.NumChunks > 0 ? Config.NumChunks : (int32_t)std::max(1u, std::thread::hardware_concurrency());
+    const uint64_t TotalPackets = (m_FileSize - FirstPacket) / PacketSize;
+    NumChunks = (int32_t)std::max<uint64_t>(1, std::min<uint64_t>({ (uint64_t)NumChunks, (uint64_t)MaxChunks, TotalPackets / MinChunkPackets }));
+    const uint64_t ChunkPackets = (TotalPackets + NumChunks - 1) / NumChunks;
+
+    for(int32_t c = 0; c < NumChunks; c++)
+    {
+        m_Chunks.push_back(std::make_unique<xChunk>());
+        xChunk& Chunk = *m_Chunks.back();
+        Chunk.Idx = c;
+        Chunk.Beg = c == 0             ? 0          : FirstPacket + (uint64_t)c       * ChunkPackets * PacketSize;
+        Chunk.End = c == NumChunks - 1 ? m_FileSize : FirstPacket + (uint64_t)(c + 1) * ChunkPackets * PacketSize;
+        Chunk.NumPackets .assign(xTS_Demuxer::NumPIDs, 0);
+        Chunk.NumCCErrors.assign(xTS_Demuxer::NumPIDs, 0);
+        Chunk.FirstCC    .assign(xTS_Demuxer::NumPIDs, -1);
+        Chunk.LastCC     .assign(xTS_Demuxer::NumPIDs, -1);
+    }
+    return true;
+}
+
+void xTS_ChunkedParser::ParseChunk(int32_t Idx, xPES_BufferPool& Pool, xTS_PacketBatch& Headers)
+{
+    xChunk&     Chunk = *m_Chunks[Idx];
+    xTS_Demuxer Demuxer;
+    Demuxer.setBufferPool(&Pool);
+    Demuxer.setAutoAddPES(m_Config.AutoAddPES);
+    Demuxer.setLossPolicy(m_Config.LossPolicy);
+    for(int32_t PID : m_Config.PIDs) { Demuxer.AddPID(PID); }
+
+    xChunk* ChunkPtr = &Chunk;
+    if(!m_Config.WriteFiles) { Demuxer.setSinkFactory([](int32_t, uint8_t, uint8_t) { return std::unique_ptr<xES_Sink>(); }); }
+    else
+    {
+        const std::string&          Prefix      = m_Config.OutputPrefix;
+        const std::vector<uint8_t>& StreamTypes = m_StreamTypes;
+        Demuxer.setSinkFactory([ChunkPtr, &Prefix, &StreamTypes](int32_t PID, uint8_t StreamId, uint8_t)
+        {
+            // the first chunk writes straight to the final file, the others to part files appended after the join
+            xPart Part;
+            Part.PID          = PID;
+            Part.FileName     = Prefix + xTS_Demuxer::DefaultFileName(PID, StreamId, StreamTypes[PID]);
+            Part.PartFileName = ChunkPtr->Idx == 0 ? Part.FileName : Part.FileName + ".part" + std::to_string(ChunkPtr->Idx);
+            ChunkPtr->Parts.push_back(Part);
+            return std::unique_ptr<xES_Sink>(std::make_unique<xES_FileSink>(Part.PartFileName));
+        });
+    }
+
+    xParseChunk(Chunk, Demuxer, Headers);
+
+    // finished on this thread - the assemblers give their buffers back to this thread's pool, sinks close their files
+    Demuxer.Finish();
+    if(!Demuxer.CloseSinks()) { Chunk.Ok = false; } // an incomplete part file would be merged into the output
+    for(const xTS_Demuxer::xStream& Stream : Demuxer.getStreams())
+    {
+        xPIDStats Stats;
+        Stats.PID       = Stream.PID;
+        Stats.Extracted = true;
+        Stats.NumPES    = Stream.NumPES;
+        Stats.NumBytes  = Stream.NumBytes;
+        Chunk.Streams.push_back(Stats);
+    }
+}
+
+bool xTS_ChunkedParser::Finish()
+{
+    if(m_Chunks.empty()) { return true; }
+    bool Ok = true;
+    for(std::unique_ptr<xChunk>& Chunk : m_Chunks)
+    {
+        Ok &= Chunk->Ok;
+        m_NumSkippedBytes += Chunk->NumSkippedBytes;
+        m_NumSyncLosses   += Chunk->NumSyncLosses;
+    }
+    m_TrailingBytes = m_Chunks.back()->TrailingBytes;
+    m_NumBytesRead  = m_FileSize;
+
+    xMergeStats();
+    if(m_Config.WriteFiles) { Ok &= xMergeFiles(); }
+    return Ok;
+}
+
+/**
+ * @brief Learn the PMT stream types from the start of the input
+ * Chunks past the first may not see a PMT before their first PES, so the output names (PMT stream_type, as in a
+ * sequential run) come from here. Stops at the PAT and every PMT it lists, or after MaxPSIProbeBytes.
+ */
+void xTS_ChunkedParser::xProbeStreamTypes(xTS_MappedFileSource& Source)
+{
+    if(!Source.Seek(0)) { return; }
+    xPSI_Parser         PSI;
+    xTS_PacketHeader    PacketHeader;
+    xTS_AdaptationField AdaptationField;
+    xTS_PacketSpan      Span;
+    auto Complete = [&PSI]() { return PSI.hasPAT() && PSI.getPMTs().size() >= PSI.getPAT().Programs.size(); };
+    while(!Complete() && Source.ReadSpan(Span) > 0 && Span.Offset < (uint64_t)MaxPSIProbeBytes)
+    {
+        for(int32_t i = 0; i < Span.NumPackets; i++)
+        {
+            const uint8_t* Packet = Span.getPacket(i);
+            PacketHeader.Parse(Packet);
+            if(!PSI.isPSIPID(PacketHeader.getPID())) { continue; }
+            if(PacketHeader.hasAdaptationField()) { AdaptationField.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)PacketHeader.getAFC()); }
+            PSI.ProcessPacket(Packet, PacketHeader, AdaptationField);
+        }
+    }
+    for(const xPSI_PMT& PMT : PSI.getPMTs())
+    {
+        for(const xPSI_PMT::xStream& Stream : PMT.Streams) { m_StreamTypes[Stream.PID] = Stream.StreamType; }
+    }
+}
+
+/**
+ * @brief Parse one chunk - packets in [Beg, End) plus the continuation of PES packets still open at End
+ */
+void xTS_ChunkedParser::xParseChunk(xChunk& Chunk, xTS_Demuxer& Demuxer, xTS_PacketBatch& Headers)
+{
+    xTS_MappedFileSource Source;
+    if(!Source.Open(m_FileName.c_str()) || !Source.Seek(Chunk.Beg)) { Chunk.Ok = false; return; }
+
+    xTS_PacketHeader    PacketHeader;
+    xTS_AdaptationField AdaptationField;
+
+    std::vector<uint8_t> Owned (xTS_Demuxer::NumPIDs, 0); // PUSI seen - earlier packets belong to a PES of the previous chunk
+    std::vector<uint8_t> Opened(xTS_Demuxer::NumPIDs, 0); // PES started and not finished yet
+    int32_t NumOpened = 0;
+    bool    InTail    = false;
+    bool    Done      = false;
+
+    xTS_PacketSpan Span;
+    int32_t  NumPackets  = 0;
+    uint64_t InitialSkip = UINT64_MAX;
+    while(!Done && (NumPackets = Source.ReadSpan(Span)) > 0)
+    {
+        // bytes skipped to lock at the start of a chunk were already consumed (or skipped) by the previous one
+        if(InitialSkip == UINT64_MAX) { InitialSkip = Chunk.Idx > 0 ? Source.getNumSkippedBytes() : 0; }
+        Headers.Decode(Span);
+        for(int32_t i = 0; i < NumPackets && !Done; i++)
+        {
+            const uint16_t PID  = Headers.PID [i];
+            const bool     PUSI = Headers.PUSI[i] != 0;
+            if(Span.getPacketOffset(i) >= Chunk.End)
+            {
+                if(!InTail)
+                {
+                    // source counters past this point belong to the next chunk
+                    InTail                = true;
+                    Chunk.NumSkippedBytes = Source.getNumSkippedBytes() - InitialSkip;
+                    Chunk.NumSyncLosses   = Source.getNumSyncLosses();
+                    if(NumOpened == 0) { Done = true; break; }
+                }
+                if(!Opened[PID]) { continue; }
+                if(PUSI)
+                {
+                    // next PES of the PID is owned by the next chunk - an unbounded PES ends right here
+                    Demuxer.FinishPES(PID);
+                    Opened[PID] = 0;
+                    Done = --NumOpened == 0;
+                    continue;
+                }
+            }
+            else
+            {
+                Chunk.NumPackets[PID]++;
+                if((Headers.AFC[i] & 0x1) && PID != (uint16_t)xTS_PacketHeader::ePID::NuLL) // CC does not advance without payload
+                {
+                    const int8_t Last = Chunk.LastCC[PID];
+                    const int8_t Curr = (int8_t)Headers.CC[i];
+                    Chunk.NumCCErrors[PID] += (Last >= 0 && Curr != Last && Curr != ((Last + 1) & 0xF));
+                    if(Chunk.FirstCC[PID] < 0) { Chunk.FirstCC[PID] = Curr; }
+                    Chunk.LastCC[PID] = Curr;
+                }
+                if(!Owned[PID])
+                {
+                    if(!PUSI) { continue; }
+                    Owned[PID] = 1;
+                }
+            }
+
+            if(!Demuxer.hasPID(PID) && !(m_Config.AutoAddPES && PUSI)) { continue; }
+            const uint8_t* Packet = Headers.getPacket(i);
+            Headers.getHeader(i, PacketHeader);
+            if(PacketHeader.hasAdaptationField()) { AdaptationField.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)PacketHeader.getAFC()); }
+            switch(Demuxer.ProcessPacket(Packet, PacketHeader, AdaptationField))
+            {
+                case xPES_Assembler::eResult::AssemblingStarted:
+                case xPES_Assembler::eResult::AssemblingContinue:
+                    if(!Opened[PID]) { Opened[PID] = 1; NumOpened++; }
+                    break;
+                case xPES_Assembler::eResult::AssemblingFinished:
+                    if(Opened[PID]) { Opened[PID] = 0; NumOpened--; Done = InTail && NumOpened == 0; }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    if(NumPackets < 0) { Chunk.Ok = false; }
+    if(!InTail)
+    {
+        // end of input reached inside the chunk - the last chunk
+        Chunk.NumSkippedBytes = Source.getNumSkippedBytes() - (InitialSkip == UINT64_MAX ? 0 : InitialSkip);
+        Chunk.NumSyncLosses   = Source.getNumSyncLosses();
+        Chunk.TrailingBytes   = Source.getTrailingBytes();
+    }
+}
+
+void xTS_ChunkedParser::xMergeStats()
+{
+    m_Stats.clear();
+    m_NumPackets = 0;
+    for(int32_t PID = 0; PID < xTS_Demuxer::NumPIDs; PID++)
+    {
+        xPIDStats Stats;
+        Stats.PID = PID;
+        int8_t LastCC = -1;
+        for(const std::unique_ptr<xChunk>& Chunk : m_Chunks)
+        {
+            Stats.NumPackets  += Chunk->NumPackets [PID];
+            Stats.NumCCErrors += Chunk->NumCCErrors[PID];
+            // seam - last CC of the previous chunk containing the PID against the first one of this chunk
+            const int8_t FirstCC = Chunk->FirstCC[PID];
+            if(FirstCC >= 0)
+            {
+                Stats.NumCCErrors += (LastCC >= 0 && FirstCC != LastCC && FirstCC != ((LastCC + 1) & 0xF));
+                LastCC = Chunk->LastCC[PID];
+            }
+            for(const xPIDStats& Stream : Chunk->Streams)
+            {
+                if(Stream.PID != PID) { continue; }
+                Stats.Extracted = true;
+                Stats.NumPES   += Stream.NumPES;
+                Stats.NumBytes += Stream.NumBytes;
+            }
+        }
+        if(Stats.NumPackets == 0 && !Stats.Extracted) { continue; }
+        m_NumPackets += Stats.NumPackets;
+        m_Stats.push_back(Stats);
+    }
+}
+
+/**
+ * @brief Append part files of chunks 1..N-1 to the output of their PID, in chunk order
+ */
+bool xTS_ChunkedParser::xMergeFiles()
+{
+    bool Ok = true;
+    std::vector<std::string> Targets(xTS_Demuxer::NumPIDs);
+    std::vector<uint8_t>     Buffer(1 << 20);
+    for(const std::unique_ptr<xChunk>& Chunk : m_Chunks)
+    {
+        for(const xPart& Part : Chunk->Parts)
+        {
+            std::string& Target = Targets[Part.PID];
+            if(Target.empty())
+            {
+                // PID first seen past the first chunk - its first part becomes the output file
+                Target = Part.FileName;
+                if(Part.PartFileName != Target)
+                {
+                    std::remove(Target.c_str());
+                    if(std::rename(Part.PartFileName.c_str(), Target.c_str()) != 0) { std::perror(Target.c_str()); Ok = false; }
+                }
+                continue;
+            }
+            FILE* Out = std::fopen(Target.c_str(), "ab");
+            FILE* In  = std::fopen(Part.PartFileName.c_str(), "rb");
+            if(!Out || !In) { std::perror(!Out ? Target.c_str() : Part.PartFileName.c_str()); Ok = false; }
+            else
+            {
+                size_t Size = 0;
+                while((Size = std::fread(Buffer.data(), 1, Buffer.size(), In)) > 0)
+                {
+                    if(std::fwrite(Buffer.data(), 1, Size, Out) != Size) { std::perror(Target.c_str()); Ok = false; break; }
+                }
+            }
+            if(In ) { std::fclose(In ); }
+            if(Out) { std::fclose(Out); }
+            std::remove(Part.PartFileName.c_str());
+        }
+    }
+    return Ok;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsPacketSource.h"
+#include "tsDemuxer.h"
+#include "tsPacketBatch.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_ChunkedParser
+//=============================================================================================================================================================================
+
+// Whole-file parsing split across cores. The mapped input is cut into N chunks on packet boundaries and every chunk
+// is parsed by its own thread with its own demuxer, assemblers and buffer pool, so nothing is shared while parsing.
+// Seams are reconciled by ownership instead of by moving partial PES packets between threads: a chunk owns every PES
+// whose first packet (PUSI) lies inside it, skips leading packets that continue a PES of its predecessor and, past its
+// end, keeps reading the packets of its still open PES until their next PUSI. Continuity counters are checked inside
+// each chunk and, after the join, across every seam from the first/last CC each chunk saw per PID.
+// Chunks write part files that are concatenated in chunk order, so every output file matches a sequential run.
+// Run() parses the chunks on threads of its own. Prepare() / ParseChunk() / Finish() hand them to a scheduler instead
+// (see xTS_BatchRunner): chunks may be parsed on any threads in any order, with buffer pools the threads keep.
+class xTS_ChunkedParser
+{
+public:
+  static constexpr int32_t MaxChunks       = 256;
+  static constexpr int32_t MinChunkPackets = 16384; // ~3 MB - smaller chunks cost more in seams than they gain
+  static constexpr int64_t MaxPSIProbeBytes = 32 << 20; // searched for the PAT and every PMT it lists
+
+  struct xConfig
+  {
+    int32_t              NumChunks  = 0;    // 0 - one chunk per hardware thread
+    std::vector<int32_t> PIDs;              // explicit PIDs to extract
+    bool                 AutoAddPES = false;
+    bool                 WriteFiles = true; // false - assemble and count only, no output files
+    std::string          OutputPrefix;      // prepended to the PID<PID>.<ext> output names
+    xPES_Assembler::eLossPolicy LossPolicy = xPES_Assembler::eLossPolicy::Drop;
+  };
+
+  struct xPIDStats
+  {
+    int32_t  PID         = -1;
+    bool     Extracted   = false;
+    uint64_t NumPackets  = 0;
+    uint64_t NumCCErrors = 0; // including errors across chunk seams
+    uint64_t NumPES      = 0;
+    uint64_t NumBytes    = 0;
+  };
+
+public:
+  // Parses the whole file, returns false if it cannot be mapped or an output file cannot be merged.
+  bool Run(const char* FileName, const xConfig& Config);
+
+  // Probes the packet format and cuts the chunks, returns false if the file cannot be mapped. No chunks - no packets.
+  bool Prepare   (const char* FileName, const xConfig& Config);
+  // Parses chunk Idx. Pool and Headers belong to the calling thread and may be reused for other chunks and files.
+  void ParseChunk(int32_t Idx, xPES_BufferPool& Pool, xTS_PacketBatch& Headers);
+  // After every chunk has been parsed - merges statistics and output files.
+  bool Finish    ();
+
+  // Every PID present in the input, ordered by PID. Valid after Run().
+  const std::vector<xPIDStats>& getStats() const { return m_Stats; }
+
+  int32_t                  getNumChunks      () const { return (int32_t)m_Chunks.size(); }
+  uint64_t                 getNumPackets     () const { return m_NumPackets; }
+  uint64_t                 getNumBytesRead   () const { return m_NumBytesRead; }
+  uint64_t                 getTrailingBytes  () const { return m_TrailingBytes; }
+  uint64_t                 getNumSkippedBytes() const { return m_NumSkippedBytes; }
+  uint64_t                 getNumSyncLosses  () const { return m_NumSyncLosses; }
+  xTS_SyncScanner::xFormat getFormat         () const { return m_Format; }
+
+protected:
+  struct xPart
+  {
+    int32_t     PID = -1;
+    std::string FileName;     // final output name
+    std::string PartFileName; // written by the chunk
+  };
+
+  struct xChunk
+  {
+    int32_t                          Idx = 0;
+    uint64_t                         Beg = 0; // [Beg, End) - byte range of packets owned by the chunk
+    uint64_t                         End = 0;
+    std::vector<uint64_t>            NumPackets;
+    std::vector<uint64_t>            NumCCErrors;
+    std::vector<int8_t>              FirstCC;  // -1 = no payload packet of the PID in the chunk
+    std::vector<int8_t>              LastCC;
+    std::vector<xPart>               Parts;
+    std::vector<xPIDStats>           Streams;  // extracted streams, taken over from the demuxer before it goes away
+    bool                             Ok              = true;
+    uint64_t                         NumSkippedBytes = 0;
+    uint64_t                         NumSyncLosses   = 0;
+    uint64_t                         TrailingBytes   = 0;
+  };
+
+  void xProbeStreamTypes(xTS_MappedFileSource& Source);
+  void xParseChunk (xChunk& Chunk, xTS_Demuxer& Demuxer, xTS_PacketBatch& Headers);
+  void xMergeStats ();
+  bool xMergeFiles ();
+
+  xConfig                                m_Config;
+  std::string                            m_FileName;
+  std::vector<std::unique_ptr<xChunk>>   m_Chunks;
+  std::vector<xPIDStats>                 m_Stats;
+  std::vector<uint8_t>                   m_StreamTypes; // PMT stream_type per PID, names the outputs of every chunk alike
+  xTS_SyncScanner::xFormat               m_Format;
+  uint64_t                               m_NumPackets      = 0;
+  uint64_t                               m_NumBytesRead    = 0;
+  uint64_t                               m_TrailingBytes   = 0;
+  uint64_t                               m_NumSkippedBytes = 0;
+  uint64_t                               m_NumSyncLosses   = 0;
+  uint64_t                               m_FileSize        = 0;
+};
@@ -0,0 +1,374 @@
+#include "tsDemuxer.h"
+#include "tsCheckpoint.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+//=============================================================================================================================================================================
+// xES_FileSink
+//=============================================================================================================================================================================
+
+void xES_FileSink::Write(const uint8_t* Data, int32_t Size)
+{
+    if(m_Failed || m_Closed || Size <= 0) { return; }
+    if(!m_File)
+    {
+        m_File = std::fopen(m_FileName.c_str(), "wb");
+        if(!m_File)
+        {
+            std::perror(m_FileName.c_str());
+            m_Failed = true;
+            return;
+        }
+    }
+    if(std::fwrite(Data, 1, (size_t)Size, m_File) != (size_t)Size)
+    {
+        std::perror(m_FileName.c_str()); // disk full, I/O error - the rest of the stream would have a hole
+        m_Failed = true;
+    }
+}
+
+void xES_FileSink::Flush()
+{
+    if(!m_File || m_Failed) { return; }
+    if(std::fflush(m_File) != 0)
+    {
+        std::perror(m_FileName.c_str());
+        m_Failed = true;
+    }
+}
+
+bool xES_FileSink::Close()
+{
+    if(m_File)
+    {
+        if(std::fclose(m_File) != 0 && !m_Failed)
+        {
+            std::perror(m_FileName.c_str());
+            m_Failed = true;
+        }
+        m_File = nullptr;
+    }
+    m_Closed = true;
+    return !m_Failed;
+}
+
+// Cuts the file back to Size bytes (the tail written after the checkpoint) and appends from there.
+bool xES_FileSink::Resume(uint64_t Size)
+{
+    if(m_File || m_Failed) { return false; }
+    std::error_code Error;
+    const uint64_t FileSize = (uint64_t)std::filesystem::file_size(m_FileName, Error);
+    if(!Error && FileSize >= Size) { std::filesystem::resize_file(m_FileName, Size, Error); }
+    if(Error || FileSize < Size)
+    {
+        std::fprintf(stderr, "%s: output shorter than recorded in the checkpoint (%" PRIu64 " bytes), not resumed\n", m_FileName.c_str(), Size);
+        m_Failed = true;
+        return false;
+    }
+    m_File = std::fopen(m_FileName.c_str(), "ab");
+    if(!m_File)
+    {
+        std::perror(m_FileName.c_str());
+        m_Failed = true;
+        return false;
+    }
+    return true;
+}
+
+//=============================================================================================================================================================================
+// xTS_Demuxer
+//=============================================================================================================================================================================
+
+xTS_Demuxer::xTS_Demuxer()
+{
+    for(int32_t i = 0; i < NumPIDs; i++) { m_PIDToStream[i] = NoStream; }
+    m_SinkFactory = DefaultSinkFactory;
+}
+
+bool xTS_Demuxer::AddPID(int32_t PID)
+{
+    if(PID < 0 || PID >= NumPIDs) { return false; }
+    if(hasPID(PID)) { return true; }
+
+    m_PIDToStream[PID] = (int16_t)m_Streams.size();
+    m_Streams.emplace_back();
+    xStream& Stream = m_Streams.back();
+    Stream.PID = PID;
+    Stream.Assembler.Init(PID, m_Pool);
+    Stream.Assembler.setScatterGather(m_ScatterGather);
+    Stream.Assembler.setLossPolicy(m_LossPolicy);
+    if(m_PSI) { Stream.StreamType = m_PSI->getStreamType(PID); } // streams added on sight after their PMT
+    m_LastTime.push_back(INT64_MIN);
+    return true;
+}
+
+void xTS_Demuxer::setPSI(bool Enable, bool AddFromPMT)
+{
+    if(!Enable) { m_PSI.reset(); return; }
+    m_PSI = std::make_unique<xPSI_Parser>();
+    m_PSI->setOnPMT([this, AddFromPMT](const xPSI_PMT& PMT)
+    {
+        for(const xPSI_PMT::xStream& ES : PMT.Streams)
+        {
+            if(AddFromPMT && xPSI_Parser::isPESStreamType(ES.StreamType)) { AddPID(ES.PID); }
+            if(hasPID(ES.PID)) { m_Streams[m_PIDToStream[ES.PID]].StreamType = ES.StreamType; }
+        }
+        if(m_OnPMT) { m_OnPMT(PMT); }
+    });
+}
+
+/**
+ * @brief Route packet to the assembler of its PID and hand finished PES payloads to the PID sink
+ * @return assembler result, UnexpectedPID for packets of unregistered PIDs
+ */
+xPES_Assembler::eResult xTS_Demuxer::ProcessPacket(const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField, uint64_t Offset)
+{
+    const int32_t PID = (int32_t)PacketHeader.getPID();
+    if(m_PSI && m_PSI->ProcessPacket(Packet, PacketHeader, AdaptationField)) { return xPES_Assembler::eResult::UnexpectedPID; } // tables, not PES
+    int16_t StreamIdx = m_PIDToStream[PID];
+    if(StreamIdx == NoStream)
+    {
+        // discover elementary streams on the fly - first payload unit starting with a PES start code
+        if((!m_AutoAddPES && !xWatchesForeignPES()) || !PacketHeader.getS() || xIsPSIPID(PID) || !xStartsWithPES(Packet, PacketHeader, AdaptationField)) { return xPES_Assembler::eResult::UnexpectedPID; }
+        if(!m_AutoAddPES) { xOnForeignPESStart(PID, Packet, PacketHeader, AdaptationField, Offset); return xPES_Assembler::eResult::UnexpectedPID; }
+        AddPID(PID);
+        StreamIdx = m_PIDToStream[PID];
+    }
+
+    xStream& Stream = m_Streams[StreamIdx];
+    Stream.NumPackets++;
+    if(!Stream.Synced)
+    {
+        // PID added in the middle of a PES packet (e.g. from a PMT) - its tail cannot be assembled
+        if(!PacketHeader.getS()) { return xPES_Assembler::eResult::UnexpectedPID; }
+        Stream.Synced = true;
+    }
+
+    // the assembler drops its buffer on PUSI - an unbounded (or damaged) PES ends here and has to leave first
+    if(PacketHeader.getS())
+    {
+        if(Stream.StartPending) { xOnPendingStart(Stream); } // its header never completed
+        if(Stream.Assembler.isPending() && Stream.Assembler.FinishPending(&PacketHeader, &AdaptationField)) { xEmitPES(Stream); }
+    }
+
+    const xPES_Assembler::eResult Result = Stream.Assembler.AbsorbPacket(Packet, &PacketHeader, &AdaptationField);
+    const bool RandomAccess = PacketHeader.hasAdaptationField() && AdaptationField.RA;
+    switch(Result)
+    {
+        case xPES_Assembler::eResult::AssemblingStarted:
+            if(!Stream.Assembler.isHeaderPending()) { xOnPESStart(Stream, RandomAccess, Offset); break; }
+            // PTS/DTS are in the next packet
+            Stream.StartPending      = true;
+            Stream.StartRandomAccess = RandomAccess;
+            Stream.StartOffset       = Offset;
+            break;
+        case xPES_Assembler::eResult::AssemblingContinue:
+            if(Stream.StartPending && !Stream.Assembler.isHeaderPending()) { xOnPendingStart(Stream); }
+            break;
+        case xPES_Assembler::eResult::AssemblingFinished:
+            if(PacketHeader.getS()) { xOnPESStart(Stream, RandomAccess, Offset); } // PES in a single packet
+            else if(Stream.StartPending) { xOnPendingStart(Stream); }
+            xEmitPES(Stream);
+            break;
+        default:
+            break;
+    }
+    return Result;
+}
+
+void xTS_Demuxer::xOnPendingStart(xStream& Stream)
+{
+    Stream.StartPending = false;
+    xOnPESStart(Stream, Stream.StartRandomAccess, Stream.StartOffset);
+}
+
+void xTS_Demuxer::xOnPESStart(xStream& Stream, bool RandomAccess, uint64_t Offset)
+{
+    const xPES_PacketHeader& PESH = Stream.Assembler.getPESH();
+    if(m_OnPESStart) { m_OnPESStart(Stream.PID, PESH, RandomAccess, Offset); }
+    if(!m_Windowed) { return; }
+    // a PES without PTS (e.g. further slices of a frame) follows the decision of the previous one
+    if(!PESH.hasPTS()) { return; }
+    if(m_FirstPTS == NoPTS) { m_FirstPTS = PESH.getPTS(); }
+    const int64_t Time = xPES_PacketHeader::PTSDiff(m_FirstPTS, PESH.getPTS());
+    Stream.InWindow = Time >= m_WindowBeg && Time < m_WindowEnd;
+    m_LastTime[m_PIDToStream[Stream.PID]] = Time;
+}
+
+// PES start of a PID not extracted - only seen by the all-PID PES start callback and as time origin of the window.
+void xTS_Demuxer::xOnForeignPESStart(int32_t PID, const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField, uint64_t Offset)
+{
+    int32_t PayloadOffset = xTS::TS_HeaderLength;
+    if(PacketHeader.hasAdaptationField()) { PayloadOffset += 1 + AdaptationField.AFL; }
+    xPES_PacketHeader PESH;
+    PESH.Parse(Packet + PayloadOffset, (int32_t)xTS::TS_PacketLength - PayloadOffset);
+    if(m_PESStartAllPIDs && m_OnPESStart) { m_OnPESStart(PID, PESH, PacketHeader.hasAdaptationField() && AdaptationField.RA, Offset); }
+    if(m_Windowed && m_FirstPTS == NoPTS && PESH.hasPTS()) { m_FirstPTS = PESH.getPTS(); }
+}
+
+void xTS_Demuxer::setTimeWindow(int64_t Beg, int64_t End, uint64_t FirstPTS)
+{
+    m_Windowed  = true;
+    m_WindowBeg = Beg;
+    m_WindowEnd = End;
+    m_FirstPTS  = FirstPTS;
+}
+
+bool xTS_Demuxer::isPastWindow() const
+{
+    if(!m_Windowed || m_Streams.empty() || m_WindowEnd > INT64_MAX - ReorderMargin) { return false; }
+    for(int64_t Time : m_LastTime) { if(Time < m_WindowEnd + ReorderMargin) { return false; } }
+    return true;
+}
+
+void xTS_Demuxer::xEmitPES(xStream& Stream)
+{
+    if(m_Windowed && !Stream.InWindow) { return; }
+    if(!Stream.Sink && m_SinkFactory)
+    {
+        Stream.StreamId       = Stream.Assembler.getPESH().getStreamId();
+        Stream.SinkStreamType = Stream.StreamType;
+        Stream.Sink           = m_SinkFactory(Stream.PID, Stream.StreamId, Stream.SinkStreamType);
+    }
+    if(Stream.Sink)
+    {
+        if(Stream.Assembler.isScatterGather()) { Stream.Sink->WriteSlices(Stream.Assembler.getSlices().data(), (int32_t)Stream.Assembler.getSlices().size()); }
+        else                                   { Stream.Sink->Write(Stream.Assembler.getPacket(), Stream.Assembler.getNumPacketBytes()); }
+    }
+    if(m_OnPES) { m_OnPES(Stream); }
+    Stream.NumPES++;
+    if(Stream.Assembler.isDamaged()) { Stream.NumDamagedPES++; }
+    Stream.NumBytes += (uint64_t)Stream.Assembler.getNumPacketBytes();
+}
+
+void xTS_Demuxer::FinishPES(int32_t PID)
+{
+    if(!hasPID(PID)) { return; }
+    xStream& Stream = m_Streams[m_PIDToStream[PID]];
+    if(Stream.StartPending) { xOnPendingStart(Stream); }
+    if(Stream.Assembler.isPending() && Stream.Assembler.FinishPending(nullptr, nullptr)) { xEmitPES(Stream); }
+    Stream.Assembler.Reset();
+}
+
+void xTS_Demuxer::ProcessBatch(const xTS_PacketBatch& Batch)
+{
+    xTS_PacketHeader    PacketHeader;
+    xTS_AdaptationField AdaptationField;
+    const int32_t NumPackets = Batch.getNumPackets();
+    for(int32_t i = 0; i < NumPackets; i++)
+    {
+        if(m_PIDToStream[Batch.PID[i]] == NoStream && !((m_AutoAddPES || xWatchesForeignPES()) && Batch.PUSI[i]) && !(m_PSI && m_PSI->isPSIPID(Batch.PID[i]))) { continue; }
+        const uint8_t* Packet = Batch.getPacket(i);
+        Batch.getHeader(i, PacketHeader);
+        if(PacketHeader.hasAdaptationField()) { AdaptationField.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)PacketHeader.getAFC()); }
+        ProcessPacket(Packet, PacketHeader, AdaptationField, Batch.getPacketOffset(i));
+    }
+}
+
+void xTS_Demuxer::Flush()
+{
+    for(xStream& Stream : m_Streams) { if(Stream.Sink) { Stream.Sink->Flush(); } }
+}
+
+void xTS_Demuxer::Finish()
+{
+    for(xStream& Stream : m_Streams) { FinishPES(Stream.PID); }
+    Flush();
+}
+
+bool xTS_Demuxer::CloseSinks()
+{
+    bool Ok = true;
+    for(xStream& Stream : m_Streams) { if(Stream.Sink && !Stream.Sink->Close()) { Ok = false; } }
+    return Ok;
+}
+
+bool xTS_Demuxer::hasFailedSinks() const
+{
+    return std::any_of(m_Streams.begin(), m_Streams.end(), [](const xStream& Stream) { return Stream.Sink && Stream.Sink->hasFailed(); });
+}
+
+void xTS_Demuxer::SaveState(xTS_StateWriter& Writer) const
+{
+    Writer.Put((uint32_t)m_Streams.size());
+    for(const xStream& Stream : m_Streams)
+    {
+        Writer.Put(Stream.PID, Stream.StreamType, Stream.Synced, Stream.InWindow, Stream.NumPackets, Stream.NumPES, Stream.NumBytes, Stream.NumDamagedPES, Stream.StreamId, Stream.SinkStreamType,
+                   Stream.StartPending, Stream.StartRandomAccess, Stream.StartOffset);
+        Stream.Assembler.SaveState(Writer);
+    }
+}
+
+bool xTS_Demuxer::LoadState(xTS_StateReader& Reader)
+{
+    uint32_t NumStreams = 0;
+    if(!Reader.Get(NumStreams) || NumStreams > (uint32_t)NumPIDs) { return false; }
+    for(uint32_t i = 0; i < NumStreams; i++)
+    {
+        int32_t PID = -1;
+        if(!Reader.Get(PID) || !AddPID(PID)) { return false; }
+        xStream& Stream = m_Streams[m_PIDToStream[PID]];
+        if(!Reader.Get(Stream.StreamType, Stream.Synced, Stream.InWindow, Stream.NumPackets, Stream.NumPES, Stream.NumBytes, Stream.NumDamagedPES, Stream.StreamId, Stream.SinkStreamType,
+                       Stream.StartPending, Stream.StartRandomAccess, Stream.StartOffset)) { return false; }
+        if(!Stream.Assembler.LoadState(Reader)) { return false; }
+    }
+    return true;
+}
+
+// Every output is checked, so all the outputs that cannot be continued are reported at once.
+bool xTS_Demuxer::ResumeSinks()
+{
+    bool Ok = true;
+    for(xStream& Stream : m_Streams)
+    {
+        if(Stream.Sink || !Stream.NumBytes || !m_SinkFactory) { continue; }
+        Stream.Sink = m_SinkFactory(Stream.PID, Stream.StreamId, Stream.SinkStreamType);
+        if(Stream.Sink && !Stream.Sink->Resume(Stream.NumBytes)) { Ok = false; }
+    }
+    return Ok;
+}
+
+std::unique_ptr<xES_Sink> xTS_Demuxer::DefaultSinkFactory(int32_t PID, uint8_t StreamId, uint8_t StreamType)
+{
+    return std::make_unique<xES_FileSink>(DefaultFileName(PID, StreamId, StreamType));
+}
+
+std::string xTS_Demuxer::DefaultFileName(int32_t PID, uint8_t StreamId, uint8_t StreamType)
+{
+    char FileName[64];
+    std::snprintf(FileName, sizeof(FileName), "PID%d.%s", PID, StreamToExtension(StreamId, StreamType));
+    return FileName;
+}
+
+const char* xTS_Demuxer::StreamToExtension(uint8_t StreamId, uint8_t StreamType)
+{
+    switch(StreamType)
+    {
+        case 0x01: case 0x02: return "m2v";  // MPEG-1/2 video
+        case 0x03: case 0x04: return "mp2";  // MPEG-1/2 audio
+        case 0x0F:            return "aac";  // ADTS AAC
+        case 0x1B:            return "h264";
+        case 0x24:            return "h265";
+        default:              break;
+    }
+    // the stream_id only tells MPEG audio and video number spaces apart - H.264/HEVC video uses 0xE0-0xEF too
+    if(StreamId >= 0xC0 && StreamId <= 0xDF) { return "mp2"; } // MPEG audio
+    if(StreamId >= 0xE0 && StreamId <= 0xEF) { return "m2v"; } // MPEG video
+    return "bin";
+}
+
+bool xTS_Demuxer::xIsPSIPID(int32_t PID)
+{
+    // 0x0000-0x001F are reserved for PSI/SI tables
+    return PID < 0x0020 || PID == (int32_t)xTS_PacketHeader::ePID::NuLL;
+}
+
+bool xTS_Demuxer::xStartsWithPES(const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField)
+{
+    if(!PacketHeader.hasPayload()) { return false; }
+    int32_t Offset = xTS::TS_HeaderLength;
+    if(PacketHeader.hasAdaptationField()) { Offset += 1 + AdaptationField.AFL; }
+    if(Offset + 3 > (int32_t)xTS::TS_PacketLength) { return false; }
+    return Packet[Offset] == 0x00 && Packet[Offset + 1] == 0x00 && Packet[Offset + 2] == 0x01;
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketBatch.h"
+#include "tsPSI.h"
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xES_Sink
+//=============================================================================================================================================================================
+
+// Destination for assembled PES payloads of a single PID.
+class xES_Sink
+{
+public:
+  virtual ~xES_Sink() {}
+  virtual void Write(const uint8_t* Data, int32_t Size) = 0;
+  virtual void WriteSlices(const xPES_Slice* Slices, int32_t NumSlices) { for(int32_t i = 0; i < NumSlices; i++) { Write(Slices[i].Data, Slices[i].Size); } }
+  virtual void Flush() {}
+  // Continues an output of which the first Size bytes were written before (by a run that saved a checkpoint), anything
+  // past them is dropped. Called before the first write. False if the sink cannot append.
+  virtual bool Resume(uint64_t Size) { (void)Size; return false; }
+  // Ends the output. False if it is incomplete - a write, a flush or the close itself failed (reported when it happened).
+  virtual bool Close() { Flush(); return !hasFailed(); }
+  virtual bool hasFailed() const { return false; }
+};
+
+// Writes the elementary stream to a file, opened lazily on the first write so that unused PIDs leave no empty files behind.
+class xES_FileSink : public xES_Sink
+{
+public:
+  explicit xES_FileSink(std::string FileName) : m_FileName(std::move(FileName)) {}
+  ~xES_FileSink() override { Close(); }
+
+  void Write(const uint8_t* Data, int32_t Size) override;
+  void Flush() override;
+  bool Resume(uint64_t Size) override;
+  bool Close() override;
+  bool hasFailed() const override { return m_Failed; }
+
+  const std::string& getFileName() const { return m_FileName; }
+
+protected:
+  std::string m_FileName;
+  FILE*       m_File   = nullptr;
+  bool        m_Failed = false; // first error reported, the output is incomplete - later writes are dropped
+  bool        m_Closed = false;
+};
+
+//=============================================================================================================================================================================
+// xTS_Demuxer
+//=============================================================================================================================================================================
+
+// Routes packets of many PIDs to per-PID PES assemblers in a single pass. PID lookup goes through a flat
+// 8192-entry table holding an index into the stream vector, so routing is O(1) regardless of the number of streams.
+// A PES with known length goes to the sink as soon as it is complete. A PES of unbounded length (video) is complete
+// when the next PUSI of its PID arrives, so it is emitted right then instead of waiting for a length that never comes.
+// What happens to a PES with lost packets is decided by the loss policy of the assemblers (default: drop it).
+class xTS_Demuxer
+{
+public:
+  static constexpr int32_t  NumPIDs       = 8192;
+  static constexpr int16_t  NoStream      = -1;
+  static constexpr uint64_t NoPTS         = UINT64_MAX;
+  static constexpr int64_t  ReorderMargin = xTS::BaseClockFrequency_Hz; // PTS of later PES may still be earlier (reordering, audio/video skew)
+
+  // Creates the sink for a PID when its first PES header has been parsed (stream_id is known at that point). StreamType
+  // is the PMT stream_type of the PID, 0 if no PMT announced it.
+  using tSinkFactory = std::function<std::unique_ptr<xES_Sink>(int32_t PID, uint8_t StreamId, uint8_t StreamType)>;
+  // Called on every payload unit start of a registered PID (of every PID starting a PES with AllPIDs in setOnPESStart()),
+  // once the PES header has been parsed. Offset is the byte offset of the PUSI packet in the input, RandomAccess its
+  // random_access_indicator.
+  using tPESStartCallback = std::function<void(int32_t PID, const xPES_PacketHeader& PESH, bool RandomAccess, uint64_t Offset)>;
+
+  struct xStream
+  {
+    int32_t                   PID          = -1;
+    uint8_t                   StreamType   = 0; // from the PMT, 0 = not announced
+    bool                      Synced       = false; // first payload unit start seen
+    bool                      InWindow     = false; // PTS of the PES being assembled inside the time window
+    xPES_Assembler            Assembler;
+    std::unique_ptr<xES_Sink> Sink;
+    uint64_t                  NumPackets   = 0;
+    uint64_t                  NumPES       = 0;
+    uint64_t                  NumBytes     = 0;
+    uint64_t                  NumDamagedPES = 0; // emitted with lost packets zero-filled or skipped
+    uint8_t                   StreamId     = 0; // stream_id the sink was created for
+    uint8_t                   SinkStreamType = 0; // stream_type the sink was created for - a later PMT does not rename it
+    bool                      StartPending = false; // PES header split between packets - the start is reported once it is complete
+    bool                      StartRandomAccess = false;
+    uint64_t                  StartOffset  = 0;
+  };
+  // Called with every PES handed to the sink, right after the write. Stream.Assembler still holds its header and payload
+  // (contiguous or slices) and Stream.NumBytes is the offset of its first payload byte in the elementary stream.
+  using tPESCallback = std::function<void(const xStream& Stream)>;
+
+public:
+  xTS_Demuxer();
+
+  void setSinkFactory(tSinkFactory Factory) { m_SinkFactory = std::move(Factory); }
+  void setAutoAddPES (bool AutoAdd        ) { m_AutoAddPES  = AutoAdd; }
+  bool isAutoAddPES  () const { return m_AutoAddPES; }
+  // Zero-copy assembly - payloads are handed to sinks as slices of the input buffer, which must outlive the PES packet (e.g. mmap source).
+  void setScatterGather(bool Enable       ) { m_ScatterGather = Enable; }
+  void setBufferPool  (xPES_BufferPool* Pool) { m_Pool = Pool; }
+  // Handling of PES with lost packets, for streams registered from now on.
+  void setLossPolicy  (xPES_Assembler::eLossPolicy Policy) { m_LossPolicy = Policy; }
+  // Parses PAT/PMT/CAT/SDT on the fly. With AddFromPMT every PES elementary stream announced in a PMT is extracted.
+  void setPSI         (bool Enable, bool AddFromPMT = false);
+  // Observer called with every new PMT version, after the demuxer has registered its streams.
+  void setOnPMT       (std::function<void(const xPSI_PMT&)> Callback) { m_OnPMT = std::move(Callback); }
+  void setOnPESStart  (tPESStartCallback Callback, bool AllPIDs = false) { m_OnPESStart = std::move(Callback); m_PESStartAllPIDs = AllPIDs; }
+  void setOnPES       (tPESCallback      Callback) { m_OnPES      = std::move(Callback); }
+  // Emits only PES with PTS in [Beg, End) - 90 kHz ticks since FirstPTS, or since the first PTS of any PID (registered
+  // or not, as in the PTS index) if FirstPTS is NoPTS. The PTS of each PES decides on its own, so B-frame reordering and
+  // interleaved audio are handled per PES.
+  void setTimeWindow  (int64_t Beg, int64_t End, uint64_t FirstPTS = NoPTS);
+  // True once every stream has started a PES past the window end plus ReorderMargin - the rest of the input can be skipped.
+  bool isPastWindow   () const;
+
+  // Registers PID for PES extraction. Returns false for PIDs out of range.
+  bool AddPID(int32_t PID);
+  bool hasPID(int32_t PID) const { return PID >= 0 && PID < NumPIDs && m_PIDToStream[PID] != NoStream; }
+
+  // Feeds one parsed packet. Packets of PIDs not registered return UnexpectedPID. Offset is only passed on to the PES start callback.
+  xPES_Assembler::eResult ProcessPacket(const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField, uint64_t Offset = 0);
+
+  // Feeds a decoded batch. Packets of unregistered PIDs are rejected from the SoA PID array without touching packet data.
+  void ProcessBatch(const xTS_PacketBatch& Batch);
+
+  // Ends the unbounded PES (PES_packet_length 0) in progress on PID and hands it to the sink. Such a PES is otherwise
+  // emitted when the next payload unit start of its PID arrives, i.e. one PES period late at most.
+  void FinishPES(int32_t PID);
+  // Flushes sink buffers, e.g. after every read of a live source. Does not end any PES.
+  void Flush();
+  // End of input - emits the unbounded PES still in progress on every PID and flushes the sinks.
+  void Finish();
+  // After Finish() - closes every sink. False if any output is incomplete (write, flush or close failed).
+  bool CloseSinks();
+  bool hasFailedSinks() const;
+
+  // Checkpoint (xTS_Checkpoint) - streams with their counters and assembler state. LoadState() registers the saved
+  // streams, ResumeSinks() then opens the sinks of those with output to append to it (xES_Sink::Resume()) and returns
+  // false if any output cannot be continued (missing, shorter than recorded). Sinks, callbacks, PSI tables and the time
+  // window are not part of the state.
+  void SaveState  (xTS_StateWriter& Writer) const;
+  bool LoadState  (xTS_StateReader& Reader);
+  bool ResumeSinks();
+
+  const xStream*  getStream    (int32_t PID) const { return hasPID(PID) ? &m_Streams[m_PIDToStream[PID]] : nullptr; }
+  const std::vector<xStream>& getStreams() const { return m_Streams; }
+  const xPSI_Parser*          getPSI    () const { return m_PSI.get(); }
+
+  static std::unique_ptr<xES_Sink> DefaultSinkFactory(int32_t PID, uint8_t StreamId, uint8_t StreamType);
+  static std::string DefaultFileName(int32_t PID, uint8_t StreamId, uint8_t StreamType); // PID<PID>.<ext>
+  // By the PMT stream_type, by the stream_id when there is no PMT or the stream_type has no extension of its own.
+  static const char* StreamToExtension(uint8_t StreamId, uint8_t StreamType);
+
+protected:
+  void        xEmitPES        (xStream& Stream);
+  void        xOnPESStart     (xStream& Stream, bool RandomAccess, uint64_t Offset);
+  void        xOnPendingStart (xStream& Stream);
+  void        xOnForeignPESStart(int32_t PID, const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField, uint64_t Offset);
+  bool        xWatchesForeignPES() const { return m_PESStartAllPIDs || (m_Windowed && m_FirstPTS == NoPTS); }
+  static bool xIsPSIPID       (int32_t PID);
+  static bool xStartsWithPES  (const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField);
+
+  int16_t              m_PIDToStream[NumPIDs];
+  std::vector<xStream> m_Streams;
+  tSinkFactory         m_SinkFactory;
+  bool                 m_AutoAddPES    = false;
+  bool                 m_ScatterGather = false;
+  xPES_BufferPool*     m_Pool          = nullptr;
+  xPES_Assembler::eLossPolicy m_LossPolicy = xPES_Assembler::eLossPolicy::Drop;
+  std::unique_ptr<xPSI_Parser> m_PSI;
+  std::function<void(const xPSI_PMT&)> m_OnPMT;
+  tPESStartCallback    m_OnPESStart;
+  bool                 m_PESStartAllPIDs = false;
+  tPESCallback         m_OnPES;
+  bool                 m_Windowed      = false;
+  int64_t              m_WindowBeg     = 0;
+  int64_t              m_WindowEnd     = 0;
+  uint64_t             m_FirstPTS      = NoPTS;
+  std::vector<int64_t> m_LastTime; // per stream, time of the last PES start
+};
@@ -0,0 +1,207 @@
+#include "tsEventWriter.h"
+#include <algorithm>
+
+//=============================================================================================================================================================================
+// xTS_EventWriter
+//=============================================================================================================================================================================
+
+xTS_EventWriter::xTS_EventWriter(FILE* File, eFormat Format, size_t BufferSize) : m_File(File), m_Format(Format)
+{
+    m_Buffer.resize(std::max(BufferSize, 2 * MaxEventSize));
+    if(m_Format == eFormat::Binary)
+    {
+        const xHeader Header;
+        xPut((const char*)&Header, sizeof(Header));
+    }
+}
+
+void xTS_EventWriter::WritePacket(uint64_t Index, uint64_t Offset, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField,
+                                  xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH)
+{
+    if(m_Used + MaxEventSize > m_Buffer.size()) { Flush(); }
+    switch(m_Format)
+    {
+        case eFormat::Text  : xWriteText  (Index,         PacketHeader, AdaptationField, Result, PESH); break;
+        case eFormat::NDJSON: xWriteNDJSON(Index, Offset, PacketHeader, AdaptationField, Result, PESH); break;
+        case eFormat::Binary: xWriteBinary(Index, Offset, PacketHeader, AdaptationField, Result, PESH); break;
+    }
+}
+
+void xTS_EventWriter::Flush()
+{
+    if(m_Used) { std::fwrite(m_Buffer.data(), 1, m_Used, m_File); }
+    m_Used = 0;
+    std::fflush(m_File);
+}
+
+void xTS_EventWriter::xWriteText(uint64_t Index, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField, xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH)
+{
+    xPutU(Index, 10);
+    xPut(" "         );
+    xPut(" SB = "    ); xPutU(PacketHeader.SB );
+    xPut(" E = "     ); xPutU(PacketHeader.E  );
+    xPut(" S = "     ); xPutU(PacketHeader.S  );
+    xPut(" T = "     ); xPutU(PacketHeader.T  );
+    xPut(" PID = "   ); xPutU(PacketHeader.PID);
+    xPut(" TSC = "   ); xPutU(PacketHeader.TSC);
+    xPut(" AFC = "   ); xPutU(PacketHeader.AFC);
+    xPut(" CC = "    ); xPutU(PacketHeader.CC ); xPut(" ");
+
+    if(AdaptationField)
+    {
+        xPut("\nAF: L = "); xPutU(AdaptationField->AFL);
+        xPut(" DC = "    ); xPutU(AdaptationField->DC );
+        xPut(" RA = "    ); xPutU(AdaptationField->RA );
+        xPut(" SP = "    ); xPutU(AdaptationField->SP );
+        xPut(" PR = "    ); xPutU(AdaptationField->PR );
+        xPut(" OR = "    ); xPutU(AdaptationField->OR );
+        xPut(" SF = "    ); xPutU(AdaptationField->SF );
+        xPut(" TP = "    ); xPutU(AdaptationField->TP );
+        xPut(" EX = "    ); xPutU(AdaptationField->EX ); xPut(" ");
+        if(AdaptationField->PR) { xPut("PCR = " ); xPutU(AdaptationField->PCR ); xPut(" "); }
+        if(AdaptationField->OR) { xPut("OPCR = "); xPutU(AdaptationField->OPCR); xPut(" "); }
+        if(AdaptationField->SF) { xPut("SC = "  ); xPutI(AdaptationField->SpliceCountdown); xPut(" "); }
+    }
+
+    switch(Result)
+    {
+        case xPES_Assembler::eResult::StreamPacketLost  : xPut(" Packet lost\n"          ); break;
+        case xPES_Assembler::eResult::AssemblingStarted : xPut(" Assembling started\n"   ); break;
+        case xPES_Assembler::eResult::AssemblingContinue: xPut(" Assembling continues\n" ); break;
+        case xPES_Assembler::eResult::AssemblingFinished: xPut(" Assembling finished\n"  ); break;
+        case xPES_Assembler::eResult::PacketDuplicate   : xPut(" Packet duplicate\n"     ); break;
+        default: break;
+    }
+    if(PESH && (Result == xPES_Assembler::eResult::AssemblingStarted || Result == xPES_Assembler::eResult::AssemblingFinished))
+    {
+        xPut("PES: PSCP="); xPutHex(PESH->getPacketStartCodePrefix());
+        xPut(" SID="     ); xPutU  (PESH->getStreamId());
+        xPut(" L="       ); xPutU  (PESH->getPacketLength());
+        if(PESH->hasPTS()) { xPut(" PTS="); xPutU(PESH->getPTS()); }
+        if(PESH->hasDTS()) { xPut(" DTS="); xPutU(PESH->getDTS()); }
+        xPut("\n");
+    }
+    xPut("\n");
+}
+
+void xTS_EventWriter::xWriteNDJSON(uint64_t Index, uint64_t Offset, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField, xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH)
+{
+    xPut("{\"i\":"    ); xPutU(Index);
+    xPut(",\"off\":"  ); xPutU(Offset);
+    xPut(",\"pid\":"  ); xPutU(PacketHeader.PID);
+    xPut(",\"e\":"    ); xPutU(PacketHeader.E  );
+    xPut(",\"s\":"    ); xPutU(PacketHeader.S  );
+    xPut(",\"t\":"    ); xPutU(PacketHeader.T  );
+    xPut(",\"tsc\":"  ); xPutU(PacketHeader.TSC);
+    xPut(",\"afc\":"  ); xPutU(PacketHeader.AFC);
+    xPut(",\"cc\":"   ); xPutU(PacketHeader.CC );
+
+    if(AdaptationField)
+    {
+        xPut(",\"af\":{\"l\":"); xPutU(AdaptationField->AFL);
+        xPut(",\"dc\":"       ); xPutU(AdaptationField->DC );
+        xPut(",\"ra\":"       ); xPutU(AdaptationField->RA );
+        xPut(",\"sp\":"       ); xPutU(AdaptationField->SP );
+        xPut(",\"pr\":"       ); xPutU(AdaptationField->PR );
+        xPut(",\"or\":"       ); xPutU(AdaptationField->OR );
+        xPut(",\"sf\":"       ); xPutU(AdaptationField->SF );
+        xPut(",\"tp\":"       ); xPutU(AdaptationField->TP );
+        xPut(",\"ex\":"       ); xPutU(AdaptationField->EX );
+        if(AdaptationField->PR) { xPut(",\"pcr\":"   ); xPutU(AdaptationField->PCR ); }
+        if(AdaptationField->OR) { xPut(",\"opcr\":"  ); xPutU(AdaptationField->OPCR); }
+        if(AdaptationField->SF) { xPut(",\"splice\":"); xPutI(AdaptationField->SpliceCountdown); }
+        xPut("}");
+    }
+
+    switch(Result)
+    {
+        case xPES_Assembler::eResult::StreamPacketLost  : xPut(",\"pes\":\"lost\""    ); break;
+        case xPES_Assembler::eResult::AssemblingStarted : xPut(",\"pes\":\"started\"" ); break;
+        case xPES_Assembler::eResult::AssemblingContinue: xPut(",\"pes\":\"continue\""); break;
+        case xPES_Assembler::eResult::AssemblingFinished: xPut(",\"pes\":\"finished\""); break;
+        case xPES_Assembler::eResult::PacketDuplicate   : xPut(",\"pes\":\"duplicate\""); break;
+        default: break;
+    }
+    if(PESH && (Result == xPES_Assembler::eResult::AssemblingStarted || Result == xPES_Assembler::eResult::AssemblingFinished))
+    {
+        xPut(",\"sid\":"); xPutU(PESH->getStreamId());
+        xPut(",\"len\":"); xPutU(PESH->getPacketLength());
+        if(PESH->hasPTS()) { xPut(",\"pts\":"); xPutU(PESH->getPTS()); }
+        if(PESH->hasDTS()) { xPut(",\"dts\":"); xPutU(PESH->getDTS()); }
+    }
+    xPut("}\n");
+}
+
+void xTS_EventWriter::xWriteBinary(uint64_t Index, uint64_t Offset, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField, xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH)
+{
+    xRecord Record;
+    Record.Offset    = Offset;
+    Record.Index     = (uint32_t)Index;
+    Record.PID       = (uint16_t)PacketHeader.PID;
+    Record.CC        = (uint8_t )PacketHeader.CC;
+    Record.Header    = (uint8_t )((PacketHeader.E << 7) | (PacketHeader.S << 6) | (PacketHeader.T << 5) | (PacketHeader.TSC << 2) | PacketHeader.AFC);
+    Record.AFL       = 0;
+    Record.AFFlags   = 0;
+    if(AdaptationField)
+    {
+        Record.AFL     = AdaptationField->AFL;
+        Record.AFFlags = (uint8_t)((AdaptationField->DC << 7) | (AdaptationField->RA << 6) | (AdaptationField->SP << 5) | (AdaptationField->PR << 4) |
+                                   (AdaptationField->OR << 3) | (AdaptationField->SF << 2) | (AdaptationField->TP << 1) |  AdaptationField->EX);
+    }
+    Record.Result    = Result == xPES_Assembler::eResult::UnexpectedPID ? 0 : (uint8_t)Result;
+    Record.StreamId  = 0;
+    Record.PESLength = 0;
+    if(PESH && (Result == xPES_Assembler::eResult::AssemblingStarted || Result == xPES_Assembler::eResult::AssemblingFinished))
+    {
+        Record.StreamId  = PESH->getStreamId();
+        Record.PESLength = PESH->getPacketLength();
+    }
+    Record.Reserved  = 0;
+    xPut((const char*)&Record, sizeof(Record)); // x86/ARM are little-endian - the record is written as is
+}
+
+void xTS_EventWriter::xPutU(uint64_t Value, int32_t MinDigits)
+{
+    char    Digits[24];
+    int32_t NumDigits = 0;
+    do { Digits[NumDigits++] = (char)('0' + Value % 10); Value /= 10; } while(Value);
+    while(NumDigits < MinDigits) { Digits[NumDigits++] = '0'; }
+    for(int32_t i = 0; i < NumDigits; i++) { m_Buffer[m_Used + i] = Digits[NumDigits - 1 - i]; }
+    m_Used += (size_t)NumDigits;
+}
+
+void xTS_EventWriter::xPutI(int64_t Value)
+{
+    if(Value < 0) { xPut("-"); xPutU((uint64_t)(-(Value + 1)) + 1); }
+    else          { xPutU((uint64_t)Value); }
+}
+
+void xTS_EventWriter::xPutHex(uint32_t Value)
+{
+    static const char HexDigits[] = "0123456789ABCDEF";
+    char    Digits[8];
+    int32_t NumDigits = 0;
+    do { Digits[NumDigits++] = HexDigits[Value & 0xF]; Value >>= 4; } while(Value);
+    for(int32_t i = 0; i < NumDigits; i++) { m_Buffer[m_Used + i] = Digits[NumDigits - 1 - i]; }
+    m_Used += (size_t)NumDigits;
+}
+
+bool xTS_EventWriter::StringToFormat(const char* Name, eFormat& Format)
+{
+    if     (!std::strcmp(Name, "text"  )) { Format = eFormat::Text;   }
+    else if(!std::strcmp(Name, "ndjson")) { Format = eFormat::NDJSON; }
+    else if(!std::strcmp(Name, "binary")) { Format = eFormat::Binary; }
+    else { return false; }
+    return true;
+}
+
+const char* xTS_EventWriter::FormatToString(eFormat Format)
+{
+    switch(Format)
+    {
+        case eFormat::Text  : return "text";
+        case eFormat::NDJSON: return "ndjson";
+        case eFormat::Binary: return "binary";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_EventWriter
+//=============================================================================================================================================================================
+
+// Per-packet trace writer. Events are formatted by hand into one large reusable buffer that goes to the file
+// with a single fwrite when full, instead of a dozen printf calls per packet.
+//  Text   - the classic human readable trace (same text as xTS_PacketHeader::Print() & co.)
+//  NDJSON - one JSON object per line
+//  Binary - xHeader followed by fixed-size little-endian xRecord entries
+class xTS_EventWriter
+{
+public:
+  enum class eFormat : int32_t { Text, NDJSON, Binary };
+
+  static constexpr size_t DefaultBufferSize = 1 << 20;
+  static constexpr size_t MaxEventSize      = 512; // upper bound of a single formatted event
+
+#pragma pack(push, 1)
+  struct xHeader
+  {
+    char     Magic[4]   = { 'T', 'S', 'E', 'V' };
+    uint16_t Version    = 1;
+    uint16_t RecordSize = 24;
+  };
+
+  struct xRecord
+  {
+    uint64_t Offset;    // byte offset of the packet in the input
+    uint32_t Index;     // packet number
+    uint16_t PID;
+    uint8_t  CC;
+    uint8_t  Header;    // E<<7 | S<<6 | T<<5 | TSC<<2 | AFC
+    uint8_t  AFL;       // adaptation field length (0 if none)
+    uint8_t  AFFlags;   // DC RA SP PR OR SF TP EX, DC in MSB
+    uint8_t  Result;    // xPES_Assembler::eResult, 0 if the packet was not assembled
+    uint8_t  StreamId;  // PES stream_id for started/finished PES, otherwise 0
+    uint16_t PESLength; // PES_packet_length for started/finished PES, otherwise 0
+    uint16_t Reserved;
+  };
+#pragma pack(pop)
+  static_assert(sizeof(xRecord) == 24, "binary event record layout");
+
+public:
+  explicit xTS_EventWriter(FILE* File, eFormat Format = eFormat::Text, size_t BufferSize = DefaultBufferSize);
+  ~xTS_EventWriter() { Flush(); }
+  xTS_EventWriter(const xTS_EventWriter&) = delete;
+  xTS_EventWriter& operator=(const xTS_EventWriter&) = delete;
+
+  // AdaptationField may be nullptr for packets without one, PESH is printed only for started/finished PES packets.
+  void WritePacket(uint64_t Index, uint64_t Offset, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField,
+                   xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH);
+  void Flush();
+
+  eFormat getFormat() const { return m_Format; }
+
+  static bool        StringToFormat(const char* Name, eFormat& Format);
+  static const char* FormatToString(eFormat Format);
+
+protected:
+  void xWriteText  (uint64_t Index, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField, xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH);
+  void xWriteNDJSON(uint64_t Index, uint64_t Offset, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField, xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH);
+  void xWriteBinary(uint64_t Index, uint64_t Offset, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField, xPES_Assembler::eResult Result, const xPES_PacketHeader* PESH);
+
+  void xPut   (const char* Str, size_t Length) { std::memcpy(m_Buffer.data() + m_Used, Str, Length); m_Used += Length; }
+  template <size_t N> void xPut(const char (&Str)[N]) { xPut(Str, N - 1); }
+  void xPutU  (uint64_t Value, int32_t MinDigits = 1);
+  void xPutI  (int64_t  Value);
+  void xPutHex(uint32_t Value);
+
+  FILE*             m_File;
+  eFormat           m_Format;
+  std::vector<char> m_Buffer;
+  size_t            m_Used = 0;
+};
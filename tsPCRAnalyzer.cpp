@@ -0,0 +1,138 @@
+#include "tsPCRAnalyzer.h"
+#include <algorithm>
+#include <cmath>
+
+//=============================================================================================================================================================================
+// xTS_PCRAnalyzer
+//=============================================================================================================================================================================
+
+xTS_PCRAnalyzer::xTS_PCRAnalyzer()
+{
+    for(int32_t i = 0; i < NumPIDs; i++) { m_PIDToState[i] = -1; m_PCRToState[i] = -1; }
+}
+
+int16_t xTS_PCRAnalyzer::xGetState(int32_t PCR_PID)
+{
+    if(m_PCRToState[PCR_PID] < 0)
+    {
+        m_PCRToState[PCR_PID] = (int16_t)m_States.size();
+        m_States.emplace_back();
+        m_States.back().PID = PCR_PID;
+        if(m_PIDToState[PCR_PID] < 0) { m_PIDToState[PCR_PID] = m_PCRToState[PCR_PID]; }
+    }
+    return m_PCRToState[PCR_PID];
+}
+
+void xTS_PCRAnalyzer::AddProgram(const xPSI_PMT& PMT)
+{
+    // a new version may drop or move PIDs (the PCR PID too) - the membership of the program is rebuilt from it
+    for(int16_t& State : m_PIDToState) { if(State >= 0 && m_States[State].ProgramNumber == PMT.ProgramNumber) { State = -1; } }
+    if(PMT.PCR_PID >= (uint16_t)xTS_PacketHeader::ePID::NuLL) { return; } // program without PCR
+    const int16_t Idx = xGetState(PMT.PCR_PID);
+    m_States[Idx].ProgramNumber = PMT.ProgramNumber;
+    m_PIDToState[PMT.PID    ] = Idx;
+    m_PIDToState[PMT.PCR_PID] = Idx;
+    for(const xPSI_PMT::xStream& Stream : PMT.Streams) { m_PIDToState[Stream.PID] = Idx; }
+}
+
+void xTS_PCRAnalyzer::ProcessPacket(const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField)
+{
+    const uint64_t PacketIdx = m_NumPackets++;
+    const int32_t  PID       = (int32_t)PacketHeader.PID;
+    const int16_t  Member    = m_PIDToState[PID];
+    if(Member >= 0) { m_States[Member].ProgramPackets++; }
+    // a PCR in a packet with transport_error_indicator set cannot be trusted
+    if(!AdaptationField || !AdaptationField->PR || AdaptationField->Malformed || PacketHeader.E) { return; }
+    xOnPCR(PID, PacketIdx, AdaptationField->PCR, AdaptationField->DC != 0);
+}
+
+void xTS_PCRAnalyzer::ProcessBatch(const xTS_PacketBatch& Batch)
+{
+    xTS_AdaptationField AdaptationField;
+    const int32_t NumPackets = Batch.getNumPackets();
+    for(int32_t i = 0; i < NumPackets; i++)
+    {
+        const uint64_t PacketIdx = m_NumPackets++;
+        const int16_t  Member    = m_PIDToState[Batch.PID[i]];
+        if(Member >= 0) { m_States[Member].ProgramPackets++; }
+        if(!(Batch.AFC[i] & 0x2) || Batch.TEI[i]) { continue; }
+        // adaptation_field_length and the PCR_flag are checked before parsing the whole field
+        const uint8_t* AF = Batch.getPacket(i) + xTS::TS_HeaderLength;
+        if(AF[0] < 7 || !(AF[1] & 0x10)) { continue; }
+        AdaptationField.Parse(AF, Batch.AFC[i]);
+        if(!AdaptationField.Malformed) { xOnPCR(Batch.PID[i], PacketIdx, AdaptationField.PCR, AdaptationField.DC != 0); }
+    }
+}
+
+/**
+ * @brief Account one PCR sample
+ * @param PacketIdx index of the packet in the mux - packets since the previous PCR give the transmitted bytes
+ * @param Discontinuity discontinuity_indicator - the time base may jump, the interval is not measured
+ */
+void xTS_PCRAnalyzer::xOnPCR(int32_t PID, uint64_t PacketIdx, uint64_t PCR, bool Discontinuity)
+{
+    xState& State = m_States[xGetState(PID)];
+    State.Stats.NumPCRs++;
+
+    bool Restart = !State.HasLast;
+    int64_t Ticks = 0;
+    if(!Restart)
+    {
+        Ticks = xTS_AdaptationField::PCRDiff(State.LastPCR, PCR); // a backward step wraps to a huge value
+        if     (Discontinuity                   ) { State.Stats.NumDiscontinuities++;     Restart = true; }
+        else if(Ticks == 0 || Ticks > MaxPCRGap) { State.Stats.NumDiscontinuityErrors++; Restart = true; }
+    }
+    if(!Restart)
+    {
+        const uint64_t TSPackets = PacketIdx - State.LastPacketIdx;
+        State.MinInterval = std::min(State.MinInterval, Ticks);
+        State.MaxInterval = std::max(State.MaxInterval, Ticks);
+        State.NumIntervals++;
+        if(Ticks > m_MaxInterval) { State.Stats.NumRepetitionErrors++; }
+
+        if(State.SumTicks > 0)
+        {
+            // PCR_AC - deviation from the PCR expected at the long-term transport rate
+            const double Expected  = (double)TSPackets * (double)State.SumTicks / (double)State.SumTSPackets;
+            const double Jitter_ns = ((double)Ticks - Expected) * 1e9 / xTS::ExtendedClockFrequency_Hz;
+            State.Stats.MaxJitter_ns = std::max(State.Stats.MaxJitter_ns, std::fabs(Jitter_ns));
+            State.SumJitter2 += Jitter_ns * Jitter_ns;
+            State.NumJitter++;
+            if(std::fabs(Jitter_ns) > m_MaxJitter) { State.Stats.NumAccuracyErrors++; }
+        }
+        State.SumTicks      += (uint64_t)Ticks;
+        State.SumTSPackets  += TSPackets;
+        State.SumPrgPackets += State.ProgramPackets;
+    }
+    State.HasLast        = true;
+    State.LastPCR        = PCR;
+    State.LastPacketIdx  = PacketIdx;
+    State.ProgramPackets = 0;
+}
+
+std::vector<xTS_PCRAnalyzer::xStats> xTS_PCRAnalyzer::getStats() const
+{
+    std::vector<xStats> Result;
+    for(const xState& State : m_States)
+    {
+        xStats Stats        = State.Stats;
+        Stats.PCR_PID       = State.PID;
+        Stats.ProgramNumber = State.ProgramNumber;
+        if(State.NumIntervals)
+        {
+            Stats.MinInterval_ms = (double)State.MinInterval / ClockMs;
+            Stats.MaxInterval_ms = (double)State.MaxInterval / ClockMs;
+            Stats.AvgInterval_ms = (double)State.SumTicks / State.NumIntervals / ClockMs;
+        }
+        if(State.SumTicks)
+        {
+            const double Seconds = (double)State.SumTicks / xTS::ExtendedClockFrequency_Hz;
+            Stats.TSBitrate      = (double)State.SumTSPackets  * xTS::TS_PacketLength * 8 / Seconds;
+            Stats.ProgramBitrate = (double)State.SumPrgPackets * xTS::TS_PacketLength * 8 / Seconds;
+        }
+        if(State.NumJitter) { Stats.RMSJitter_ns = std::sqrt(State.SumJitter2 / State.NumJitter); }
+        Result.push_back(Stats);
+    }
+    std::sort(Result.begin(), Result.end(), [](const xStats& A, const xStats& B) { return A.PCR_PID < B.PCR_PID; });
+    return Result;
+}
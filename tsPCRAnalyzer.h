@@ -0,0 +1,90 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketBatch.h"
+#include "tsPSI.h"
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_PCRAnalyzer
+//=============================================================================================================================================================================
+
+// Streaming PCR analysis in the spirit of ETSI TR 101 290 - for every PCR PID (one per program): transport and program
+// bitrate, PCR interval, PCR accuracy and the repetition/discontinuity/accuracy error counts. Every packet of the mux
+// has to be fed, the packet count between two PCRs is the time base. PCR accuracy compares each PCR with the value
+// expected from the previous one and the long-term transport rate, so it is meaningful for constant bitrate muxes.
+// State is a fixed record per PCR PID plus two flat PID tables, nothing grows with the length of the input.
+class xTS_PCRAnalyzer
+{
+public:
+  static constexpr int32_t NumPIDs             = 8192;
+  static constexpr int64_t ClockMs             = xTS::ExtendedClockFrequency_kHz;
+  static constexpr int64_t DefaultMaxInterval  =  40 * ClockMs; // TR 101 290 PCR_repetition_error (DVB)
+  static constexpr int64_t MaxPCRGap           = 100 * ClockMs; // larger jumps without discontinuity_indicator are errors
+  static constexpr double  DefaultMaxJitter_ns = 500.0;         // TR 101 290 PCR_accuracy_error
+
+  struct xStats
+  {
+    int32_t  PCR_PID                = -1;
+    uint16_t ProgramNumber          = 0; // 0 - PCR PID not announced in a PMT
+    uint64_t NumPCRs                = 0;
+    uint64_t NumDiscontinuities     = 0; // signalled by discontinuity_indicator
+    uint64_t NumDiscontinuityErrors = 0; // backward or > 100 ms jump without discontinuity_indicator
+    uint64_t NumRepetitionErrors    = 0; // interval above the maximum
+    uint64_t NumAccuracyErrors      = 0; // |accuracy| above the maximum
+    double   MinInterval_ms         = 0;
+    double   AvgInterval_ms         = 0;
+    double   MaxInterval_ms         = 0;
+    double   TSBitrate              = 0; // bit/s of the whole mux, measured with this PCR
+    double   ProgramBitrate         = 0; // bit/s of the program's PIDs (PMT, PCR and elementary streams)
+    double   MaxJitter_ns           = 0;
+    double   RMSJitter_ns           = 0;
+  };
+
+public:
+  xTS_PCRAnalyzer();
+
+  void setMaxInterval(int64_t MaxInterval) { m_MaxInterval = MaxInterval; } // 27 MHz units
+  void setMaxJitter  (double MaxJitter_ns) { m_MaxJitter   = MaxJitter_ns; }
+
+  // Assigns the PMT and elementary stream PIDs to the program of PMT.PCR_PID (call on every new PMT version). PIDs of
+  // an earlier version of the program that the new one no longer lists stop counting for it.
+  void AddProgram   (const xPSI_PMT& PMT);
+  // Feeds one packet of the mux - AdaptationField may be nullptr for packets without one.
+  void ProcessPacket(const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField* AdaptationField);
+  // Feeds a decoded batch, adaptation fields are parsed only for packets that carry a PCR.
+  void ProcessBatch (const xTS_PacketBatch& Batch);
+
+  uint64_t            getNumPackets() const { return m_NumPackets; }
+  std::vector<xStats> getStats     () const; // ordered by PCR PID
+
+protected:
+  struct xState
+  {
+    int32_t  PID            = -1;
+    uint16_t ProgramNumber  = 0;
+    bool     HasLast        = false;
+    uint64_t LastPCR        = 0;
+    uint64_t LastPacketIdx  = 0;
+    uint64_t ProgramPackets = 0; // packets of the program since the last PCR
+    xStats   Stats;
+    int64_t  MinInterval    = INT64_MAX;
+    int64_t  MaxInterval    = 0;
+    uint64_t NumIntervals   = 0;
+    uint64_t SumTicks       = 0;
+    uint64_t SumTSPackets   = 0;
+    uint64_t SumPrgPackets  = 0;
+    uint64_t NumJitter      = 0;
+    double   SumJitter2     = 0;
+  };
+
+  int16_t xGetState(int32_t PCR_PID);
+  void    xOnPCR   (int32_t PID, uint64_t PacketIdx, uint64_t PCR, bool Discontinuity);
+
+  int16_t             m_PIDToState[NumPIDs]; // program membership - packets counted for the program's bitrate
+  int16_t             m_PCRToState[NumPIDs]; // PCR PID -> state
+  std::vector<xState> m_States;
+  uint64_t            m_NumPackets  = 0;
+  int64_t             m_MaxInterval = DefaultMaxInterval;
+  double              m_MaxJitter   = DefaultMaxJitter_ns;
+};
@@ -0,0 +1,400 @@
+#include "tsPSI.h"
+#include "tsCRC32.h"
+#include <algorithm>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// xPSI_SectionAssembler
+//=============================================================================================================================================================================
+
+void xPSI_SectionAssembler::AbsorbPacket(const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField)
+{
+    if(!PacketHeader.hasPayload()) { return; }
+
+    const int8_t CC = (int8_t)PacketHeader.CC;
+    if(m_LastCC >= 0)
+    {
+        if(CC == m_LastCC) { return; } // duplicate packet
+        if(CC != ((m_LastCC + 1) & 0xF) && m_Active) { m_Active = false; m_NumDropped++; }
+    }
+    m_LastCC = CC;
+
+    int32_t Offset = xTS::TS_HeaderLength;
+    if(PacketHeader.hasAdaptationField()) { Offset += 1 + AdaptationField.AFL; }
+    if(Offset >= (int32_t)xTS::TS_PacketLength) { return; }
+    const uint8_t* Data = Packet + Offset;
+    int32_t        Size = (int32_t)xTS::TS_PacketLength - Offset;
+
+    if(!PacketHeader.getS())
+    {
+        // continuation only - a new section may start only in a packet with pointer_field
+        if(m_Active) { xAppend(Data, Size); }
+        return;
+    }
+
+    const int32_t Pointer = Data[0];
+    Data++;
+    Size--;
+    if(Pointer > Size) { if(m_Active) { m_Active = false; m_NumDropped++; } return; }
+    if(m_Active)
+    {
+        // tail of the previous section
+        xAppend(Data, Pointer);
+        if(m_Active) { m_Active = false; m_NumDropped++; }
+    }
+    Data += Pointer;
+    Size -= Pointer;
+
+    // sections follow back to back until stuffing (0xFF table_id) or the end of the packet
+    while(Size > 0 && Data[0] != 0xFF)
+    {
+        m_Buffer.clear();
+        m_Expected = -1;
+        m_Active   = true;
+        const int32_t Consumed = xAppend(Data, Size);
+        Data += Consumed;
+        Size -= Consumed;
+        if(m_Active) { break; } // continues in the next packet
+    }
+}
+
+int32_t xPSI_SectionAssembler::xAppend(const uint8_t* Data, int32_t Size)
+{
+    int32_t Consumed = 0;
+    while(m_Active && Consumed < Size)
+    {
+        const int32_t Target = m_Expected < 0 ? 3 : m_Expected;
+        const int32_t Chunk  = std::min(Target - (int32_t)m_Buffer.size(), Size - Consumed);
+        m_Buffer.insert(m_Buffer.end(), Data + Consumed, Data + Consumed + Chunk);
+        Consumed += Chunk;
+        if((int32_t)m_Buffer.size() < Target) { break; }
+
+        if(m_Expected < 0)
+        {
+            // table_id, flags, section_length (12 bits)
+            m_Expected = 3 + (((m_Buffer[1] & 0x0F) << 8) | m_Buffer[2]);
+            if(m_Expected > MaxSectionSize) { m_Active = false; m_NumDropped++; }
+            continue;
+        }
+        m_Active = false;
+        if(m_Callback) { m_Callback(m_Buffer.data(), (int32_t)m_Buffer.size()); }
+    }
+    return Consumed;
+}
+
+//=============================================================================================================================================================================
+// xPSI_Parser
+//=============================================================================================================================================================================
+
+xPSI_Parser::xPSI_Parser()
+{
+    for(int16_t& Idx : m_PIDToAssembler) { Idx = -1; }
+    xAddPID((int32_t)xTS_PacketHeader::ePID::PAT);
+    xAddPID((int32_t)xTS_PacketHeader::ePID::CAT);
+    xAddPID((int32_t)xTS_PacketHeader::ePID::SDT);
+}
+
+void xPSI_Parser::xAddPID(int32_t PID)
+{
+    if(PID < 0 || PID >= NumPIDs || m_PIDToAssembler[PID] >= 0) { return; }
+    int16_t Idx;
+    if(!m_FreeAssemblers.empty()) { Idx = m_FreeAssemblers.back(); m_FreeAssemblers.pop_back(); }
+    else                          { Idx = (int16_t)m_Assemblers.size(); m_Assemblers.push_back(std::make_unique<xPSI_SectionAssembler>()); }
+    xPSI_SectionAssembler& Assembler = *m_Assemblers[Idx];
+    Assembler.Reset();
+    Assembler.setCallback([this, PID](const uint8_t* Section, int32_t Size) { xOnSection(PID, Section, Size); });
+    m_PIDToAssembler[PID] = Idx;
+}
+
+void xPSI_Parser::xRemovePID(int32_t PID)
+{
+    const int16_t Idx = m_PIDToAssembler[PID];
+    if(Idx < 0) { return; }
+    m_Assemblers[Idx]->Reset();
+    m_FreeAssemblers.push_back(Idx);
+    m_PIDToAssembler[PID] = -1;
+    m_Tables.erase(std::remove_if(m_Tables.begin(), m_Tables.end(), [PID](const xTable& Table) { return Table.PID == PID; }), m_Tables.end());
+    m_PMTs  .erase(std::remove_if(m_PMTs  .begin(), m_PMTs  .end(), [PID](const xPSI_PMT& PMT) { return PMT.PID  == PID; }), m_PMTs  .end());
+}
+
+bool xPSI_Parser::ProcessPacket(const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField)
+{
+    const int16_t Idx = m_PIDToAssembler[PacketHeader.getPID()];
+    if(Idx < 0) { return false; }
+    m_Assemblers[Idx]->AbsorbPacket(Packet, PacketHeader, AdaptationField);
+    return true;
+}
+
+xPSI_Parser::xTable& xPSI_Parser::xGetTable(int32_t PID, uint8_t TableId, uint16_t Extension)
+{
+    for(xTable& Table : m_Tables)
+    {
+        if(Table.PID == PID && Table.TableId == TableId && Table.Extension == Extension) { return Table; }
+    }
+    m_Tables.emplace_back();
+    xTable& Table   = m_Tables.back();
+    Table.PID       = PID;
+    Table.TableId   = TableId;
+    Table.Extension = Extension;
+    return Table;
+}
+
+/**
+ * @brief Handle a complete section - version cache, CRC check, table completion and decoding
+ */
+void xPSI_Parser::xOnSection(int32_t PID, const uint8_t* Section, int32_t Size)
+{
+    m_Stats.NumSections++;
+    if(m_OnSection) { m_OnSection(PID, Section, Size); }
+    const uint8_t TableId = Section[0];
+    const bool    Syntax  = (Section[1] & 0x80) != 0;
+    if(!Syntax || Size < 12) { return; } // all decoded tables use the long section format
+
+    bool Known = false;
+    switch(PID)
+    {
+        case (int32_t)xTS_PacketHeader::ePID::PAT: Known = TableId == (uint8_t)eTableId::PAT;        break;
+        case (int32_t)xTS_PacketHeader::ePID::CAT: Known = TableId == (uint8_t)eTableId::CAT;        break;
+        case (int32_t)xTS_PacketHeader::ePID::SDT: Known = TableId == (uint8_t)eTableId::SDT_Actual; break;
+        default                                  : Known = TableId == (uint8_t)eTableId::PMT;        break;
+    }
+    if(!Known) { return; }
+
+    const uint16_t Extension     = (uint16_t)((Section[3] << 8) | Section[4]);
+    const int32_t  Version       = (Section[5] >> 1) & 0x1F;
+    const bool     CurrentNext   = (Section[5] & 0x01) != 0;
+    const int32_t  SectionNumber = Section[6];
+    const int32_t  LastSection   = Section[7];
+    if(!CurrentNext || SectionNumber > LastSection) { return; }
+
+    xTable& Table = xGetTable(PID, TableId, Extension);
+    if(m_VersionCache && Table.Version == Version && Table.LastSection == LastSection)
+    {
+        const std::vector<uint8_t>& Cached = Table.Sections[SectionNumber];
+        if((int32_t)Cached.size() == Size && std::memcmp(Cached.data() + Size - 4, Section + Size - 4, 4) == 0) { m_Stats.NumRepeats++; return; }
+    }
+
+    if(xTS_CRC32::Calc(Section, (size_t)Size) != 0) { m_Stats.NumCRCErrors++; return; }
+
+    if(Table.Version != Version || Table.LastSection != LastSection)
+    {
+        Table.Version     = Version;
+        Table.LastSection = LastSection;
+        Table.Complete    = false;
+        Table.Sections.assign((size_t)LastSection + 1, std::vector<uint8_t>());
+    }
+    Table.Sections[SectionNumber].assign(Section, Section + Size);
+    // section of a complete table changed without a version bump - keep the decoded one (without the cache it is decoded again)
+    if(Table.Complete && m_VersionCache) { return; }
+    for(const std::vector<uint8_t>& Sec : Table.Sections) { if(Sec.empty()) { return; } }
+    if(!Table.Complete) { m_Stats.NumTables++; }
+    Table.Complete = true;
+
+    switch((eTableId)TableId)
+    {
+        case eTableId::PAT       : xDecodePAT(Table); break;
+        case eTableId::PMT       : xDecodePMT(Table); break;
+        case eTableId::CAT       : xDecodeCAT(Table); break;
+        case eTableId::SDT_Actual: xDecodeSDT(Table); break;
+        default: break;
+    }
+}
+
+void xPSI_Parser::xDecodePAT(const xTable& Table)
+{
+    xPSI_PAT PAT;
+    PAT.TransportStreamId = Table.Extension;
+    PAT.Version           = (uint8_t)Table.Version;
+    for(const std::vector<uint8_t>& Sec : Table.Sections)
+    {
+        for(size_t Pos = 8; Pos + 4 <= Sec.size() - 4; Pos += 4)
+        {
+            xPSI_PAT::xProgram Program;
+            Program.ProgramNumber = (uint16_t)((Sec[Pos] << 8) | Sec[Pos + 1]);
+            Program.PMT_PID       = (uint16_t)(((Sec[Pos + 2] & 0x1F) << 8) | Sec[Pos + 3]);
+            if(Program.ProgramNumber == 0) { PAT.NetworkPID = Program.PMT_PID; }
+            else                           { PAT.Programs.push_back(Program); }
+        }
+    }
+
+    // follow the PMT PIDs - drop programs which disappeared, start listening to new ones
+    if(m_HasPAT)
+    {
+        for(const xPSI_PAT::xProgram& Old : m_PAT.Programs)
+        {
+            const bool Kept = std::any_of(PAT.Programs.begin(), PAT.Programs.end(), [&Old](const xPSI_PAT::xProgram& New) { return New.PMT_PID == Old.PMT_PID; });
+            if(!Kept && Old.PMT_PID >= 0x0020) { xRemovePID(Old.PMT_PID); }
+        }
+    }
+    for(const xPSI_PAT::xProgram& Program : PAT.Programs)
+    {
+        if(Program.PMT_PID >= 0x0020 && Program.PMT_PID != (uint16_t)xTS_PacketHeader::ePID::NuLL) { xAddPID(Program.PMT_PID); }
+    }
+
+    m_PAT    = PAT;
+    m_HasPAT = true;
+    if(m_OnPAT) { m_OnPAT(m_PAT); }
+}
+
+void xPSI_Parser::xDecodePMT(const xTable& Table)
+{
+    const std::vector<uint8_t>& Sec = Table.Sections[0]; // PMT sections are always single (section_number 0)
+    xPSI_PMT PMT;
+    PMT.PID           = (uint16_t)Table.PID;
+    PMT.ProgramNumber = Table.Extension;
+    PMT.Version       = (uint8_t)Table.Version;
+    PMT.PCR_PID       = (uint16_t)(((Sec[8] & 0x1F) << 8) | Sec[9]);
+    const size_t End  = Sec.size() - 4;
+    size_t Pos = 12 + (((Sec[10] & 0x0F) << 8) | Sec[11]);
+    while(Pos + 5 <= End)
+    {
+        xPSI_PMT::xStream Stream;
+        Stream.StreamType = Sec[Pos];
+        Stream.PID        = (uint16_t)(((Sec[Pos + 1] & 0x1F) << 8) | Sec[Pos + 2]);
+        const size_t InfoLength = ((Sec[Pos + 3] & 0x0F) << 8) | Sec[Pos + 4];
+        Pos += 5;
+        if(Pos + InfoLength > End) { break; }
+        Stream.Descriptors.assign(Sec.begin() + Pos, Sec.begin() + Pos + InfoLength);
+        Pos += InfoLength;
+        PMT.Streams.push_back(std::move(Stream));
+    }
+
+    std::vector<xPSI_PMT>::iterator It = std::find_if(m_PMTs.begin(), m_PMTs.end(), [&PMT](const xPSI_PMT& Old) { return Old.PID == PMT.PID && Old.ProgramNumber == PMT.ProgramNumber; });
+    if(It != m_PMTs.end()) { *It = std::move(PMT); }
+    else                   { It = m_PMTs.insert(m_PMTs.end(), std::move(PMT)); }
+    if(m_OnPMT) { m_OnPMT(*It); }
+}
+
+void xPSI_Parser::xDecodeCAT(const xTable& Table)
+{
+    xPSI_CAT CAT;
+    CAT.Version = (uint8_t)Table.Version;
+    for(const std::vector<uint8_t>& Sec : Table.Sections)
+    {
+        const size_t End = Sec.size() - 4;
+        for(size_t Pos = 8; Pos + 2 <= End; Pos += 2 + Sec[Pos + 1])
+        {
+            const uint8_t Tag    = Sec[Pos];
+            const uint8_t Length = Sec[Pos + 1];
+            if(Pos + 2 + Length > End) { break; }
+            if(Tag != 0x09 || Length < 4) { continue; } // CA_descriptor
+            xPSI_CAT::xCA CA;
+            CA.CASystemId = (uint16_t)((Sec[Pos + 2] << 8) | Sec[Pos + 3]);
+            CA.PID        = (uint16_t)(((Sec[Pos + 4] & 0x1F) << 8) | Sec[Pos + 5]);
+            CAT.Systems.push_back(CA);
+        }
+    }
+    m_CAT    = CAT;
+    m_HasCAT = true;
+    if(m_OnCAT) { m_OnCAT(m_CAT); }
+}
+
+// DVB strings may start with a character table selector (first byte below 0x20) - it is dropped, the text is kept as is.
+static std::string xDVBString(const uint8_t* Data, size_t Length)
+{
+    if(Length && Data[0] < 0x20)
+    {
+        const size_t Skip = Data[0] == 0x10 ? 3 : 1;
+        if(Skip >= Length) { return std::string(); }
+        Data   += Skip;
+        Length -= Skip;
+    }
+    return std::string((const char*)Data, Length);
+}
+
+void xPSI_Parser::xDecodeSDT(const xTable& Table)
+{
+    xPSI_SDT SDT;
+    SDT.TransportStreamId = Table.Extension;
+    SDT.Version           = (uint8_t)Table.Version;
+    for(const std::vector<uint8_t>& Sec : Table.Sections)
+    {
+        SDT.OriginalNetworkId = (uint16_t)((Sec[8] << 8) | Sec[9]);
+        const size_t End = Sec.size() - 4;
+        size_t Pos = 11;
+        while(Pos + 5 <= End)
+        {
+            xPSI_SDT::xService Service;
+            Service.ServiceId = (uint16_t)((Sec[Pos] << 8) | Sec[Pos + 1]);
+            const size_t LoopLength = ((Sec[Pos + 3] & 0x0F) << 8) | Sec[Pos + 4];
+            Pos += 5;
+            const size_t LoopEnd = std::min(Pos + LoopLength, End);
+            for(size_t D = Pos; D + 2 <= LoopEnd; D += 2 + Sec[D + 1])
+            {
+                const uint8_t Tag    = Sec[D];
+                const uint8_t Length = Sec[D + 1];
+                if(D + 2 + Length > LoopEnd || Tag != 0x48 || Length < 3) { continue; } // service_descriptor
+                const uint8_t* Desc   = Sec.data() + D + 2;
+                Service.ServiceType   = Desc[0];
+                const size_t ProviderLength = Desc[1];
+                if(2 + ProviderLength + 1 > Length) { continue; }
+                const size_t NameLength = Desc[2 + ProviderLength];
+                if(3 + ProviderLength + NameLength > Length) { continue; }
+                Service.Provider = xDVBString(Desc + 2, ProviderLength);
+                Service.Name     = xDVBString(Desc + 3 + ProviderLength, NameLength);
+            }
+            Pos = LoopEnd;
+            SDT.Services.push_back(std::move(Service));
+        }
+    }
+    m_SDT    = SDT;
+    m_HasSDT = true;
+    if(m_OnSDT) { m_OnSDT(m_SDT); }
+}
+
+const xPSI_PMT* xPSI_Parser::getPMTForPID(int32_t ElementaryPID) const
+{
+    for(const xPSI_PMT& PMT : m_PMTs)
+    {
+        for(const xPSI_PMT::xStream& Stream : PMT.Streams) { if(Stream.PID == ElementaryPID) { return &PMT; } }
+    }
+    return nullptr;
+}
+
+uint8_t xPSI_Parser::getStreamType(int32_t ElementaryPID) const
+{
+    for(const xPSI_PMT& PMT : m_PMTs)
+    {
+        for(const xPSI_PMT::xStream& Stream : PMT.Streams) { if(Stream.PID == ElementaryPID) { return Stream.StreamType; } }
+    }
+    return 0;
+}
+
+bool xPSI_Parser::isPESStreamType(uint8_t StreamType)
+{
+    switch(StreamType)
+    {
+        case 0x05: // private sections
+        case 0x0A: // DSM-CC types A-D
+        case 0x0B:
+        case 0x0C:
+        case 0x0D:
+        case 0x86: // SCTE-35 splice information
+            return false;
+        default:
+            return StreamType != 0x00;
+    }
+}
+
+const char* xPSI_Parser::StreamTypeToString(uint8_t StreamType)
+{
+    switch(StreamType)
+    {
+        case 0x01: return "MPEG-1 video";
+        case 0x02: return "MPEG-2 video";
+        case 0x03: return "MPEG-1 audio";
+        case 0x04: return "MPEG-2 audio";
+        case 0x05: return "private sections";
+        case 0x06: return "private PES";
+        case 0x0F: return "AAC audio";
+        case 0x10: return "MPEG-4 video";
+        case 0x11: return "LATM AAC audio";
+        case 0x15: return "metadata PES";
+        case 0x1B: return "H.264 video";
+        case 0x24: return "H.265 video";
+        case 0x81: return "AC-3 audio";
+        case 0x86: return "SCTE-35";
+        case 0x87: return "E-AC-3 audio";
+        default  : return "unknown";
+    }
+}
@@ -0,0 +1,208 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// PSI/SI tables
+//=============================================================================================================================================================================
+
+struct xPSI_PAT
+{
+  struct xProgram
+  {
+    uint16_t ProgramNumber = 0;
+    uint16_t PMT_PID       = 0;
+  };
+
+  uint16_t              TransportStreamId = 0;
+  uint8_t               Version           = 0;
+  uint16_t              NetworkPID        = (uint16_t)xTS_PacketHeader::ePID::NuLL; // program_number 0, NuLL if absent
+  std::vector<xProgram> Programs;
+};
+
+struct xPSI_PMT
+{
+  struct xStream
+  {
+    uint8_t              StreamType = 0;
+    uint16_t             PID        = 0;
+    std::vector<uint8_t> Descriptors; // raw ES_info descriptor loop
+  };
+
+  uint16_t             PID           = 0; // PID carrying the PMT
+  uint16_t             ProgramNumber = 0;
+  uint8_t              Version       = 0;
+  uint16_t             PCR_PID       = (uint16_t)xTS_PacketHeader::ePID::NuLL;
+  std::vector<xStream> Streams;
+};
+
+struct xPSI_CAT
+{
+  struct xCA
+  {
+    uint16_t CASystemId = 0;
+    uint16_t PID        = 0; // EMM PID
+  };
+
+  uint8_t          Version = 0;
+  std::vector<xCA> Systems;
+};
+
+struct xPSI_SDT
+{
+  struct xService
+  {
+    uint16_t    ServiceId   = 0;
+    uint8_t     ServiceType = 0;
+    std::string Provider;
+    std::string Name;
+  };
+
+  uint16_t              TransportStreamId = 0;
+  uint16_t              OriginalNetworkId = 0;
+  uint8_t               Version           = 0;
+  std::vector<xService> Services;
+};
+
+//=============================================================================================================================================================================
+// xPSI_SectionAssembler
+//=============================================================================================================================================================================
+
+// Rebuilds sections of one PID from TS packets: pointer_field, several sections per packet, sections spanning
+// packets and stuffing. A continuity error drops the section in progress, duplicate packets are ignored.
+class xPSI_SectionAssembler
+{
+public:
+  static constexpr int32_t MaxSectionSize = 4096; // private sections; PSI sections are limited to 1024
+
+  using tSectionCallback = std::function<void(const uint8_t* Section, int32_t Size)>;
+
+public:
+  xPSI_SectionAssembler() { m_Buffer.reserve(MaxSectionSize); }
+
+  void setCallback(tSectionCallback Callback) { m_Callback = std::move(Callback); }
+  void Reset      () { m_Buffer.clear(); m_Active = false; m_LastCC = -1; }
+
+  void AbsorbPacket(const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField);
+
+  uint64_t getNumDropped() const { return m_NumDropped; }
+
+protected:
+  int32_t xAppend(const uint8_t* Data, int32_t Size); // returns number of bytes consumed
+
+  tSectionCallback     m_Callback;
+  std::vector<uint8_t> m_Buffer;
+  int32_t              m_Expected   = -1; // full section size once the 3-byte header is in
+  bool                 m_Active     = false;
+  int8_t               m_LastCC     = -1;
+  uint64_t             m_NumDropped = 0;
+};
+
+//=============================================================================================================================================================================
+// xPSI_Parser
+//=============================================================================================================================================================================
+
+// PSI/SI engine - PAT (PID 0), CAT (PID 1), SDT (PID 0x11) and the PMTs announced in the PAT. Sections are CRC checked
+// and cached per (PID, table_id, table_id_extension) by version_number: a repeated section with unchanged version,
+// length and CRC_32 field is dropped after comparing those fields, without running the CRC or decoding the table again.
+// Callbacks fire once per new table version, after all its sections have been received.
+class xPSI_Parser
+{
+public:
+  static constexpr int32_t NumPIDs = 8192;
+
+  enum class eTableId : uint8_t
+  {
+    PAT        = 0x00,
+    CAT        = 0x01,
+    PMT        = 0x02,
+    SDT_Actual = 0x42,
+  };
+
+  struct xStats
+  {
+    uint64_t NumSections  = 0; // complete sections received
+    uint64_t NumRepeats   = 0; // repeated sections answered from the version cache
+    uint64_t NumCRCErrors = 0;
+    uint64_t NumTables    = 0; // new table versions decoded
+  };
+
+public:
+  xPSI_Parser();
+  xPSI_Parser(const xPSI_Parser&) = delete; // section callbacks refer to this
+  xPSI_Parser& operator=(const xPSI_Parser&) = delete;
+
+  void setOnPAT(std::function<void(const xPSI_PAT&)> Callback) { m_OnPAT = std::move(Callback); }
+  void setOnPMT(std::function<void(const xPSI_PMT&)> Callback) { m_OnPMT = std::move(Callback); }
+  void setOnCAT(std::function<void(const xPSI_CAT&)> Callback) { m_OnCAT = std::move(Callback); }
+  void setOnSDT(std::function<void(const xPSI_SDT&)> Callback) { m_OnSDT = std::move(Callback); }
+  // Observer of every complete section of a PSI PID (repeats included, CRC not checked yet), before it is decoded.
+  void setOnSection(std::function<void(int32_t PID, const uint8_t* Section, int32_t Size)> Callback) { m_OnSection = std::move(Callback); }
+  // For benchmarks - without the cache every repeated section is CRC checked and decoded again.
+  void setVersionCache(bool Enable) { m_VersionCache = Enable; }
+
+  bool isPSIPID(int32_t PID) const { return m_PIDToAssembler[PID] >= 0; }
+
+  // Feeds a packet of a PSI PID. Returns false for other PIDs.
+  bool ProcessPacket(const uint8_t* Packet, const xTS_PacketHeader& PacketHeader, const xTS_AdaptationField& AdaptationField);
+
+  bool                         hasPAT() const { return m_HasPAT; }
+  const xPSI_PAT&              getPAT() const { return m_PAT; }
+  const std::vector<xPSI_PMT>& getPMTs() const { return m_PMTs; }
+  const xPSI_PMT*              getPMTForPID(int32_t ElementaryPID) const;
+  uint8_t                      getStreamType(int32_t ElementaryPID) const; // 0 - not announced by any PMT
+  bool                         hasCAT() const { return m_HasCAT; }
+  const xPSI_CAT&              getCAT() const { return m_CAT; }
+  bool                         hasSDT() const { return m_HasSDT; }
+  const xPSI_SDT&              getSDT() const { return m_SDT; }
+  const xStats&                getStats() const { return m_Stats; }
+
+  static bool        isPESStreamType   (uint8_t StreamType); // false for section based / DSM-CC stream types
+  static const char* StreamTypeToString(uint8_t StreamType);
+
+protected:
+  struct xTable // all sections of one table version
+  {
+    int32_t                           PID         = -1;
+    uint8_t                           TableId     = 0;
+    uint16_t                          Extension   = 0;
+    int32_t                           Version     = -1;
+    int32_t                           LastSection = -1;
+    bool                              Complete    = false;
+    std::vector<std::vector<uint8_t>> Sections;
+  };
+
+  void    xAddPID         (int32_t PID);
+  void    xRemovePID      (int32_t PID);
+  void    xOnSection      (int32_t PID, const uint8_t* Section, int32_t Size);
+  xTable& xGetTable       (int32_t PID, uint8_t TableId, uint16_t Extension);
+  void    xDecodePAT      (const xTable& Table);
+  void    xDecodePMT      (const xTable& Table);
+  void    xDecodeCAT      (const xTable& Table);
+  void    xDecodeSDT      (const xTable& Table);
+
+  int16_t                            m_PIDToAssembler[NumPIDs];
+  std::vector<std::unique_ptr<xPSI_SectionAssembler>> m_Assemblers; // stable addresses - a section callback may add PIDs
+  std::vector<int16_t>               m_FreeAssemblers;
+  std::vector<xTable>                m_Tables;
+  bool                               m_VersionCache = true;
+
+  bool                               m_HasPAT = false;
+  xPSI_PAT                           m_PAT;
+  std::vector<xPSI_PMT>              m_PMTs;
+  bool                               m_HasCAT = false;
+  xPSI_CAT                           m_CAT;
+  bool                               m_HasSDT = false;
+  xPSI_SDT                           m_SDT;
+  xStats                             m_Stats;
+
+  std::function<void(const xPSI_PAT&)> m_OnPAT;
+  std::function<void(const xPSI_PMT&)> m_OnPMT;
+  std::function<void(const xPSI_CAT&)> m_OnCAT;
+  std::function<void(const xPSI_SDT&)> m_OnSDT;
+  std::function<void(int32_t, const uint8_t*, int32_t)> m_OnSection;
+};
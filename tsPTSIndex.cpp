@@ -0,0 +1,122 @@
+#include "tsPTSIndex.h"
+#include "tsPacketSource.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// xTS_PTSIndex
+//=============================================================================================================================================================================
+
+void xTS_PTSIndex::Add(int32_t PID, const xPES_PacketHeader& PESH, bool RandomAccess, uint64_t Offset)
+{
+    if(!PESH.hasPTS()) { return; }
+    if(m_FirstPTS == NoPTS) { m_FirstPTS = PESH.getPTS(); }
+    xEntry Entry;
+    Entry.Offset   = Offset;
+    Entry.Time     = xPES_PacketHeader::PTSDiff(m_FirstPTS, PESH.getPTS());
+    Entry.PID      = (uint16_t)PID;
+    Entry.StreamId = PESH.getStreamId();
+    Entry.Flags    = RandomAccess ? eFlags::RandomAccess : 0;
+    Entry.Reserved = 0;
+    m_Entries.push_back(Entry);
+}
+
+bool xTS_PTSIndex::Save(const std::string& FileName, const char* InputFileName) const
+{
+    xFileHeader Header;
+    if(!xTS_PacketSource::getFileInfo(InputFileName, Header.InputSize, Header.InputMTime)) { return false; }
+    Header.FirstPTS   = m_FirstPTS == NoPTS ? 0 : m_FirstPTS;
+    Header.NumEntries = m_Entries.size();
+
+    FILE* File = std::fopen(FileName.c_str(), "wb");
+    if(!File) { return false; }
+    bool Ok = std::fwrite(&Header, sizeof(Header), 1, File) == 1;
+    if(Ok && !m_Entries.empty()) { Ok = std::fwrite(m_Entries.data(), sizeof(xEntry), m_Entries.size(), File) == m_Entries.size(); }
+    Ok &= std::fclose(File) == 0;
+    return Ok;
+}
+
+bool xTS_PTSIndex::Load(const std::string& FileName, const char* InputFileName)
+{
+    Reset();
+    uint64_t InputSize  = 0;
+    int64_t  InputMTime = 0;
+    if(!xTS_PacketSource::getFileInfo(InputFileName, InputSize, InputMTime)) { return false; }
+
+    FILE* File = std::fopen(FileName.c_str(), "rb");
+    if(!File) { return false; }
+    xFileHeader Header;
+    const xFileHeader Expected;
+    bool Ok = std::fread(&Header, sizeof(Header), 1, File) == 1 && !std::memcmp(Header.Magic, Expected.Magic, sizeof(Header.Magic)) &&
+              Header.Version == Expected.Version && Header.EntrySize == Expected.EntrySize &&
+              Header.InputSize == InputSize && Header.InputMTime == InputMTime && Header.NumEntries <= InputSize / xTS::TS_PacketLength;
+    if(Ok)
+    {
+        m_Entries.resize((size_t)Header.NumEntries);
+        Ok = Header.NumEntries == 0 || std::fread(m_Entries.data(), sizeof(xEntry), m_Entries.size(), File) == m_Entries.size();
+        m_FirstPTS = Header.FirstPTS;
+    }
+    std::fclose(File);
+    if(!Ok) { Reset(); }
+    return Ok;
+}
+
+/**
+ * @brief Turn a time window into the byte range to read
+ * The range starts at the earliest PUSI of a PES inside the window - B-frame reordering is handled because every entry is
+ * checked, not just the first one past BegTime - and ends where the PID of the last PES inside the window starts its
+ * next PES (end of input if it has none).
+ */
+bool xTS_PTSIndex::FindRange(int64_t BegTime, int64_t EndTime, uint64_t InputSize, uint64_t& Beg, uint64_t& End, const std::vector<int32_t>& PIDs) const
+{
+    std::vector<uint8_t> Selected(8192, PIDs.empty() ? 1 : 0);
+    for(int32_t PID : PIDs) { if(PID >= 0 && PID < 8192) { Selected[PID] = 1; } }
+    std::vector<uint8_t> Pending(8192, 0); // PES of the PID inside the window, its end not seen yet
+    int32_t NumPending = 0;
+    Beg = UINT64_MAX;
+    End = 0;
+    for(const xEntry& Entry : m_Entries)
+    {
+        if(!Selected[Entry.PID]) { continue; }
+        if(Pending[Entry.PID])
+        {
+            End = std::max(End, Entry.Offset);
+            Pending[Entry.PID] = 0;
+            NumPending--;
+        }
+        if(Entry.Time >= BegTime && Entry.Time < EndTime)
+        {
+            Beg = std::min(Beg, Entry.Offset);
+            End = std::max(End, Entry.Offset + 1);
+            Pending[Entry.PID] = 1;
+            NumPending++;
+        }
+    }
+    if(NumPending) { End = InputSize; }
+    return Beg != UINT64_MAX;
+}
+
+bool xTS_PTSIndex::ParseTime(const char* Text, int64_t& Time)
+{
+    constexpr double MaxSeconds = (double)(INT64_MAX / xTS::BaseClockFrequency_Hz); // strtod also takes nan, inf and 1e300
+    double  Seconds = 0;
+    int32_t NumParts = 0;
+    const char* Pos = Text;
+    while(true)
+    {
+        char* End = nullptr;
+        const double Value = std::strtod(Pos, &End);
+        if(End == Pos || !std::isfinite(Value) || Value < 0 || Value > MaxSeconds || ++NumParts > 3) { return false; }
+        Seconds = Seconds * 60 + Value;
+        if(Seconds > MaxSeconds) { return false; }
+        if(*End == '\0') { break; }
+        const char* Dot = std::strchr(Pos, '.');
+        if(*End != ':' || (Dot && Dot < End)) { return false; } // fraction only in the last part
+        Pos = End + 1;
+    }
+    Time = (int64_t)(Seconds * xTS::BaseClockFrequency_Hz + 0.5);
+    return true;
+}
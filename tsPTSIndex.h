@@ -0,0 +1,73 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_PTSIndex
+//=============================================================================================================================================================================
+
+// Sidecar index of PES starts - byte offset of the PUSI packet and presentation time of every PES with a PTS, on every
+// PID of the input whether extracted or not. It is filled during a normal parse pass (xTS_Demuxer PES start callback
+// for all PIDs) and saved next to the input as <input>.ptsidx, so it serves a time window of any set of PIDs later.
+// Times are 90 kHz ticks since the first PTS of the input - the origin xTS_Demuxer uses without an index - so
+// "10 s from 01:23:45" becomes a byte range: one seek and a short read instead of a scan of the whole file. The
+// sidecar records size and modification time of the input and is ignored once the input changes.
+class xTS_PTSIndex
+{
+public:
+  static constexpr uint64_t NoPTS = UINT64_MAX;
+
+  enum eFlags : uint8_t
+  {
+    RandomAccess = 0x01, // random_access_indicator set in the PUSI packet (e.g. video key frame)
+  };
+
+#pragma pack(push, 1)
+  struct xFileHeader
+  {
+    char     Magic[4]   = { 'T', 'S', 'P', 'I' };
+    uint16_t Version    = 2; // 1 indexed only the extracted PIDs
+    uint16_t EntrySize  = 24;
+    uint64_t InputSize  = 0;
+    int64_t  InputMTime = 0;
+    uint64_t FirstPTS   = 0;
+    uint64_t NumEntries = 0;
+  };
+
+  struct xEntry
+  {
+    uint64_t Offset;   // byte offset of the PUSI packet in the input
+    int64_t  Time;     // PTS - first PTS, 90 kHz, wrap-around removed
+    uint16_t PID;
+    uint8_t  StreamId;
+    uint8_t  Flags;    // eFlags
+    uint32_t Reserved;
+  };
+#pragma pack(pop)
+  static_assert(sizeof(xEntry) == 24, "PTS index entry layout");
+
+public:
+  void Reset() { m_Entries.clear(); m_FirstPTS = NoPTS; }
+  void Add  (int32_t PID, const xPES_PacketHeader& PESH, bool RandomAccess, uint64_t Offset);
+
+  bool Save(const std::string& FileName, const char* InputFileName) const;
+  // Returns false if the sidecar is missing or corrupt, or the input changed since it was written.
+  bool Load(const std::string& FileName, const char* InputFileName);
+
+  // Byte range [Beg, End) holding every indexed PES of PIDs (all PIDs if empty) with time in [BegTime, EndTime). False
+  // if the window is empty.
+  bool FindRange(int64_t BegTime, int64_t EndTime, uint64_t InputSize, uint64_t& Beg, uint64_t& End, const std::vector<int32_t>& PIDs = {}) const;
+
+  uint64_t                   getFirstPTS() const { return m_FirstPTS; }
+  const std::vector<xEntry>& getEntries () const { return m_Entries; }
+
+  static std::string SidecarName(const char* InputFileName) { return std::string(InputFileName) + ".ptsidx"; }
+  // "[[hh:]mm:]ss[.fff]" to 90 kHz ticks
+  static bool        ParseTime  (const char* Text, int64_t& Time);
+
+protected:
+  std::vector<xEntry> m_Entries;
+  uint64_t            m_FirstPTS = NoPTS;
+};
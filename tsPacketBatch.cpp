@@ -0,0 +1,174 @@
+#include "tsPacketBatch.h"
+#include "tsSyncScanner.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#define X_PACKET_BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define X_TARGET_AVX2 __attribute__((target("avx2")))
+#define X_CTZ32(x) __builtin_ctz(x)
+#else
+#define X_TARGET_AVX2
+static inline uint32_t X_CTZ32(uint32_t x) { unsigned long Idx; _BitScanForward(&Idx, x); return Idx; }
+#endif
+
+//=============================================================================================================================================================================
+// xTS_PacketBatch
+//=============================================================================================================================================================================
+
+void xTS_PacketBatch::xDecodeScalarRange(int32_t Beg, int32_t End)
+{
+    for(int32_t i = Beg; i < End; i++)
+    {
+        uint32_t H;
+        std::memcpy(&H, m_Span.getPacket(i), sizeof(H));
+        H = xSwapBytes32(H);
+        SB  [i] = (uint8_t )( H >> 24);
+        TEI [i] = (uint8_t )((H >> 23) & 0x1);
+        PUSI[i] = (uint8_t )((H >> 22) & 0x1);
+        PID [i] = (uint16_t)((H >>  8) & 0x1FFF);
+        TSC [i] = (uint8_t )((H >>  6) & 0x3);
+        AFC [i] = (uint8_t )((H >>  4) & 0x3);
+        CC  [i] = (uint8_t )( H        & 0xF);
+    }
+}
+
+int32_t xTS_PacketBatch::Decode(const xTS_PacketSpan& Span)
+{
+    if(xTS_SyncScanner::getISA() == xTS_SyncScanner::eISA::AVX2) { return xDecodeAVX2(Span); }
+    return DecodeScalar(Span);
+}
+
+int32_t xTS_PacketBatch::DecodeScalar(const xTS_PacketSpan& Span)
+{
+    m_Span       = Span;
+    m_NumPackets = std::min(Span.NumPackets, MaxPackets);
+    xDecodeScalarRange(0, m_NumPackets);
+    return m_NumPackets;
+}
+
+#if defined(X_PACKET_BATCH_X86)
+// Narrows the low byte of each of 8 dwords to 8 consecutive bytes.
+X_TARGET_AVX2 static inline void xStore8x8(uint8_t* Dst, __m256i V)
+{
+    const __m256i Shuffle = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i Packed  = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(V, Shuffle), _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+    _mm_storel_epi64((__m128i*)Dst, _mm256_castsi256_si128(Packed));
+}
+
+// Narrows the low word of each of 8 dwords to 8 consecutive words.
+X_TARGET_AVX2 static inline void xStore8x16(uint16_t* Dst, __m256i V)
+{
+    const __m256i Shuffle = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i Packed  = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(V, Shuffle), _mm256_setr_epi32(0, 1, 4, 5, 0, 0, 0, 0));
+    _mm_storeu_si128((__m128i*)Dst, _mm256_castsi256_si128(Packed));
+}
+
+// 8 headers per iteration: gather 4 bytes at packet stride, then extract all fields with shifts/masks on
+// the little-endian dword (b0 = sync, b1 = E|S|T|PID hi, b2 = PID lo, b3 = TSC|AFC|CC).
+X_TARGET_AVX2 static int32_t xDecodeAVX2_Impl(xTS_PacketBatch& B, const xTS_PacketSpan& Span, int32_t NumPackets)
+{
+    const int32_t  Stride  = Span.PacketSize;
+    const __m256i  Offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(Stride));
+    const __m256i  Mask1   = _mm256_set1_epi32(0x1);
+    const __m256i  Mask2   = _mm256_set1_epi32(0x3);
+    const __m256i  Mask4   = _mm256_set1_epi32(0xF);
+    const __m256i  MaskFF  = _mm256_set1_epi32(0xFF);
+    const __m256i  PIDHi   = _mm256_set1_epi32(0x1F00);
+
+    int32_t i = 0;
+    for(; i + 8 <= NumPackets; i += 8)
+    {
+        const int*    Base = (const int*)Span.getPacket(i);
+        const __m256i H    = _mm256_i32gather_epi32(Base, Offsets, 1);
+
+        xStore8x8 (B.SB   + i, _mm256_and_si256(H, MaskFF));
+        xStore8x8 (B.TEI  + i, _mm256_and_si256(_mm256_srli_epi32(H, 15), Mask1));
+        xStore8x8 (B.PUSI + i, _mm256_and_si256(_mm256_srli_epi32(H, 14), Mask1));
+        xStore8x16(B.PID  + i, _mm256_or_si256 (_mm256_and_si256(H, PIDHi), _mm256_and_si256(_mm256_srli_epi32(H, 16), MaskFF)));
+        xStore8x8 (B.TSC  + i, _mm256_and_si256(_mm256_srli_epi32(H, 30), Mask2));
+        xStore8x8 (B.AFC  + i, _mm256_and_si256(_mm256_srli_epi32(H, 28), Mask2));
+        xStore8x8 (B.CC   + i, _mm256_and_si256(_mm256_srli_epi32(H, 24), Mask4));
+    }
+    return i;
+}
+#endif
+
+int32_t xTS_PacketBatch::xDecodeAVX2(const xTS_PacketSpan& Span)
+{
+#if defined(X_PACKET_BATCH_X86)
+    m_Span       = Span;
+    m_NumPackets = std::min(Span.NumPackets, MaxPackets);
+    const int32_t Done = xDecodeAVX2_Impl(*this, Span, m_NumPackets);
+    xDecodeScalarRange(Done, m_NumPackets);
+    return m_NumPackets;
+#else
+    return DecodeScalar(Span);
+#endif
+}
+
+void xTS_PacketBatch::getHeader(int32_t Idx, xTS_PacketHeader& Header) const
+{
+    Header.SB  = SB  [Idx];
+    Header.E   = TEI [Idx];
+    Header.S   = PUSI[Idx];
+    Header.T   = (getPacket(Idx)[1] >> 5) & 0x1; // priority is rarely needed, not kept in SoA
+    Header.PID = PID [Idx];
+    Header.TSC = TSC [Idx];
+    Header.AFC = AFC [Idx];
+    Header.CC  = CC  [Idx];
+}
+
+#if defined(X_PACKET_BATCH_X86)
+X_TARGET_AVX2 static int32_t xFilterPID_AVX2(const uint16_t* PIDs, int32_t NumPackets, uint16_t SelectedPID, int32_t* Indices, int32_t& i)
+{
+    const __m256i Selected = _mm256_set1_epi16((short)SelectedPID);
+    int32_t NumFound = 0;
+    for(i = 0; i + 16 <= NumPackets; i += 16)
+    {
+        const __m256i Eq   = _mm256_cmpeq_epi16(_mm256_load_si256((const __m256i*)(PIDs + i)), Selected);
+        uint32_t      Mask = (uint32_t)_mm256_movemask_epi8(Eq) & 0x55555555u; // one bit per 16-bit lane
+        while(Mask)
+        {
+            Indices[NumFound++] = i + (int32_t)(X_CTZ32(Mask) >> 1);
+            Mask &= Mask - 1;
+        }
+    }
+    return NumFound;
+}
+#endif
+
+int32_t xTS_PacketBatch::FilterPID(uint16_t SelectedPID, int32_t* Indices) const
+{
+    int32_t i        = 0;
+    int32_t NumFound = 0;
+#if defined(X_PACKET_BATCH_X86)
+    if(xTS_SyncScanner::getISA() == xTS_SyncScanner::eISA::AVX2) { NumFound = xFilterPID_AVX2(PID, m_NumPackets, SelectedPID, Indices, i); }
+#endif
+    for(; i < m_NumPackets; i++)
+    {
+        Indices[NumFound] = i;
+        NumFound += PID[i] == SelectedPID;
+    }
+    return NumFound;
+}
+
+uint32_t xTS_PacketBatch::CountCCErrors(int8_t* LastCC) const
+{
+    uint32_t NumErrors = 0;
+    for(int32_t i = 0; i < m_NumPackets; i++)
+    {
+        if(!(AFC[i] & 0x1) || PID[i] == (uint16_t)xTS_PacketHeader::ePID::NuLL) { continue; } // CC does not advance without payload
+        const int8_t Last = LastCC[PID[i]];
+        const int8_t Curr = (int8_t)CC[i];
+        NumErrors += (Last >= 0 && Curr != Last && Curr != ((Last + 1) & 0xF));
+        LastCC[PID[i]] = Curr;
+    }
+    return NumErrors;
+}
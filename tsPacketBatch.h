@@ -0,0 +1,49 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketSource.h"
+
+//=============================================================================================================================================================================
+// xTS_PacketBatch
+//=============================================================================================================================================================================
+
+// Structure-of-arrays view of the headers of a span of packets. Decode() turns thousands of 4-byte headers
+// into flat per-field arrays (AVX2: 8 headers per gather + byte shuffle), so PID filtering, routing and
+// continuity checks become tight loops over contiguous data instead of per-packet object parsing.
+class xTS_PacketBatch
+{
+public:
+  static constexpr int32_t MaxPackets = xTS_PacketSource::DefaultBatchPackets;
+
+  alignas(32) uint16_t PID [MaxPackets];
+  alignas(32) uint8_t  TEI [MaxPackets]; // transport error indicator
+  alignas(32) uint8_t  PUSI[MaxPackets]; // payload unit start indicator
+  alignas(32) uint8_t  TSC [MaxPackets]; // transport scrambling control
+  alignas(32) uint8_t  AFC [MaxPackets]; // adaptation field control
+  alignas(32) uint8_t  CC  [MaxPackets]; // continuity counter
+  alignas(32) uint8_t  SB  [MaxPackets]; // sync byte
+
+public:
+  // Decodes up to MaxPackets headers of Span. Returns number of decoded packets.
+  int32_t Decode       (const xTS_PacketSpan& Span);
+  int32_t DecodeScalar (const xTS_PacketSpan& Span);
+
+  int32_t        getNumPackets() const { return m_NumPackets; }
+  const uint8_t* getPacket    (int32_t Idx) const { return m_Span.getPacket(Idx); }
+  uint64_t       getPacketOffset(int32_t Idx) const { return m_Span.getPacketOffset(Idx); }
+  // Fills the classic per-packet header object from the SoA arrays (no re-parse).
+  void           getHeader    (int32_t Idx, xTS_PacketHeader& Header) const;
+
+  // Writes indices of packets carrying PID to Indices (capacity getNumPackets()). Returns count.
+  int32_t FilterPID(uint16_t SelectedPID, int32_t* Indices) const;
+  // Counts continuity errors, LastCC holds per-PID state across batches (-1 = unknown). Packets without
+  // payload (AFC=2) and duplicates (repeated CC) are not errors, as in ISO/IEC 13818-1 2.4.3.3.
+  uint32_t CountCCErrors(int8_t* LastCC) const;
+
+protected:
+  void    xDecodeScalarRange(int32_t Beg, int32_t End);
+  int32_t xDecodeAVX2       (const xTS_PacketSpan& Span);
+
+  xTS_PacketSpan m_Span;
+  int32_t        m_NumPackets = 0;
+};
@@ -0,0 +1,290 @@
+#include "tsPacketIndex.h"
+#include "tsPacketBatch.h"
+#include "tsCRC32.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+//=============================================================================================================================================================================
+// xTS_PacketIndex
+//=============================================================================================================================================================================
+
+const char* xTS_PacketIndex::StateToString(eState State)
+{
+    switch(State)
+    {
+        case eState::Missing   : return "missing";
+        case eState::Valid     : return "valid";
+        case eState::Appendable: return "appendable";
+        case eState::Invalid   : return "invalid";
+        default                : return "unknown";
+    }
+}
+
+xTS_PacketIndex::eState xTS_PacketIndex::Open(const std::string& IndexFileName, const char* InputFileName)
+{
+    Close();
+    if(!m_Mapping.Open(IndexFileName.c_str())) { return m_State; }
+    const uint8_t*    Data     = m_Mapping.getData();
+    const uint64_t    Size     = m_Mapping.getSize();
+    const xFileHeader Expected;
+    if(Size < sizeof(xFileHeader) || std::memcmp(Data, Expected.Magic, sizeof(Expected.Magic))) { Close(); return m_State; }
+    const xFileHeader* Header = (const xFileHeader*)Data;
+    // every section has to fit and together they have to fill the file exactly
+    if(Header->Version != Expected.Version || Header->NumSegments > Size || Header->NumPIDs > Size || Header->NumRecords > Size || Header->NumEvents > Size ||
+       sizeof(xFileHeader) + Header->NumSegments * sizeof(xSegment) + Header->NumPIDs * sizeof(xPIDInfo) + Header->NumRecords * sizeof(uint32_t) +
+       Header->NumEvents * sizeof(xEvent) != Size)
+    {
+        Close();
+        return m_State;
+    }
+    m_Header   = Header;
+    m_Segments = (const xSegment*)(Data + sizeof(xFileHeader));
+    m_PIDs     = (const xPIDInfo*)(m_Segments + Header->NumSegments);
+    m_Records  = (const uint32_t*)(m_PIDs     + Header->NumPIDs    );
+    m_Events   = (const xEvent*  )(m_Records  + Header->NumRecords );
+    for(uint64_t i = 0; i < Header->NumPIDs; i++)
+    {
+        const xPIDInfo& Info = m_PIDs[i];
+        if(Info.FirstRecord + Info.NumPackets > Header->NumRecords || Info.FirstEvent + Info.NumEvents > Header->NumEvents) { Close(); return m_State; }
+    }
+
+    m_State = eState::Invalid;
+    uint64_t InputSize  = 0;
+    int64_t  InputMTime = 0;
+    if(!xTS_PacketSource::getFileInfo(InputFileName, InputSize, InputMTime)) { return m_State; }
+    if(InputSize == Header->InputSize && InputMTime == Header->InputMTime) { m_State = eState::Valid; return m_State; }
+    if(InputSize <= Header->InputSize) { return m_State; }
+
+    // grown input - the indexed part is taken as unchanged if its last packet still is
+    if(Header->IndexedBytes == 0) { m_State = eState::Appendable; return m_State; }
+    xTS_MappedFileSource Input;
+    if(!Input.Open(InputFileName) || Input.getSize() < Header->IndexedBytes || Header->IndexedBytes < Header->PacketSize) { return m_State; }
+    const uint32_t TailCRC = xTS_CRC32::Calc(Input.getData() + Header->IndexedBytes - Header->PacketSize, Header->PacketSize);
+    if(TailCRC == Header->TailCRC) { m_State = eState::Appendable; }
+    return m_State;
+}
+
+void xTS_PacketIndex::Close()
+{
+    m_Mapping.Close();
+    m_State    = eState::Missing;
+    m_Header   = nullptr;
+    m_Segments = nullptr;
+    m_PIDs     = nullptr;
+    m_Records  = nullptr;
+    m_Events   = nullptr;
+}
+
+/**
+ * @brief Build or extend the sidecar
+ * A Valid index is kept as it is. An Appendable one is loaded and only the bytes past IndexedBytes are scanned - packet
+ * numbering, segments and continuity state carry on. Anything else is rebuilt from the start of the input. The new
+ * sidecar is written next to the old one and renamed over it, so concurrent readers never map a half-written file.
+ */
+bool xTS_PacketIndex::Update(const std::string& IndexFileName, const char* InputFileName, uint64_t* NumScannedBytes)
+{
+    if(NumScannedBytes) { *NumScannedBytes = 0; }
+    const eState State = Open(IndexFileName, InputFileName);
+    if(State == eState::Valid) { return true; }
+
+    std::vector<xBuildPID> PIDs(8192);
+    std::vector<xSegment>  Segments;
+    xFileHeader            Header;
+    if(State == eState::Appendable)
+    {
+        Header = *m_Header;
+        xLoad(PIDs, Segments);
+    }
+    Close();
+
+    // modification time first - a write racing with the scan makes the next Open() see a changed input
+    uint64_t InputSize = 0;
+    if(!xTS_PacketSource::getFileInfo(InputFileName, InputSize, Header.InputMTime)) { return false; }
+    xTS_MappedFileSource Source;
+    if(!Source.Open(InputFileName)) { return false; }
+    if(Header.IndexedBytes > 0) { Source.Seek(Header.IndexedBytes); }
+
+    std::unique_ptr<xTS_PacketBatch> Batch = std::make_unique<xTS_PacketBatch>();
+    xTS_PacketSpan Span;
+    uint64_t NextOffset   = Header.IndexedBytes;
+    uint64_t PacketNumber = Header.NumPackets;
+    int32_t  NumPackets   = 0;
+    while((NumPackets = Source.ReadSpan(Span)) > 0)
+    {
+        if(PacketNumber + (uint64_t)NumPackets > MaxPackets) { return false; }
+        if(Segments.empty() || Span.Offset != NextOffset) { Segments.push_back({ PacketNumber, Span.Offset }); }
+        Batch->Decode(Span);
+        for(int32_t i = 0; i < NumPackets; i++)
+        {
+            const uint16_t PID = Batch->PID[i];
+            if(PID == (uint16_t)xTS_PacketHeader::ePID::NuLL) { continue; }
+            xBuildPID& Build  = PIDs[PID];
+            const uint32_t Packet = (uint32_t)(PacketNumber + (uint64_t)i);
+            Build.Packets.push_back(Packet);
+
+            uint8_t Flags = Batch->PUSI[i] ? eEventFlags::PUSI : 0;
+            const uint8_t* Raw = Batch->getPacket(i);
+            if((Batch->AFC[i] & 0x2) && Raw[4] > 0)
+            {
+                if(Raw[5] & 0x40) { Flags |= eEventFlags::RandomAccess;  }
+                if(Raw[5] & 0x80) { Flags |= eEventFlags::Discontinuity; }
+            }
+            // as xTS_PacketBatch::CountCCErrors - no payload and repeated CC are fine, a signalled discontinuity as well
+            if(Batch->AFC[i] & 0x1)
+            {
+                const uint8_t CC = Batch->CC[i];
+                if(Build.LastCC >= 0 && !(Flags & eEventFlags::Discontinuity) && CC != (uint8_t)Build.LastCC && CC != ((Build.LastCC + 1) & 0xF)) { Flags |= eEventFlags::CCError; }
+                Build.LastCC = (int8_t)CC;
+            }
+            if(!Flags) { continue; }
+            Build.Events.push_back({ Packet, Flags, { 0, 0, 0 } });
+            if(Flags & eEventFlags::PUSI         ) { Build.Info.NumPUSI++;            }
+            if(Flags & eEventFlags::RandomAccess ) { Build.Info.NumRandomAccess++;    }
+            if(Flags & eEventFlags::Discontinuity) { Build.Info.NumDiscontinuities++; }
+            if(Flags & eEventFlags::CCError      ) { Build.Info.NumCCErrors++;        }
+        }
+        PacketNumber += (uint64_t)NumPackets;
+        NextOffset    = Span.Offset + (uint64_t)NumPackets * Span.PacketSize;
+    }
+    if(NumPackets < 0) { return false; }
+    if(NumScannedBytes) { *NumScannedBytes = Source.getSize() - Header.IndexedBytes; }
+
+    if(PacketNumber > Header.NumPackets)
+    {
+        Header.PacketSize   = (uint16_t)Source.getFormat().PacketSize;
+        Header.SyncOffset   = (uint32_t)Source.getFormat().SyncOffset;
+        Header.IndexedBytes = NextOffset;
+        Header.TailCRC      = xTS_CRC32::Calc(Source.getData() + NextOffset - Header.PacketSize, Header.PacketSize);
+    }
+    Header.InputSize  = Source.getSize();
+    Header.NumPackets = PacketNumber;
+    Source.Close();
+
+    const std::string TempFileName = IndexFileName + ".tmp";
+    if(!xWrite(TempFileName, Header, Segments, PIDs)) { std::remove(TempFileName.c_str()); return false; }
+    std::error_code Error;
+    std::filesystem::rename(TempFileName, IndexFileName, Error);
+    if(Error) { std::remove(TempFileName.c_str()); return false; }
+    return Open(IndexFileName, InputFileName) == eState::Valid;
+}
+
+bool xTS_PacketIndex::xLoad(std::vector<xBuildPID>& PIDs, std::vector<xSegment>& Segments) const
+{
+    Segments.assign(m_Segments, m_Segments + m_Header->NumSegments);
+    for(uint64_t i = 0; i < m_Header->NumPIDs; i++)
+    {
+        const xPIDInfo& Info  = m_PIDs[i];
+        xBuildPID&      Build = PIDs[Info.PID & 0x1FFF];
+        Build.Info   = Info;
+        Build.LastCC = Info.LastCC;
+        Build.Packets.assign(getPackets(Info), getPackets(Info) + Info.NumPackets);
+        Build.Events .assign(getEvents (Info), getEvents (Info) + Info.NumEvents );
+    }
+    return true;
+}
+
+bool xTS_PacketIndex::xWrite(const std::string& FileName, const xFileHeader& Header, const std::vector<xSegment>& Segments, const std::vector<xBuildPID>& PIDs) const
+{
+    xFileHeader FileHeader = Header;
+    std::vector<xPIDInfo> Infos;
+    FileHeader.NumRecords = 0;
+    FileHeader.NumEvents  = 0;
+    for(int32_t PID = 0; PID < (int32_t)PIDs.size(); PID++)
+    {
+        const xBuildPID& Build = PIDs[PID];
+        if(Build.Packets.empty()) { continue; }
+        xPIDInfo Info    = Build.Info;
+        Info.PID         = (uint16_t)PID;
+        Info.LastCC      = Build.LastCC;
+        Info.FirstRecord = FileHeader.NumRecords;
+        Info.NumPackets  = Build.Packets.size();
+        Info.FirstEvent  = FileHeader.NumEvents;
+        Info.NumEvents   = Build.Events.size();
+        std::memset(Info.Reserved, 0, sizeof(Info.Reserved));
+        FileHeader.NumRecords += Info.NumPackets;
+        FileHeader.NumEvents  += Info.NumEvents;
+        Infos.push_back(Info);
+    }
+    FileHeader.NumSegments = Segments.size();
+    FileHeader.NumPIDs     = Infos.size();
+
+    FILE* File = std::fopen(FileName.c_str(), "wb");
+    if(!File) { return false; }
+    bool Ok = std::fwrite(&FileHeader, sizeof(FileHeader), 1, File) == 1;
+    Ok = Ok && (Segments.empty() || std::fwrite(Segments.data(), sizeof(xSegment), Segments.size(), File) == Segments.size());
+    Ok = Ok && (Infos   .empty() || std::fwrite(Infos   .data(), sizeof(xPIDInfo), Infos   .size(), File) == Infos   .size());
+    for(const xBuildPID& Build : PIDs)
+    {
+        if(Ok && !Build.Packets.empty()) { Ok = std::fwrite(Build.Packets.data(), sizeof(uint32_t), Build.Packets.size(), File) == Build.Packets.size(); }
+    }
+    for(const xBuildPID& Build : PIDs)
+    {
+        if(Ok && !Build.Packets.empty() && !Build.Events.empty()) { Ok = std::fwrite(Build.Events.data(), sizeof(xEvent), Build.Events.size(), File) == Build.Events.size(); }
+    }
+    Ok &= std::fclose(File) == 0;
+    return Ok;
+}
+
+const xTS_PacketIndex::xPIDInfo* xTS_PacketIndex::getPID(int32_t PID) const
+{
+    const xPIDInfo* End  = m_PIDs + m_Header->NumPIDs;
+    const xPIDInfo* Info = std::lower_bound(m_PIDs, End, PID, [](const xPIDInfo& A, int32_t B) { return (int32_t)A.PID < B; });
+    return (Info != End && Info->PID == PID) ? Info : nullptr;
+}
+
+uint64_t xTS_PacketIndex::getPacketOffset(uint64_t Packet) const
+{
+    const xSegment* End     = m_Segments + m_Header->NumSegments;
+    const xSegment* Segment = std::upper_bound(m_Segments, End, Packet, [](uint64_t A, const xSegment& B) { return A < B.FirstPacket; }) - 1;
+    return Segment->Offset + (Packet - Segment->FirstPacket) * m_Header->PacketSize;
+}
+
+uint64_t xTS_PacketIndex::FindStart(const xPIDInfo& Info, uint64_t Offset) const
+{
+    const uint32_t* Packets = getPackets(Info);
+    const uint32_t* Target  = std::lower_bound(Packets, Packets + Info.NumPackets, Offset, [this](uint32_t A, uint64_t B) { return getPacketOffset(A) < B; });
+    if(Target == Packets + Info.NumPackets) { return Info.NumPackets; }
+
+    const uint8_t Wanted = Info.NumRandomAccess ? eEventFlags::RandomAccess : eEventFlags::PUSI;
+    const xEvent* Events = getEvents(Info);
+    const xEvent* Event  = std::upper_bound(Events, Events + Info.NumEvents, *Target, [](uint32_t A, const xEvent& B) { return A < B.Packet; });
+    while(Event != Events)
+    {
+        --Event;
+        if(Event->Flags & Wanted) { return (uint64_t)(std::lower_bound(Packets, Target, Event->Packet) - Packets); }
+    }
+    return (uint64_t)(Target - Packets);
+}
+
+void xTS_PacketIndex::ForEachPacket(const std::vector<int32_t>& PIDs, uint64_t StartOffset, const std::function<void(int32_t PID, uint64_t Offset)>& Callback) const
+{
+    struct xCursor
+    {
+        int32_t         PID;
+        const uint32_t* Pos;
+        const uint32_t* End;
+    };
+    std::vector<xCursor> Cursors;
+    for(int32_t PID : PIDs)
+    {
+        const xPIDInfo* Info = getPID(PID);
+        if(!Info || Info->NumPackets == 0) { continue; }
+        const uint32_t* Packets = getPackets(*Info);
+        Cursors.push_back({ PID, Packets + FindStart(*Info, StartOffset), Packets + Info->NumPackets });
+    }
+
+    // a handful of PIDs - the smallest packet number is picked by a linear pass, segments are walked forward
+    uint64_t Segment = 0;
+    while(true)
+    {
+        xCursor* Next = nullptr;
+        for(xCursor& Cursor : Cursors) { if(Cursor.Pos != Cursor.End && (!Next || *Cursor.Pos < *Next->Pos)) { Next = &Cursor; } }
+        if(!Next) { break; }
+        const uint64_t Packet = *Next->Pos++;
+        while(Segment + 1 < m_Header->NumSegments && m_Segments[Segment + 1].FirstPacket <= Packet) { Segment++; }
+        Callback(Next->PID, m_Segments[Segment].Offset + (Packet - m_Segments[Segment].FirstPacket) * m_Header->PacketSize);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsPacketSource.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_PacketIndex
+//=============================================================================================================================================================================
+
+// Persistent packet index <input>.tsidx - for every PID the numbers of its packets and the positions of payload unit
+// starts, random access points (RA, e.g. key frames), discontinuity indicators and continuity errors. The sidecar is
+// memory-mapped on open and queried in place, so listing the streams of a multi-GB recording or extracting one PID
+// (only its packets are touched) starts without a scan. Packets are numbered in input order, a segment table maps
+// numbers to byte offsets across sync losses. Null packets are counted but not listed.
+// The index is valid while size and modification time of the input match. A grown input whose last indexed packet is
+// unchanged (recording in progress) is extended by scanning only the new bytes.
+class xTS_PacketIndex
+{
+public:
+  static constexpr uint32_t MaxPackets = UINT32_MAX; // packet numbers are 32 bit - about 750 GB of input
+
+  enum class eState : int32_t
+  {
+    Missing,    // no sidecar or not an index
+    Valid,      // covers the input as it is
+    Appendable, // input grew since, the indexed part is unchanged
+    Invalid,    // input changed, index has to be rebuilt
+  };
+
+  enum eEventFlags : uint8_t
+  {
+    PUSI          = 0x01,
+    RandomAccess  = 0x02,
+    Discontinuity = 0x04, // discontinuity_indicator
+    CCError       = 0x08,
+  };
+
+#pragma pack(push, 1)
+  struct xFileHeader
+  {
+    char     Magic[4]     = { 'T', 'S', 'P', 'X' };
+    uint16_t Version      = 1;
+    uint16_t PacketSize   = 0;
+    uint32_t SyncOffset   = 0;
+    uint32_t TailCRC      = 0; // CRC32 of the last indexed packet - detects a rewritten input on append
+    uint64_t IndexedBytes = 0; // input bytes covered, up to the end of the last complete packet
+    uint64_t InputSize    = 0;
+    int64_t  InputMTime   = 0;
+    uint64_t NumPackets   = 0; // including null packets
+    uint64_t NumSegments  = 0;
+    uint64_t NumPIDs      = 0;
+    uint64_t NumRecords   = 0; // packet numbers of all PIDs
+    uint64_t NumEvents    = 0;
+  };
+
+  struct xSegment // packets FirstPacket.. are contiguous from Offset on
+  {
+    uint64_t FirstPacket;
+    uint64_t Offset;
+  };
+
+  struct xPIDInfo
+  {
+    uint16_t PID;
+    int8_t   LastCC;       // continuity state for append
+    uint8_t  Reserved[5];
+    uint64_t FirstRecord;  // first packet number of the PID in the record array
+    uint64_t NumPackets;
+    uint64_t FirstEvent;
+    uint64_t NumEvents;
+    uint64_t NumPUSI;
+    uint64_t NumRandomAccess;
+    uint64_t NumDiscontinuities;
+    uint64_t NumCCErrors;
+  };
+
+  struct xEvent
+  {
+    uint32_t Packet; // packet number
+    uint8_t  Flags;  // eEventFlags
+    uint8_t  Reserved[3];
+  };
+#pragma pack(pop)
+
+public:
+  ~xTS_PacketIndex() { Close(); }
+
+  static std::string SidecarName  (const char* InputFileName) { return std::string(InputFileName) + ".tsidx"; }
+  static const char* StateToString(eState State);
+
+  // Maps the sidecar and checks it against the input. The index is usable for queries in state Valid only.
+  eState Open (const std::string& IndexFileName, const char* InputFileName);
+  void   Close();
+  // Builds the sidecar, or extends it if the input only grew. Leaves the index open and Valid. NumScannedBytes
+  // receives the number of input bytes read. Returns false on I/O errors or inputs beyond MaxPackets.
+  bool   Update(const std::string& IndexFileName, const char* InputFileName, uint64_t* NumScannedBytes = nullptr);
+
+  bool               isValid     () const { return m_State == eState::Valid; }
+  const xFileHeader& getHeader   () const { return *m_Header; }
+  uint64_t           getNumPIDs  () const { return m_Header->NumPIDs; }
+  const xPIDInfo*    getPIDs     () const { return m_PIDs; } // ordered by PID
+  const xPIDInfo*    getPID      (int32_t PID) const;
+  const uint32_t*    getPackets  (const xPIDInfo& Info) const { return m_Records + Info.FirstRecord; }
+  const xEvent*      getEvents   (const xPIDInfo& Info) const { return m_Events  + Info.FirstEvent; }
+
+  uint64_t getPacketOffset(uint64_t Packet) const;
+  // Position in the packet list of the PID where decoding starts for output at or after byte Offset: its last random
+  // access point at or before Offset, the last payload unit start if the PID signals none, else the first packet past Offset.
+  uint64_t FindStart      (const xPIDInfo& Info, uint64_t Offset) const;
+  // Calls Callback with the byte offset of every packet of PIDs in input order, each PID from FindStart(StartOffset)
+  // on. PIDs missing from the index are skipped.
+  void     ForEachPacket  (const std::vector<int32_t>& PIDs, uint64_t StartOffset, const std::function<void(int32_t PID, uint64_t Offset)>& Callback) const;
+
+protected:
+  struct xBuildPID
+  {
+    int8_t                LastCC = -1;
+    std::vector<uint32_t> Packets;
+    std::vector<xEvent>   Events;
+    xPIDInfo              Info   = {};
+  };
+
+  bool xLoad (std::vector<xBuildPID>& PIDs, std::vector<xSegment>& Segments) const;
+  bool xWrite(const std::string& FileName, const xFileHeader& Header, const std::vector<xSegment>& Segments, const std::vector<xBuildPID>& PIDs) const;
+
+  xTS_MappedFileSource m_Mapping; // sidecar mapping - only used as a read-only view, no packet parsing
+  eState               m_State    = eState::Missing;
+  const xFileHeader*   m_Header   = nullptr;
+  const xSegment*      m_Segments = nullptr;
+  const xPIDInfo*      m_PIDs     = nullptr;
+  const uint32_t*      m_Records  = nullptr;
+  const xEvent*        m_Events   = nullptr;
+};
@@ -0,0 +1,758 @@
+#include "tsPacketSource.h"
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_PacketSource
+//=============================================================================================================================================================================
+
+std::unique_ptr<xTS_PacketSource> xTS_PacketSource::Create(eType Type)
+{
+    switch(Type)
+    {
+        case eType::Mapped  : return std::make_unique<xTS_MappedFileSource  >();
+        case eType::Buffered: return std::make_unique<xTS_BufferedFileSource>();
+        case eType::Stream  : return std::make_unique<xTS_StreamSource      >();
+        case eType::UDP     : return std::make_unique<xTS_UDPSource         >();
+        default: return nullptr;
+    }
+}
+
+const char* xTS_PacketSource::TypeToString(eType Type)
+{
+    switch(Type)
+    {
+        case eType::Mapped  : return "mmap";
+        case eType::Buffered: return "buffered";
+        case eType::Stream  : return "stream";
+        case eType::UDP     : return "udp";
+        default: return "unknown";
+    }
+}
+
+xTS_PacketSource::eType xTS_PacketSource::TypeForInput(const char* Input, eType FileType)
+{
+    if(!std::strcmp(Input, "-")) { return eType::Stream; }
+    if(!std::strncmp(Input, "udp://", 6) || !std::strncmp(Input, "rtp://", 6)) { return eType::UDP; }
+    return FileType;
+}
+
+bool xTS_PacketSource::getFileInfo(const char* FileName, uint64_t& Size, int64_t& MTime)
+{
+    std::error_code Error;
+    Size  = (uint64_t)std::filesystem::file_size(FileName, Error);
+    if(Error) { return false; }
+    MTime = (int64_t)std::filesystem::last_write_time(FileName, Error).time_since_epoch().count();
+    return !Error;
+}
+
+void xTS_PacketSource::xResetSync()
+{
+    m_Format          = xTS_SyncScanner::xFormat();
+    m_Locked          = false;
+    m_NumSkippedBytes = 0;
+    m_NumSyncLosses   = 0;
+}
+
+/**
+ * @brief Find the next run of packets in sync
+ * @param Window     unconsumed input
+ * @param AtEnd      no data follows Window
+ * @param Skip       [out] bytes to drop before the run (garbage or trailing bytes of a broken packet)
+ * @return number of packets in the run, 0 if more data is needed (or, with AtEnd, the input is exhausted)
+ * A packet is accepted only if the sync byte of the following packet is in place too, so a packet
+ * truncated by a dropped byte is discarded instead of being passed on with the next packet's head.
+ */
+int32_t xTS_PacketSource::xFindRun(const uint8_t* Window, size_t Size, bool AtEnd, int32_t MaxPackets, size_t& Skip)
+{
+    Skip = 0;
+    while(true)
+    {
+        if(!m_Locked)
+        {
+            const uint8_t* Data     = Window + Skip;
+            const size_t   DataSize = Size   - Skip;
+            int32_t NumCheck = xTS_SyncScanner::NumLockPackets;
+            int64_t SyncPos  = xTS_SyncScanner::DetectFormat(Data, DataSize, NumCheck, m_Format, m_Format.PacketSize);
+            // close to the end of input there may be fewer packets than required for a regular lock
+            while(SyncPos < 0 && AtEnd && --NumCheck >= 1)
+            {
+                if(NumCheck == 1 && DataSize >= 2 * (size_t)xTS_SyncScanner::PacketSize_TS) { break; }
+                SyncPos = xTS_SyncScanner::DetectFormat(Data, DataSize, NumCheck, m_Format, m_Format.PacketSize);
+            }
+            if(SyncPos < 0)
+            {
+                // keep the tail - the beginning of a lock may be split between reads
+                const size_t Drop = AtEnd ? DataSize : (DataSize > LockWindowSize ? DataSize - LockWindowSize : 0);
+                Skip              += Drop;
+                m_NumSkippedBytes += Drop;
+                return 0;
+            }
+            if(SyncPos < m_Format.SyncOffset) { SyncPos += m_Format.PacketSize; } // M2TS header would start before the window
+            Skip              += (size_t)SyncPos - m_Format.SyncOffset;
+            m_NumSkippedBytes += (size_t)SyncPos - m_Format.SyncOffset;
+            m_Locked           = true;
+        }
+
+        const uint8_t* Run        = Window + Skip;
+        const size_t   RunSize    = Size   - Skip;
+        const size_t   PacketSize = (size_t)m_Format.PacketSize;
+        const size_t   SyncOffset = (size_t)m_Format.SyncOffset;
+        int32_t NumPackets = 0;
+        while(NumPackets < MaxPackets)
+        {
+            const size_t PacketPos = (size_t)NumPackets * PacketSize;
+            if(PacketPos + PacketSize > RunSize || Run[PacketPos + SyncOffset] != xTS_SyncScanner::SyncByte) { break; }
+            const size_t NextSync = PacketPos + PacketSize + SyncOffset;
+            if(PacketPos + 2 * PacketSize > RunSize)
+            {
+                // next packet incomplete - at the end of input the trailing bytes cannot be judged, accept
+                if(!AtEnd && NextSync >= RunSize) { break; }
+                if(!AtEnd && Run[NextSync] != xTS_SyncScanner::SyncByte) { break; }
+            }
+            else if(Run[NextSync] != xTS_SyncScanner::SyncByte) { break; }
+            NumPackets++;
+        }
+        if(NumPackets > 0) { return NumPackets; }
+
+        if(RunSize < PacketSize) { return 0; } // wait for more data, or trailing bytes at the end of input
+        if(!AtEnd && Run[SyncOffset] == xTS_SyncScanner::SyncByte && PacketSize + SyncOffset >= RunSize) { return 0; } // next sync not read yet
+
+        // lock lost - rescan starting right after the broken packet's sync position
+        m_Locked = false;
+        m_NumSyncLosses++;
+        Skip              += 1;
+        m_NumSkippedBytes += 1;
+    }
+}
+
+//=============================================================================================================================================================================
+// xTS_MappedFileSource
+//=============================================================================================================================================================================
+
+/**
+ * @brief Map the whole input file read-only
+ * @param FileName path to TS file
+ * @return true on success
+ */
+bool xTS_MappedFileSource::Open(const char* FileName)
+{
+    Close();
+#if defined(_WIN32)
+    HANDLE File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(File == INVALID_HANDLE_VALUE) { return false; }
+    LARGE_INTEGER Size;
+    if(!GetFileSizeEx(File, &Size)) { CloseHandle(File); return false; }
+    m_File = File;
+    m_Size = (uint64_t)Size.QuadPart;
+    if(m_Size > 0)
+    {
+        m_Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(m_Mapping == nullptr) { Close(); return false; }
+        m_Data = (const uint8_t*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+        if(m_Data == nullptr) { Close(); return false; }
+    }
+#else
+    m_FD = ::open(FileName, O_RDONLY);
+    if(m_FD < 0) { return false; }
+    struct stat St;
+    if(fstat(m_FD, &St) != 0) { Close(); return false; }
+    m_Size = (uint64_t)St.st_size;
+    if(m_Size > 0)
+    {
+        void* Ptr = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_FD, 0);
+        if(Ptr == MAP_FAILED) { Close(); return false; }
+        m_Data = (const uint8_t*)Ptr;
+        // sequential scan - let the kernel read ahead aggressively and drop pages behind us
+        madvise(Ptr, m_Size, MADV_SEQUENTIAL);
+    }
+#endif
+    m_Pos           = 0;
+    m_EOF           = false;
+    m_NumBytesRead  = 0;
+    m_TrailingBytes = 0;
+    xResetSync();
+    return true;
+}
+
+void xTS_MappedFileSource::Close()
+{
+#if defined(_WIN32)
+    if(m_Data   ) { UnmapViewOfFile(m_Data); }
+    if(m_Mapping) { CloseHandle((HANDLE)m_Mapping); }
+    if(m_File   ) { CloseHandle((HANDLE)m_File   ); }
+    m_Mapping = nullptr;
+    m_File    = nullptr;
+#else
+    if(m_Data   ) { munmap((void*)m_Data, m_Size); }
+    if(m_FD >= 0) { ::close(m_FD); }
+    m_FD = -1;
+#endif
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Pos  = 0;
+}
+
+bool xTS_MappedFileSource::Seek(uint64_t Offset)
+{
+    if(Offset > m_Size) { return false; }
+    m_Pos           = Offset;
+    m_EOF           = false;
+    m_NumBytesRead  = Offset;
+    m_TrailingBytes = 0;
+    const xTS_SyncScanner::xFormat Format = m_Format;
+    xResetSync();
+    m_Format = Format; // keep the detected packet size as preferred one for relocking
+    return true;
+}
+
+int32_t xTS_MappedFileSource::ReadSpan(xTS_PacketSpan& Span, int32_t MaxPackets)
+{
+    size_t  Skip       = 0;
+    const int32_t NumPackets = xFindRun(m_Data + m_Pos, (size_t)(m_Size - m_Pos), true, MaxPackets, Skip);
+    m_Pos += Skip;
+
+    Span.Data       = m_Data + m_Pos;
+    Span.NumPackets = NumPackets;
+    Span.PacketSize = m_Format.PacketSize;
+    Span.SyncOffset = m_Format.SyncOffset;
+    Span.Offset     = m_Pos;
+
+    m_Pos          += (uint64_t)NumPackets * m_Format.PacketSize;
+    m_NumBytesRead  = m_Pos;
+    if(NumPackets == 0)
+    {
+        m_EOF           = true;
+        m_TrailingBytes = m_Size - m_Pos;
+    }
+    return NumPackets;
+}
+
+//=============================================================================================================================================================================
+// xTS_BufferedFileSource
+//=============================================================================================================================================================================
+
+xTS_BufferedFileSource::xTS_BufferedFileSource(int32_t BlockPackets)
+{
+    m_Buffer.resize((size_t)std::max(BlockPackets, 1) * xTS::TS_PacketLength);
+}
+
+bool xTS_BufferedFileSource::Open(const char* FileName)
+{
+    Close();
+    m_File = std::fopen(FileName, "rb");
+    if(!m_File) { return false; }
+    // we do our own blocking - stdio buffering would only add a second copy
+    std::setvbuf(m_File, nullptr, _IONBF, 0);
+    xResetBuffer();
+    return true;
+}
+
+void xTS_BufferedFileSource::xResetBuffer()
+{
+    m_BufferBeg     = 0;
+    m_BufferEnd     = 0;
+    m_BufferOffset  = 0;
+    m_FileEOF       = false;
+    m_Error         = false;
+    m_EOF           = false;
+    m_NumBytesRead  = 0;
+    m_TrailingBytes = 0;
+    xResetSync();
+}
+
+void xTS_BufferedFileSource::Close()
+{
+    if(m_File) { std::fclose(m_File); }
+    m_File = nullptr;
+}
+
+// Moves the unconsumed tail (partial packet) to the front and tops the buffer up with one large read.
+bool xTS_BufferedFileSource::xFillBuffer()
+{
+    const size_t Remaining = m_BufferEnd - m_BufferBeg;
+    if(Remaining && m_BufferBeg) { std::memmove(m_Buffer.data(), m_Buffer.data() + m_BufferBeg, Remaining); }
+    m_BufferOffset += m_BufferBeg;
+    m_BufferBeg     = 0;
+    m_BufferEnd     = Remaining;
+
+    const int64_t ReadBytes = xRead(m_Buffer.data() + m_BufferEnd, m_Buffer.size() - m_BufferEnd);
+    if(ReadBytes < 0) { m_Error = true; m_FileEOF = true; return false; }
+    if(ReadBytes == 0) { m_FileEOF = true; }
+    m_BufferEnd    += (size_t)ReadBytes;
+    m_NumBytesRead += (uint64_t)ReadBytes;
+    return ReadBytes > 0;
+}
+
+int64_t xTS_BufferedFileSource::xRead(uint8_t* Data, size_t Size)
+{
+    const size_t ReadBytes = std::fread(Data, 1, Size, m_File);
+    if(std::ferror(m_File)) { return -1; }
+    if(std::feof(m_File)) { m_FileEOF = true; } // saves one more read just to see the end
+    return (int64_t)ReadBytes;
+}
+
+int32_t xTS_BufferedFileSource::ReadSpan(xTS_PacketSpan& Span, int32_t MaxPackets)
+{
+    Span.NumPackets = 0;
+    if(!xIsOpen() || m_Error) { return -1; }
+
+    while(true)
+    {
+        if(!m_FileEOF && m_BufferEnd - m_BufferBeg < LockWindowSize)
+        {
+            xFillBuffer();
+            if(m_Error) { return -1; }
+        }
+
+        size_t Skip = 0;
+        const int32_t NumPackets = xFindRun(m_Buffer.data() + m_BufferBeg, m_BufferEnd - m_BufferBeg, m_FileEOF, MaxPackets, Skip);
+        m_BufferBeg += Skip;
+
+        if(NumPackets > 0)
+        {
+            Span.Data       = m_Buffer.data() + m_BufferBeg;
+            Span.NumPackets = NumPackets;
+            Span.PacketSize = m_Format.PacketSize;
+            Span.SyncOffset = m_Format.SyncOffset;
+            Span.Offset     = m_BufferOffset + m_BufferBeg;
+            m_BufferBeg    += (size_t)NumPackets * m_Format.PacketSize;
+            return NumPackets;
+        }
+        if(m_FileEOF)
+        {
+            m_EOF           = true;
+            m_TrailingBytes = m_BufferEnd - m_BufferBeg;
+            return 0;
+        }
+        // run needs bytes beyond the current block
+        xFillBuffer();
+        if(m_Error) { return -1; }
+    }
+}
+
+//=============================================================================================================================================================================
+// xTS_StreamSource
+//=============================================================================================================================================================================
+
+bool xTS_StreamSource::Open(const char* FileName)
+{
+    Close();
+    if(!std::strcmp(FileName, "-"))
+    {
+#if defined(_WIN32)
+        _setmode(0, _O_BINARY);
+#endif
+        m_FD      = 0;
+        m_OwnedFD = false;
+    }
+    else
+    {
+#if defined(_WIN32)
+        m_FD = _open(FileName, _O_RDONLY | _O_BINARY);
+#else
+        m_FD = ::open(FileName, O_RDONLY); // blocks until a writer opens a FIFO
+#endif
+        if(m_FD < 0) { return false; }
+        m_OwnedFD = true;
+    }
+    xResetBuffer();
+    return true;
+}
+
+void xTS_StreamSource::Close()
+{
+#if defined(_WIN32)
+    if(m_FD >= 0 && m_OwnedFD) { _close(m_FD); }
+#else
+    if(m_FD >= 0 && m_OwnedFD) { ::close(m_FD); }
+#endif
+    m_FD      = -1;
+    m_OwnedFD = false;
+}
+
+int64_t xTS_StreamSource::xRead(uint8_t* Data, size_t Size)
+{
+#if defined(_WIN32)
+    return (int64_t)_read(m_FD, Data, (unsigned)std::min(Size, (size_t)INT32_MAX));
+#else
+    while(true)
+    {
+        const ssize_t ReadBytes = ::read(m_FD, Data, Size);
+        if(ReadBytes >= 0 || errno != EINTR) { return (int64_t)ReadBytes; }
+    }
+#endif
+}
+
+//=============================================================================================================================================================================
+// xTS_FollowSource
+//=============================================================================================================================================================================
+
+bool xTS_FollowSource::Open(const char* FileName)
+{
+    Close();
+    if(!std::strcmp(FileName, "-") || !xTS_StreamSource::Open(FileName)) { return false; }
+    m_Idle_ms  = 0;
+    m_Gone     = false;
+    m_NumWaits = 0;
+#if defined(__linux__)
+    // watched before the first read - growth from then on is never missed. Unlinking shows as IN_ATTRIB: the open
+    // file keeps the inode, IN_DELETE_SELF would come only after Close().
+    m_Notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_Notify >= 0 && inotify_add_watch(m_Notify, FileName, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0)
+    {
+        ::close(m_Notify); // no inotify for this file system - polling
+        m_Notify = -1;
+    }
+#endif
+    return true;
+}
+
+void xTS_FollowSource::Close()
+{
+#if defined(__linux__)
+    if(m_Notify >= 0) { ::close(m_Notify); }
+#endif
+    m_Notify = -1;
+    xTS_StreamSource::Close();
+}
+
+bool xTS_FollowSource::Seek(uint64_t Offset)
+{
+    if(m_FD < 0) { return false; }
+#if defined(_WIN32)
+    if(_lseeki64(m_FD, (__int64)Offset, SEEK_SET) < 0) { return false; }
+#else
+    if(::lseek(m_FD, (off_t)Offset, SEEK_SET) < 0) { return false; }
+#endif
+    xResetBuffer();
+    m_BufferOffset = Offset; // spans keep absolute input offsets
+    return true;
+}
+
+int64_t xTS_FollowSource::xRead(uint8_t* Data, size_t Size)
+{
+    while(true)
+    {
+        const int64_t ReadBytes = xTS_StreamSource::xRead(Data, Size);
+        if(ReadBytes != 0) { m_Idle_ms = 0; return ReadBytes; }
+        // a file gone away is read to its end once more - its last write may have come with the event
+        if(m_Gone) { return 0; }
+        if(m_OnIdle) { m_OnIdle(); }
+        if(!xWait()) { return 0; }
+    }
+}
+
+// Waits PollInterval_ms at most, so OnIdle comes again in between - e.g. to save a checkpoint it deferred.
+bool xTS_FollowSource::xWait()
+{
+    if(m_TimeoutMs > 0 && m_Idle_ms >= m_TimeoutMs) { return false; }
+    const int32_t Wait = m_TimeoutMs > 0 ? (int32_t)std::min<int64_t>(PollInterval_ms, m_TimeoutMs - m_Idle_ms) : PollInterval_ms;
+    m_NumWaits++;
+#if defined(__linux__)
+    if(m_Notify >= 0)
+    {
+        pollfd Poll = {};
+        Poll.fd     = m_Notify;
+        Poll.events = POLLIN;
+        const int Ready = ::poll(&Poll, 1, Wait);
+        if(Ready == 0) { m_Idle_ms += Wait; return true; }
+        if(Ready <  0) { return errno == EINTR; }
+        // drain the queue - events of writes that were read already cost one empty read at most
+        alignas(inotify_event) uint8_t Events[4096];
+        ssize_t Size = 0;
+        while((Size = ::read(m_Notify, Events, sizeof(Events))) > 0)
+        {
+            for(ssize_t Pos = 0; Pos < Size; )
+            {
+                const inotify_event* Event = (const inotify_event*)(Events + Pos);
+                if(Event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) { m_Gone = true; }
+                if(Event->mask & IN_ATTRIB)
+                {
+                    struct stat Stat;
+                    if(::fstat(m_FD, &Stat) == 0 && Stat.st_nlink == 0) { m_Gone = true; }
+                }
+                Pos += (ssize_t)sizeof(inotify_event) + Event->len;
+            }
+        }
+        return true;
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::milliseconds(Wait));
+    m_Idle_ms += Wait;
+    return true;
+}
+
+//=============================================================================================================================================================================
+// xTS_UDPSource
+//=============================================================================================================================================================================
+
+/**
+ * @brief Split "udp://[address]:port" into host and port
+ * @return false if the port is missing or out of range
+ */
+bool xTS_UDPSource::ParseAddress(const char* Address, std::string& Host, uint16_t& Port)
+{
+    const char* Beg = std::strstr(Address, "://");
+    Beg = Beg ? Beg + 3 : Address;
+    if(*Beg == '@') { Beg++; } // "udp://@239.1.1.1:1234" - VLC style multicast notation
+    const char* Colon = std::strrchr(Beg, ':');
+    if(!Colon || !Colon[1]) { return false; }
+    char* End = nullptr;
+    const long Value = std::strtol(Colon + 1, &End, 10);
+    if(*End || Value < 0 || Value > 65535) { return false; }
+    Host.assign(Beg, Colon);
+    Port = (uint16_t)Value;
+    return true;
+}
+
+bool xTS_UDPSource::Open(const char* Address)
+{
+    Close();
+#if defined(_WIN32)
+    (void)Address;
+    return false;
+#else
+    std::string Host;
+    uint16_t    Port = 0;
+    if(!ParseAddress(Address, Host, Port)) { return false; }
+
+    sockaddr_in Local = {};
+    Local.sin_family      = AF_INET;
+    Local.sin_port        = htons(Port);
+    Local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if(!Host.empty() && inet_pton(AF_INET, Host.c_str(), &Local.sin_addr) != 1)
+    {
+        addrinfo  Hints  = {};
+        addrinfo* Result = nullptr;
+        Hints.ai_family   = AF_INET;
+        Hints.ai_socktype = SOCK_DGRAM;
+        if(getaddrinfo(Host.c_str(), nullptr, &Hints, &Result) != 0 || !Result) { return false; }
+        Local.sin_addr = ((sockaddr_in*)Result->ai_addr)->sin_addr;
+        freeaddrinfo(Result);
+    }
+    const bool Multicast = IN_MULTICAST(ntohl(Local.sin_addr.s_addr));
+
+    m_Socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if(m_Socket < 0) { return false; }
+    int One = 1;
+    setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One));
+    // a few hundred ms of a high bitrate stream - bursts must not overflow the socket while a batch is being parsed
+    int BufferSize = 8 << 20;
+    setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, &BufferSize, sizeof(BufferSize));
+    if(::bind(m_Socket, (const sockaddr*)&Local, sizeof(Local)) != 0) { Close(); return false; }
+    if(Multicast)
+    {
+        ip_mreq Membership = {};
+        Membership.imr_multiaddr        = Local.sin_addr;
+        Membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        if(setsockopt(m_Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &Membership, sizeof(Membership)) != 0) { Close(); return false; }
+    }
+    sockaddr_in Bound = {};
+    socklen_t   BoundSize = sizeof(Bound);
+    getsockname(m_Socket, (sockaddr*)&Bound, &BoundSize);
+    m_Port = ntohs(Bound.sin_port);
+
+    m_Datagrams.resize((size_t)MaxDatagrams * MaxDatagramSize);
+    m_Packets.clear();
+    m_Packets.reserve((size_t)MaxDatagrams * MaxDatagramSize);
+    m_PacketsBeg      = 0;
+    m_PacketsOffset   = 0;
+    m_LastSeq         = -1;
+    m_NumDatagrams    = 0;
+    m_NumRTPDatagrams = 0;
+    m_NumRTPLost      = 0;
+    m_EOF             = false;
+    m_NumBytesRead    = 0;
+    m_TrailingBytes   = 0;
+    xResetSync();
+    return true;
+#endif
+}
+
+void xTS_UDPSource::Close()
+{
+#if !defined(_WIN32)
+    if(m_Socket >= 0) { ::close(m_Socket); }
+#endif
+    m_Socket = -1;
+}
+
+int32_t xTS_UDPSource::ReadSpan(xTS_PacketSpan& Span, int32_t MaxPackets)
+{
+    Span.NumPackets = 0;
+    if(m_Socket < 0) { return -1; }
+
+    while(m_PacketsBeg >= m_Packets.size())
+    {
+        if(m_EOF) { return 0; }
+        m_PacketsOffset += m_Packets.size();
+        m_Packets.clear();
+        m_PacketsBeg = 0;
+        const int32_t NumDatagrams = xReceive();
+        if(NumDatagrams < 0) { return -1; }
+        if(NumDatagrams == 0) { m_EOF = true; return 0; }
+        for(int32_t i = 0; i < NumDatagrams; i++) { xAddDatagram(m_Datagrams.data() + (size_t)i * MaxDatagramSize, m_DatagramSizes[i]); }
+    }
+
+    const int32_t NumAvailable = (int32_t)((m_Packets.size() - m_PacketsBeg) / xTS::TS_PacketLength);
+    const int32_t NumPackets   = std::min(NumAvailable, MaxPackets);
+    Span.Data       = m_Packets.data() + m_PacketsBeg;
+    Span.NumPackets = NumPackets;
+    Span.PacketSize = xTS::TS_PacketLength;
+    Span.SyncOffset = 0;
+    Span.Offset     = m_PacketsOffset + m_PacketsBeg;
+    m_PacketsBeg   += (size_t)NumPackets * xTS::TS_PacketLength;
+    return NumPackets;
+}
+
+// Waits for at least one datagram (up to the timeout) and takes everything that is already queued, up to MaxDatagrams.
+int32_t xTS_UDPSource::xReceive()
+{
+#if defined(_WIN32)
+    return -1;
+#else
+    while(true)
+    {
+        pollfd Poll = {};
+        Poll.fd     = m_Socket;
+        Poll.events = POLLIN;
+        const int Ready = ::poll(&Poll, 1, m_TimeoutMs > 0 ? m_TimeoutMs : -1);
+        if(Ready == 0) { return 0; }
+        if(Ready <  0) { if(errno == EINTR) { continue; } return -1; }
+
+#if defined(__linux__)
+        mmsghdr Messages[MaxDatagrams];
+        iovec   Vectors [MaxDatagrams];
+        for(int32_t i = 0; i < MaxDatagrams; i++)
+        {
+            Vectors[i].iov_base = m_Datagrams.data() + (size_t)i * MaxDatagramSize;
+            Vectors[i].iov_len  = MaxDatagramSize;
+            Messages[i]         = {};
+            Messages[i].msg_hdr.msg_iov    = &Vectors[i];
+            Messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int NumReceived = ::recvmmsg(m_Socket, Messages, MaxDatagrams, MSG_DONTWAIT, nullptr);
+        if(NumReceived < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) { continue; }
+            return -1;
+        }
+        for(int32_t i = 0; i < NumReceived; i++)
+        {
+            // a truncated datagram cannot hold whole packets - give it a size that fails validation
+            m_DatagramSizes[i] = (Messages[i].msg_hdr.msg_flags & MSG_TRUNC) ? 1 : (int32_t)Messages[i].msg_len;
+        }
+#else
+        int32_t NumReceived = 0;
+        while(NumReceived < MaxDatagrams)
+        {
+            const ssize_t Size = ::recv(m_Socket, m_Datagrams.data() + (size_t)NumReceived * MaxDatagramSize, MaxDatagramSize, MSG_DONTWAIT);
+            if(Size < 0)
+            {
+                if(errno == EINTR) { continue; }
+                if(errno == EAGAIN || errno == EWOULDBLOCK) { break; }
+                return -1;
+            }
+            m_DatagramSizes[NumReceived++] = (int32_t)Size;
+        }
+#endif
+        if(NumReceived > 0) { return NumReceived; }
+    }
+#endif
+}
+
+/**
+ * @brief Validate one datagram and append its TS packets (M2TS header / RS parity removed) to m_Packets
+ * The packet size is checked per datagram, so a sender may switch formats; the first matching candidate is the
+ * format of the previous datagram.
+ */
+void xTS_UDPSource::xAddDatagram(const uint8_t* Data, int32_t Size)
+{
+    m_NumDatagrams++;
+    int32_t Padding = 0;
+    const int32_t HeaderLength = xStripRTP(Data, Size, Padding);
+    if(HeaderLength > 0) { Data += HeaderLength; Size -= HeaderLength + Padding; }
+    if(HeaderLength >= 0) { m_NumBytesRead += (uint64_t)Size; }
+
+    xTS_SyncScanner::xFormat Candidates[4];
+    Candidates[0] = m_Format;
+    Candidates[1].PacketSize = xTS_SyncScanner::PacketSize_TS;
+    Candidates[2].PacketSize = xTS_SyncScanner::PacketSize_RS;
+    Candidates[3].PacketSize = xTS_SyncScanner::PacketSize_M2TS;
+    Candidates[3].SyncOffset = xTS_SyncScanner::FormatToSyncOffset(xTS_SyncScanner::PacketSize_M2TS);
+    for(const xTS_SyncScanner::xFormat& Format : Candidates)
+    {
+        if(HeaderLength < 0 || Size <= 0 || Size % Format.PacketSize) { continue; }
+        const int32_t NumPackets = Size / Format.PacketSize;
+        int32_t Idx = 0;
+        while(Idx < NumPackets && Data[(size_t)Idx * Format.PacketSize + Format.SyncOffset] == xTS_SyncScanner::SyncByte) { Idx++; }
+        if(Idx < NumPackets) { continue; }
+
+        if(m_Locked && (Format.PacketSize != m_Format.PacketSize)) { m_NumSyncLosses++; }
+        m_Format = Format;
+        m_Locked = true;
+        for(int32_t i = 0; i < NumPackets; i++)
+        {
+            const uint8_t* Packet = Data + (size_t)i * Format.PacketSize + Format.SyncOffset;
+            m_Packets.insert(m_Packets.end(), Packet, Packet + xTS::TS_PacketLength);
+        }
+        return;
+    }
+
+    if(HeaderLength >= 0) { m_NumSkippedBytes += (uint64_t)std::max(Size, 0); }
+    if(m_Locked) { m_Locked = false; m_NumSyncLosses++; }
+}
+
+// RFC 3550 header in front of the TS packets (RFC 2250, payload type 33). Plain TS starts with the sync byte.
+int32_t xTS_UDPSource::xStripRTP(const uint8_t* Data, int32_t Size, int32_t& Padding)
+{
+    Padding = 0;
+    if(Size > 0 && Data[0] == xTS_SyncScanner::SyncByte) { return 0; }
+    if(Size < RTPHeaderLength || (Data[0] >> 6) != 2) { return -1; }
+
+    int32_t Length = RTPHeaderLength + 4 * (Data[0] & 0x0F); // CSRC list
+    if(Data[0] & 0x10) // header extension
+    {
+        if(Size < Length + 4) { return -1; }
+        Length += 4 + 4 * ((Data[Length + 2] << 8) | Data[Length + 3]);
+    }
+    if(Data[0] & 0x20) { Padding = Data[Size - 1]; }
+    if(Length + Padding > Size) { return -1; }
+
+    m_NumRTPDatagrams++;
+    const int32_t Seq = (Data[2] << 8) | Data[3];
+    if(m_LastSeq < 0) { m_LastSeq = Seq; return Length; }
+    // only a step forward (modulo 2^16) is a gap - a duplicated or late datagram is no loss and keeps the last number
+    const int32_t Diff = (Seq - m_LastSeq) & 0xFFFF;
+    if(Diff != 0 && Diff < 0x8000)
+    {
+        m_NumRTPLost += (uint64_t)(Diff - 1);
+        m_LastSeq     = Seq;
+    }
+    return Length;
+}
@@ -0,0 +1,262 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsSyncScanner.h"
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_PacketSpan
+//=============================================================================================================================================================================
+
+// Non-owning view on a contiguous run of TS packets. Data points directly into the source storage
+// (file mapping or read block) and stays valid until the next ReadSpan() call on the same source.
+// All packets in a span are in sync; getPacket() skips the M2TS timestamp header, so it always points at the sync byte.
+struct xTS_PacketSpan
+{
+  const uint8_t* Data       = nullptr;
+  int32_t        NumPackets = 0;
+  int32_t        PacketSize = xTS::TS_PacketLength; // stride between consecutive packets (188, 192 or 204)
+  int32_t        SyncOffset = 0;                    // offset of the TS packet inside each stride (4 for M2TS)
+  uint64_t       Offset     = 0;                    // byte offset of the first packet in the input
+
+  const uint8_t* getPacket(int32_t Idx) const { return Data + (size_t)Idx * PacketSize + SyncOffset; }
+  uint64_t getPacketOffset(int32_t Idx) const { return Offset + (uint64_t)Idx * PacketSize; }
+  bool isEmpty() const { return NumPackets == 0; }
+};
+
+//=============================================================================================================================================================================
+// xTS_PacketSource
+//=============================================================================================================================================================================
+
+class xTS_PacketSource
+{
+public:
+  enum class eType : int32_t
+  {
+    Mapped,   // whole file memory-mapped, spans point into the mapping
+    Buffered, // large-block fread into an internal buffer
+    Stream,   // stdin or a named pipe - reads return whatever has arrived
+    UDP,      // local UDP/RTP socket, datagrams received in batches
+  };
+
+  static constexpr int32_t DefaultBatchPackets = 4096;
+
+  virtual ~xTS_PacketSource() {}
+
+  virtual bool    Open (const char* FileName) = 0;
+  virtual void    Close() = 0;
+  // Returns number of packets in Span (at most MaxPackets), 0 on end of input, -1 on I/O error.
+  virtual int32_t ReadSpan(xTS_PacketSpan& Span, int32_t MaxPackets = DefaultBatchPackets) = 0;
+
+  bool     isEOF           () const { return m_EOF; }
+  uint64_t getNumBytesRead () const { return m_NumBytesRead; }
+  uint64_t getTrailingBytes() const { return m_TrailingBytes; } // bytes left after the last complete packet
+  // Sync statistics - bytes thrown away while searching for lock and number of times lock was lost
+  uint64_t getNumSkippedBytes() const { return m_NumSkippedBytes; }
+  uint64_t getNumSyncLosses  () const { return m_NumSyncLosses; }
+  const xTS_SyncScanner::xFormat& getFormat() const { return m_Format; }
+
+  static std::unique_ptr<xTS_PacketSource> Create(eType Type);
+  static const char* TypeToString(eType Type);
+  // Source type implied by the input name: "-" is stdin, udp:// and rtp:// are sockets, anything else uses FileType.
+  static eType       TypeForInput(const char* Input, eType FileType);
+  // Live sources deliver data as it arrives and never see the whole input at once.
+  static bool        isLive      (eType Type) { return Type == eType::Stream || Type == eType::UDP; }
+  // Size and modification time of a file - sidecar indexes are validated against them.
+  static bool        getFileInfo (const char* FileName, uint64_t& Size, int64_t& MTime);
+
+protected:
+  // Bytes kept between reads while looking for lock - enough for NumLockPackets of the largest packet size.
+  static constexpr size_t LockWindowSize = (xTS_SyncScanner::NumLockPackets + 1) * xTS_SyncScanner::PacketSize_RS;
+
+  void    xResetSync();
+  int32_t xFindRun  (const uint8_t* Window, size_t Size, bool AtEnd, int32_t MaxPackets, size_t& Skip);
+
+  bool     m_EOF             = false;
+  uint64_t m_NumBytesRead    = 0;
+  uint64_t m_TrailingBytes   = 0;
+
+  xTS_SyncScanner::xFormat m_Format;
+  bool     m_Locked          = false;
+  uint64_t m_NumSkippedBytes = 0;
+  uint64_t m_NumSyncLosses   = 0;
+};
+
+//=============================================================================================================================================================================
+// xTS_MappedFileSource
+//=============================================================================================================================================================================
+
+class xTS_MappedFileSource : public xTS_PacketSource
+{
+public:
+  xTS_MappedFileSource() {}
+  ~xTS_MappedFileSource() override { Close(); }
+
+  bool    Open    (const char* FileName) override;
+  void    Close   () override;
+  int32_t ReadSpan(xTS_PacketSpan& Span, int32_t MaxPackets = DefaultBatchPackets) override;
+
+  // Repositions the reader at byte Offset and drops the sync lock - the next ReadSpan() relocks from there.
+  bool           Seek   (uint64_t Offset);
+
+  const uint8_t* getData() const { return m_Data; }
+  uint64_t       getSize() const { return m_Size; }
+
+protected:
+  const uint8_t* m_Data = nullptr;
+  uint64_t       m_Size = 0;
+  uint64_t       m_Pos  = 0;
+#if defined(_WIN32)
+  void* m_File    = nullptr;
+  void* m_Mapping = nullptr;
+#else
+  int   m_FD      = -1;
+#endif
+};
+
+//=============================================================================================================================================================================
+// xTS_BufferedFileSource
+//=============================================================================================================================================================================
+
+class xTS_BufferedFileSource : public xTS_PacketSource
+{
+public:
+  explicit xTS_BufferedFileSource(int32_t BlockPackets = DefaultBatchPackets);
+  ~xTS_BufferedFileSource() override { Close(); }
+
+  bool    Open    (const char* FileName) override;
+  void    Close   () override;
+  int32_t ReadSpan(xTS_PacketSpan& Span, int32_t MaxPackets = DefaultBatchPackets) override;
+
+protected:
+  bool            xFillBuffer();
+  // Reads up to Size bytes, returns the number of bytes read (0 at end of input) or -1 on error.
+  virtual int64_t xRead      (uint8_t* Data, size_t Size);
+  virtual bool    xIsOpen    () const { return m_File != nullptr; }
+  void            xResetBuffer();
+
+  FILE*                m_File = nullptr;
+  std::vector<uint8_t> m_Buffer;
+  size_t               m_BufferBeg = 0; // first unconsumed byte
+  size_t               m_BufferEnd = 0; // one past the last valid byte
+  bool                 m_FileEOF   = false;
+  bool                 m_Error     = false;
+  uint64_t             m_BufferOffset = 0; // input offset of m_Buffer[0]
+};
+
+//=============================================================================================================================================================================
+// xTS_StreamSource
+//=============================================================================================================================================================================
+
+// stdin ("-") or a named pipe. Same blocking and sync handling as the buffered source, but every read returns
+// as soon as some data is available instead of waiting for a full block, so packets are handed out as they arrive.
+// A packet is released once the sync byte of the next one has been seen (see xFindRun()).
+class xTS_StreamSource : public xTS_BufferedFileSource
+{
+public:
+  explicit xTS_StreamSource(int32_t BlockPackets = DefaultBatchPackets) : xTS_BufferedFileSource(BlockPackets) {}
+  ~xTS_StreamSource() override { Close(); }
+
+  bool    Open (const char* FileName) override;
+  void    Close() override;
+
+protected:
+  int64_t xRead  (uint8_t* Data, size_t Size) override;
+  bool    xIsOpen() const override { return m_FD >= 0; }
+
+  int  m_FD      = -1;
+  bool m_OwnedFD = false; // stdin is not closed
+};
+
+//=============================================================================================================================================================================
+// xTS_FollowSource
+//=============================================================================================================================================================================
+
+// A file still being written (recording in progress), read like a stream - but at the end of the file the source
+// waits for it to grow instead of ending: woken by inotify (IN_MODIFY) on Linux, polling every PollInterval_ms
+// elsewhere. The input ends after Timeout without new data (0 - never) or when the file is deleted or moved away.
+// OnIdle is called whenever the reader has caught up with the writer, before waiting and again every PollInterval_ms
+// while waiting - the point to flush outputs and save a checkpoint, as every span handed out has been processed then.
+class xTS_FollowSource : public xTS_StreamSource
+{
+public:
+  static constexpr int32_t PollInterval_ms = 100;
+
+  explicit xTS_FollowSource(int32_t BlockPackets = DefaultBatchPackets) : xTS_StreamSource(BlockPackets) {}
+  ~xTS_FollowSource() override { Close(); }
+
+  bool Open (const char* FileName) override;
+  void Close() override;
+  // Continues at byte Offset of the file (e.g. from a checkpoint), before the first ReadSpan().
+  bool Seek (uint64_t Offset);
+
+  void     setTimeout(int32_t TimeoutMs) { m_TimeoutMs = TimeoutMs; }
+  void     setOnIdle (std::function<void()> Callback) { m_OnIdle = std::move(Callback); }
+  uint64_t getNumWaits() const { return m_NumWaits; }
+
+protected:
+  int64_t xRead(uint8_t* Data, size_t Size) override;
+  bool    xWait(); // false - timeout, or the file is gone
+
+  int                   m_Notify    = -1; // inotify instance, -1 - polling
+  int32_t               m_TimeoutMs = 0;
+  int64_t               m_Idle_ms   = 0;  // waited without new data
+  bool                  m_Gone      = false; // deleted or moved away - ends at the next end of file
+  std::function<void()> m_OnIdle;
+  uint64_t              m_NumWaits  = 0;
+};
+
+//=============================================================================================================================================================================
+// xTS_UDPSource
+//=============================================================================================================================================================================
+
+// Local UDP socket, "udp://[address]:port" (rtp:// is accepted as well). An empty or unicast address binds to
+// that interface, a multicast address joins the group. Datagrams are received up to MaxDatagrams per system call
+// (recvmmsg on Linux) and an RTP header is stripped automatically when present. Every datagram has to carry whole
+// packets - a datagram that does not is dropped and counted as skipped bytes. POSIX only, Open() fails on Windows.
+class xTS_UDPSource : public xTS_PacketSource
+{
+public:
+  static constexpr int32_t MaxDatagrams    = 64;
+  static constexpr int32_t MaxDatagramSize = 2048; // 7 x 204-byte packets + RTP header
+  static constexpr int32_t RTPHeaderLength = 12;
+
+  xTS_UDPSource() {}
+  ~xTS_UDPSource() override { Close(); }
+
+  bool    Open    (const char* Address) override;
+  void    Close   () override;
+  int32_t ReadSpan(xTS_PacketSpan& Span, int32_t MaxPackets = DefaultBatchPackets) override;
+
+  // End of input after TimeoutMs without a datagram, 0 waits forever.
+  void     setTimeout(int32_t TimeoutMs) { m_TimeoutMs = TimeoutMs; }
+  uint16_t getPort   () const { return m_Port; } // bound port, useful when port 0 was requested
+
+  uint64_t getNumDatagrams   () const { return m_NumDatagrams;    }
+  uint64_t getNumRTPDatagrams() const { return m_NumRTPDatagrams; }
+  uint64_t getNumRTPLost     () const { return m_NumRTPLost;      } // gaps in RTP sequence numbers
+
+  static bool ParseAddress(const char* Address, std::string& Host, uint16_t& Port);
+
+protected:
+  int32_t xReceive      (); // returns number of datagrams, 0 on timeout, -1 on error
+  void    xAddDatagram  (const uint8_t* Data, int32_t Size);
+  int32_t xStripRTP     (const uint8_t* Data, int32_t Size, int32_t& Padding); // returns RTP header length, 0 for plain TS, -1 if malformed
+
+  std::vector<uint8_t> m_Datagrams;       // MaxDatagrams x MaxDatagramSize receive slots
+  int32_t              m_DatagramSizes[MaxDatagrams] = {};
+  std::vector<uint8_t> m_Packets;         // validated packets of the last receive, spans point here
+  size_t               m_PacketsBeg = 0;  // first packet not handed out yet
+  uint64_t             m_PacketsOffset = 0; // offset of m_Packets[0] in the received packet stream
+  int32_t              m_TimeoutMs  = 0;
+  uint16_t             m_Port       = 0;
+  int32_t              m_LastSeq    = -1; // last RTP sequence number
+  uint64_t             m_NumDatagrams    = 0;
+  uint64_t             m_NumRTPDatagrams = 0;
+  uint64_t             m_NumRTPLost      = 0;
+  int                  m_Socket     = -1;
+};
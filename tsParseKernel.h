@@ -0,0 +1,153 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketSource.h"
+#include "tsDemuxer.h"
+#include "tsPCRAnalyzer.h"
+#include <vector>
+
+//=============================================================================================================================================================================
+// PID filters of xTS_ParseKernel
+//=============================================================================================================================================================================
+
+// A filter tells by PID (and the packet, for filters that need the PUSI flag) whether the packet goes on to the
+// enabled features. Every packet passes - the test compiles away.
+struct xTS_AnyPID
+{
+  static constexpr bool AcceptsAll = true;
+  bool Accept(uint16_t /*PID*/, const uint8_t* /*Packet*/) const { return true; }
+};
+
+// A single PID - one compare of the two PID bytes.
+struct xTS_OnePID
+{
+  static constexpr bool AcceptsAll = false;
+  explicit xTS_OnePID(int32_t PID) : m_PID((uint16_t)PID) {}
+  bool Accept(uint16_t PID, const uint8_t* /*Packet*/) const { return PID == m_PID; }
+protected:
+  uint16_t m_PID;
+};
+
+// Any set of PIDs - 8192-bit mask, may grow while parsing (e.g. PMT PIDs once the PAT is known).
+struct xTS_PIDSet
+{
+  static constexpr bool AcceptsAll = false;
+  xTS_PIDSet() : m_Mask(8192 / 64, 0) {}
+  explicit xTS_PIDSet(const std::vector<int32_t>& PIDs) : xTS_PIDSet() { for(int32_t PID : PIDs) { Add(PID); } }
+  void Add   (int32_t  PID)       { if(PID >= 0 && PID < 8192) { m_Mask[PID >> 6] |= 1ull << (PID & 63); } }
+  bool Accept(uint16_t PID, const uint8_t* /*Packet*/) const { return (m_Mask[PID >> 6] >> (PID & 63)) & 1; }
+protected:
+  std::vector<uint64_t> m_Mask;
+};
+
+// Whatever the demuxer takes - its PIDs, the PSI PIDs known so far and, with automatic PES discovery, payload unit
+// starts of new PIDs. The same test as xTS_Demuxer::ProcessBatch().
+struct xTS_DemuxerPIDs
+{
+  static constexpr bool AcceptsAll = false;
+  explicit xTS_DemuxerPIDs(const xTS_Demuxer& Demuxer) : m_Demuxer(Demuxer) {}
+  bool Accept(uint16_t PID, const uint8_t* Packet) const
+  {
+    return m_Demuxer.hasPID(PID) || (m_Demuxer.isAutoAddPES() && (Packet[1] & 0x40)) || (m_Demuxer.getPSI() && m_Demuxer.getPSI()->isPSIPID(PID));
+  }
+protected:
+  const xTS_Demuxer& m_Demuxer;
+};
+
+//=============================================================================================================================================================================
+// Feature policies of xTS_ParseKernel
+//=============================================================================================================================================================================
+
+// What the kernel does with a packet. Packet and CC error counts are kept for every PID passing the filter.
+template <bool tPCR, bool tDemux> struct xTS_Features
+{
+  static constexpr bool PCR   = tPCR;   // PCR analysis (xTS_PCRAnalyzer) - sees every packet, the filter does not apply
+  static constexpr bool Demux = tDemux; // PSI tables and PES extraction (xTS_Demuxer)
+};
+
+using xTS_HeadersOnly = xTS_Features<false, false>; // packet and CC error counts per PID
+using xTS_Demux       = xTS_Features<false, true >;
+using xTS_DemuxAndPCR = xTS_Features<true , true >; // the analyzer learns the programs from the PMTs the demuxer parses
+
+//=============================================================================================================================================================================
+// xTS_ParseKernel
+//=============================================================================================================================================================================
+
+// Packet loop specialized at compile time for a feature policy and a PID filter. The PID is read straight from the
+// packet bytes and tested before anything is parsed, headers and adaptation fields are parsed only when a feature
+// needs them (the AF of a non-PCR packet is skipped after two byte tests), and disabled features leave no branch
+// behind - "extract one PID" becomes a compare, a CC check and the demuxer call for its packets only. The generic
+// loop of the per-packet trace parses everything and tests every option per packet instead.
+template <class tFeatures, class tPIDFilter> class xTS_ParseKernel
+{
+public:
+  static constexpr int32_t NumPIDs = 8192;
+
+  struct xPIDCounts
+  {
+    uint64_t NumPackets  = 0;
+    uint64_t NumCCErrors = 0;
+  };
+
+public:
+  xTS_ParseKernel(tPIDFilter Filter, xTS_Demuxer* Demuxer = nullptr, xTS_PCRAnalyzer* PCRAnalyzer = nullptr)
+    : m_Filter(std::move(Filter)), m_Demuxer(Demuxer), m_PCRAnalyzer(PCRAnalyzer), m_Counts(NumPIDs), m_LastCC(NumPIDs, -1) {}
+
+  tPIDFilter&       getFilter()                  { return m_Filter; }
+  const xPIDCounts& getCounts(int32_t PID) const { return m_Counts[PID]; }
+  uint64_t          getNumPackets()        const { return m_NumPackets; }
+
+  void ProcessSpan(const xTS_PacketSpan& Span)
+  {
+    m_NumPackets += (uint64_t)Span.NumPackets;
+    for(int32_t i = 0; i < Span.NumPackets; i++)
+    {
+      const uint8_t* Packet = Span.getPacket(i);
+      const uint16_t PID    = (uint16_t)(((Packet[1] & 0x1F) << 8) | Packet[2]);
+      if constexpr(tFeatures::PCR) { xProcessPCR(Packet); }
+      if constexpr(!tPIDFilter::AcceptsAll) { if(!m_Filter.Accept(PID, Packet)) { continue; } }
+
+      // CC check on the raw byte - packets without payload (AFC=2) do not advance the counter, repeats are duplicates
+      const uint8_t Byte3 = Packet[3];
+      xPIDCounts&   Counts = m_Counts[PID];
+      Counts.NumPackets++;
+      if(Byte3 & 0x10)
+      {
+        const int8_t CC     = (int8_t)(Byte3 & 0x0F);
+        const int8_t LastCC = m_LastCC[PID];
+        Counts.NumCCErrors += LastCC >= 0 && CC != LastCC && CC != ((LastCC + 1) & 0x0F);
+        m_LastCC[PID] = CC;
+      }
+
+      if constexpr(tFeatures::Demux)
+      {
+        if constexpr(!tFeatures::PCR) { m_Header.Parse(Packet); } // with PCR analysis parsed already
+        if(m_Header.hasAdaptationField()) { m_AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)m_Header.getAFC()); }
+        m_Demuxer->ProcessPacket(Packet, m_Header, m_AF, Span.getPacketOffset(i));
+      }
+    }
+  }
+
+protected:
+  void xProcessPCR(const uint8_t* Packet)
+  {
+    m_Header.Parse(Packet);
+    // adaptation_field_length and the PCR_flag are checked before parsing the whole field
+    const uint8_t* AF = Packet + xTS::TS_HeaderLength;
+    if(m_Header.hasAdaptationField() && AF[0] >= 7 && (AF[1] & 0x10))
+    {
+      m_AF.Parse(AF, (uint8_t)m_Header.getAFC());
+      m_PCRAnalyzer->ProcessPacket(m_Header, &m_AF);
+    }
+    else { m_PCRAnalyzer->ProcessPacket(m_Header, nullptr); }
+  }
+
+  tPIDFilter              m_Filter;
+  xTS_Demuxer*            m_Demuxer;
+  xTS_PCRAnalyzer*        m_PCRAnalyzer;
+  xTS_PacketHeader        m_Header;
+  xTS_AdaptationField     m_AF;
+  std::vector<xPIDCounts> m_Counts;
+  std::vector<int8_t>     m_LastCC;
+  uint64_t                m_NumPackets = 0;
+};
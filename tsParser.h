@@ -0,0 +1,266 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsBufferPool.h"
+#include "tsSyncScanner.h"
+#include "tsPSI.h"
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_ParserSink
+//=============================================================================================================================================================================
+
+// Base of the sinks of xTS_Parser. A sink derives from it and hides the callbacks it wants with non-virtual methods of
+// the same signature - calls are resolved at compile time and inlined, callbacks left out cost nothing (the work
+// behind them, e.g. PES assembly, is skipped as well). Pointers passed to callbacks are valid during the call only.
+struct xTS_ParserSink
+{
+  // Every packet in sync, Packet points to its 188 bytes - in place in the buffer given to Feed() where possible.
+  void onPacket     (const uint8_t* /*Packet*/, const xTS_PacketHeader& /*PacketHeader*/, const xTS_AdaptationField* /*AdaptationField*/, uint64_t /*Offset*/) {}
+  // Complete PES payload of a registered PID. Damaged - packets were lost and zero-filled or skipped (loss policy).
+  void onPESComplete(int32_t /*PID*/, const xPES_PacketHeader& /*PESH*/, const uint8_t* /*Payload*/, int32_t /*Size*/, bool /*Damaged*/) {}
+  // Every complete section of PAT, CAT, SDT and the PMTs, repeats included, CRC not checked.
+  void onSection    (int32_t /*PID*/, const uint8_t* /*Section*/, int32_t /*Size*/) {}
+  // Every PCR, 27 MHz units. Discontinuity - discontinuity_indicator of the packet.
+  void onPCR        (int32_t /*PID*/, uint64_t /*PCR*/, bool /*Discontinuity*/, uint64_t /*Offset*/) {}
+};
+
+//=============================================================================================================================================================================
+// xTS_Parser
+//=============================================================================================================================================================================
+
+// Embeddable push parser - the caller owns the input and hands it over in buffers of any size (socket reads, file
+// blocks, a whole mapping), the parser calls back into tSink. Packets are parsed in place; only a packet split
+// between two buffers and input out of sync go through a small carry buffer. Plain 188-byte packets only, sync
+// is (re)acquired with xTS_SyncScanner. PES of registered PIDs are assembled in pool buffers (see
+// xPES_Assembler for the loss policies), the PSI tables are decoded on the way (getPSI()).
+template <class tSink> class xTS_Parser
+{
+public:
+  static constexpr int32_t NumPIDs    = 8192;
+  static constexpr int16_t NoStream   = -1;
+  static constexpr size_t  PacketSize = xTS::TS_PacketLength;
+
+  static_assert(std::is_base_of_v<xTS_ParserSink, tSink>, "xTS_Parser sink has to derive from xTS_ParserSink");
+  static constexpr bool HasOnPacket      = !std::is_same_v<decltype(&tSink::onPacket     ), decltype(&xTS_ParserSink::onPacket     )>;
+  static constexpr bool HasOnPESComplete = !std::is_same_v<decltype(&tSink::onPESComplete), decltype(&xTS_ParserSink::onPESComplete)>;
+  static constexpr bool HasOnSection     = !std::is_same_v<decltype(&tSink::onSection    ), decltype(&xTS_ParserSink::onSection    )>;
+  static constexpr bool HasOnPCR         = !std::is_same_v<decltype(&tSink::onPCR        ), decltype(&xTS_ParserSink::onPCR        )>;
+
+public:
+  explicit xTS_Parser(tSink& Sink) : m_Sink(Sink)
+  {
+    for(int16_t& Idx : m_PIDToStream) { Idx = NoStream; }
+    if constexpr(HasOnSection) { m_PSI.setOnSection([this](int32_t PID, const uint8_t* Section, int32_t Size) { m_Sink.onSection(PID, Section, Size); }); }
+    m_PSI.setOnPMT([this](const xPSI_PMT& PMT)
+    {
+      if(!m_AddFromPMT) { return; }
+      for(const xPSI_PMT::xStream& ES : PMT.Streams) { if(xPSI_Parser::isPESStreamType(ES.StreamType)) { AddPID(ES.PID); } }
+    });
+  }
+  xTS_Parser(const xTS_Parser&) = delete; // PSI callbacks refer to this
+  xTS_Parser& operator=(const xTS_Parser&) = delete;
+
+  // Registers PID for PES assembly. Returns false for PIDs out of range.
+  bool AddPID(int32_t PID)
+  {
+    if(PID < 0 || PID >= NumPIDs) { return false; }
+    if(m_PIDToStream[PID] != NoStream) { return true; }
+    m_PIDToStream[PID] = (int16_t)m_Streams.size();
+    m_Streams.emplace_back();
+    m_Streams.back().Assembler.Init(PID, &m_Pool);
+    m_Streams.back().Assembler.setLossPolicy(m_LossPolicy);
+    return true;
+  }
+  // Assembles every PES elementary stream announced in a PMT.
+  void setAddFromPMT (bool Enable) { m_AddFromPMT = Enable; }
+  // For streams registered from now on.
+  void setLossPolicy (xPES_Assembler::eLossPolicy Policy) { m_LossPolicy = Policy; }
+
+  // Parses Data, the next Size bytes of the input. As with the file sources, a packet is released once the sync byte
+  // of the next one is in place, so a packet truncated by lost bytes is discarded instead of being passed on.
+  void Feed(const uint8_t* Data, size_t Size)
+  {
+    while(Size > 0)
+    {
+      if(m_Synced && !m_Carry.empty())
+      {
+        // packet split between buffers - completed in the carry buffer, released on the next sync byte
+        const size_t Take = std::min(Size, PacketSize - m_Carry.size());
+        xTake(Data, Size, Take);
+        if(Size == 0) { break; }
+        if(Data[0] == xTS_SyncScanner::SyncByte)
+        {
+          xProcessPacket(m_Carry.data(), m_Offset - PacketSize);
+          m_Carry.clear();
+          continue;
+        }
+        // broken packet - search again right after its sync byte
+        m_Carry.erase(m_Carry.begin());
+        m_NumSkippedBytes++;
+        xLoseSync();
+        continue;
+      }
+      if(!m_Synced)
+      {
+        if(m_Carry.empty())
+        {
+          // lock found in the buffer itself - no copy
+          const int64_t Sync = xTS_SyncScanner::FindSync(Data, Size, (int32_t)PacketSize, xTS_SyncScanner::NumLockPackets);
+          if(Sync >= 0)
+          {
+            xSkip(Data, Size, (size_t)Sync);
+            m_Synced = true;
+            continue;
+          }
+          // no lock - only the last packets can still start one, together with the next buffer
+          xSkip(Data, Size, Size - std::min(Size, (size_t)xTS_SyncScanner::NumLockPackets * PacketSize));
+        }
+        // the lock may be split between buffers - searched in the carry buffer a few packets at a time
+        xTake(Data, Size, std::min(Size, 2 * xTS_SyncScanner::NumLockPackets * PacketSize));
+        xDrainCarry();
+        continue;
+      }
+      // in sync and packet aligned - packets are parsed in place
+      while(Size > PacketSize && Data[PacketSize] == xTS_SyncScanner::SyncByte)
+      {
+        xProcessPacket(Data, m_Offset);
+        Data     += PacketSize;
+        Size     -= PacketSize;
+        m_Offset += PacketSize;
+      }
+      if(Size <= PacketSize)
+      {
+        xTake(Data, Size, Size); // last packet waits for the next sync byte
+        break;
+      }
+      // broken packet - search again right after its sync byte
+      xSkip(Data, Size, 1);
+      xLoseSync();
+    }
+  }
+
+  // End of input - releases the last packet, hands the unbounded PES still in progress to the sink. Feed() may be
+  // called again afterwards.
+  void Finish()
+  {
+    if(m_Synced && m_Carry.size() == PacketSize) { xProcessPacket(m_Carry.data(), m_Offset - PacketSize); m_Carry.clear(); }
+    if constexpr(HasOnPESComplete)
+    {
+      for(xStream& Stream : m_Streams)
+      {
+        if(Stream.Assembler.isPending() && Stream.Assembler.FinishPending(nullptr, nullptr)) { xEmitPES(Stream); }
+        Stream.Assembler.Reset();
+        Stream.Synced = false;
+      }
+    }
+    m_NumSkippedBytes += m_Carry.size(); // trailing bytes
+    m_Carry.clear();
+    m_Synced = false;
+  }
+
+  const xPSI_Parser&      getPSI           () const { return m_PSI; }
+  const xPES_Assembler*   getAssembler     (int32_t PID) const { return PID >= 0 && PID < NumPIDs && m_PIDToStream[PID] != NoStream ? &m_Streams[m_PIDToStream[PID]].Assembler : nullptr; }
+  uint64_t                getNumPackets    () const { return m_NumPackets; }
+  uint64_t                getNumSyncLosses () const { return m_NumSyncLosses; }
+  uint64_t                getNumSkippedBytes() const { return m_NumSkippedBytes; }
+
+protected:
+  struct xStream
+  {
+    bool           Synced = false; // first payload unit start seen
+    xPES_Assembler Assembler;
+  };
+
+  void xTake(const uint8_t*& Data, size_t& Size, size_t Take) { m_Carry.insert(m_Carry.end(), Data, Data + Take); Data += Take; Size -= Take; m_Offset += Take; }
+  void xSkip(const uint8_t*& Data, size_t& Size, size_t Skip) { m_NumSkippedBytes += Skip; Data += Skip; Size -= Skip; m_Offset += Skip; }
+  void xLoseSync() { m_Synced = false; m_NumSyncLosses++; }
+
+  // Parses the carry buffer out of sync (input offset m_Offset - size). Keeps the last packet of a lock, which waits
+  // for the next sync byte, or the tail that may start a lock.
+  void xDrainCarry()
+  {
+    const size_t   Size = m_Carry.size();
+    const uint64_t Base = m_Offset - Size;
+    size_t Pos = 0;
+    while(true)
+    {
+      if(!m_Synced)
+      {
+        const int64_t Sync = xTS_SyncScanner::FindSync(m_Carry.data() + Pos, Size - Pos, (int32_t)PacketSize, xTS_SyncScanner::NumLockPackets);
+        if(Sync < 0)
+        {
+          const size_t Keep = std::min(Size - Pos, (size_t)xTS_SyncScanner::NumLockPackets * PacketSize);
+          m_NumSkippedBytes += Size - Pos - Keep;
+          Pos = Size - Keep;
+          break;
+        }
+        m_NumSkippedBytes += (uint64_t)Sync;
+        Pos     += (size_t)Sync;
+        m_Synced = true;
+      }
+      while(Size - Pos > PacketSize && m_Carry[Pos + PacketSize] == xTS_SyncScanner::SyncByte)
+      {
+        xProcessPacket(m_Carry.data() + Pos, Base + Pos);
+        Pos += PacketSize;
+      }
+      if(Size - Pos <= PacketSize) { break; }
+      m_NumSkippedBytes++; // broken packet - search again right after its sync byte
+      Pos++;
+      xLoseSync();
+    }
+    m_Carry.erase(m_Carry.begin(), m_Carry.begin() + (std::ptrdiff_t)Pos);
+  }
+
+  void xProcessPacket(const uint8_t* Packet, uint64_t Offset)
+  {
+    m_NumPackets++;
+    m_Header.Parse(Packet);
+    const bool HasAF = m_Header.hasAdaptationField();
+    if(HasAF) { m_AF.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)m_Header.getAFC()); }
+    const int32_t PID = (int32_t)m_Header.getPID();
+
+    if constexpr(HasOnPacket) { m_Sink.onPacket(Packet, m_Header, HasAF ? &m_AF : nullptr, Offset); }
+    if constexpr(HasOnPCR) { if(HasAF && m_AF.PR) { m_Sink.onPCR(PID, m_AF.PCR, m_AF.DC != 0, Offset); } }
+    if(m_PSI.ProcessPacket(Packet, m_Header, m_AF)) { return; }
+
+    if constexpr(HasOnPESComplete)
+    {
+      const int16_t Idx = m_PIDToStream[PID];
+      if(Idx == NoStream) { return; }
+      xStream& Stream = m_Streams[Idx];
+      if(!Stream.Synced)
+      {
+        if(!m_Header.getS()) { return; } // registered in the middle of a PES
+        Stream.Synced = true;
+      }
+      // the assembler drops its buffer on PUSI - an unbounded (or damaged) PES ends here and has to leave first
+      if(m_Header.getS() && Stream.Assembler.isPending() && Stream.Assembler.FinishPending(&m_Header, &m_AF)) { xEmitPES(Stream); }
+      if(Stream.Assembler.AbsorbPacket(Packet, &m_Header, &m_AF) == xPES_Assembler::eResult::AssemblingFinished) { xEmitPES(Stream); }
+    }
+  }
+
+  void xEmitPES(xStream& Stream)
+  {
+    const xPES_Assembler& Assembler = Stream.Assembler;
+    m_Sink.onPESComplete(Assembler.getPID(), Assembler.getPESH(), Assembler.getPacket(), Assembler.getNumPacketBytes(), Assembler.isDamaged());
+  }
+
+  tSink&                      m_Sink;
+  xTS_PacketHeader            m_Header;
+  xTS_AdaptationField         m_AF;
+  xPSI_Parser                 m_PSI;
+  xPES_BufferPool             m_Pool;
+  int16_t                     m_PIDToStream[NumPIDs];
+  std::vector<xStream>        m_Streams;
+  bool                        m_AddFromPMT      = false;
+  xPES_Assembler::eLossPolicy m_LossPolicy      = xPES_Assembler::eLossPolicy::Drop;
+  std::vector<uint8_t>        m_Carry;
+  bool                        m_Synced          = false;
+  uint64_t                    m_Offset          = 0; // input offset of the next byte given to Feed()
+  uint64_t                    m_NumPackets      = 0;
+  uint64_t                    m_NumSyncLosses   = 0;
+  uint64_t                    m_NumSkippedBytes = 0;
+};
@@ -0,0 +1,204 @@
+#include "tsPipeline.h"
+#include "tsPacketBatch.h"
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+//=============================================================================================================================================================================
+// xTS_Pipeline
+//=============================================================================================================================================================================
+
+xTS_Pipeline::xLink::xLink(int32_t Depth, int32_t BatchPackets) : Full((uint32_t)Depth), Free((uint32_t)Depth)
+{
+    for(int32_t i = 0; i < Depth; i++)
+    {
+        Storage.push_back(std::make_unique<xBatch>());
+        Storage.back()->Data.resize((size_t)BatchPackets * xTS::TS_PacketLength);
+        Free.Push(Storage.back().get());
+    }
+}
+
+bool xTS_Pipeline::Run(xTS_PacketSource& Source, const xConfig& Config)
+{
+    m_Config = Config;
+    m_Config.NumWorkers   = std::max(1, std::min(Config.NumWorkers, MaxWorkers));
+    m_Config.BatchPackets = std::max(1, std::min(Config.BatchPackets, xTS_PacketBatch::MaxPackets));
+    m_Config.QueueDepth   = std::max(2, Config.QueueDepth);
+    m_NumPackets          = 0;
+    for(std::atomic<uint8_t>& StreamType : m_StreamTypes) { StreamType.store(0, std::memory_order_relaxed); }
+    const xTS_Demuxer::tSinkFactory Factory = m_Config.SinkFactory ? m_Config.SinkFactory : xTS_Demuxer::tSinkFactory(xTS_Demuxer::DefaultSinkFactory);
+
+    m_ReaderLink = std::make_unique<xLink>(m_Config.QueueDepth, m_Config.BatchPackets);
+    m_WorkerLinks.clear();
+    m_WorkerDemuxers.clear();
+    m_WorkerPools.clear();
+    for(int32_t w = 0; w < m_Config.NumWorkers; w++)
+    {
+        m_WorkerLinks.push_back(std::make_unique<xLink>(m_Config.QueueDepth, m_Config.BatchPackets));
+        m_WorkerPools.push_back(std::make_unique<xPES_BufferPool>());
+        m_WorkerDemuxers.push_back(std::make_unique<xTS_Demuxer>());
+        xTS_Demuxer& Demuxer = *m_WorkerDemuxers.back();
+        Demuxer.setBufferPool(m_WorkerPools.back().get()); // one pool per worker thread, pools are not thread-safe
+        Demuxer.setAutoAddPES(m_Config.AutoAddPES);
+        Demuxer.setLossPolicy(m_Config.LossPolicy);
+        // workers see no PSI - the stream type learned by the demux thread before it handed over the PES is used
+        Demuxer.setSinkFactory([this, Factory](int32_t PID, uint8_t StreamId, uint8_t)
+        {
+            return Factory(PID, StreamId, m_StreamTypes[PID].load(std::memory_order_relaxed));
+        });
+    }
+
+    // static PID -> worker assignment for explicit PIDs, automatic PIDs are assigned on first sight by the demux thread
+    for(int16_t& Worker : m_PIDToWorker) { Worker = -1; }
+    int32_t NextWorker = 0;
+    for(int32_t PID : m_Config.PIDs)
+    {
+        if(PID < 0 || PID >= xTS_Demuxer::NumPIDs || m_PIDToWorker[PID] >= 0) { continue; }
+        m_PIDToWorker[PID] = (int16_t)NextWorker;
+        m_WorkerDemuxers[NextWorker]->AddPID(PID);
+        NextWorker = (NextWorker + 1) % m_Config.NumWorkers;
+    }
+
+    std::vector<std::thread> Workers;
+    for(int32_t w = 0; w < m_Config.NumWorkers; w++) { Workers.emplace_back(&xTS_Pipeline::xWorkerThread, this, w); }
+    std::thread Demux(&xTS_Pipeline::xDemuxThread, this);
+
+    bool Ok = xReaderThread(Source); // I/O stage runs on the calling thread
+
+    Demux.join();
+    for(std::thread& Worker : Workers) { Worker.join(); }
+    for(std::unique_ptr<xTS_Demuxer>& Demuxer : m_WorkerDemuxers)
+    {
+        Demuxer->Finish();
+        if(!Demuxer->CloseSinks()) { Ok = false; }
+    }
+    return Ok;
+}
+
+bool xTS_Pipeline::xReaderThread(xTS_PacketSource& Source)
+{
+    xTS_PacketSpan Span;
+    int32_t NumPackets = 0;
+    bool    Ok         = true;
+    while((NumPackets = Source.ReadSpan(Span, m_Config.BatchPackets)) > 0)
+    {
+        xBatch* Batch = m_ReaderLink->Free.Pop();
+        if(Span.PacketSize == (int32_t)xTS::TS_PacketLength)
+        {
+            std::memcpy(Batch->Data.data(), Span.Data, (size_t)NumPackets * xTS::TS_PacketLength);
+        }
+        else
+        {
+            // normalize M2TS / RS packets to plain 188-byte stride
+            for(int32_t i = 0; i < NumPackets; i++) { std::memcpy(Batch->getPacket(i), Span.getPacket(i), xTS::TS_PacketLength); }
+        }
+        Batch->NumPackets = NumPackets;
+        Batch->Last       = false;
+        m_ReaderLink->Full.Push(Batch);
+        m_NumPackets += (uint64_t)NumPackets;
+    }
+    if(NumPackets < 0) { Ok = false; }
+
+    xBatch* Last = m_ReaderLink->Free.Pop();
+    Last->NumPackets = 0;
+    Last->Last       = true;
+    m_ReaderLink->Full.Push(Last);
+    return Ok;
+}
+
+void xTS_Pipeline::xDemuxThread()
+{
+    const int32_t NumWorkers = m_Config.NumWorkers;
+    std::vector<xBatch*> Pending(NumWorkers, nullptr);
+    std::unique_ptr<xTS_PacketBatch> Headers = std::make_unique<xTS_PacketBatch>();
+    int32_t NextWorker = 0;
+
+    xPSI_Parser         PSI;
+    xTS_PacketHeader    PacketHeader;
+    xTS_AdaptationField AdaptationField;
+    PSI.setOnPMT([this](const xPSI_PMT& PMT)
+    {
+        for(const xPSI_PMT::xStream& ES : PMT.Streams) { m_StreamTypes[ES.PID].store(ES.StreamType, std::memory_order_relaxed); }
+    });
+
+    auto Dispatch = [&](int32_t Worker)
+    {
+        m_WorkerLinks[Worker]->Full.Push(Pending[Worker]);
+        Pending[Worker] = nullptr;
+    };
+
+    while(true)
+    {
+        xBatch* In = m_ReaderLink->Full.Pop();
+        if(In->Last) { m_ReaderLink->Free.Push(In); break; }
+
+        xTS_PacketSpan Span;
+        Span.Data       = In->Data.data();
+        Span.NumPackets = In->NumPackets;
+        Headers->Decode(Span);
+
+        for(int32_t i = 0; i < In->NumPackets; i++)
+        {
+            const uint16_t PID    = Headers->PID[i];
+            if(PSI.isPSIPID(PID))
+            {
+                Headers->getHeader(i, PacketHeader);
+                if(PacketHeader.hasAdaptationField()) { AdaptationField.Parse(In->getPacket(i) + xTS::TS_HeaderLength, (uint8_t)PacketHeader.getAFC()); }
+                PSI.ProcessPacket(In->getPacket(i), PacketHeader, AdaptationField);
+                continue;
+            }
+            int16_t        Worker = m_PIDToWorker[PID];
+            if(Worker < 0)
+            {
+                // discovered stream - only payload units may open a new elementary stream
+                if(!m_Config.AutoAddPES || !Headers->PUSI[i] || PID < 0x0020 || PID == (uint16_t)xTS_PacketHeader::ePID::NuLL) { continue; }
+                Worker = (int16_t)NextWorker;
+                m_PIDToWorker[PID] = Worker;
+                NextWorker = (NextWorker + 1) % NumWorkers;
+            }
+            if(!Pending[Worker]) { Pending[Worker] = m_WorkerLinks[Worker]->Free.Pop(); Pending[Worker]->NumPackets = 0; Pending[Worker]->Last = false; }
+            xBatch* Out = Pending[Worker];
+            std::memcpy(Out->getPacket(Out->NumPackets++), In->getPacket(i), xTS::TS_PacketLength);
+            if(Out->NumPackets == m_Config.BatchPackets) { Dispatch(Worker); }
+        }
+        m_ReaderLink->Free.Push(In);
+    }
+
+    for(int32_t w = 0; w < NumWorkers; w++)
+    {
+        if(Pending[w] && Pending[w]->NumPackets) { Dispatch(w); }
+        if(!Pending[w]) { Pending[w] = m_WorkerLinks[w]->Free.Pop(); }
+        Pending[w]->NumPackets = 0;
+        Pending[w]->Last       = true;
+        Dispatch(w);
+    }
+}
+
+void xTS_Pipeline::xWorkerThread(int32_t WorkerIdx)
+{
+    xLink&       Link    = *m_WorkerLinks[WorkerIdx];
+    xTS_Demuxer& Demuxer = *m_WorkerDemuxers[WorkerIdx];
+    std::unique_ptr<xTS_PacketBatch> Headers = std::make_unique<xTS_PacketBatch>();
+
+    while(true)
+    {
+        xBatch* In = Link.Full.Pop();
+        if(In->Last) { Link.Free.Push(In); break; }
+        xTS_PacketSpan Span;
+        Span.Data       = In->Data.data();
+        Span.NumPackets = In->NumPackets;
+        Headers->Decode(Span);
+        Demuxer.ProcessBatch(*Headers);
+        Link.Free.Push(In);
+    }
+}
+
+std::vector<const xTS_Demuxer::xStream*> xTS_Pipeline::getStreams() const
+{
+    std::vector<const xTS_Demuxer::xStream*> Streams;
+    for(const std::unique_ptr<xTS_Demuxer>& Demuxer : m_WorkerDemuxers)
+    {
+        for(const xTS_Demuxer::xStream& Stream : Demuxer->getStreams()) { Streams.push_back(&Stream); }
+    }
+    return Streams;
+}
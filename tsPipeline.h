@@ -0,0 +1,75 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsPacketSource.h"
+#include "tsDemuxer.h"
+#include "tsSPSCQueue.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_Pipeline
+//=============================================================================================================================================================================
+
+// Threaded extraction: I/O thread -> demux thread -> N assembler/writer workers.
+// The I/O thread copies spans into 188-byte-stride batches, the demux thread decodes headers (SoA) and fans packets
+// out to the worker owning their PID, every worker runs its own xTS_Demuxer (assemblers + sinks) for a disjoint set
+// of PIDs. All hand-offs go through SPSC rings, and emptied batches travel back to their producer on return rings,
+// so the steady state allocates nothing. A PID always maps to one worker and rings are FIFO - per-PID order is kept.
+// The demux thread also parses the PSI, so the outputs are named by the PMT stream types as in a sequential run.
+class xTS_Pipeline
+{
+public:
+  static constexpr int32_t MaxWorkers = 256;
+
+  struct xConfig
+  {
+    int32_t                    NumWorkers   = 2;
+    int32_t                    BatchPackets = 1024; // packets per hand-off batch
+    int32_t                    QueueDepth   = 16;   // batches in flight per ring
+    std::vector<int32_t>       PIDs;                // explicit PIDs to extract
+    bool                       AutoAddPES   = false;
+    xPES_Assembler::eLossPolicy LossPolicy  = xPES_Assembler::eLossPolicy::Drop;
+    xTS_Demuxer::tSinkFactory  SinkFactory;         // default: xTS_Demuxer::DefaultSinkFactory, called from worker threads
+  };
+
+  struct xBatch
+  {
+    std::vector<uint8_t> Data;
+    int32_t              NumPackets = 0;
+    bool                 Last       = false; // end-of-stream marker
+
+    const uint8_t* getPacket(int32_t Idx) const { return Data.data() + (size_t)Idx * xTS::TS_PacketLength; }
+    uint8_t*       getPacket(int32_t Idx)       { return Data.data() + (size_t)Idx * xTS::TS_PacketLength; }
+  };
+
+public:
+  // Runs the whole input through the pipeline, returns false on I/O error.
+  bool Run(xTS_PacketSource& Source, const xConfig& Config);
+
+  // Streams of all workers, valid after Run().
+  std::vector<const xTS_Demuxer::xStream*> getStreams() const;
+  uint64_t getNumPackets() const { return m_NumPackets; }
+
+protected:
+  struct xLink // one producer -> consumer ring with its free-batch return ring
+  {
+    xSPSC_Queue<xBatch*>                 Full;
+    xSPSC_Queue<xBatch*>                 Free;
+    std::vector<std::unique_ptr<xBatch>> Storage;
+    xLink(int32_t Depth, int32_t BatchPackets);
+  };
+
+  bool xReaderThread (xTS_PacketSource& Source);
+  void xDemuxThread  ();
+  void xWorkerThread (int32_t WorkerIdx);
+
+  xConfig                             m_Config;
+  std::unique_ptr<xLink>              m_ReaderLink;
+  std::vector<std::unique_ptr<xLink>> m_WorkerLinks;
+  std::vector<std::unique_ptr<xPES_BufferPool>> m_WorkerPools; // declared before the demuxers - must outlive their assemblers
+  std::vector<std::unique_ptr<xTS_Demuxer>> m_WorkerDemuxers;
+  int16_t                             m_PIDToWorker[xTS_Demuxer::NumPIDs];
+  std::atomic<uint8_t>                m_StreamTypes[xTS_Demuxer::NumPIDs]; // written by the demux thread, read by sink factories
+  uint64_t                            m_NumPackets = 0;
+};
@@ -0,0 +1,394 @@
+#include "tsPlayout.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+
+#if !defined(_WIN32) && !defined(__linux__)
+struct mmsghdr { msghdr msg_hdr; unsigned msg_len; }; // no sendmmsg() - the messages are sent one by one
+#endif
+
+//=============================================================================================================================================================================
+// xTS_Playout
+//=============================================================================================================================================================================
+
+const int64_t xTS_Playout::LateBounds_ns[NumLateBuckets - 1] = { 1000, 10000, 100000, 1000000 };
+
+static int64_t xMonotonicNs()
+{
+#if defined(_WIN32)
+    return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time); // the clock clock_nanosleep() waits on
+    return (int64_t)Time.tv_sec * 1000000000 + Time.tv_nsec;
+#endif
+}
+
+static inline void xCpuRelax()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86)) || defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    _mm_pause();
+#endif
+}
+
+#if !defined(_WIN32)
+// "udp://address:port" to an IPv4 address and port, an empty address is the local host
+static bool xResolve(const char* Address, uint32_t& Host, uint16_t& Port)
+{
+    std::string Name;
+    if(!xTS_UDPSource::ParseAddress(Address, Name, Port) || Port == 0) { return false; }
+    in_addr Addr;
+    Addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(!Name.empty() && inet_pton(AF_INET, Name.c_str(), &Addr) != 1)
+    {
+        addrinfo  Hints  = {};
+        addrinfo* Result = nullptr;
+        Hints.ai_family   = AF_INET;
+        Hints.ai_socktype = SOCK_DGRAM;
+        if(getaddrinfo(Name.c_str(), nullptr, &Hints, &Result) != 0 || !Result) { return false; }
+        Addr = ((sockaddr_in*)Result->ai_addr)->sin_addr;
+        freeaddrinfo(Result);
+    }
+    Host = Addr.s_addr;
+    return true;
+}
+#endif
+
+bool xTS_Playout::Run(const std::vector<xChannel>& Channels, const xConfig& Config)
+{
+    m_Config = Config;
+    m_Config.PacketsPerDatagram = std::clamp(m_Config.PacketsPerDatagram, 1, MaxPacketsPerDatagram);
+    m_Config.BatchSize          = std::clamp(m_Config.BatchSize, 1, MaxBatch);
+    m_Stats    = xStats();
+    m_SumLate  = m_SumLate2 = 0;
+    m_Streams.clear();
+    m_ChannelStats.clear();
+#if defined(_WIN32)
+    (void)Channels;
+    return false;
+#else
+    for(const xChannel& Channel : Channels)
+    {
+        std::unique_ptr<xStream> Stream = std::make_unique<xStream>();
+        if(!xResolve(Channel.Address.c_str(), Stream->Host, Stream->Port)) { std::fprintf(stderr, "%s: invalid address\n", Channel.Address.c_str()); return false; }
+        if(!Stream->Source.Open(Channel.InputFileName.c_str())) { std::perror(Channel.InputFileName.c_str()); return false; }
+        Stream->InputFileName = Channel.InputFileName;
+        Stream->Stats.PCR_PID = m_Config.PCR_PID;
+        m_Streams.push_back(std::move(Stream));
+    }
+
+    m_Socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if(m_Socket < 0) { std::perror("socket"); return false; }
+    // a whole batch of every stream has to fit, or sendmmsg() stops short
+    int BufferSize = 4 << 20;
+    setsockopt(m_Socket, SOL_SOCKET, SO_SNDBUF, &BufferSize, sizeof(BufferSize));
+    int TTL = m_Config.MulticastTTL;
+    setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_TTL, &TTL, sizeof(TTL));
+
+    bool          Ok    = true;
+    const int64_t Limit = m_Config.Duration_ms > 0 ? m_Config.Duration_ms * 1000000 : INT64_MAX;
+    m_StartNs  = xMonotonicNs();
+    int64_t Now = 0;
+    while(Ok)
+    {
+        int64_t Next = INT64_MAX;
+        for(const std::unique_ptr<xStream>& Stream : m_Streams)
+        {
+            xFill(*Stream, Now);
+            if(Stream->hasReady()) { Next = std::min(Next, Stream->getFirst().Due); }
+        }
+        if(Next == INT64_MAX || Next >= Limit || Now >= Limit) { break; }
+        if(Next > Now) { xWaitUntil(Next); Now = xNow(); continue; } // streams are refilled up to the new time first
+        Ok  = xSend(Now);
+        Now = xNow();
+    }
+    m_Stats.Seconds = (double)xNow() / 1e9;
+    ::close(m_Socket);
+    m_Socket = -1;
+
+    for(const std::unique_ptr<xStream>& Stream : m_Streams)
+    {
+        xChannelStats Stats = Stream->Stats;
+        Stats.StreamSeconds = (double)Stream->AnchorTicks / xTS::ExtendedClockFrequency_Hz;
+        if(Stats.StreamSeconds > 0) { Stats.Bitrate = (double)Stream->NumTimed * xTS::TS_PacketLength * 8 / Stats.StreamSeconds; }
+        m_ChannelStats.push_back(Stats);
+        Ok = Ok && !Stream->Failed;
+        Stream->Source.Close();
+    }
+    const uint64_t NumLate = m_Config.Speed > 0 ? m_Stats.NumDatagrams : 0;
+    if(NumLate)
+    {
+        m_Stats.AvgLate_ns = m_SumLate / (double)NumLate;
+        m_Stats.RMSLate_ns = std::sqrt(m_SumLate2 / (double)NumLate);
+    }
+    m_Streams.clear();
+    return Ok;
+#endif
+}
+
+/**
+ * @brief Times packets of Stream until it has a datagram due later than Now (or a full batch, or has ended)
+ */
+void xTS_Playout::xFill(xStream& Stream, int64_t Now)
+{
+    while(!Stream.Ended && (!Stream.hasReady() || (Stream.Ready.back().Due <= Now && Stream.getNumReady() < m_Config.BatchSize))) { xAdvance(Stream); }
+}
+
+/**
+ * @brief Takes the next packet of the input - packets wait in Untimed until the PCR closing their segment arrives
+ */
+void xTS_Playout::xAdvance(xStream& Stream)
+{
+    xTS_PacketBatch& Batch = *Stream.Batch;
+    if(Stream.BatchIdx >= Batch.getNumPackets())
+    {
+        xTS_PacketSpan Span;
+        const int32_t  NumRead = Stream.Source.ReadSpan(Span);
+        if(NumRead > 0) { Batch.Decode(Span); Stream.BatchIdx = 0; return; }
+
+        Stream.Failed = NumRead < 0 || !Stream.HasPCR;
+        if(Stream.Failed)
+        {
+            std::fprintf(stderr, "%s: %s\n", Stream.InputFileName.c_str(), NumRead < 0 ? "I/O error when reading" : "no PCR");
+            Stream.Ended = true;
+            return;
+        }
+        // packets after the last PCR leave at the last rate
+        xTime(Stream, Stream.TicksPerPacket * (double)Stream.Untimed.size(), true);
+        if((m_Config.NumLoops == 0 || ++Stream.NumLoops < m_Config.NumLoops) && Stream.LoopPackets > 0)
+        {
+            Stream.Source.Seek(0);
+            Stream.LoopPackets = 0;
+            Stream.Resync      = true; // the PCR starts over - the first one of the next play is a discontinuity
+            return;
+        }
+        if(Stream.Forming.NumPackets) { Stream.Ready.push_back(Stream.Forming); Stream.Forming.NumPackets = 0; }
+        Stream.Ended = true;
+        return;
+    }
+
+    const int32_t  Idx    = Stream.BatchIdx++;
+    const uint8_t* Packet = Batch.getPacket(Idx);
+    Stream.Untimed.push_back(Packet);
+    Stream.LoopPackets++;
+    // adaptation_field_length and the PCR_flag are checked before parsing the whole field
+    const uint8_t* AF = Packet + xTS::TS_HeaderLength;
+    if((Batch.AFC[Idx] & 0x2) && !Batch.TEI[Idx] && AF[0] >= 7 && (AF[1] & 0x10))
+    {
+        if(Stream.Stats.PCR_PID < 0) { Stream.Stats.PCR_PID = Batch.PID[Idx]; }
+        if(Batch.PID[Idx] == Stream.Stats.PCR_PID)
+        {
+            xTS_AdaptationField AdaptationField;
+            AdaptationField.Parse(AF, Batch.AFC[Idx]);
+            if(!AdaptationField.Malformed) { xOnPCR(Stream, AdaptationField.PCR, AdaptationField.DC != 0); }
+        }
+    }
+    if((int32_t)Stream.Untimed.size() >= MaxUntimed)
+    {
+        if(!Stream.HasPCR) { std::fprintf(stderr, "%s: no PCR in the first %d packets\n", Stream.InputFileName.c_str(), MaxUntimed); Stream.Failed = Stream.Ended = true; return; }
+        xTime(Stream, Stream.TicksPerPacket * (double)Stream.Untimed.size(), true);
+        Stream.Resync = true; // the PCR closing this stretch would measure it twice
+    }
+}
+
+/**
+ * @brief Closes the segment since the previous PCR - its packets, this PCR's packet last, are spread over the PCR difference
+ * @param Discontinuity discontinuity_indicator - the time base may jump, the last rate is kept
+ */
+void xTS_Playout::xOnPCR(xStream& Stream, uint64_t PCR, bool Discontinuity)
+{
+    Stream.Stats.NumPCRs++;
+    if(!Stream.HasPCR)
+    {
+        xTime(Stream, 0, false); // packets before the first PCR leave with it
+    }
+    else
+    {
+        const int64_t Ticks = xTS_AdaptationField::PCRDiff(Stream.LastPCR, PCR); // a backward step wraps to a huge value
+        const double  Num   = (double)Stream.Untimed.size();
+        if(Stream.Resync || Discontinuity || Ticks == 0 || Ticks > MaxPCRGap)
+        {
+            Stream.Stats.NumDiscontinuities++;
+            xTime(Stream, Stream.TicksPerPacket * Num, true);
+        }
+        else
+        {
+            Stream.TicksPerPacket = (double)Ticks / Num;
+            xTime(Stream, (double)Ticks, false);
+        }
+    }
+    Stream.HasPCR  = true;
+    Stream.Resync  = false;
+    Stream.LastPCR = PCR;
+}
+
+void xTS_Playout::xTime(xStream& Stream, double SpanTicks, bool Extrapolated)
+{
+    const size_t NumPackets = Stream.Untimed.size();
+    if(!NumPackets) { return; }
+    const double Step  = SpanTicks / (double)NumPackets;
+    const double Scale = m_Config.Speed > 0 ? 1e9 / xTS::ExtendedClockFrequency_Hz / m_Config.Speed : 0; // unpaced - everything is due at once
+    for(size_t i = 0; i < NumPackets; i++)
+    {
+        const double Ticks = (double)Stream.AnchorTicks + Step * (double)(i + 1);
+        xAddPacket(Stream, Stream.Untimed[i], (int64_t)(Ticks * Scale));
+    }
+    Stream.AnchorTicks += std::llround(SpanTicks);
+    Stream.NumTimed    += NumPackets;
+    if(Extrapolated) { Stream.Stats.NumExtrapolated += NumPackets; }
+    Stream.Untimed.clear();
+}
+
+void xTS_Playout::xAddPacket(xStream& Stream, const uint8_t* Packet, int64_t Due)
+{
+    xDatagram& Datagram = Stream.Forming;
+    Datagram.Packets[Datagram.NumPackets++] = Packet;
+    Datagram.Due = Due; // sent when its last packet would have been
+    if(Datagram.NumPackets == m_Config.PacketsPerDatagram)
+    {
+        Stream.Ready.push_back(Datagram);
+        Datagram.NumPackets = 0;
+    }
+}
+
+/**
+ * @brief Sends the datagrams of all streams due at Now, up to BatchSize in one system call
+ * @return false on a socket error other than a refused datagram
+ */
+bool xTS_Playout::xSend(int64_t Now)
+{
+#if defined(_WIN32)
+    (void)Now;
+    return false;
+#else
+    mmsghdr     Messages[MaxBatch];
+    iovec       Vectors [MaxBatch * MaxPacketsPerDatagram];
+    sockaddr_in Names   [MaxBatch];
+    int64_t     Dues    [MaxBatch];
+    xStream*    Owners  [MaxBatch];
+    int32_t     NumPackets[MaxBatch];
+    int32_t     Num        = 0;
+    int32_t     NumVectors = 0;
+    // served round robin from a different stream each time - when a batch is full the rest waits for the next call
+    const int32_t NumStreams = (int32_t)m_Streams.size();
+    for(int32_t s = 0; s < NumStreams && Num < m_Config.BatchSize; s++)
+    {
+        xStream& Stream = *m_Streams[(m_NextStream + s) % NumStreams];
+        while(Stream.hasReady() && Stream.getFirst().Due <= Now && Num < m_Config.BatchSize)
+        {
+            const xDatagram& Datagram = Stream.getFirst();
+            iovec* const First = Vectors + NumVectors;
+            for(int32_t p = 0; p < Datagram.NumPackets; p++)
+            {
+                // packets adjacent in the mapping (188-byte input) share one vector
+                if(p > 0 && (const uint8_t*)Vectors[NumVectors - 1].iov_base + Vectors[NumVectors - 1].iov_len == Datagram.Packets[p]) { Vectors[NumVectors - 1].iov_len += xTS::TS_PacketLength; continue; }
+                Vectors[NumVectors].iov_base = (void*)Datagram.Packets[p];
+                Vectors[NumVectors].iov_len  = xTS::TS_PacketLength;
+                NumVectors++;
+            }
+            Names[Num]                      = {};
+            Names[Num].sin_family           = AF_INET;
+            Names[Num].sin_port             = htons(Stream.Port);
+            Names[Num].sin_addr.s_addr      = Stream.Host;
+            Messages[Num]                   = {};
+            Messages[Num].msg_hdr.msg_name    = &Names[Num];
+            Messages[Num].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            Messages[Num].msg_hdr.msg_iov     = First;
+            Messages[Num].msg_hdr.msg_iovlen  = (size_t)(Vectors + NumVectors - First);
+            Dues      [Num] = Datagram.Due;
+            Owners    [Num] = &Stream;
+            NumPackets[Num] = Datagram.NumPackets;
+            Num++;
+            Stream.PopFirst();
+        }
+    }
+    m_NextStream = (m_NextStream + 1) % std::max(NumStreams, 1);
+    if(!Num) { return true; }
+
+    const int64_t SendTime = xNow();
+    int32_t       Sent     = 0;
+    while(Sent < Num)
+    {
+        int Result;
+#if defined(__linux__)
+        if(Num - Sent > 1) { Result = ::sendmmsg(m_Socket, Messages + Sent, (unsigned)(Num - Sent), 0); }
+        else
+#endif
+        { Result = ::sendmsg(m_Socket, &Messages[Sent].msg_hdr, 0) < 0 ? -1 : 1; }
+        m_Stats.NumCalls++;
+        if(Result < 0)
+        {
+            if(errno == EINTR) { continue; }
+            // the datagram is lost, pacing goes on - a receiver coming and going must not stop the playout
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == ECONNREFUSED || errno == EHOSTUNREACH || errno == ENETUNREACH)
+            {
+                m_Stats.NumSendErrors++;
+                Sent++;
+                continue;
+            }
+            std::perror("sendmmsg");
+            return false;
+        }
+        Sent += Result;
+    }
+
+    for(int32_t i = 0; i < Num; i++)
+    {
+        m_Stats.NumDatagrams++;
+        m_Stats.NumPackets += (uint64_t)NumPackets[i];
+        Owners[i]->Stats.NumDatagrams++;
+        Owners[i]->Stats.NumPackets += (uint64_t)NumPackets[i];
+        if(m_Config.Speed <= 0) { continue; } // unpaced - nothing is late
+        const int64_t Late = SendTime - Dues[i];
+        if(m_Stats.NumDatagrams == 1 || Late < m_Stats.MinLate_ns) { m_Stats.MinLate_ns = Late; }
+        if(m_Stats.NumDatagrams == 1 || Late > m_Stats.MaxLate_ns) { m_Stats.MaxLate_ns = Late; }
+        m_SumLate  += (double)Late;
+        m_SumLate2 += (double)Late * (double)Late;
+        int32_t Bucket = 0;
+        while(Bucket < NumLateBuckets - 1 && Late > LateBounds_ns[Bucket]) { Bucket++; }
+        m_Stats.NumLate[Bucket]++;
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Sleeps until SpinTime before Due, then polls the clock - the sleep alone overshoots by the timer slack and the wake-up latency
+ */
+void xTS_Playout::xWaitUntil(int64_t Due)
+{
+    const int64_t Wake = Due - m_Config.SpinTime_ns;
+    if(Wake > xNow())
+    {
+#if defined(__linux__)
+        const int64_t Abs = m_StartNs + Wake;
+        timespec Time;
+        Time.tv_sec  = (time_t)(Abs / 1000000000);
+        Time.tv_nsec = (long)(Abs % 1000000000);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Time, nullptr) == EINTR) {}
+#else
+        std::this_thread::sleep_for(std::chrono::nanoseconds(Wake - xNow()));
+#endif
+        m_Stats.NumSleeps++;
+    }
+    while(xNow() < Due) { xCpuRelax(); }
+}
+
+int64_t xTS_Playout::xNow() const
+{
+    return xMonotonicNs() - m_StartNs;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketSource.h"
+#include "tsPacketBatch.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_Playout
+//=============================================================================================================================================================================
+
+// Real-time UDP playout of recorded multiplexes, paced by their own PCRs. The packets between two PCRs of the PCR PID
+// are spread evenly over the PCR difference, so each multiplex leaves at the rate it was multiplexed with. Packets are
+// sent as plain 188-byte TS (M2TS headers and RS parity are left out), PacketsPerDatagram per datagram (7 - 1316 bytes,
+// within the Ethernet MTU), a datagram being due when its last packet is. Any number of multiplexes is played from one
+// thread through one socket: the datagrams of all streams that are due go out with one sendmmsg(), gathered straight
+// from the input mappings. The thread sleeps (clock_nanosleep) until SpinTime before the next datagram is due and
+// busy-polls the clock for the rest - a sleep alone wakes up tens of microseconds late. The send error (time of the
+// system call minus the due time) of every datagram is measured. Across a PCR discontinuity (signalled or not), a long
+// stretch without PCR and after the last PCR the last measured rate is kept; a loop restarts the input the same way.
+// POSIX only, Run() fails on Windows.
+class xTS_Playout
+{
+public:
+  static constexpr int32_t MaxPacketsPerDatagram = 7;
+  static constexpr int32_t MaxBatch              = 64;      // datagrams per sendmmsg()
+  static constexpr int32_t MaxUntimed            = 1 << 16; // packets without a PCR before the last rate is extrapolated
+  static constexpr int64_t MaxPCRGap             = 100 * xTS::ExtendedClockFrequency_kHz; // larger jumps are discontinuities, as in xTS_PCRAnalyzer
+  static constexpr int32_t NumLateBuckets        = 5;       // send error up to 1 us, 10 us, 100 us, 1 ms and above
+
+  struct xChannel
+  {
+    std::string InputFileName;
+    std::string Address;       // "udp://address:port", unicast or multicast
+  };
+
+  struct xConfig
+  {
+    int32_t PacketsPerDatagram = MaxPacketsPerDatagram;
+    int32_t BatchSize          = MaxBatch; // datagrams per system call at most, 1 - one sendmsg() per datagram
+    int32_t NumLoops           = 1;        // plays of every input, 0 - endless
+    double  Speed              = 1.0;      // 2.0 - twice the real-time rate, 0 - unpaced, as fast as the socket takes it
+    int64_t SpinTime_ns        = 100000;   // busy-polled before a datagram is due, 0 - sleep only
+    int64_t Duration_ms        = 0;        // stop after this much playout time, 0 - at the end of the inputs
+    int32_t PCR_PID            = -1;       // -1 - the first PID carrying a PCR, for every input
+    int32_t MulticastTTL       = 1;
+  };
+
+  struct xChannelStats
+  {
+    int32_t  PCR_PID            = -1;
+    uint64_t NumPackets         = 0;
+    uint64_t NumDatagrams       = 0;
+    uint64_t NumPCRs            = 0;
+    uint64_t NumDiscontinuities = 0; // signalled, a jump or a loop - the last rate was kept
+    uint64_t NumExtrapolated    = 0; // packets timed with the last rate instead of between two PCRs
+    double   StreamSeconds      = 0; // playout time of the stream's packets (before Speed)
+    double   Bitrate            = 0; // bit/s from the PCRs
+  };
+
+  struct xStats
+  {
+    uint64_t NumPackets    = 0;
+    uint64_t NumDatagrams  = 0;
+    uint64_t NumCalls      = 0; // sendmmsg / sendmsg
+    uint64_t NumSendErrors = 0; // datagrams the socket refused
+    uint64_t NumSleeps     = 0;
+    int64_t  MinLate_ns    = 0; // send error - how much later than due the datagram was handed to the socket
+    int64_t  MaxLate_ns    = 0;
+    double   AvgLate_ns    = 0;
+    double   RMSLate_ns    = 0;
+    uint64_t NumLate[NumLateBuckets] = {};
+    double   Seconds       = 0; // wall time of the playout
+  };
+
+public:
+  // Plays every input to its address until all of them end (or Config.Duration_ms). Returns false if an input or an
+  // address cannot be opened, or an input has no PCR.
+  bool Run(const std::vector<xChannel>& Channels, const xConfig& Config);
+
+  const xStats&                     getStats       () const { return m_Stats; }
+  const std::vector<xChannelStats>& getChannelStats() const { return m_ChannelStats; }
+
+  static const int64_t LateBounds_ns[NumLateBuckets - 1];
+
+protected:
+  struct xDatagram
+  {
+    int64_t        Due        = 0; // ns since the start of the playout
+    int32_t        NumPackets = 0;
+    const uint8_t* Packets[MaxPacketsPerDatagram];
+  };
+
+  struct xStream
+  {
+    std::string                      InputFileName;
+    xTS_MappedFileSource             Source;
+    std::unique_ptr<xTS_PacketBatch> Batch = std::make_unique<xTS_PacketBatch>();
+    int32_t                          BatchIdx      = 0;
+    uint32_t                         Host          = 0; // IPv4, network byte order
+    uint16_t                         Port          = 0;
+    int32_t                          NumLoops      = 0;
+    uint64_t                         LoopPackets   = 0;
+    bool                             Ended         = false;
+    bool                             Failed        = false;
+    std::vector<const uint8_t*>      Untimed;           // packets since the last PCR
+    bool                             HasPCR        = false;
+    bool                             Resync        = false; // the next PCR does not continue the last one
+    uint64_t                         LastPCR       = 0;
+    int64_t                          AnchorTicks   = 0; // playout time of the last timed packet, 27 MHz
+    double                           TicksPerPacket = 0; // last measured rate, 0 - none yet
+    uint64_t                         NumTimed      = 0;
+    xDatagram                        Forming;
+    std::vector<xDatagram>           Ready;             // timed datagrams, not sent yet from ReadyBeg on - the storage is
+    size_t                           ReadyBeg      = 0; // reused, a deque would allocate and free a node every few datagrams
+    xChannelStats                    Stats;
+
+    bool             hasReady() const { return ReadyBeg < Ready.size(); }
+    int32_t          getNumReady() const { return (int32_t)(Ready.size() - ReadyBeg); }
+    const xDatagram& getFirst() const { return Ready[ReadyBeg]; }
+    void             PopFirst()
+    {
+      if(++ReadyBeg == Ready.size()) { Ready.clear(); ReadyBeg = 0; }
+      else if(ReadyBeg >= 1024)      { Ready.erase(Ready.begin(), Ready.begin() + (std::ptrdiff_t)ReadyBeg); ReadyBeg = 0; } // never drained - a playout running behind
+    }
+  };
+
+  void    xFill      (xStream& Stream, int64_t Now);
+  void    xAdvance   (xStream& Stream);
+  void    xOnPCR     (xStream& Stream, uint64_t PCR, bool Discontinuity);
+  void    xTime      (xStream& Stream, double SpanTicks, bool Extrapolated); // spreads the untimed packets over SpanTicks
+  void    xAddPacket (xStream& Stream, const uint8_t* Packet, int64_t Due);
+  bool    xSend      (int64_t Now);
+  void    xWaitUntil (int64_t Due);
+  int64_t xNow       () const;
+
+  xConfig                               m_Config;
+  std::vector<std::unique_ptr<xStream>> m_Streams;
+  std::vector<xChannelStats>            m_ChannelStats;
+  int                                   m_Socket     = -1;
+  int32_t                               m_NextStream = 0; // served first by the next xSend()
+  int64_t                               m_StartNs    = 0; // monotonic clock at the start, ns
+  double                                m_SumLate    = 0;
+  double                                m_SumLate2   = 0;
+  xStats                                m_Stats;
+};
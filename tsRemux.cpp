@@ -0,0 +1,426 @@
+#include "tsRemux.h"
+#include "tsCRC32.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_Remuxer
+//=============================================================================================================================================================================
+
+bool xTS_Remuxer::Run(const char* InputFileName, const char* OutputFileName, const xConfig& Config)
+{
+    m_Config = Config;
+    m_Stats  = xStats();
+    m_RunBeg = m_RunEnd = 0;
+    m_Gather.clear();
+    m_GatherSize = 0;
+
+    if(!m_Source.Open(InputFileName)) { return false; }
+#if defined(_WIN32)
+    m_InFD = _open(InputFileName, _O_RDONLY | _O_BINARY);
+#else
+    m_InFD = open(InputFileName, O_RDONLY);
+#endif
+    if(m_InFD < 0) { std::perror(InputFileName); return false; }
+
+    const bool ToStdout = !std::strcmp(OutputFileName, "-");
+#if defined(_WIN32)
+    if(ToStdout) { _setmode(1, _O_BINARY); }
+    m_OutFD = ToStdout ? 1 : _open(OutputFileName, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    m_OutFD = ToStdout ? STDOUT_FILENO : open(OutputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if(m_OutFD < 0)
+    {
+        std::perror(OutputFileName);
+#if defined(_WIN32)
+        _close(m_InFD);
+#else
+        close(m_InFD);
+#endif
+        m_InFD = -1;
+        return false;
+    }
+
+    m_Copy = m_Config.Copy;
+#if defined(__linux__)
+    if(m_Copy == eCopy::Auto)
+    {
+        struct stat Stat;
+        m_Copy = fstat(m_OutFD, &Stat) == 0 && S_ISFIFO(Stat.st_mode) ? eCopy::Splice : eCopy::CopyFileRange;
+    }
+#else
+    m_Copy = eCopy::Write; // kernel copies are Linux only
+#endif
+
+    std::fill(m_Actions, m_Actions + NumPIDs, eAction::Drop);
+    std::fill(m_CC, m_CC + NumPIDs, (int8_t)-1);
+    m_VersionBump = 0;
+    m_KeptPrograms.clear();
+    m_PAT = { 0, {} };
+    m_PSI = std::make_unique<xPSI_Parser>();
+    m_PSI->setOnPAT([this](const xPSI_PAT&) { xUpdateActions(); });
+    m_PSI->setOnPMT([this](const xPSI_PMT&) { xUpdateActions(); });
+    m_PSI->setOnSection([this](int32_t PID, const uint8_t* Section, int32_t Size)
+    {
+        const uint8_t TableId = Section[0];
+        if((PID == 0) != (TableId == (uint8_t)xPSI_Parser::eTableId::PAT) || (TableId != (uint8_t)xPSI_Parser::eTableId::PAT && TableId != (uint8_t)xPSI_Parser::eTableId::PMT)) { return; }
+        m_Sections.push_back({ PID, std::vector<uint8_t>(Section, Section + Size) });
+        if(PID == 0) { m_PAT = m_Sections.back(); }
+    });
+    xUpdateActions();
+
+    xTS_PacketHeader    PacketHeader;
+    xTS_AdaptationField AdaptationField;
+    xTS_PacketSpan      Span;
+    bool                Ok         = true;
+    int32_t             NumRead    = 0;
+    while(Ok && (NumRead = m_Source.ReadSpan(Span)) > 0)
+    {
+        const int32_t NumPackets = m_Batch->Decode(Span);
+        m_Stats.NumPackets += (uint64_t)NumPackets;
+        for(int32_t i = 0; i < NumPackets && Ok; i++)
+        {
+            const int32_t PID = m_Batch->PID[i];
+            if(m_PSI->isPSIPID(PID))
+            {
+                const uint8_t* Packet = m_Batch->getPacket(i);
+                m_Batch->getHeader(i, PacketHeader);
+                if(PacketHeader.hasAdaptationField()) { AdaptationField.Parse(Packet + xTS::TS_HeaderLength, (uint8_t)PacketHeader.getAFC()); }
+                const uint8_t VersionBump = m_VersionBump;
+                m_Sections.clear();
+                m_PSI->ProcessPacket(Packet, PacketHeader, AdaptationField);
+                // a PMT bringing a program in changes the PAT too - it is sent right away, not with the next PAT repetition
+                if(m_Config.RewritePSI && VersionBump != m_VersionBump && PID != 0 && !m_PAT.Data.empty()) { Ok = xWriteSection(m_PAT, Packet - Span.SyncOffset, Span.PacketSize, Span.SyncOffset); }
+                if(m_Actions[PID] == eAction::Rewrite) // actions may have just changed with the tables of this packet
+                {
+                    for(const xSection& Section : m_Sections) { Ok = Ok && xWriteSection(Section, Packet - Span.SyncOffset, Span.PacketSize, Span.SyncOffset); }
+                    continue;
+                }
+            }
+            switch(m_Actions[PID])
+            {
+                case eAction::Copy: Ok = xKeepPacket(m_Batch->getPacketOffset(i), Span.PacketSize); break;
+                case eAction::Drop: if(PID == (int32_t)xTS_PacketHeader::ePID::NuLL) { m_Stats.NumNull++; } break;
+                default           : break;
+            }
+        }
+    }
+    Ok = Ok && NumRead == 0 && xFlushRun() && xFlushGather();
+
+#if defined(_WIN32)
+    _close(m_InFD);
+    if(!ToStdout) { _close(m_OutFD); }
+#else
+    close(m_InFD);
+    if(!ToStdout && close(m_OutFD) != 0) { std::perror(OutputFileName); Ok = false; }
+#endif
+    m_InFD = m_OutFD = -1;
+    return Ok;
+}
+
+/**
+ * @brief Recomputes what happens to every PID from the configuration and the tables received so far
+ */
+void xTS_Remuxer::xUpdateActions()
+{
+    const eAction         PSIAction = m_Config.RewritePSI ? eAction::Rewrite : eAction::Copy;
+    const bool            PassAll   = m_Config.PIDs.empty() && m_Config.Programs.empty();
+    eAction               Actions[NumPIDs];
+    std::vector<uint16_t> KeptPrograms;
+
+    std::fill(Actions, Actions + NumPIDs, PassAll ? eAction::Copy : eAction::Drop);
+    for(int32_t PID : m_Config.PIDs) { if(PID >= 0 && PID < NumPIDs) { Actions[PID] = eAction::Copy; } }
+
+    const std::vector<xPSI_PMT>& PMTs = m_PSI->getPMTs();
+    if(m_PSI->hasPAT())
+    {
+        for(const xPSI_PAT::xProgram& Program : m_PSI->getPAT().Programs)
+        {
+            const bool Selected = PassAll || std::find(m_Config.Programs.begin(), m_Config.Programs.end(), (int32_t)Program.ProgramNumber) != m_Config.Programs.end();
+            if(Selected) { KeptPrograms.push_back(Program.ProgramNumber); }
+        }
+    }
+    for(const xPSI_PMT& PMT : PMTs)
+    {
+        bool Kept = std::find(KeptPrograms.begin(), KeptPrograms.end(), PMT.ProgramNumber) != KeptPrograms.end();
+        if(Kept) { for(const xPSI_PMT::xStream& Stream : PMT.Streams) { Actions[Stream.PID] = eAction::Copy; } }
+        else
+        {
+            for(const xPSI_PMT::xStream& Stream : PMT.Streams) { Kept = Kept || std::find(m_Config.PIDs.begin(), m_Config.PIDs.end(), (int32_t)Stream.PID) != m_Config.PIDs.end(); }
+            if(Kept) { KeptPrograms.push_back(PMT.ProgramNumber); }
+        }
+        if(Kept && PMT.PCR_PID != (uint16_t)xTS_PacketHeader::ePID::NuLL) { Actions[PMT.PCR_PID] = eAction::Copy; }
+    }
+    if(m_PSI->hasPAT()) // PMT PIDs of kept programs, set last - PSI wins over a stream sharing the PID
+    {
+        for(const xPSI_PAT::xProgram& Program : m_PSI->getPAT().Programs)
+        {
+            if(Program.ProgramNumber != 0 && std::find(KeptPrograms.begin(), KeptPrograms.end(), Program.ProgramNumber) != KeptPrograms.end()) { Actions[Program.PMT_PID] = PSIAction; }
+        }
+    }
+    Actions[0] = PSIAction;
+    Actions[(int32_t)xTS_PacketHeader::ePID::NuLL] = m_Config.StripNull ? eAction::Drop : eAction::Copy;
+
+    if(!std::equal(Actions, Actions + NumPIDs, m_Actions) || KeptPrograms != m_KeptPrograms) { m_VersionBump++; }
+    std::copy(Actions, Actions + NumPIDs, m_Actions);
+    m_KeptPrograms = std::move(KeptPrograms);
+}
+
+bool xTS_Remuxer::xIsProgramKept(int32_t ProgramNumber) const
+{
+    return std::find(m_KeptPrograms.begin(), m_KeptPrograms.end(), (uint16_t)ProgramNumber) != m_KeptPrograms.end();
+}
+
+/**
+ * @brief Adds a packet to the current run - a packet not adjacent to it in the input closes the run first
+ */
+bool xTS_Remuxer::xKeepPacket(uint64_t Offset, int32_t Size)
+{
+    if(Offset != m_RunEnd || m_RunEnd - m_RunBeg >= MaxRunSize)
+    {
+        if(!xFlushRun()) { return false; }
+        m_RunBeg = Offset;
+    }
+    m_RunEnd = Offset + (uint64_t)Size;
+    m_Stats.NumKept++;
+    return true;
+}
+
+/**
+ * @brief Closes the current run - a long one is copied by the kernel, short ones are gathered for one writev()
+ */
+bool xTS_Remuxer::xFlushRun()
+{
+    if(m_RunEnd == m_RunBeg) { return true; }
+    const uint64_t Offset = m_RunBeg;
+    const uint64_t Size   = m_RunEnd - m_RunBeg;
+    m_RunBeg = m_RunEnd;
+    m_Stats.NumRuns++;
+    m_Stats.NumBytesCopied += Size;
+    if(Size >= MinCopySize && m_Copy != eCopy::Write) { return xFlushGather() && xCopy(Offset, Size); }
+    m_Gather.push_back({ m_Source.getData() + Offset, Size });
+    m_GatherSize += Size;
+    return (m_Gather.size() < (size_t)MaxGather && m_GatherSize < MaxRunSize) || xFlushGather();
+}
+
+/**
+ * @brief Writes the gathered runs straight from the input mapping, in as few writev() calls as the kernel allows
+ */
+bool xTS_Remuxer::xFlushGather()
+{
+    bool Ok = true;
+#if defined(_WIN32)
+    for(size_t i = 0; i < m_Gather.size() && Ok; i++) { Ok = xWrite(m_Gather[i].first, m_Gather[i].second); }
+#else
+    size_t Done = 0; // runs written completely
+    while(Done < m_Gather.size())
+    {
+        iovec         IOV[MaxGather];
+        const int32_t NumIOV = (int32_t)std::min<size_t>(m_Gather.size() - Done, (size_t)MaxGather);
+        for(int32_t i = 0; i < NumIOV; i++) { IOV[i] = { (void*)m_Gather[Done + (size_t)i].first, (size_t)m_Gather[Done + (size_t)i].second }; }
+        const ssize_t Written = writev(m_OutFD, IOV, NumIOV);
+        if(Written < 0 && errno == EINTR) { continue; }
+        if(Written <= 0) { std::perror("xTS_Remuxer"); Ok = false; break; }
+        m_Stats.NumCalls++;
+        m_Stats.NumBytesOut += (uint64_t)Written;
+        for(uint64_t Left = (uint64_t)Written; Left > 0;) // partial write - skip what went out, resume inside a run
+        {
+            tRun& Run = m_Gather[Done];
+            if(Left >= Run.second) { Left -= Run.second; Done++; }
+            else                   { Run.first += Left; Run.second -= Left; Left = 0; }
+        }
+    }
+#endif
+    m_Gather.clear();
+    m_GatherSize = 0;
+    return Ok;
+}
+
+/**
+ * @brief Copies Size bytes at input offset Offset to the output - in the kernel when it can, from the mapping otherwise
+ */
+bool xTS_Remuxer::xCopy(uint64_t Offset, uint64_t Size)
+{
+#if defined(__linux__)
+    while(Size > 0 && m_Copy != eCopy::Write)
+    {
+        loff_t        InOffset = (loff_t)Offset;
+        const ssize_t Copied   = m_Copy == eCopy::Splice ? splice(m_InFD, &InOffset, m_OutFD, nullptr, (size_t)Size, SPLICE_F_MOVE | SPLICE_F_MORE) : copy_file_range(m_InFD, &InOffset, m_OutFD, nullptr, (size_t)Size, 0);
+        if(Copied < 0 && errno == EINTR) { continue; }
+        m_Stats.NumCalls++;
+        if(Copied > 0)
+        {
+            Offset += (uint64_t)Copied;
+            Size   -= (uint64_t)Copied;
+            m_Stats.NumBytesOut += (uint64_t)Copied;
+            continue;
+        }
+        // nothing copied: output on another file system (old kernels), special files, no kernel support - from here on write()
+        if(Copied < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP && errno != EBADF) { std::perror("xTS_Remuxer"); return false; }
+        m_Copy = eCopy::Write;
+    }
+#endif
+    return xWrite(m_Source.getData() + Offset, Size);
+}
+
+bool xTS_Remuxer::xWrite(const uint8_t* Data, uint64_t Size)
+{
+    while(Size > 0)
+    {
+        const uint32_t Chunk = (uint32_t)std::min<uint64_t>(Size, MaxRunSize);
+#if defined(_WIN32)
+        const int     Written = _write(m_OutFD, Data, Chunk);
+#else
+        const ssize_t Written = write(m_OutFD, Data, Chunk);
+#endif
+        if(Written < 0 && errno == EINTR) { continue; }
+        if(Written <= 0) { std::perror("xTS_Remuxer"); return false; }
+        m_Stats.NumCalls++;
+        Data += Written;
+        Size -= (uint64_t)Written;
+        m_Stats.NumBytesOut += (uint64_t)Written;
+    }
+    return true;
+}
+
+/**
+ * @brief Rewrites a PAT or PMT section and packetizes it on its PID, in the packet format of the input
+ * @param Stride input packet the section was completed in - source of the M2TS TP_extra_header
+ */
+bool xTS_Remuxer::xWriteSection(const xSection& Section, const uint8_t* Stride, int32_t PacketSize, int32_t SyncOffset)
+{
+    uint8_t       Table[1024]; // section_length of PAT and PMT is at most 1021
+    const int32_t Size = (int32_t)Section.Data.size();
+    if(Size > (int32_t)sizeof(Table)) { return true; }
+    const int32_t TableSize = Section.Data[0] == (uint8_t)xPSI_Parser::eTableId::PAT ? xRewritePAT(Section.Data.data(), Size, Table) : xRewritePMT(Section.Data.data(), Size, Table);
+    if(TableSize == 0) { return true; }
+    if(!xFlushRun() || !xFlushGather()) { return false; }
+
+    uint8_t       Packets[xTS_SyncScanner::PacketSize_RS * 8];
+    int32_t       NumBytes = 0;
+    int32_t       Done     = -1; // -1: pointer_field not written yet
+    const int32_t PID      = Section.PID;
+    while(Done < TableSize)
+    {
+        uint8_t* Out = Packets + NumBytes;
+        std::memset(Out, 0xFF, (size_t)PacketSize);
+        if(SyncOffset) { std::memcpy(Out, Stride, (size_t)SyncOffset); }
+        if(PacketSize == xTS_SyncScanner::PacketSize_RS) { std::memset(Out + xTS::TS_PacketLength, 0, (size_t)(PacketSize - xTS::TS_PacketLength)); } // parity is not recomputed
+
+        uint8_t* Packet = Out + SyncOffset;
+        m_CC[PID] = (int8_t)((m_CC[PID] + 1) & 0xF);
+        Packet[0] = xTS_SyncScanner::SyncByte;
+        Packet[1] = (uint8_t)((Done < 0 ? 0x40 : 0x00) | (PID >> 8));
+        Packet[2] = (uint8_t)(PID & 0xFF);
+        Packet[3] = (uint8_t)(0x10 | m_CC[PID]); // payload only
+        int32_t Pos = xTS::TS_HeaderLength;
+        if(Done < 0) { Packet[Pos++] = 0; Done = 0; } // pointer_field - the section starts right after it
+        const int32_t Chunk = std::min(TableSize - Done, (int32_t)xTS::TS_PacketLength - Pos);
+        std::memcpy(Packet + Pos, Table + Done, (size_t)Chunk);
+        Done     += Chunk;
+        NumBytes += PacketSize;
+        m_Stats.NumPSIPackets++;
+    }
+    return xWrite(Packets, (uint64_t)NumBytes);
+}
+
+/**
+ * @brief PAT with only the kept programs (and the network PID entry)
+ * @return size of the rewritten section, 0 if the section is damaged
+ */
+int32_t xTS_Remuxer::xRewritePAT(const uint8_t* Section, int32_t Size, uint8_t* Out) const
+{
+    if(Size < 12 || xTS_CRC32::Calc(Section, (size_t)Size) != 0) { return 0; }
+    std::memcpy(Out, Section, 8);
+    int32_t OutSize = 8;
+    for(int32_t Pos = 8; Pos + 4 <= Size - 4; Pos += 4)
+    {
+        const int32_t ProgramNumber = (Section[Pos] << 8) | Section[Pos + 1];
+        if(ProgramNumber != 0 && !xIsProgramKept(ProgramNumber)) { continue; }
+        std::memcpy(Out + OutSize, Section + Pos, 4);
+        OutSize += 4;
+    }
+    OutSize += 4;
+    xFinishSection(Out, OutSize);
+    return OutSize;
+}
+
+/**
+ * @brief PMT of a kept program listing only the kept streams
+ * @return size of the rewritten section, 0 if the program is not kept or the section is damaged
+ */
+int32_t xTS_Remuxer::xRewritePMT(const uint8_t* Section, int32_t Size, uint8_t* Out) const
+{
+    if(Size < 16 || xTS_CRC32::Calc(Section, (size_t)Size) != 0) { return 0; }
+    const int32_t ProgramNumber   = (Section[3] << 8) | Section[4];
+    const int32_t ProgramInfoSize = ((Section[10] & 0x0F) << 8) | Section[11];
+    if(!xIsProgramKept(ProgramNumber) || 12 + ProgramInfoSize > Size - 4) { return 0; }
+
+    int32_t OutSize = 12 + ProgramInfoSize;
+    std::memcpy(Out, Section, (size_t)OutSize);
+    for(int32_t Pos = OutSize; Pos + 5 <= Size - 4;)
+    {
+        const int32_t PID        = ((Section[Pos + 1] & 0x1F) << 8) | Section[Pos + 2];
+        const int32_t EntrySize  = 5 + (((Section[Pos + 3] & 0x0F) << 8) | Section[Pos + 4]);
+        if(Pos + EntrySize > Size - 4) { break; }
+        if(m_Actions[PID] == eAction::Copy)
+        {
+            std::memcpy(Out + OutSize, Section + Pos, (size_t)EntrySize);
+            OutSize += EntrySize;
+        }
+        Pos += EntrySize;
+    }
+    OutSize += 4;
+    xFinishSection(Out, OutSize);
+    return OutSize;
+}
+
+void xTS_Remuxer::xFinishSection(uint8_t* Out, int32_t Size) const
+{
+    const int32_t SectionLength = Size - 3;
+    Out[1] = (uint8_t)((Out[1] & 0xF0) | (SectionLength >> 8));
+    Out[2] = (uint8_t)(SectionLength & 0xFF);
+    const uint8_t Version = (uint8_t)((((Out[5] >> 1) & 0x1F) + m_VersionBump) & 0x1F);
+    Out[5] = (uint8_t)((Out[5] & 0xC1) | (Version << 1));
+    const uint32_t CRC = xTS_CRC32::Calc(Out, (size_t)(Size - 4));
+    Out[Size - 4] = (uint8_t)(CRC >> 24);
+    Out[Size - 3] = (uint8_t)(CRC >> 16);
+    Out[Size - 2] = (uint8_t)(CRC >>  8);
+    Out[Size - 1] = (uint8_t)(CRC      );
+}
+
+const char* xTS_Remuxer::CopyToString(eCopy Copy)
+{
+    switch(Copy)
+    {
+        case eCopy::Auto         : return "auto";
+        case eCopy::CopyFileRange: return "copy_file_range";
+        case eCopy::Splice       : return "splice";
+        case eCopy::Write        : return "write";
+        default                  : return "unknown";
+    }
+}
+
+bool xTS_Remuxer::StringToCopy(const char* Name, eCopy& Copy)
+{
+    if     (!std::strcmp(Name, "auto"           )) { Copy = eCopy::Auto;          }
+    else if(!std::strcmp(Name, "copy_file_range")) { Copy = eCopy::CopyFileRange; }
+    else if(!std::strcmp(Name, "splice"         )) { Copy = eCopy::Splice;        }
+    else if(!std::strcmp(Name, "write"          )) { Copy = eCopy::Write;         }
+    else { return false; }
+    return true;
+}
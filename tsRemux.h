@@ -0,0 +1,108 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsPacketSource.h"
+#include "tsPacketBatch.h"
+#include "tsPSI.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_Remuxer
+//=============================================================================================================================================================================
+
+// PID-filtered transport stream output: whole packets of the selected PIDs and programs are written to a new .ts
+// instead of de-packetized PES. The PAT and the PMTs of the kept programs (and their PCR PIDs) come along, optionally
+// rewritten to list only what is kept, and null packets can be stripped. Kept packets that are contiguous in the input
+// are coalesced into runs; a long run is copied by the kernel from the input file (copy_file_range, or splice into a
+// pipe), so its payload never passes through user space, short runs are gathered and written from the input mapping
+// with one writev() per MaxGather runs. Only the headers are read to decide what to keep. Where the kernel cannot copy
+// (other platforms, file systems without copy_file_range) every run is written from the mapping. The output keeps the
+// packet format of the input (188, 192 or 204 bytes).
+class xTS_Remuxer
+{
+public:
+  static constexpr int32_t  NumPIDs     = 8192;
+  static constexpr uint64_t MaxRunSize  = 16 << 20; // a longer run is copied in pieces, so output keeps up with the scan
+  static constexpr uint64_t MinCopySize = 64 << 10; // shorter runs are gathered into writev() - a system call each would cost more than the copy
+  static constexpr int32_t  MaxGather   = 1024;     // runs per writev() (IOV_MAX)
+
+  enum class eCopy : int32_t
+  {
+    Auto,          // splice for a pipe, copy_file_range otherwise - falls back to Write when the kernel refuses
+    CopyFileRange,
+    Splice,        // output must be a pipe
+    Write,         // write() from the input mapping
+  };
+
+  struct xConfig
+  {
+    std::vector<int32_t> PIDs;               // kept PIDs; nothing in PIDs and Programs - every PID is kept
+    std::vector<int32_t> Programs;           // kept programs (program_number) with all their streams
+    bool                 RewritePSI = false; // PAT/PMT list only the kept programs and streams
+    bool                 StripNull  = false;
+    eCopy                Copy       = eCopy::Auto;
+  };
+
+  struct xStats
+  {
+    uint64_t NumPackets     = 0; // read from the input
+    uint64_t NumKept        = 0; // copied unchanged
+    uint64_t NumNull        = 0; // null packets stripped
+    uint64_t NumPSIPackets  = 0; // rewritten PAT/PMT packets written
+    uint64_t NumRuns        = 0; // coalesced runs of kept packets
+    uint64_t NumCalls       = 0; // output system calls (copy_file_range / splice / writev / write)
+    uint64_t NumBytesCopied = 0; // bytes of kept packets
+    uint64_t NumBytesOut    = 0;
+  };
+
+public:
+  // Filters InputFileName into OutputFileName ("-" - stdout). Returns false on an I/O error.
+  bool Run(const char* InputFileName, const char* OutputFileName, const xConfig& Config);
+
+  const xStats&           getStats () const { return m_Stats; }
+  eCopy                   getCopy  () const { return m_Copy; } // method used in the end
+  const xTS_PacketSource& getSource() const { return m_Source; }
+
+  static const char* CopyToString(eCopy Copy);
+  static bool        StringToCopy(const char* Name, eCopy& Copy);
+
+protected:
+  enum class eAction : uint8_t { Drop, Copy, Rewrite };
+
+  struct xSection { int32_t PID; std::vector<uint8_t> Data; };
+
+  using tRun = std::pair<const uint8_t*, uint64_t>; // kept packets in the input mapping
+
+  void    xUpdateActions();
+  bool    xKeepPacket   (uint64_t Offset, int32_t Size);
+  bool    xFlushRun     ();
+  bool    xFlushGather  ();
+  bool    xCopy         (uint64_t Offset, uint64_t Size);
+  bool    xWrite        (const uint8_t* Data, uint64_t Size);
+  bool    xWriteSection (const xSection& Section, const uint8_t* Stride, int32_t PacketSize, int32_t SyncOffset);
+  int32_t xRewritePAT   (const uint8_t* Section, int32_t Size, uint8_t* Out) const; // size of the rewritten section, 0 - nothing to write
+  int32_t xRewritePMT   (const uint8_t* Section, int32_t Size, uint8_t* Out) const;
+  void    xFinishSection(uint8_t* Out, int32_t Size) const; // section_length, version and CRC_32 of a rewritten section
+  bool    xIsProgramKept(int32_t ProgramNumber) const;
+
+  xConfig                          m_Config;
+  xTS_MappedFileSource             m_Source;
+  std::unique_ptr<xTS_PacketBatch> m_Batch = std::make_unique<xTS_PacketBatch>();
+  std::unique_ptr<xPSI_Parser>     m_PSI;               // new per Run()
+  eAction                          m_Actions[NumPIDs];
+  std::vector<uint16_t>            m_KeptPrograms;      // derived from the PAT/PMTs
+  std::vector<xSection>            m_Sections;          // PAT/PMT sections completed by the packet just parsed
+  xSection                         m_PAT;               // last PAT section - repeated at once when the kept set changes
+  uint8_t                          m_VersionBump = 0;   // rewritten tables change when the kept set does, not only with the input
+  int8_t                           m_CC[NumPIDs];       // continuity counters of rewritten PIDs
+  int32_t                          m_InFD        = -1;
+  int32_t                          m_OutFD       = -1;
+  eCopy                            m_Copy        = eCopy::Write;
+  uint64_t                         m_RunBeg      = 0;   // [RunBeg, RunEnd) - kept packets not copied yet
+  uint64_t                         m_RunEnd      = 0;
+  std::vector<tRun>                m_Gather;            // short runs waiting for writev()
+  uint64_t                         m_GatherSize  = 0;
+  xStats                           m_Stats;
+};
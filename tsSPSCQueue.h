@@ -0,0 +1,72 @@
+#pragma once
+#include "tsCommon.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xSPSC_Queue
+//=============================================================================================================================================================================
+
+// Bounded lock-free single-producer/single-consumer ring. Head and tail live on separate cache lines and each side
+// caches the other side's index, so in steady state a push or pop touches shared state only once per wrap.
+template <typename T> class xSPSC_Queue
+{
+public:
+  explicit xSPSC_Queue(uint32_t MinCapacity)
+  {
+    uint32_t Capacity = 2;
+    while(Capacity < MinCapacity) { Capacity <<= 1; }
+    m_Data.resize(Capacity);
+    m_Mask = Capacity - 1;
+  }
+  xSPSC_Queue(const xSPSC_Queue&) = delete;
+  xSPSC_Queue& operator=(const xSPSC_Queue&) = delete;
+
+  bool TryPush(const T& Item)
+  {
+    const uint32_t Tail = m_Tail.load(std::memory_order_relaxed);
+    if(Tail - m_CachedHead > m_Mask)
+    {
+      m_CachedHead = m_Head.load(std::memory_order_acquire);
+      if(Tail - m_CachedHead > m_Mask) { return false; }
+    }
+    m_Data[Tail & m_Mask] = Item;
+    m_Tail.store(Tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T& Item)
+  {
+    const uint32_t Head = m_Head.load(std::memory_order_relaxed);
+    if(Head == m_CachedTail)
+    {
+      m_CachedTail = m_Tail.load(std::memory_order_acquire);
+      if(Head == m_CachedTail) { return false; }
+    }
+    Item = m_Data[Head & m_Mask];
+    m_Head.store(Head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Blocking variants - spin briefly, then yield the core.
+  void Push(const T& Item) { for(uint32_t Spin = 0; !TryPush(Item); Spin++) { xBackoff(Spin); } }
+  T    Pop ()              { T Item; for(uint32_t Spin = 0; !TryPop(Item); Spin++) { xBackoff(Spin); } return Item; }
+
+  uint32_t getCapacity() const { return m_Mask + 1; }
+
+protected:
+  static void xBackoff(uint32_t Spin)
+  {
+    if(Spin < 64) { return; }
+    std::this_thread::yield();
+  }
+
+  std::vector<T> m_Data;
+  uint32_t       m_Mask = 0;
+
+  alignas(64) std::atomic<uint32_t> m_Head{0}; // consumer side
+  uint32_t                          m_CachedTail = 0;
+  alignas(64) std::atomic<uint32_t> m_Tail{0}; // producer side
+  uint32_t                          m_CachedHead = 0;
+};
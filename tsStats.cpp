@@ -0,0 +1,238 @@
+#include "tsStats.h"
+#include <algorithm>
+#include <cstdio>
+
+//=============================================================================================================================================================================
+// xTS_Stats::xTimedSink
+//=============================================================================================================================================================================
+
+class xTS_Stats::xTimedSink : public xES_Sink
+{
+public:
+  xTimedSink(std::unique_ptr<xES_Sink> Sink, xTS_Stats& Stats) : m_Sink(std::move(Sink)), m_Stats(Stats) {}
+
+  void Write(const uint8_t* Data, int32_t Size) override
+  {
+    const uint64_t Scale = xNextScale();
+    if(!Scale) { m_Sink->Write(Data, Size); return; }
+    const uint64_t Beg = getTicks();
+    m_Sink->Write(Data, Size);
+    m_Stats.AddTicks(eStage::Write, (getTicks() - Beg) * Scale);
+  }
+  void WriteSlices(const xPES_Slice* Slices, int32_t NumSlices) override
+  {
+    const uint64_t Scale = xNextScale();
+    if(!Scale) { m_Sink->WriteSlices(Slices, NumSlices); return; }
+    const uint64_t Beg = getTicks();
+    m_Sink->WriteSlices(Slices, NumSlices);
+    m_Stats.AddTicks(eStage::Write, (getTicks() - Beg) * Scale);
+  }
+  void Flush() override { xStageTimer Timer(&m_Stats, eStage::Write); m_Sink->Flush(); }
+  bool Resume(uint64_t Size) override { return m_Sink->Resume(Size); }
+  bool Close() override { xStageTimer Timer(&m_Stats, eStage::Write); return m_Sink->Close(); }
+  bool hasFailed() const override { return m_Sink->hasFailed(); }
+
+protected:
+  // Weight of the time of this call, 0 if it is not timed. The first call (file opened lazily) stands for itself,
+  // then calls 2, 2 + R, 2 + 2R, ... are timed and each stands for the R = WriteSampleRate calls up to the next one.
+  uint64_t xNextScale()
+  {
+    const uint64_t Call = m_NumCalls++;
+    if(Call == 0) { return 1; }
+    return (Call - 1) % WriteSampleRate ? 0 : WriteSampleRate;
+  }
+
+  std::unique_ptr<xES_Sink> m_Sink;
+  xTS_Stats&                m_Stats;
+  uint64_t                  m_NumCalls = 0;
+};
+
+//=============================================================================================================================================================================
+// xTS_Stats
+//=============================================================================================================================================================================
+
+xTS_Stats::xTS_Stats()
+    : m_PIDs(NumPIDs), m_LastCC(NumPIDs, -1), m_Start(std::chrono::steady_clock::now()), m_StartTicks(getTicks())
+{
+}
+
+void xTS_Stats::setOutput(const std::string& FileName, int32_t Interval_ms)
+{
+    m_FileName    = FileName;
+    m_Interval_ms = Interval_ms;
+    const size_t Dot = FileName.find_last_of('.');
+    const std::string Extension = Dot == std::string::npos ? std::string() : FileName.substr(Dot);
+    m_Format       = (Extension == ".prom" || Extension == ".txt") ? eFormat::Prometheus : eFormat::JSON;
+    m_NextSnapshot = std::chrono::steady_clock::now() + std::chrono::milliseconds(Interval_ms);
+}
+
+void xTS_Stats::AddBatch(const xTS_PacketBatch& Batch)
+{
+    const int32_t NumPackets = Batch.getNumPackets();
+    m_NumPackets += (uint64_t)NumPackets;
+    if(NumPackets == 0) { return; }
+
+    // counters of the current run live in registers, the per-PID arrays are touched once per run
+    int32_t      RunPID = Batch.PID[0];
+    int8_t       LastCC = m_LastCC[RunPID];
+    xPIDCounters Run;
+    auto FlushRun = [&]()
+    {
+        xPIDCounters& Counters = m_PIDs[RunPID];
+        Counters.NumPackets   += Run.NumPackets;
+        Counters.NumCCErrors  += Run.NumCCErrors;
+        Counters.NumScrambled += Run.NumScrambled;
+        Counters.NumTEI       += Run.NumTEI;
+        m_LastCC[RunPID] = LastCC;
+        Run = xPIDCounters();
+    };
+    for(int32_t i = 0; i < NumPackets; i++)
+    {
+        const int32_t PID = Batch.PID[i];
+        if(PID != RunPID) { FlushRun(); RunPID = PID; LastCC = m_LastCC[PID]; }
+        Run.NumPackets++;
+        Run.NumScrambled += Batch.TSC[i] != 0;
+        Run.NumTEI       += Batch.TEI[i];
+        if((Batch.AFC[i] & 0x1) && PID != (int32_t)xTS_PacketHeader::ePID::NuLL) // CC does not advance without payload
+        {
+            const int8_t Curr = (int8_t)Batch.CC[i];
+            Run.NumCCErrors += LastCC >= 0 && Curr != LastCC && Curr != ((LastCC + 1) & 0xF);
+            LastCC = Curr;
+        }
+    }
+    FlushRun();
+}
+
+void xTS_Stats::AddPacket(const xTS_PacketHeader& Header)
+{
+    const int32_t PID = (int32_t)Header.PID;
+    xPIDCounters& Counters = m_PIDs[PID];
+    m_NumPackets++;
+    Counters.NumPackets++;
+    Counters.NumScrambled += Header.TSC != 0;
+    Counters.NumTEI       += Header.E;
+    if((Header.AFC & 0x1) && PID != (int32_t)xTS_PacketHeader::ePID::NuLL)
+    {
+        const int8_t Last = m_LastCC[PID];
+        const int8_t Curr = (int8_t)Header.CC;
+        Counters.NumCCErrors += Last >= 0 && Curr != Last && Curr != ((Last + 1) & 0xF);
+        m_LastCC[PID] = Curr;
+    }
+}
+
+xTS_Demuxer::tSinkFactory xTS_Stats::WrapSinkFactory(xTS_Demuxer::tSinkFactory Factory)
+{
+    return [this, Factory = std::move(Factory)](int32_t PID, uint8_t StreamId, uint8_t StreamType) -> std::unique_ptr<xES_Sink>
+    {
+        std::unique_ptr<xES_Sink> Sink = Factory(PID, StreamId, StreamType);
+        if(!Sink) { return nullptr; }
+        return std::make_unique<xTimedSink>(std::move(Sink), *this);
+    };
+}
+
+double xTS_Stats::getSeconds(eStage Stage) const
+{
+    // ticks to seconds by the ratio measured since construction - the TSC frequency is not known up front
+    const uint64_t Ticks = getTicks() - m_StartTicks;
+    const double   Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+    if(Ticks == 0) { return 0; }
+    uint64_t StageTicks = m_Ticks[(int32_t)Stage];
+    // sink writes happen inside assembly - Assemble is reported without them
+    if(Stage == eStage::Assemble) { StageTicks -= std::min(StageTicks, m_Ticks[(int32_t)eStage::Write]); }
+    return (double)StageTicks * Elapsed / (double)Ticks;
+}
+
+const char* xTS_Stats::StageToString(eStage Stage)
+{
+    switch(Stage)
+    {
+        case eStage::Read    : return "read";
+        case eStage::Parse   : return "parse";
+        case eStage::Assemble: return "assemble";
+        case eStage::Write   : return "write";
+        default              : return "unknown";
+    }
+}
+
+std::string xTS_Stats::Format(const xTS_Demuxer* Demuxer) const
+{
+    std::string Out;
+    char Line[512];
+    const double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+    auto getNumPES = [Demuxer](int32_t PID) -> uint64_t { const xTS_Demuxer::xStream* Stream = Demuxer ? Demuxer->getStream(PID) : nullptr; return Stream ? Stream->NumPES : 0; };
+
+    if(m_Format == eFormat::JSON)
+    {
+        std::snprintf(Line, sizeof(Line), "{\"elapsed_s\":%.3f,\"packets\":%" PRIu64 ",\"bytes\":%" PRIu64 ",\"stages\":{", Elapsed, m_NumPackets, m_NumPackets * (uint64_t)m_PacketSize);
+        Out += Line;
+        for(int32_t s = 0; s < (int32_t)eStage::NumStages; s++)
+        {
+            std::snprintf(Line, sizeof(Line), "%s\"%s_s\":%.6f", s ? "," : "", StageToString((eStage)s), getSeconds((eStage)s));
+            Out += Line;
+        }
+        Out += "},\"pids\":[";
+        bool First = true;
+        for(int32_t PID = 0; PID < NumPIDs; PID++)
+        {
+            const xPIDCounters& C = m_PIDs[PID];
+            if(!C.NumPackets) { continue; }
+            std::snprintf(Line, sizeof(Line), "%s{\"pid\":%d,\"packets\":%" PRIu64 ",\"bytes\":%" PRIu64 ",\"pes\":%" PRIu64 ",\"cc_errors\":%" PRIu64 ",\"scrambled\":%" PRIu64 ",\"tei\":%" PRIu64 "}",
+                          First ? "" : ",", PID, C.NumPackets, C.NumPackets * (uint64_t)m_PacketSize, getNumPES(PID), C.NumCCErrors, C.NumScrambled, C.NumTEI);
+            Out += Line;
+            First = false;
+        }
+        Out += "]}\n";
+        return Out;
+    }
+
+    // Prometheus text exposition format
+    std::snprintf(Line, sizeof(Line), "# HELP tsparser_elapsed_seconds Time since the start of the run.\n# TYPE tsparser_elapsed_seconds gauge\ntsparser_elapsed_seconds %.3f\n", Elapsed);
+    Out += Line;
+    Out += "# HELP tsparser_stage_seconds_total Time spent per processing stage.\n# TYPE tsparser_stage_seconds_total counter\n";
+    for(int32_t s = 0; s < (int32_t)eStage::NumStages; s++)
+    {
+        std::snprintf(Line, sizeof(Line), "tsparser_stage_seconds_total{stage=\"%s\"} %.6f\n", StageToString((eStage)s), getSeconds((eStage)s));
+        Out += Line;
+    }
+    struct xMetric { const char* Name; const char* Help; };
+    static const xMetric Metrics[] =
+    {
+        { "tsparser_packets_total"          , "Transport stream packets per PID." },
+        { "tsparser_bytes_total"            , "Transport stream bytes per PID."   },
+        { "tsparser_pes_total"              , "PES packets completed per PID."    },
+        { "tsparser_cc_errors_total"        , "Continuity counter errors per PID." },
+        { "tsparser_scrambled_packets_total", "Packets with transport_scrambling_control set per PID." },
+        { "tsparser_tei_packets_total"      , "Packets with transport_error_indicator set per PID." },
+    };
+    for(int32_t m = 0; m < (int32_t)(sizeof(Metrics) / sizeof(Metrics[0])); m++)
+    {
+        std::snprintf(Line, sizeof(Line), "# HELP %s %s\n# TYPE %s counter\n", Metrics[m].Name, Metrics[m].Help, Metrics[m].Name);
+        Out += Line;
+        for(int32_t PID = 0; PID < NumPIDs; PID++)
+        {
+            const xPIDCounters& C = m_PIDs[PID];
+            if(!C.NumPackets) { continue; }
+            const uint64_t Values[] = { C.NumPackets, C.NumPackets * (uint64_t)m_PacketSize, getNumPES(PID), C.NumCCErrors, C.NumScrambled, C.NumTEI };
+            std::snprintf(Line, sizeof(Line), "%s{pid=\"%d\"} %" PRIu64 "\n", Metrics[m].Name, PID, Values[m]);
+            Out += Line;
+        }
+    }
+    return Out;
+}
+
+bool xTS_Stats::WriteSnapshot(const xTS_Demuxer* Demuxer)
+{
+    m_NextSnapshot = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_Interval_ms);
+    if(m_FileName.empty()) { return true; }
+    // written next to the target and renamed over it
+    const std::string Text     = Format(Demuxer);
+    const std::string TempName = m_FileName + ".tmp";
+    FILE* File = std::fopen(TempName.c_str(), "wb");
+    if(!File) { return false; }
+    const bool Written = std::fwrite(Text.data(), 1, Text.size(), File) == Text.size();
+    if(std::fclose(File) != 0 || !Written) { std::remove(TempName.c_str()); return false; }
+#if defined(_WIN32)
+    std::remove(m_FileName.c_str()); // rename does not replace on Windows
+#endif
+    return std::rename(TempName.c_str(), m_FileName.c_str()) == 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsPacketBatch.h"
+#include "tsDemuxer.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_Stats
+//=============================================================================================================================================================================
+
+// Run-time counters and stage timers for the extraction loop, written as snapshots for a local scraper.
+// Packet counters come from the SoA arrays of the decoded header batches: consecutive packets of one PID are
+// accumulated in registers and stored once per run, so the loop does not stall on per-PID memory counters. Stages
+// are timed once per span with the TSC (steady_clock where there is none), sink writes - many per span - with every
+// WriteSampleRate-th call scaled up. PES counts are taken from the demuxer when a snapshot is written.
+class xTS_Stats
+{
+public:
+  static constexpr int32_t NumPIDs         = 8192;
+  static constexpr int32_t WriteSampleRate = 16;
+
+  enum class eStage  : int32_t { Read, Parse, Assemble, Write, NumStages };
+  enum class eFormat : int32_t { JSON, Prometheus };
+
+  struct xPIDCounters
+  {
+    uint64_t NumPackets   = 0;
+    uint64_t NumCCErrors  = 0; // as xTS_PacketBatch::CountCCErrors()
+    uint64_t NumScrambled = 0; // transport_scrambling_control != 0
+    uint64_t NumTEI       = 0;
+  };
+
+  // Times the enclosing scope into a stage, no-op for a null xTS_Stats.
+  class xStageTimer
+  {
+  public:
+    xStageTimer(xTS_Stats* Stats, eStage Stage) : m_Stats(Stats), m_Stage(Stage), m_Beg(Stats ? getTicks() : 0) {}
+    ~xStageTimer() { if(m_Stats) { m_Stats->AddTicks(m_Stage, getTicks() - m_Beg); } }
+  protected:
+    xTS_Stats* m_Stats;
+    eStage     m_Stage;
+    uint64_t   m_Beg;
+  };
+
+public:
+  xTS_Stats();
+
+  // Snapshot file, rewritten every Interval_ms (0: only by the final WriteSnapshot()). Prometheus text for names
+  // ending in .prom or .txt, JSON otherwise. The file is replaced atomically - a reader never sees half of it.
+  void setOutput(const std::string& FileName, int32_t Interval_ms);
+  void setPacketSize(int32_t PacketSize) { m_PacketSize = PacketSize; }
+
+  void AddBatch (const xTS_PacketBatch& Batch);
+  void AddPacket(const xTS_PacketHeader& Header);
+  void AddTicks (eStage Stage, uint64_t Ticks) { m_Ticks[(int32_t)Stage] += Ticks; }
+
+  // Wraps a sink factory so that writes of the created sinks are timed (sampled) into eStage::Write.
+  xTS_Demuxer::tSinkFactory WrapSinkFactory(xTS_Demuxer::tSinkFactory Factory);
+
+  // Writes a snapshot when the interval has passed, cheap enough to call once per span.
+  void Tick(const xTS_Demuxer* Demuxer) { if(m_Interval_ms > 0 && std::chrono::steady_clock::now() >= m_NextSnapshot) { WriteSnapshot(Demuxer); } }
+  bool WriteSnapshot(const xTS_Demuxer* Demuxer);
+  std::string Format(const xTS_Demuxer* Demuxer) const;
+
+  const xPIDCounters& getCounters  (int32_t PID) const { return m_PIDs[PID]; }
+  uint64_t            getNumPackets()            const { return m_NumPackets; }
+  double              getSeconds   (eStage Stage) const;
+  static const char*  StageToString(eStage Stage);
+
+  static uint64_t getTicks()
+  {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86)) || defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+  }
+
+protected:
+  class xTimedSink;
+
+  std::vector<xPIDCounters> m_PIDs;
+  std::vector<int8_t>       m_LastCC;
+  uint64_t                  m_NumPackets = 0;
+  int32_t                   m_PacketSize = xTS::TS_PacketLength;
+  uint64_t                  m_Ticks[(int32_t)eStage::NumStages] = {};
+
+  std::string               m_FileName;
+  eFormat                   m_Format = eFormat::JSON;
+  int32_t                   m_Interval_ms = 0;
+  std::chrono::steady_clock::time_point m_NextSnapshot;
+  std::chrono::steady_clock::time_point m_Start;
+  uint64_t                  m_StartTicks = 0;
+};
@@ -0,0 +1,316 @@
+#include "tsStreamGenerator.h"
+#include "tsCRC32.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_StreamGenerator
+//=============================================================================================================================================================================
+
+static constexpr double   TicksPerSecond = (double)xTS::ExtendedClockFrequency_Hz;
+static constexpr uint64_t StartPCR       = xTS::ExtendedClockFrequency_Hz; // the first packet goes out at PCR = 1 s
+
+static void AppendSectionEnd(std::vector<uint8_t>& Section)
+{
+    // section_length counts everything after it, CRC_32 included
+    const int32_t SectionLength = (int32_t)Section.size() - 3 + 4;
+    Section[1] = (uint8_t)(0xB0 | (SectionLength >> 8));
+    Section[2] = (uint8_t)(SectionLength & 0xFF);
+    const uint32_t CRC = xTS_CRC32::Calc(Section.data(), Section.size());
+    for(int32_t s = 24; s >= 0; s -= 8) { Section.push_back((uint8_t)(CRC >> s)); }
+}
+
+xTS_StreamGenerator::xTS_StreamGenerator(const xConfig& Config)
+    : m_Config(Config), m_RandomState(Config.Seed ? Config.Seed : 0x9E3779B9)
+{
+    const int32_t NumVideo = std::clamp(Config.NumVideo, 0, MaxVideoStreams);
+    const int32_t NumAudio = std::clamp(Config.NumAudio, 0, MaxStreams - NumVideo);
+    // stream PIDs above the PSI range, below the null PID and clear of the PMT
+    int32_t FirstPID = std::clamp(Config.FirstPID, 0x0020, (int32_t)xTS_PacketHeader::ePID::NuLL - (NumVideo + NumAudio));
+    if(FirstPID <= PMT_PID && FirstPID + NumVideo + NumAudio > PMT_PID) { FirstPID = PMT_PID + 1; }
+    int64_t SumBitrate = 0;
+    for(int32_t i = 0; i < NumVideo + NumAudio; i++)
+    {
+        xStream Stream;
+        Stream.Video      = i < NumVideo;
+        Stream.PID        = (uint16_t)(FirstPID + i);
+        Stream.StreamType = Stream.Video ? 0x1B : 0x03;
+        Stream.StreamId   = (uint8_t)(Stream.Video ? 0xE0 + i : 0xC0 + (i - NumVideo));
+        Stream.Bitrate    = std::max<int64_t>(1000, Stream.Video ? Config.VideoBitrate : Config.AudioBitrate);
+        Stream.PESSize    = std::max<int32_t>(64, Stream.Video ? Config.VideoPESSize : Config.AudioPESSize);
+        Stream.Duration   = (uint64_t)((double)Stream.PESSize * 8 * TicksPerSecond / (double)Stream.Bitrate);
+        SumBitrate += Stream.Bitrate;
+        m_Streams.push_back(std::move(Stream));
+    }
+
+    const int64_t PacketBits = xTS::TS_PacketLength * 8;
+    m_MuxBitrate = Config.MuxBitrate;
+    if(m_MuxBitrate <= 0)
+    {
+        m_MuxBitrate = SumBitrate * xTS::TS_PacketLength / 184 * 11 / 10;
+        m_MuxBitrate += 2 * PacketBits * 1000 / std::max(1, Config.PSIInterval_ms) + PacketBits * 1000 / std::max(1, Config.PCRInterval_ms);
+        m_MuxBitrate = std::max<int64_t>(m_MuxBitrate, 1000000);
+    }
+
+    // PAT: program 1 -> PMT_PID
+    m_PAT = { 0x00, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01, (uint8_t)(0xE0 | (PMT_PID >> 8)), (uint8_t)(PMT_PID & 0xFF) };
+    AppendSectionEnd(m_PAT);
+    // PMT: PCR in the first stream, no descriptors
+    const int32_t PCR_PID = getPCR_PID();
+    m_PMT = { 0x02, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00, (uint8_t)(0xE0 | (PCR_PID >> 8)), (uint8_t)(PCR_PID & 0xFF), 0xF0, 0x00 };
+    for(const xStream& Stream : m_Streams)
+    {
+        const uint8_t Entry[5] = { Stream.StreamType, (uint8_t)(0xE0 | (Stream.PID >> 8)), (uint8_t)(Stream.PID & 0xFF), 0xF0, 0x00 };
+        m_PMT.insert(m_PMT.end(), Entry, Entry + 5);
+    }
+    AppendSectionEnd(m_PMT);
+}
+
+uint32_t xTS_StreamGenerator::xRandom()
+{
+    // xorshift32
+    uint32_t X = m_RandomState;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    return m_RandomState = X;
+}
+
+bool xTS_StreamGenerator::xChance(double Probability)
+{
+    return Probability > 0 && (double)xRandom() < Probability * 4294967296.0;
+}
+
+uint64_t xTS_StreamGenerator::xDueTime(const xStream& Stream) const
+{
+    return (uint64_t)((double)Stream.NumSent * 8 * TicksPerSecond / (double)Stream.Bitrate);
+}
+
+void xTS_StreamGenerator::xBuildPES(xStream& Stream)
+{
+    // the size tracks NumPES * PESSize, the +-50% jitter does not accumulate
+    const int64_t Target = (int64_t)(Stream.NumPES + 1) * Stream.PESSize - (int64_t)Stream.SizeSum;
+    const int64_t Jitter = (int64_t)(xRandom() % (uint32_t)(Stream.PESSize + 1)) - Stream.PESSize / 2;
+    const int32_t Size   = (int32_t)std::max<int64_t>(16, Target + Jitter);
+    const uint64_t PTS   = ((StartPCR + Stream.NumPES * Stream.Duration) / xTS::BaseToExtendedClockMultiplier + (uint64_t)PTSDelay_ms * xTS::BaseClockFrequency_kHz) & ((1ull << 33) - 1);
+
+    Stream.PES.resize(xTS::PES_HeaderLength + 8 + (size_t)Size);
+    uint8_t* P = Stream.PES.data();
+    const int32_t PESLength = Stream.Video || Size + 8 > 0xFFFF ? 0 : Size + 8; // video PES unbounded as in broadcast
+    P[0] = 0x00; P[1] = 0x00; P[2] = 0x01; P[3] = Stream.StreamId;
+    P[4] = (uint8_t)(PESLength >> 8); P[5] = (uint8_t)(PESLength & 0xFF);
+    P[6] = 0x80; P[7] = 0x80; P[8] = 5; // PTS only
+    P[ 9] = (uint8_t)(0x21 | ((PTS >> 29) & 0x0E));
+    P[10] = (uint8_t)(PTS >> 22);
+    P[11] = (uint8_t)(0x01 | ((PTS >> 14) & 0xFE));
+    P[12] = (uint8_t)(PTS >> 7);
+    P[13] = (uint8_t)(0x01 | ((PTS << 1) & 0xFE));
+
+    // payload: random bytes without zeros, so no start code is emulated, then the elementary stream syntax on top
+    uint8_t* ES = P + 14;
+    for(int32_t i = 0; i < Size; i += 4)
+    {
+        const uint32_t R = xRandom() | 0x01010101;
+        for(int32_t b = 0; b < 4 && i + b < Size; b++) { ES[i + b] = (uint8_t)(R >> (8 * b)); }
+    }
+    Stream.IDR = false;
+    if(Stream.Video)
+    {
+        static const uint8_t AUD[] = { 0, 0, 0, 1, 0x09, 0xF0 };
+        static const uint8_t SPS[] = { 0, 0, 0, 1, 0x67 };
+        static const uint8_t PPS[] = { 0, 0, 0, 1, 0x68 };
+        static const uint8_t IDR[] = { 0, 0, 0, 1, 0x65 };
+        static const uint8_t NonIDR[] = { 0, 0, 0, 1, 0x41 };
+        Stream.IDR = Stream.NumPES % (uint64_t)std::max(1, m_Config.GOPLength) == 0;
+        int32_t Pos = 0;
+        auto Put = [&](const uint8_t* NAL, int32_t Length, int32_t Skip) { if(Pos + Length <= Size) { std::memcpy(ES + Pos, NAL, (size_t)Length); } Pos += Length + Skip; };
+        Put(AUD, sizeof(AUD), 0);
+        if(Stream.IDR) { Put(SPS, sizeof(SPS), 8); Put(PPS, sizeof(PPS), 4); Put(IDR, sizeof(IDR), 0); }
+        else           { Put(NonIDR, sizeof(NonIDR), 0); }
+    }
+    else
+    {
+        // MPEG-1 layer II frames, 48 kHz 192 kbit/s: 576 bytes each
+        for(int32_t i = 0; i + 4 <= Size; i += 576) { ES[i] = 0xFF; ES[i + 1] = 0xFD; ES[i + 2] = 0xA4; ES[i + 3] = 0x04; }
+    }
+
+    Stream.Pos      = 0;
+    Stream.SizeSum += (uint64_t)Size;
+    Stream.NumPES++;
+    m_Stats.NumPES++;
+}
+
+void xTS_StreamGenerator::xPacketizePSI(uint8_t* Packet, uint16_t PID, const uint8_t* Section, int32_t Size)
+{
+    uint8_t& CC = PID == 0 ? m_PAT_CC : m_PMT_CC;
+    Packet[0] = 0x47;
+    Packet[1] = (uint8_t)(0x40 | (PID >> 8));
+    Packet[2] = (uint8_t)(PID & 0xFF);
+    Packet[3] = (uint8_t)(0x10 | CC);
+    Packet[4] = 0; // pointer_field
+    std::memcpy(Packet + 5, Section, (size_t)Size);
+    std::memset(Packet + 5 + Size, 0xFF, xTS::TS_PacketLength - 5 - (size_t)Size);
+    CC = (CC + 1) & 0x0F;
+    m_Stats.NumPSI++;
+}
+
+void xTS_StreamGenerator::xPacketizeES(uint8_t* Packet, xStream& Stream, bool WithPayload, bool WithPCR, uint64_t PCR)
+{
+    if(WithPayload && Stream.Pos >= Stream.PES.size()) { xBuildPES(Stream); }
+    const bool PUSI = WithPayload && Stream.Pos == 0;
+    const bool RAI  = PUSI && Stream.IDR;
+
+    // adaptation field body after adaptation_field_length: flags, PCR, stuffing
+    bool    HasAF  = WithPCR || RAI || !WithPayload;
+    int32_t AFBody = HasAF ? 1 + (WithPCR ? 6 : 0) : 0;
+    if(WithPayload && xChance(m_Config.AFDensity)) { HasAF = true; AFBody = 1 + (WithPCR ? 6 : 0) + (int32_t)(xRandom() % 8); }
+    int32_t Space = 184 - (HasAF ? 1 + AFBody : 0);
+    if(PUSI && m_Config.SplitPESHeader > 0) { Space = std::min(Space, m_Config.SplitPESHeader); } // PTS in the next packet
+    const int32_t Payload = WithPayload ? (int32_t)std::min<size_t>((size_t)Space, Stream.PES.size() - Stream.Pos) : 0;
+    HasAF |= Payload < 184; // the last packet of a PES is stuffed through the adaptation field
+
+    Packet[0] = 0x47;
+    Packet[1] = (uint8_t)((PUSI ? 0x40 : 0) | (Stream.PID >> 8));
+    Packet[2] = (uint8_t)(Stream.PID & 0xFF);
+    Packet[3] = (uint8_t)((HasAF ? 0x20 : 0) | (Payload ? 0x10 : 0) | Stream.CC);
+    uint8_t* P = Packet + xTS::TS_HeaderLength;
+    if(HasAF)
+    {
+        const int32_t AFLength = 183 - Payload;
+        P[0] = (uint8_t)AFLength;
+        if(AFLength > 0)
+        {
+            P[1] = (uint8_t)((RAI ? 0x40 : 0) | (WithPCR ? 0x10 : 0));
+            int32_t Pos = 2;
+            if(WithPCR)
+            {
+                const uint64_t Base      = PCR / xTS::BaseToExtendedClockMultiplier;
+                const uint32_t Extension = (uint32_t)(PCR % xTS::BaseToExtendedClockMultiplier);
+                P[2] = (uint8_t)(Base >> 25);
+                P[3] = (uint8_t)(Base >> 17);
+                P[4] = (uint8_t)(Base >>  9);
+                P[5] = (uint8_t)(Base >>  1);
+                P[6] = (uint8_t)(((Base & 1) << 7) | 0x7E | (Extension >> 8));
+                P[7] = (uint8_t)(Extension & 0xFF);
+                Pos  = 8;
+                m_Stats.NumPCR++;
+            }
+            std::memset(P + Pos, 0xFF, (size_t)(1 + AFLength - Pos));
+        }
+        P += 1 + AFLength;
+    }
+    if(Payload)
+    {
+        std::memcpy(P, Stream.PES.data() + Stream.Pos, (size_t)Payload);
+        Stream.Pos     += (size_t)Payload;
+        Stream.NumSent += (uint64_t)Payload;
+        Stream.CC       = (Stream.CC + 1) & 0x0F;
+    }
+}
+
+void xTS_StreamGenerator::xMakeNull(uint8_t* Packet)
+{
+    Packet[0] = 0x47;
+    Packet[1] = 0x1F;
+    Packet[2] = 0xFF;
+    Packet[3] = 0x10;
+    std::memset(Packet + xTS::TS_HeaderLength, 0xFF, xTS::TS_PacketLength - xTS::TS_HeaderLength);
+    m_Stats.NumNull++;
+}
+
+void xTS_StreamGenerator::xEmit(uint8_t* Packet, std::vector<uint8_t>& Output)
+{
+    m_Stats.NumPackets++;
+    if(xChance(m_Config.LossRate)) { m_Stats.NumLost++; return; }
+    if(xChance(m_Config.SyncLossRate))
+    {
+        const uint32_t NumBytes = 1 + xRandom() % (xTS::TS_PacketLength - 1);
+        for(uint32_t i = 0; i < NumBytes; i++) { Output.push_back((uint8_t)xRandom()); }
+        m_Stats.NumGarbage += NumBytes;
+    }
+    if(xChance(m_Config.TEIRate)) { Packet[1] |= 0x80; m_Stats.NumTEI++; }
+    if(xChance(m_Config.CorruptRate))
+    {
+        const uint32_t NumBytes = 1 + xRandom() % 4;
+        for(uint32_t i = 0; i < NumBytes; i++) { Packet[xTS::TS_HeaderLength + xRandom() % (xTS::TS_PacketLength - xTS::TS_HeaderLength)] = (uint8_t)xRandom(); }
+        m_Stats.NumCorrupted++;
+    }
+    Output.insert(Output.end(), Packet, Packet + xTS::TS_PacketLength);
+    if(xChance(m_Config.DuplicateRate))
+    {
+        Output.insert(Output.end(), Packet, Packet + xTS::TS_PacketLength);
+        m_Stats.NumDuplicated++;
+    }
+}
+
+void xTS_StreamGenerator::Generate(int64_t NumPackets, std::vector<uint8_t>& Output)
+{
+    const double  TicksPerPacket = xTS::TS_PacketLength * 8 * TicksPerSecond / (double)m_MuxBitrate;
+    const uint64_t PSIInterval   = (uint64_t)std::max(1, m_Config.PSIInterval_ms) * xTS::ExtendedClockFrequency_kHz;
+    const uint64_t PCRInterval   = (uint64_t)std::max(1, m_Config.PCRInterval_ms) * xTS::ExtendedClockFrequency_kHz;
+    uint8_t Packet[xTS::TS_PacketLength];
+    Output.reserve(Output.size() + (size_t)NumPackets * xTS::TS_PacketLength);
+
+    for(int64_t n = 0; n < NumPackets; n++, m_PacketIdx++)
+    {
+        const uint64_t Now = (uint64_t)((double)m_PacketIdx * TicksPerPacket);
+        if(m_PMTPending)
+        {
+            xPacketizePSI(Packet, PMT_PID, m_PMT.data(), (int32_t)m_PMT.size());
+            m_PMTPending = false;
+        }
+        else if(Now >= m_NextPSI)
+        {
+            xPacketizePSI(Packet, 0, m_PAT.data(), (int32_t)m_PAT.size());
+            m_PMTPending = true;
+            m_NextPSI   += PSIInterval;
+        }
+        else if(!m_Streams.empty() && Now >= m_NextPCR)
+        {
+            xStream& Stream = m_Streams[0];
+            xPacketizeES(Packet, Stream, xDueTime(Stream) <= Now, true, (StartPCR + Now) % xTS_AdaptationField::PCR_Modulus);
+            m_NextPCR += PCRInterval;
+        }
+        else
+        {
+            // the stream furthest behind its bitrate, null packet when all are on time
+            xStream* Next    = nullptr;
+            uint64_t NextDue = Now;
+            for(xStream& Stream : m_Streams)
+            {
+                const uint64_t Due = xDueTime(Stream);
+                if(Due <= NextDue) { Next = &Stream; NextDue = Due; }
+            }
+            if(Next) { xPacketizeES(Packet, *Next, true, false, 0); }
+            else     { xMakeNull(Packet); }
+        }
+        xEmit(Packet, Output);
+    }
+}
+
+bool xTS_StreamGenerator::WriteFile(const std::string& FileName, int64_t NumPackets)
+{
+    const bool ToStdout = FileName == "-";
+#if defined(_WIN32)
+    if(ToStdout) { _setmode(1, _O_BINARY); }
+#endif
+    FILE* File = ToStdout ? stdout : std::fopen(FileName.c_str(), "wb");
+    if(!File) { return false; }
+    constexpr int64_t BlockPackets = 4096;
+    std::vector<uint8_t> Block;
+    bool Ok = true;
+    for(int64_t Done = 0; Ok && Done < NumPackets; Done += BlockPackets)
+    {
+        Block.clear();
+        Generate(std::min(BlockPackets, NumPackets - Done), Block);
+        Ok = std::fwrite(Block.data(), 1, Block.size(), File) == Block.size();
+    }
+    Ok = (ToStdout ? std::fflush(File) : std::fclose(File)) == 0 && Ok;
+    return Ok;
+}
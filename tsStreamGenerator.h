@@ -0,0 +1,122 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include <string>
+#include <vector>
+
+//=============================================================================================================================================================================
+// xTS_StreamGenerator
+//=============================================================================================================================================================================
+
+// Deterministic synthetic multiplex for benchmarks and robustness runs: one program (PAT + PMT), H.264-like video
+// and MPEG audio PES streams and null packets at a constant mux rate. Video PES carry access unit delimiters and
+// IDR/non-IDR slices, an IDR PES starts with random_access_indicator set; the PCR rides in the first video (or
+// audio) PID. Every stream is scheduled by its own bitrate, PES sizes vary +-50% around the configured average with
+// the sum kept on track, so PTS stay a fixed delay ahead of the PCR. Impairments (loss, duplicates, corruption,
+// TEI, garbage between packets) are applied to the output only - the multiplex itself and its CC stay consistent.
+// The same seed and config produce the same bytes on every platform (own xorshift, no std distributions, random words
+// stored byte by byte in little-endian order).
+class xTS_StreamGenerator
+{
+public:
+  static constexpr int32_t  MaxStreams     = 32;    // all ES entries fit a single-packet PMT
+  static constexpr int32_t  MaxVideoStreams = 16;   // video stream_id 0xE0-0xEF
+  static constexpr uint16_t PMT_PID        = 0x1000;
+  static constexpr int32_t  PTSDelay_ms    = 700;   // PTS of a PES ahead of the PCR at its first byte
+
+  struct xConfig
+  {
+    uint32_t Seed           = 1;
+    int32_t  NumVideo       = 1;       // video streams (stream_type 0x1B) on PIDs FirstPID, FirstPID+1, ...
+    int32_t  NumAudio       = 2;       // audio streams (stream_type 0x03) on the PIDs after the video ones
+    int32_t  FirstPID       = 256;     // moved into 0x0020-0x1FFE, past PMT_PID if the streams would overlap it
+    int64_t  VideoBitrate   = 8000000; // ES bits/s per stream
+    int64_t  AudioBitrate   =  192000;
+    int32_t  VideoPESSize   =   40000; // average PES payload bytes
+    int32_t  AudioPESSize   =    2304;
+    int32_t  GOPLength      =      25; // video PES per IDR
+    int64_t  MuxBitrate     =       0; // 0: 10% above the streams, the rest is null packets
+    double   AFDensity      =    0.05; // share of other payload packets with an adaptation field (stuffing only)
+    int32_t  PCRInterval_ms =      30;
+    int32_t  PSIInterval_ms =     100;
+    int32_t  SplitPESHeader =       0; // 1-13: a PES start packet carries only that many bytes of the 14-byte PES header
+    // output impairments, probabilities per packet
+    double   LossRate       = 0;       // packet not written
+    double   DuplicateRate  = 0;       // packet written twice
+    double   CorruptRate    = 0;       // 1-4 payload bytes overwritten, the 4-byte header is kept
+    double   TEIRate        = 0;       // transport_error_indicator set
+    double   SyncLossRate   = 0;       // 1-187 garbage bytes written before the packet
+  };
+
+  struct xStats
+  {
+    uint64_t NumPackets    = 0; // generated, before impairments
+    uint64_t NumNull       = 0;
+    uint64_t NumPSI        = 0;
+    uint64_t NumPCR        = 0;
+    uint64_t NumPES        = 0;
+    uint64_t NumLost       = 0;
+    uint64_t NumDuplicated = 0;
+    uint64_t NumCorrupted  = 0;
+    uint64_t NumTEI        = 0;
+    uint64_t NumGarbage    = 0; // garbage bytes written
+  };
+
+public:
+  explicit xTS_StreamGenerator(const xConfig& Config);
+
+  // Appends the next NumPackets packets of the multiplex (impairments applied) to Output.
+  void Generate(int64_t NumPackets, std::vector<uint8_t>& Output);
+  // Writes NumPackets packets to a file ("-" for stdout), false on I/O error.
+  bool WriteFile(const std::string& FileName, int64_t NumPackets);
+
+  int64_t        getMuxBitrate    () const { return m_MuxBitrate; }
+  int64_t        DurationToPackets(double Seconds) const { return (int64_t)(Seconds * (double)m_MuxBitrate / (xTS::TS_PacketLength * 8)); }
+  int32_t        getNumStreams    () const { return (int32_t)m_Streams.size(); }
+  int32_t        getStreamPID     (int32_t Idx) const { return m_Streams[Idx].PID; }
+  uint8_t        getStreamType    (int32_t Idx) const { return m_Streams[Idx].StreamType; }
+  int32_t        getPCR_PID       () const { return m_Streams.empty() ? (int32_t)xTS_PacketHeader::ePID::NuLL : m_Streams[0].PID; }
+  const xStats&  getStats         () const { return m_Stats; }
+
+protected:
+  struct xStream
+  {
+    uint16_t             PID        = 0;
+    uint8_t              StreamType = 0;
+    uint8_t              StreamId   = 0;
+    bool                 Video      = false;
+    int64_t              Bitrate    = 0;
+    int32_t              PESSize    = 0;
+    uint64_t             Duration   = 0; // 27 MHz ticks of one average PES
+    uint64_t             NumPES     = 0;
+    uint64_t             SizeSum    = 0; // PES payload bytes generated so far
+    uint64_t             NumSent    = 0; // ES bytes packetized so far
+    std::vector<uint8_t> PES;
+    size_t               Pos        = 0;
+    bool                 IDR        = false;
+    uint8_t              CC         = 0;
+  };
+
+  uint32_t xRandom     ();
+  bool     xChance     (double Probability);
+  uint64_t xDueTime    (const xStream& Stream) const;
+  void     xBuildPES   (xStream& Stream);
+  void     xPacketizePSI(uint8_t* Packet, uint16_t PID, const uint8_t* Section, int32_t Size);
+  void     xPacketizeES(uint8_t* Packet, xStream& Stream, bool WithPayload, bool WithPCR, uint64_t PCR);
+  void     xMakeNull   (uint8_t* Packet);
+  void     xEmit       (uint8_t* Packet, std::vector<uint8_t>& Output);
+
+  xConfig              m_Config;
+  std::vector<xStream> m_Streams;
+  std::vector<uint8_t> m_PAT;
+  std::vector<uint8_t> m_PMT;
+  uint8_t              m_PAT_CC       = 0;
+  uint8_t              m_PMT_CC       = 0;
+  int64_t              m_MuxBitrate   = 0;
+  uint64_t             m_PacketIdx    = 0;
+  uint64_t             m_NextPSI      = 0; // 27 MHz ticks
+  uint64_t             m_NextPCR      = 0;
+  bool                 m_PMTPending   = false; // the PMT follows the PAT in the next packet
+  uint32_t             m_RandomState  = 0;
+  xStats               m_Stats;
+};
@@ -0,0 +1,169 @@
+#include "tsSyncScanner.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#define X_SYNC_SCANNER_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define X_TARGET_AVX2 __attribute__((target("avx2")))
+#define X_CTZ32(x) __builtin_ctz(x)
+#else
+#define X_TARGET_AVX2
+static inline uint32_t X_CTZ32(uint32_t x) { unsigned long Idx; _BitScanForward(&Idx, x); return Idx; }
+#endif
+
+//=============================================================================================================================================================================
+// xTS_SyncScanner - ISA selection
+//=============================================================================================================================================================================
+
+static xTS_SyncScanner::eISA xDetectISA()
+{
+#if defined(X_SYNC_SCANNER_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) { return xTS_SyncScanner::eISA::AVX2; }
+    return xTS_SyncScanner::eISA::SSE2;
+#elif defined(X_SYNC_SCANNER_X86)
+    return xTS_SyncScanner::eISA::SSE2; // SSE2 is baseline on x86-64
+#else
+    return xTS_SyncScanner::eISA::Scalar;
+#endif
+}
+
+static const xTS_SyncScanner::eISA s_DetectedISA = xDetectISA();
+static       xTS_SyncScanner::eISA s_ActiveISA   = s_DetectedISA;
+
+xTS_SyncScanner::eISA xTS_SyncScanner::getISA() { return s_ActiveISA; }
+
+void xTS_SyncScanner::forceISA(eISA ISA)
+{
+    s_ActiveISA = (int32_t)ISA <= (int32_t)s_DetectedISA ? ISA : s_DetectedISA;
+}
+
+const char* xTS_SyncScanner::ISAToString(eISA ISA)
+{
+    switch(ISA)
+    {
+        case eISA::Scalar: return "scalar";
+        case eISA::SSE2  : return "SSE2";
+        case eISA::AVX2  : return "AVX2";
+        default          : return "unknown";
+    }
+}
+
+//=============================================================================================================================================================================
+// xTS_SyncScanner - stride search
+//=============================================================================================================================================================================
+
+int64_t xTS_SyncScanner::FindSync(const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck)
+{
+    if(NumCheck < 1 || Stride < 1) { return -1; }
+    const size_t Span = (size_t)(NumCheck - 1) * Stride + 1; // bytes covered by one candidate
+    if(Size < Span) { return -1; }
+
+    switch(s_ActiveISA)
+    {
+        case eISA::AVX2: return xFindSync_AVX2  (Data, Size, Stride, NumCheck);
+        case eISA::SSE2: return xFindSync_SSE2  (Data, Size, Stride, NumCheck);
+        default        : return xFindSync_Scalar(Data, Size, Stride, NumCheck);
+    }
+}
+
+int64_t xTS_SyncScanner::xFindSync_Scalar(const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck)
+{
+    const size_t Last = Size - (size_t)(NumCheck - 1) * Stride; // one past the last candidate
+    for(size_t Pos = 0; Pos < Last; Pos++)
+    {
+        if(Data[Pos] != SyncByte) { continue; }
+        int32_t k = 1;
+        while(k < NumCheck && Data[Pos + (size_t)k * Stride] == SyncByte) { k++; }
+        if(k == NumCheck) { return (int64_t)Pos; }
+    }
+    return -1;
+}
+
+int64_t xTS_SyncScanner::xFindSync_SSE2(const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck)
+{
+#if defined(X_SYNC_SCANNER_X86)
+    const size_t  Last = Size - (size_t)(NumCheck - 1) * Stride;
+    const __m128i Sync = _mm_set1_epi8((char)SyncByte);
+    size_t Pos = 0;
+    for(; Pos + 16 <= Last; Pos += 16)
+    {
+        uint32_t Mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(Data + Pos)), Sync));
+        for(int32_t k = 1; k < NumCheck && Mask; k++)
+        {
+            const __m128i Block = _mm_loadu_si128((const __m128i*)(Data + Pos + (size_t)k * Stride));
+            Mask &= (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Block, Sync));
+        }
+        if(Mask) { return (int64_t)(Pos + X_CTZ32(Mask)); }
+    }
+    const int64_t Tail = xFindSync_Scalar(Data + Pos, Size - Pos, Stride, NumCheck);
+    return Tail < 0 ? -1 : (int64_t)Pos + Tail;
+#else
+    return xFindSync_Scalar(Data, Size, Stride, NumCheck);
+#endif
+}
+
+#if defined(X_SYNC_SCANNER_X86)
+X_TARGET_AVX2 static int64_t xFindSync_AVX2_Impl(const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck, size_t& Pos)
+{
+    const size_t  Last = Size - (size_t)(NumCheck - 1) * Stride;
+    const __m256i Sync = _mm256_set1_epi8((char)xTS_SyncScanner::SyncByte);
+    for(Pos = 0; Pos + 32 <= Last; Pos += 32)
+    {
+        uint32_t Mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(Data + Pos)), Sync));
+        for(int32_t k = 1; k < NumCheck && Mask; k++)
+        {
+            const __m256i Block = _mm256_loadu_si256((const __m256i*)(Data + Pos + (size_t)k * Stride));
+            Mask &= (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Block, Sync));
+        }
+        if(Mask) { return (int64_t)(Pos + X_CTZ32(Mask)); }
+    }
+    return -1;
+}
+#endif
+
+int64_t xTS_SyncScanner::xFindSync_AVX2(const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck)
+{
+#if defined(X_SYNC_SCANNER_X86)
+    size_t Pos = 0;
+    const int64_t Found = xFindSync_AVX2_Impl(Data, Size, Stride, NumCheck, Pos);
+    if(Found >= 0) { return Found; }
+    const int64_t Tail = xFindSync_SSE2(Data + Pos, Size - Pos, Stride, NumCheck);
+    return Tail < 0 ? -1 : (int64_t)Pos + Tail;
+#else
+    return xFindSync_Scalar(Data, Size, Stride, NumCheck);
+#endif
+}
+
+//=============================================================================================================================================================================
+// xTS_SyncScanner - packet format detection
+//=============================================================================================================================================================================
+
+int64_t xTS_SyncScanner::DetectFormat(const uint8_t* Data, size_t Size, int32_t NumCheck, xFormat& Format, int32_t PreferredPacketSize)
+{
+    static constexpr int32_t PacketSizes[] = { PacketSize_TS, PacketSize_M2TS, PacketSize_RS };
+
+    int64_t BestPos = -1;
+    // preferred size first, so it wins ties (the same sync run can match a larger stride only by accident)
+    for(int32_t Pass = 0; Pass < 2; Pass++)
+    {
+        for(int32_t PacketSize : PacketSizes)
+        {
+            if((Pass == 0) != (PacketSize == PreferredPacketSize)) { continue; }
+            // searching past the best lock so far is pointless
+            const size_t Limit = BestPos < 0 ? Size : std::min(Size, (size_t)BestPos + (size_t)(NumCheck - 1) * PacketSize);
+            const int64_t Pos  = FindSync(Data, Limit, PacketSize, NumCheck);
+            if(Pos >= 0 && (BestPos < 0 || Pos < BestPos))
+            {
+                BestPos           = Pos;
+                Format.PacketSize = PacketSize;
+                Format.SyncOffset = FormatToSyncOffset(PacketSize);
+            }
+        }
+    }
+    return BestPos;
+}
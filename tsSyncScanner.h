@@ -0,0 +1,51 @@
+#pragma once
+#include "tsCommon.h"
+
+//=============================================================================================================================================================================
+// xTS_SyncScanner
+//=============================================================================================================================================================================
+
+// Locates sync byte (0x47) lock in raw input. A position is accepted only when the sync byte repeats
+// at packet stride for several consecutive packets, which rules out 0x47 values inside payloads.
+// The stride test is vectorized: for a block of 16 (SSE2) or 32 (AVX2) candidate positions the
+// compare masks of all checked packets are ANDed, so every candidate is verified in one pass.
+class xTS_SyncScanner
+{
+public:
+  static constexpr uint8_t SyncByte        = 0x47;
+  static constexpr int32_t NumLockPackets  = 5; // consecutive packets required to declare lock
+
+  static constexpr int32_t PacketSize_TS   = 188; // plain transport stream
+  static constexpr int32_t PacketSize_M2TS = 192; // 4-byte TP_extra_header + TS packet (Blu-ray/AVCHD)
+  static constexpr int32_t PacketSize_RS   = 204; // TS packet + 16 bytes Reed-Solomon parity (DVB)
+
+  enum class eISA : int32_t
+  {
+    Scalar,
+    SSE2,
+    AVX2,
+  };
+
+  struct xFormat
+  {
+    int32_t PacketSize = PacketSize_TS;
+    int32_t SyncOffset = 0; // position of the sync byte inside a packet (4 for M2TS)
+  };
+
+public:
+  // Returns offset of the first sync byte repeating at Stride for NumCheck packets, -1 if none in [Data, Data+Size).
+  static int64_t FindSync(const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck);
+  // Tries all supported packet sizes and picks the earliest lock. Returns sync byte offset or -1. Preferred wins ties.
+  static int64_t DetectFormat(const uint8_t* Data, size_t Size, int32_t NumCheck, xFormat& Format, int32_t PreferredPacketSize = PacketSize_TS);
+
+  static int32_t FormatToSyncOffset(int32_t PacketSize) { return PacketSize == PacketSize_M2TS ? 4 : 0; }
+
+  static eISA        getISA     ();
+  static void        forceISA   (eISA ISA); // for benchmarks - ISA above the detected one is ignored
+  static const char* ISAToString(eISA ISA);
+
+protected:
+  static int64_t xFindSync_Scalar(const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck);
+  static int64_t xFindSync_SSE2  (const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck);
+  static int64_t xFindSync_AVX2  (const uint8_t* Data, size_t Size, int32_t Stride, int32_t NumCheck);
+};
@@ -1,280 +1,767 @@
-#include "tsTransportStream.h"
-#include <iostream>
-
-//=============================================================================================================================================================================
-// xTS_PacketHeader
-//=============================================================================================================================================================================
-
-/// @brief Reset - reset all TS packet header fields
-void xTS_PacketHeader::Reset()
-{
-    SB  = 0;
-    E   = 0;
-    S   = 0;
-    T   = 0;
-    PID = 0;
-    TSC = 0;
-    AFC = 0;
-    CC  = 0;
-}
-
-/**
- * @brief Parse all TS packet header fields
- * @param Input is pointer to buffer containing TS packet
- * @return Number of parsed bytes (4 on success, -1 on failure) 
- */
-int32_t xTS_PacketHeader::Parse(const uint8_t* Input)
-{
-    // obrócenie bitów przód - tył bo architektura tego wymaga
-    uint32_t* H_ptr = (uint32_t*) Input;
-    uint32_t  H_val = xSwapBytes32(*H_ptr);
-
-    uint32_t E_m   = 0x00800000; 
-    uint32_t S_m   = 0x00400000;
-    uint32_t T_m   = 0x00200000; 
-    uint32_t PID_m = 0x001FFF00;  
-    uint32_t TSC_m = 0x000000C0;      
-    uint32_t AFC_m = 0x00000030;     
-    uint32_t CC_m  = 0x0000000F;      
-
-    SB   = H_val >> 24;                 
-    E    = (H_val & E_m)  >> 23;
-    S    = (H_val & S_m)  >> 22;
-    T    = (H_val & T_m)  >> 21;
-    PID  = (H_val & PID_m)>>  8;
-    TSC  = (H_val & TSC_m)>>  6;
-    AFC  = (H_val & AFC_m)>>  4;
-    CC   = H_val & CC_m;        
-
-    return 4;
-}
-
-/// @brief Print all TS packet header fields
-void xTS_PacketHeader::Print() const
-{
-    printf(" SB = %d", SB);
-    printf(" E = %d", E);
-    printf(" S = %d", S);
-    printf(" T = %d", T);
-    printf(" PID = %d", PID);
-    printf(" TSC = %d", TSC);
-    printf(" AFC = %d", AFC);
-    printf(" CC = %d ", CC);
-}
-
-uint32_t xTS_PacketHeader::getPID() const {
-  return PID;  // Upewnij się, że PID jest zmienną członkowską klasy xTS_PacketHeader
-}
-
-//=============================================================================================================================================================================
-// xTS_AdaptationField
-//=============================================================================================================================================================================
-
-void xTS_AdaptationField::Reset()
-{
-    AFL = 0;
-    DC = 0;
-    RA = 0;
-    SP = 0;
-    PR = 0;
-    OR = 0;
-    SF = 0;
-    TP = 0;
-    EX = 0;
-}
-
-int32_t xTS_AdaptationField::Parse(const uint8_t* Input, uint8_t AFC)
-{
-    if (AFC == 2 || AFC == 3) {
-        AFL = Input[0];
-        if (AFL > 0) {
-            uint8_t flags = Input[1];
-            DC = (flags & 0x80) >> 7;
-            RA = (flags & 0x40) >> 6;
-            SP = (flags & 0x20) >> 5;
-            PR = (flags & 0x10) >> 4;
-            OR = (flags & 0x08) >> 3;
-            SF = (flags & 0x04) >> 2;
-            TP = (flags & 0x02) >> 1;
-            EX = (flags & 0x01);
-            return AFL + 1;  
-        }
-    }
-    return 4;  
-}
-
-void xTS_AdaptationField::Print() const
-{
-    printf("\nAF: L = %d ", AFL);
-    printf("DC = %d ", DC);
-    printf("RA = %d ", RA);
-    printf("SP = %d ", SP);
-    printf("PR = %d ", PR);
-    printf("OR = %d ", OR);
-    printf("SF = %d ", SF);
-    printf("TP = %d ", TP);
-    printf("EX = %d ", EX);
-}
-
-//=============================================================================================================================================================================
-// xPES_PacketHeader
-//=============================================================================================================================================================================
-
-xPES_PacketHeader::xPES_PacketHeader()
-{
-    Reset();
-}
-
-// Metoda Reset() resetuje wszystkie składowe nagłówka PES do ich wartości początkowych.
-void xPES_PacketHeader::Reset()
-{
-    m_PacketStartCodePrefix = 0;
-    m_StreamId = 0;
-    m_PacketLength = 0;
-}
-
-// Metoda Parse() służy do analizy danych wejściowych i wyodrębnienia z nich informacji o nagłówku PES.
-int32_t xPES_PacketHeader::Parse(const uint8_t* PacketBuffer){
-        
-        uint64_t* H_ptr = (uint64_t*) PacketBuffer;
-        uint64_t  H_val = xSwapBytes64(*H_ptr);
-        
-        uint64_t PSCP_m = 0xFFFFFF0000000000; 
-        uint64_t SId_m = 0x000000FF00000000; 
-        uint64_t PL_m = 0x00000000FFFF0000; 
-
-        m_PacketStartCodePrefix = (H_val & PSCP_m) >> 40;
-        m_StreamId = (H_val & SId_m) >> 32;
-        m_PacketLength = (H_val & PL_m) >> 16;
-        
-        if (m_StreamId != eStreamId::eStreamId_program_stream_map && 
-            m_StreamId != eStreamId::eStreamId_padding_stream &&
-            m_StreamId != eStreamId::eStreamId_private_stream_2 && 
-            m_StreamId != eStreamId::eStreamId_ECM && 
-            m_StreamId != eStreamId::eStreamId_EMM && 
-            m_StreamId != eStreamId::eStreamId_program_stream_directory && 
-            m_StreamId != eStreamId::eStreamId_DSMCC_stream && 
-            m_StreamId != eStreamId::eStreamId_DSMCC_stream && 
-            m_StreamId != eStreamId::eStreamId_ITUT_H222_1_type_E)
-        {
-            PacketBuffer+=8;
-            return 9+PacketBuffer[0];
-        }
-        
-        return 6;
-}
-
-// Metoda Print() wyświetla informacje o nagłówku PES.
-void xPES_PacketHeader::Print() const
-{
-    printf("PES: PSCP=%X SID=%u L=%d\n",
-           m_PacketStartCodePrefix, (int) m_StreamId, m_PacketLength);
-}
-
-
-//=============================================================================================================================================================================
-// xPES_Assembler
-//=============================================================================================================================================================================
-
-// Metoda Init() inicjalizuje assembler PES, ustawiając identyfikator procesu (PID).
-void xPES_Assembler::Init(int32_t PID)
-{
-    m_PID = PID;
-    Helper = 0;
-    xBufferReset();
-    m_Started = false;
-    m_LastContinuityCounter = -1;
-}
-
-// Resetuje stan assemblera PES oraz jego bufor.
-void xPES_Assembler::Reset() {
-    m_Buffer.clear();
-    Helper = 0;
-    m_LastContinuityCounter = -1;
-    m_Started = false;
-    m_PESH.Reset(); // Resetowanie nagłówka PES
-}
-
-// Metoda AbsorbPacket() przetwarza pojedynczy pakiet strumienia transportowego.
-xPES_Assembler::eResult xPES_Assembler::AbsorbPacket(const uint8_t* TransportStreamPacket, const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField) {
-    if (PacketHeader->PID != m_PID) return eResult::UnexpectedPID;
-
-    if (PacketHeader->getS() == 1) { // Sprawdzanie, czy jest to początek nowego pakietu PES
-        Reset(); // Resetowanie stanu assemblera PES
-    }
-
-    // Sprawdzanie licznika ciągłości
-    int8_t CC = PacketHeader->CC;
-    if (m_Started && (m_LastContinuityCounter != -1) && (CC != ((m_LastContinuityCounter + 1) % 16))) {
-        return eResult::StreamPacketLost;
-    }
-
-    m_LastContinuityCounter = CC;
-    const uint8_t* Payload = TransportStreamPacket + xTS::TS_HeaderLength;
-    int32_t PayloadSize = xTS::TS_PacketLength - xTS::TS_HeaderLength;
-    if (PacketHeader->hasAdaptationField()) {
-        Payload += 1 + AdaptationField->AFL;
-        PayloadSize -= 1 + AdaptationField->AFL;
-    }
-
-    if (!m_Started) { 
-        m_Started = true;
-        Helper = m_PESH.Parse(Payload);
-        m_Buffer.assign(Payload + Helper, Payload + PayloadSize);
-        return eResult::AssemblingStarted;
-    } else {
-        m_Buffer.insert(m_Buffer.end(), Payload, Payload + PayloadSize);
-        if (m_Buffer.size() >= m_PESH.getPacketLength() - Helper + 6)
-            return eResult::AssemblingFinished;
-        else
-            return eResult::AssemblingContinue;
-    }
-}
-
-void xPES_Assembler::SavePayloadToFile(const char* filename) {
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
-        std::cerr << "Cannot open file for writing.\n";
-        return;
-    }
-    
-    if (!m_Buffer.empty()) {
-        fwrite(m_Buffer.data(), 1, m_Buffer.size(), file);
-    }
-
-    fclose(file);
-}
-
-// Metoda PrintPESH() wyświetla informacje o nagłówku PES.
-void xPES_Assembler::PrintPESH() const
-{
-    m_PESH.Print();
-}
-
-// Zwraca wskaźnik do bufora z pakietami.
-const uint8_t* xPES_Assembler::getPacket() const
-{
-    return m_Buffer.data();
-}
-
-// Zwraca liczbę bajtów w buforze.
-int32_t xPES_Assembler::getNumPacketBytes() const
-{
-    return static_cast<int32_t>(m_Buffer.size());
-}
-
-// Resetuje bufor.
-void xPES_Assembler::xBufferReset()
-{
-    m_Buffer.clear();
-}
-
-// Dodaje dane do bufora.
-void xPES_Assembler::xBufferAppend(const uint8_t* Data, int32_t Size)
-{
-    m_Buffer.insert(m_Buffer.end(), Data, Data + Size);
-}
-
-// Konstruktor i destruktor klasy xPES_Assembler.
-xPES_Assembler::xPES_Assembler() : m_PID(-1), m_LastContinuityCounter(-1), m_Started(false) {}
-xPES_Assembler::~xPES_Assembler() {}
+#include "tsTransportStream.h"
+#include "tsCheckpoint.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+//=============================================================================================================================================================================
+// xTS_PacketHeader
+//=============================================================================================================================================================================
+
+/// @brief Reset - reset all TS packet header fields
+void xTS_PacketHeader::Reset()
+{
+    SB  = 0;
+    E   = 0;
+    S   = 0;
+    T   = 0;
+    PID = 0;
+    TSC = 0;
+    AFC = 0;
+    CC  = 0;
+}
+
+/**
+ * @brief Parse all TS packet header fields
+ * @param Input is pointer to buffer containing TS packet
+ * @return Number of parsed bytes (4 on success, -1 on failure) 
+ */
+int32_t xTS_PacketHeader::Parse(const uint8_t* Input)
+{
+    // obrócenie bitów przód - tył bo architektura tego wymaga
+    // (memcpy zamiast rzutowania na uint32_t* - wejście nie musi być wyrównane)
+    uint32_t  H_val;
+    std::memcpy(&H_val, Input, sizeof(H_val));
+    H_val = xSwapBytes32(H_val);
+
+    uint32_t E_m   = 0x00800000; 
+    uint32_t S_m   = 0x00400000;
+    uint32_t T_m   = 0x00200000; 
+    uint32_t PID_m = 0x001FFF00;  
+    uint32_t TSC_m = 0x000000C0;      
+    uint32_t AFC_m = 0x00000030;     
+    uint32_t CC_m  = 0x0000000F;      
+
+    SB   = H_val >> 24;                 
+    E    = (H_val & E_m)  >> 23;
+    S    = (H_val & S_m)  >> 22;
+    T    = (H_val & T_m)  >> 21;
+    PID  = (H_val & PID_m)>>  8;
+    TSC  = (H_val & TSC_m)>>  6;
+    AFC  = (H_val & AFC_m)>>  4;
+    CC   = H_val & CC_m;        
+
+    return 4;
+}
+
+/// @brief Print all TS packet header fields
+void xTS_PacketHeader::Print() const
+{
+    printf(" SB = %d", SB);
+    printf(" E = %d", E);
+    printf(" S = %d", S);
+    printf(" T = %d", T);
+    printf(" PID = %d", PID);
+    printf(" TSC = %d", TSC);
+    printf(" AFC = %d", AFC);
+    printf(" CC = %d ", CC);
+}
+
+uint32_t xTS_PacketHeader::getPID() const {
+  return PID;  // Upewnij się, że PID jest zmienną członkowską klasy xTS_PacketHeader
+}
+
+//=============================================================================================================================================================================
+// xTS_AdaptationField
+//=============================================================================================================================================================================
+
+void xTS_AdaptationField::Reset()
+{
+    AFL = 0;
+    DC = 0;
+    RA = 0;
+    SP = 0;
+    PR = 0;
+    OR = 0;
+    SF = 0;
+    TP = 0;
+    EX = 0;
+    xResetOptional();
+}
+
+void xTS_AdaptationField::xResetOptional()
+{
+    PCR               = 0;
+    OPCR              = 0;
+    SpliceCountdown   = 0;
+    PrivateDataLength = 0;
+    PrivateDataOffset = 0;
+    AFEL              = 0;
+    LTW               = 0;
+    PW                = 0;
+    SS                = 0;
+    LTWValid          = 0;
+    LTWOffset         = 0;
+    PiecewiseRate     = 0;
+    SpliceType        = 0;
+    DTSNextAU         = 0;
+    StuffingBytes     = 0;
+    Malformed         = false;
+}
+
+// program_clock_reference_base (33 bits), 6 reserved bits, program_clock_reference_extension (9 bits)
+static inline uint64_t xReadPCR(const uint8_t* Input)
+{
+    const uint64_t Base = ((uint64_t)Input[0] << 25) | ((uint64_t)Input[1] << 17) | ((uint64_t)Input[2] << 9) | ((uint64_t)Input[3] << 1) | (Input[4] >> 7);
+    const uint64_t Ext  = ((uint64_t)(Input[4] & 0x01) << 8) | Input[5];
+    return Base * xTS::BaseToExtendedClockMultiplier + Ext;
+}
+
+/**
+ * @brief Parse the adaptation field including its optional fields and extension
+ * @param Input points at adaptation_field_length (the byte following the TS header)
+ * @return Number of bytes taken by the adaptation field (AFL + 1), 4 if the packet has none
+ * Fields that do not fit into AFL are not decoded and set Malformed.
+ */
+int32_t xTS_AdaptationField::Parse(const uint8_t* Input, uint8_t AFC)
+{
+    xResetOptional();
+    if (AFC != 2 && AFC != 3) {
+        return 4;
+    }
+    AFL = Input[0];
+    if (AFL == 0) { // single stuffing byte
+        DC = RA = SP = PR = OR = SF = TP = EX = 0;
+        return 4;
+    }
+
+    uint8_t flags = Input[1];
+    DC = (flags & 0x80) >> 7;
+    RA = (flags & 0x40) >> 6;
+    SP = (flags & 0x20) >> 5;
+    PR = (flags & 0x10) >> 4;
+    OR = (flags & 0x08) >> 3;
+    SF = (flags & 0x04) >> 2;
+    TP = (flags & 0x02) >> 1;
+    EX = (flags & 0x01);
+
+    // AFL may not exceed the packet (183 without payload)
+    const int32_t End = 1 + std::min<int32_t>(AFL, xTS::TS_PacketLength - xTS::TS_HeaderLength - 1);
+    Malformed = AFL > xTS::TS_PacketLength - xTS::TS_HeaderLength - 1;
+    int32_t Pos = 2;
+
+    if (PR) {
+        if (Pos + 6 > End) { Malformed = true; return AFL + 1; }
+        PCR = xReadPCR(Input + Pos);
+        Pos += 6;
+    }
+    if (OR) {
+        if (Pos + 6 > End) { Malformed = true; return AFL + 1; }
+        OPCR = xReadPCR(Input + Pos);
+        Pos += 6;
+    }
+    if (SF) {
+        if (Pos + 1 > End) { Malformed = true; return AFL + 1; }
+        SpliceCountdown = (int8_t)Input[Pos];
+        Pos += 1;
+    }
+    if (TP) {
+        if (Pos + 1 > End || Pos + 1 + Input[Pos] > End) { Malformed = true; return AFL + 1; }
+        PrivateDataLength = Input[Pos];
+        PrivateDataOffset = (uint8_t)(Pos + 1);
+        Pos += 1 + PrivateDataLength;
+    }
+    if (EX) {
+        if (Pos + 2 > End || Pos + 1 + Input[Pos] > End) { Malformed = true; return AFL + 1; }
+        AFEL = Input[Pos];
+        const int32_t ExtEnd = Pos + 1 + AFEL;
+        const uint8_t ExtFlags = Input[Pos + 1];
+        LTW = (ExtFlags & 0x80) >> 7;
+        PW  = (ExtFlags & 0x40) >> 6;
+        SS  = (ExtFlags & 0x20) >> 5;
+        int32_t ExtPos = Pos + 2;
+        if (LTW) {
+            if (ExtPos + 2 > ExtEnd) { Malformed = true; return AFL + 1; }
+            LTWValid  = Input[ExtPos] >> 7;
+            LTWOffset = (uint16_t)(((Input[ExtPos] & 0x7F) << 8) | Input[ExtPos + 1]);
+            ExtPos += 2;
+        }
+        if (PW) {
+            if (ExtPos + 3 > ExtEnd) { Malformed = true; return AFL + 1; }
+            PiecewiseRate = ((uint32_t)(Input[ExtPos] & 0x3F) << 16) | ((uint32_t)Input[ExtPos + 1] << 8) | Input[ExtPos + 2];
+            ExtPos += 3;
+        }
+        if (SS) {
+            if (ExtPos + 5 > ExtEnd) { Malformed = true; return AFL + 1; }
+            const uint8_t* D = Input + ExtPos;
+            SpliceType = D[0] >> 4;
+            DTSNextAU  = ((uint64_t)(D[0] & 0x0E) << 29) | ((uint64_t)D[1] << 22) | ((uint64_t)(D[2] & 0xFE) << 14) | ((uint64_t)D[3] << 7) | (D[4] >> 1);
+        }
+        Pos = ExtEnd;
+    }
+    StuffingBytes = (uint8_t)(End - Pos);
+    return AFL + 1;
+}
+
+void xTS_AdaptationField::Print() const
+{
+    printf("\nAF: L = %d ", AFL);
+    printf("DC = %d ", DC);
+    printf("RA = %d ", RA);
+    printf("SP = %d ", SP);
+    printf("PR = %d ", PR);
+    printf("OR = %d ", OR);
+    printf("SF = %d ", SF);
+    printf("TP = %d ", TP);
+    printf("EX = %d ", EX);
+    if (PR) printf("PCR = %" PRIu64 " ", PCR);
+    if (OR) printf("OPCR = %" PRIu64 " ", OPCR);
+    if (SF) printf("SC = %d ", SpliceCountdown);
+}
+
+//=============================================================================================================================================================================
+// xPES_PacketHeader
+//=============================================================================================================================================================================
+
+xPES_PacketHeader::xPES_PacketHeader()
+{
+    Reset();
+}
+
+// Metoda Reset() resetuje wszystkie składowe nagłówka PES do ich wartości początkowych.
+void xPES_PacketHeader::Reset()
+{
+    m_PacketStartCodePrefix = 0;
+    m_StreamId = 0;
+    m_PacketLength = 0;
+    m_HeaderLength = 0;
+    m_Truncated = false;
+
+    m_HasOptionalHeader = false;
+    m_ScramblingControl = 0;
+    m_Priority = false;
+    m_DataAlignment = false;
+    m_Copyright = false;
+    m_Original = false;
+    m_PTSDTSFlags = 0;
+    m_ESCRFlag = false;
+    m_ESRateFlag = false;
+    m_TrickModeFlag = false;
+    m_AdditionalCopyInfoFlag = false;
+    m_CRCFlag = false;
+    m_ExtensionFlag = false;
+    m_HeaderDataLength = 0;
+
+    m_PTS = 0;
+    m_DTS = 0;
+    m_ESCR = 0;
+    m_ESRate = 0;
+    m_TrickMode = 0;
+    m_AdditionalCopyInfo = 0;
+    m_PreviousCRC = 0;
+    m_SequenceCounterFlag = false;
+    m_SequenceCounter = 0;
+    m_PSTDBufferFlag = false;
+    m_PSTDBufferSize = 0;
+}
+
+// Znacznik 33-bitowy zapisany w 5 bajtach: 4 bity prefiksu, [32..30], marker, [29..15], marker, [14..0], marker.
+static inline uint64_t xReadTimestamp(const uint8_t* Input)
+{
+    return ((uint64_t)(Input[0] & 0x0E) << 29) | ((uint64_t)Input[1] << 22) | ((uint64_t)(Input[2] & 0xFE) << 14) |
+           ((uint64_t)Input[3] << 7) | ((uint64_t)Input[4] >> 1);
+}
+
+// Metoda Parse() służy do analizy danych wejściowych i wyodrębnienia z nich informacji o nagłówku PES.
+// Zwraca długość nagłówka (nie więcej niż Size) - pola, które nie zmieściły się w Size, nie są dekodowane.
+int32_t xPES_PacketHeader::Parse(const uint8_t* PacketBuffer, int32_t Size){
+        Reset();
+        if (Size < (int32_t)xTS::PES_HeaderLength) {
+            m_Truncated = true;
+            return std::max(Size, 0);
+        }
+
+        m_PacketStartCodePrefix = ((uint32_t)PacketBuffer[0] << 16) | ((uint32_t)PacketBuffer[1] << 8) | PacketBuffer[2];
+        m_StreamId = PacketBuffer[3];
+        m_PacketLength = (uint16_t)((PacketBuffer[4] << 8) | PacketBuffer[5]);
+        m_HeaderLength = xTS::PES_HeaderLength;
+
+        if (m_StreamId != eStreamId::eStreamId_program_stream_map && 
+            m_StreamId != eStreamId::eStreamId_padding_stream &&
+            m_StreamId != eStreamId::eStreamId_private_stream_2 && 
+            m_StreamId != eStreamId::eStreamId_ECM && 
+            m_StreamId != eStreamId::eStreamId_EMM && 
+            m_StreamId != eStreamId::eStreamId_program_stream_directory && 
+            m_StreamId != eStreamId::eStreamId_DSMCC_stream && 
+            m_StreamId != eStreamId::eStreamId_DSMCC_stream && 
+            m_StreamId != eStreamId::eStreamId_ITUT_H222_1_type_E)
+        {
+            xParseOptional(PacketBuffer, Size);
+        }
+        
+        return m_HeaderLength;
+}
+
+void xPES_PacketHeader::xParseOptional(const uint8_t* Input, int32_t Size)
+{
+    if (Size < 9) { m_Truncated = true; m_HeaderLength = (uint8_t)Size; return; }
+
+    m_HasOptionalHeader      = true;
+    m_ScramblingControl      = (Input[6] >> 4) & 0x3;
+    m_Priority               = (Input[6] & 0x08) != 0;
+    m_DataAlignment          = (Input[6] & 0x04) != 0;
+    m_Copyright              = (Input[6] & 0x02) != 0;
+    m_Original               = (Input[6] & 0x01) != 0;
+    m_PTSDTSFlags            = Input[7] >> 6;
+    m_ESCRFlag               = (Input[7] & 0x20) != 0;
+    m_ESRateFlag             = (Input[7] & 0x10) != 0;
+    m_TrickModeFlag          = (Input[7] & 0x08) != 0;
+    m_AdditionalCopyInfoFlag = (Input[7] & 0x04) != 0;
+    m_CRCFlag                = (Input[7] & 0x02) != 0;
+    m_ExtensionFlag          = (Input[7] & 0x01) != 0;
+    m_HeaderDataLength       = Input[8];
+
+    // Pola opcjonalne kończą się razem z PES_header_data_length (dalej są bajty wypełnienia)
+    const int32_t End = 9 + m_HeaderDataLength;
+    m_Truncated    = End > Size;
+    m_HeaderLength = (uint8_t)std::min(End, Size);
+    const int32_t Limit = m_HeaderLength;
+    int32_t Pos = 9;
+
+    if (m_PTSDTSFlags & 0x2) {
+        if (Pos + 5 > Limit) { m_PTSDTSFlags = 0; return; }
+        m_PTS = m_DTS = xReadTimestamp(Input + Pos);
+        Pos += 5;
+    }
+    if (m_PTSDTSFlags == 0x3) {
+        if (Pos + 5 > Limit) { m_PTSDTSFlags = 0x2; return; }
+        m_DTS = xReadTimestamp(Input + Pos);
+        Pos += 5;
+    }
+    if (m_ESCRFlag) {
+        if (Pos + 6 > Limit) { m_ESCRFlag = false; return; }
+        const uint8_t* D = Input + Pos;
+        const uint64_t Base = ((uint64_t)(D[0] & 0x38) << 27) | ((uint64_t)(D[0] & 0x03) << 28) | ((uint64_t)D[1] << 20) |
+                              ((uint64_t)(D[2] & 0xF8) << 12) | ((uint64_t)(D[2] & 0x03) << 13) | ((uint64_t)D[3] << 5) | (D[4] >> 3);
+        const uint64_t Ext  = ((uint64_t)(D[4] & 0x03) << 7) | (D[5] >> 1);
+        m_ESCR = Base * xTS::BaseToExtendedClockMultiplier + Ext;
+        Pos += 6;
+    }
+    if (m_ESRateFlag) {
+        if (Pos + 3 > Limit) { m_ESRateFlag = false; return; }
+        m_ESRate = ((uint32_t)(Input[Pos] & 0x7F) << 15) | ((uint32_t)Input[Pos + 1] << 7) | (Input[Pos + 2] >> 1);
+        Pos += 3;
+    }
+    if (m_TrickModeFlag) {
+        if (Pos + 1 > Limit) { m_TrickModeFlag = false; return; }
+        m_TrickMode = Input[Pos];
+        Pos += 1;
+    }
+    if (m_AdditionalCopyInfoFlag) {
+        if (Pos + 1 > Limit) { m_AdditionalCopyInfoFlag = false; return; }
+        m_AdditionalCopyInfo = Input[Pos] & 0x7F;
+        Pos += 1;
+    }
+    if (m_CRCFlag) {
+        if (Pos + 2 > Limit) { m_CRCFlag = false; return; }
+        m_PreviousCRC = (uint16_t)((Input[Pos] << 8) | Input[Pos + 1]);
+        Pos += 2;
+    }
+    if (m_ExtensionFlag) {
+        if (Pos + 1 > Limit) { m_ExtensionFlag = false; return; }
+        const uint8_t Flags = Input[Pos];
+        Pos += 1;
+        if (Flags & 0x80) { Pos += 16; }                                // PES_private_data
+        if (Flags & 0x40) { if (Pos + 1 > Limit) return; Pos += 1 + Input[Pos]; } // pack_header_field
+        if (Flags & 0x20) {                                             // program_packet_sequence_counter
+            if (Pos + 2 > Limit) return;
+            m_SequenceCounterFlag = true;
+            m_SequenceCounter = Input[Pos] & 0x7F;
+            Pos += 2;
+        }
+        if (Flags & 0x10) {                                             // P-STD_buffer, skala 128 lub 1024 bajtów
+            if (Pos + 2 > Limit) return;
+            m_PSTDBufferFlag = true;
+            const uint32_t BufferSize = ((uint32_t)(Input[Pos] & 0x1F) << 8) | Input[Pos + 1];
+            m_PSTDBufferSize = BufferSize * ((Input[Pos] & 0x20) ? 1024 : 128);
+        }
+    }
+}
+
+// Zwraca prefix startowy pakietu.
+uint32_t xPES_PacketHeader::getPacketStartCodePrefix() const
+{
+    return m_PacketStartCodePrefix;
+}
+
+// Zwraca identyfikator strumienia.
+uint8_t xPES_PacketHeader::getStreamId() const
+{
+    return m_StreamId;
+}
+
+// Metoda Print() wyświetla informacje o nagłówku PES.
+void xPES_PacketHeader::Print() const
+{
+    printf("PES: PSCP=%X SID=%u L=%d",
+           m_PacketStartCodePrefix, (int) m_StreamId, m_PacketLength);
+    if (hasPTS()) printf(" PTS=%" PRIu64, m_PTS);
+    if (hasDTS()) printf(" DTS=%" PRIu64, m_DTS);
+    printf("\n");
+}
+
+
+//=============================================================================================================================================================================
+// xPES_Assembler
+//=============================================================================================================================================================================
+
+// Metoda Init() inicjalizuje assembler PES, ustawiając identyfikator procesu (PID).
+void xPES_Assembler::Init(int32_t PID, xPES_BufferPool* Pool)
+{
+    xBufferRelease();
+    m_PID = PID;
+    m_Pool = Pool; // nullptr - pula wątku, który składa pakiety (ustalana przy pierwszej alokacji)
+    Helper = 0;
+    xBufferReset();
+    m_Started = false;
+    m_Dropped = false;
+    m_Damaged = false;
+    m_LastContinuityCounter = -1;
+    m_Stats = xStats();
+}
+
+// Resetuje stan assemblera PES oraz jego bufor. Blok bufora jest zachowywany do ponownego użycia.
+void xPES_Assembler::Reset() {
+    xStartPES();
+    m_LastContinuityCounter = -1;
+}
+
+// Rozpoczyna nowy pakiet PES. Licznik ciągłości nie jest zerowany - utrata pakietu tuż przed PUSI też jest wykrywana.
+void xPES_Assembler::xStartPES()
+{
+    xBufferReset();
+    Helper = 0;
+    m_Started = false;
+    m_Dropped = false;
+    m_Damaged = false;
+    m_HeaderSize = 0;
+    m_PESH.Reset(); // Resetowanie nagłówka PES
+}
+
+// Pobiera bajty nagłówka PES z początku danych pakietu TS (przesuwa Payload za nie). Nagłówek, który nie zmieścił się
+// w pakiecie z PUSI (np. pakiet z długim polem adaptacyjnym), jest zbierany w m_Header i analizowany ponownie, gdy
+// dojdą kolejne bajty - PTS/DTS nie giną, a reszta nagłówka nie trafia do danych.
+void xPES_Assembler::xAbsorbHeader(const uint8_t*& Payload, int32_t& PayloadSize)
+{
+    if (m_HeaderSize == 0) {
+        Helper = m_PESH.Parse(Payload, PayloadSize);
+        if (m_PESH.isTruncated()) {
+            std::memcpy(m_Header, Payload, Helper);
+            m_HeaderSize = Helper;
+        }
+        Payload += Helper;
+        PayloadSize -= Helper;
+    }
+    while (m_PESH.isTruncated() && PayloadSize > 0) {
+        // brakuje części stałej (6), początku nagłówka opcjonalnego (9) albo pól do końca PES_header_data_length
+        int32_t Missing = 9 + (int32_t)m_Header[8] - m_HeaderSize;
+        if (m_HeaderSize < 9) Missing = 9 - m_HeaderSize;
+        if (m_HeaderSize < (int32_t)xTS::PES_HeaderLength) Missing = (int32_t)xTS::PES_HeaderLength - m_HeaderSize;
+        const int32_t Size = std::min(Missing, PayloadSize);
+        std::memcpy(m_Header + m_HeaderSize, Payload, Size);
+        m_HeaderSize += Size;
+        Payload += Size;
+        PayloadSize -= Size;
+        Helper = m_PESH.Parse(m_Header, m_HeaderSize);
+    }
+    if (m_PESH.isTruncated()) return;
+    // Gdy długość PES jest znana, bufor jest alokowany od razu w docelowym rozmiarze
+    const int32_t Expected = xExpectedPayloadSize();
+    if (!m_ScatterGather) xBufferReserve(Expected > 0 ? Expected : DefaultBufferSize);
+}
+
+// Sprawdza licznik ciągłości pakietu względem poprzedniego pakietu tego PID (ISO/IEC 13818-1 2.4.3.3). Pakiety bez
+// danych (AFC=2) nie zwiększają licznika, a discontinuity_indicator dopuszcza dowolną nową wartość.
+int32_t xPES_Assembler::xCheckContinuity(const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField) const
+{
+    if (!PacketHeader->hasPayload() || m_LastContinuityCounter < 0) return 0;
+    if (PacketHeader->hasAdaptationField() && AdaptationField->DC) return 0;
+    const int32_t CC = (int32_t)PacketHeader->CC;
+    if (CC == m_LastContinuityCounter) return -1;
+    return (CC - m_LastContinuityCounter - 1) & 0xF;
+}
+
+// Stosuje politykę utraty dla NumMissing brakujących pakietów przed pakietem z PayloadSize bajtami danych.
+bool xPES_Assembler::xOnLoss(int32_t NumMissing, int32_t PayloadSize)
+{
+    switch (m_LossPolicy) {
+        case eLossPolicy::Drop:
+            m_Dropped = true;
+            m_Stats.NumDroppedPES++;
+            xBufferReset();
+            return false;
+        case eLossPolicy::ZeroFill: {
+            // przy znanej długości PES wypełnienie nie może wyprzeć danych bieżącego pakietu
+            int32_t Size = NumMissing * (int32_t)(xTS::TS_PacketLength - xTS::TS_HeaderLength);
+            const int32_t Expected = xExpectedPayloadSize();
+            if (Expected >= 0) Size = std::min(Size, Expected - m_Size - PayloadSize);
+            xAppendZeros(Size);
+            break;
+        }
+        case eLossPolicy::PassThrough:
+        default:
+            break;
+    }
+    m_Damaged = true;
+    return true;
+}
+
+// Dopisuje zera - w trybie scatter-gather jako fragmenty wskazujące na stały blok zer.
+void xPES_Assembler::xAppendZeros(int32_t Size)
+{
+    static const uint8_t Zeros[xTS::TS_PacketLength] = {};
+    if (!m_ScatterGather && Size > 0) xBufferReserve(m_Size + Size);
+    while (Size > 0) {
+        const int32_t Chunk = std::min(Size, (int32_t)sizeof(Zeros));
+        xBufferAppend(Zeros, Chunk);
+        Size -= Chunk;
+    }
+}
+
+bool xPES_Assembler::isPending() const
+{
+    if (!m_Started || m_Dropped) return false;
+    const int32_t Expected = xExpectedPayloadSize();
+    return Expected < 0 || (m_Damaged && m_Size < Expected);
+}
+
+bool xPES_Assembler::FinishPending(const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField)
+{
+    if (!isPending()) return false;
+    if (PacketHeader) {
+        if (PacketHeader->E) return false; // pakiet z błędem - nie wiadomo, czy to początek nowego PES
+        const int32_t Missing = xCheckContinuity(PacketHeader, AdaptationField);
+        if (Missing < 0) return false; // duplikat ostatniego pakietu, bieżący PES trwa
+        // utrata końca pakietu PES - liczona przez AbsorbPacket() dla pakietu z PUSI
+        if (Missing > 0 && !xOnLoss(Missing, 0)) return false;
+    }
+    // niekompletny PES o znanej długości jest uzupełniany zerami do pełnej długości
+    const int32_t Expected = xExpectedPayloadSize();
+    if (m_LossPolicy == eLossPolicy::ZeroFill && Expected > m_Size) xAppendZeros(Expected - m_Size);
+    return true;
+}
+
+// Metoda AbsorbPacket() przetwarza pojedynczy pakiet strumienia transportowego.
+xPES_Assembler::eResult xPES_Assembler::AbsorbPacket(const uint8_t* TransportStreamPacket, const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField) {
+    if ((int32_t)PacketHeader->PID != m_PID) return eResult::UnexpectedPID;
+
+    // Pakiet z błędem transmisji jest odrzucany - jego licznik ciągłości jest niewiarygodny, brak pakietu wykaże następny
+    if (PacketHeader->E) {
+        m_Stats.NumTEI++;
+        return eResult::StreamPacketLost;
+    }
+
+    // Sprawdzanie licznika ciągłości
+    const int32_t Missing = xCheckContinuity(PacketHeader, AdaptationField);
+    if (Missing < 0) {
+        m_Stats.NumDuplicates++;
+        return eResult::PacketDuplicate;
+    }
+    if (PacketHeader->hasAdaptationField() && AdaptationField->DC) m_Stats.NumDiscontinuities++;
+    if (PacketHeader->hasPayload()) m_LastContinuityCounter = (int8_t)PacketHeader->CC;
+    m_Stats.NumLost += (uint64_t)Missing;
+
+    const uint8_t* Payload = TransportStreamPacket + xTS::TS_HeaderLength;
+    int32_t PayloadSize = PacketHeader->hasPayload() ? (int32_t)(xTS::TS_PacketLength - xTS::TS_HeaderLength) : 0;
+    if (PacketHeader->hasAdaptationField() && PayloadSize > 0) {
+        Payload += 1 + AdaptationField->AFL;
+        PayloadSize = std::max(0, PayloadSize - 1 - (int32_t)AdaptationField->AFL);
+    }
+
+    if (PacketHeader->getS() == 1) { // Sprawdzanie, czy jest to początek nowego pakietu PES
+        xStartPES(); // utrata przed PUSI dotyczy poprzedniego pakietu PES (FinishPending)
+    }
+    else {
+        // Bez rozpoczętego pakietu PES (lub za końcem zakończonego) dane nie mają gdzie trafić
+        const int32_t Expected = xExpectedPayloadSize();
+        if (!m_Started || m_Dropped || (Expected >= 0 && m_Size >= Expected)) return eResult::StreamPacketLost;
+        if (Missing > 0 && m_PESH.isTruncated()) {
+            // utracona część nagłówka - nie wiadomo, gdzie zaczynają się dane, pakiet PES jest odrzucany niezależnie od polityki
+            m_Dropped = true;
+            m_Stats.NumDroppedPES++;
+            xBufferReset();
+            return eResult::StreamPacketLost;
+        }
+        if (Missing > 0 && !xOnLoss(Missing, PayloadSize)) return eResult::StreamPacketLost;
+    }
+
+    eResult Result = eResult::AssemblingContinue;
+    if (!m_Started) { 
+        m_Started = true;
+        xAbsorbHeader(Payload, PayloadSize);
+        Result = eResult::AssemblingStarted;
+    }
+    else if (m_PESH.isTruncated()) {
+        xAbsorbHeader(Payload, PayloadSize); // dokończenie nagłówka z pakietu z PUSI
+    }
+
+    // Dane za końcem pakietu PES nie należą do niego
+    const int32_t Expected = xExpectedPayloadSize();
+    if (Expected >= 0 && m_Size + PayloadSize > Expected) PayloadSize = Expected - m_Size;
+    xBufferAppend(Payload, PayloadSize);
+
+    if (Expected >= 0 && m_Size >= Expected)
+        return eResult::AssemblingFinished;
+    return Result;
+}
+
+void xPES_Assembler::SavePayloadToFile(const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        std::cerr << "Cannot open file for writing.\n";
+        return;
+    }
+    
+    if (m_ScatterGather) {
+        for (const xPES_Slice& Slice : m_Slices) fwrite(Slice.Data, 1, Slice.Size, file);
+    } else if (m_Size > 0) {
+        fwrite(m_Block.Data, 1, m_Size, file);
+    }
+
+    fclose(file);
+}
+
+// Zapisuje stan składania - w trybie scatter-gather dane fragmentów są kopiowane do obrazu stanu.
+void xPES_Assembler::SaveState(xTS_StateWriter& Writer) const
+{
+    Writer.Put(m_PID, m_Size, m_PESH, m_LastContinuityCounter, m_Started, m_Dropped, m_Damaged, m_Stats, Helper, m_HeaderSize);
+    Writer.PutBytes(m_Header, (size_t)m_HeaderSize);
+    if (m_ScatterGather) {
+        for (const xPES_Slice& Slice : m_Slices) Writer.PutBytes(Slice.Data, (size_t)Slice.Size);
+    } else if (m_Size > 0) {
+        Writer.PutBytes(m_Block.Data, (size_t)m_Size);
+    }
+}
+
+// Odtwarza stan zapisany przez SaveState(). Bufor jest rezerwowany tak jak przy rozpoczęciu pakietu PES w AbsorbPacket().
+bool xPES_Assembler::LoadState(xTS_StateReader& Reader)
+{
+    int32_t PID = -1;
+    int32_t Size = 0;
+    if (!Reader.Get(PID, Size) || PID != m_PID || Size < 0 || (m_ScatterGather && Size > 0)) return false;
+    xStartPES();
+    if (!Reader.Get(m_PESH, m_LastContinuityCounter, m_Started, m_Dropped, m_Damaged, m_Stats, Helper, m_HeaderSize)) return false;
+    if (m_HeaderSize < 0 || m_HeaderSize > MaxHeaderLength) return false;
+    const uint8_t* Header = Reader.GetBytes((size_t)m_HeaderSize);
+    if (!Header) return false;
+    std::memcpy(m_Header, Header, (size_t)m_HeaderSize);
+    const uint8_t* Data = Reader.GetBytes((size_t)Size);
+    if (!Data) return false;
+    if (m_Started && !m_ScatterGather) {
+        const int32_t Expected = xExpectedPayloadSize();
+        xBufferReserve(std::max(Size, Expected > 0 ? Expected : DefaultBufferSize));
+    }
+    xBufferAppend(Data, Size);
+    return true;
+}
+
+// Metoda PrintPESH() wyświetla informacje o nagłówku PES.
+void xPES_Assembler::PrintPESH() const
+{
+    m_PESH.Print();
+}
+
+// Zwraca wskaźnik do bufora z pakietami.
+const uint8_t* xPES_Assembler::getPacket() const
+{
+    return m_ScatterGather ? nullptr : m_Block.Data;
+}
+
+// Zwraca liczbę bajtów w buforze.
+int32_t xPES_Assembler::getNumPacketBytes() const
+{
+    return m_Size;
+}
+
+// Zwraca oczekiwaną liczbę bajtów danych PES (bez nagłówka) lub -1, gdy pole długości wynosi 0 (pakiet nieograniczony).
+int32_t xPES_Assembler::xExpectedPayloadSize() const
+{
+    if (m_PESH.getPacketLength() == 0) return -1;
+    return std::max(0, (int32_t)m_PESH.getPacketLength() + (int32_t)xTS::PES_HeaderLength - Helper);
+}
+
+// Resetuje bufor.
+void xPES_Assembler::xBufferReset()
+{
+    m_Size = 0;
+    m_Slices.clear();
+}
+
+// Zapewnia miejsce w buforze - przy powiększaniu blok jest wymieniany na większy z puli.
+// Brak pamięci zgłaszany jest jak przez std::vector (std::bad_alloc), stary blok pozostaje nienaruszony.
+void xPES_Assembler::xBufferReserve(int32_t Size)
+{
+    if ((uint32_t)Size <= m_Block.Capacity) return;
+    if (!m_Pool) m_Pool = &xPES_BufferPool::getThreadDefault();
+    xPES_BufferPool::xBlock Block = m_Pool->Acquire((uint32_t)Size);
+    if (!Block.Data) throw std::bad_alloc();
+    if (m_Size > 0) std::memcpy(Block.Data, m_Block.Data, m_Size);
+    m_Pool->Release(m_Block);
+    m_Block = Block;
+}
+
+// Dodaje dane do bufora.
+void xPES_Assembler::xBufferAppend(const uint8_t* Data, int32_t Size)
+{
+    if (Size <= 0) return;
+    if (m_ScatterGather) {
+        m_Slices.push_back({ Data, Size });
+    } else {
+        if ((uint32_t)(m_Size + Size) > m_Block.Capacity) xBufferReserve(std::max(m_Size + Size, (int32_t)m_Block.Capacity * 2));
+        std::memcpy(m_Block.Data + m_Size, Data, Size);
+    }
+    m_Size += Size;
+}
+
+// Zwraca blok do puli.
+void xPES_Assembler::xBufferRelease()
+{
+    if (m_Pool) m_Pool->Release(m_Block);
+    m_Size = 0;
+}
+
+// Konstruktor i destruktor klasy xPES_Assembler.
+xPES_Assembler::xPES_Assembler() : m_PID(-1), m_Pool(nullptr), m_Size(0), m_ScatterGather(false), m_LastContinuityCounter(-1), m_Started(false), m_Dropped(false),
+                                   m_Damaged(false), m_LossPolicy(eLossPolicy::Drop), Helper(0), m_HeaderSize(0) {}
+xPES_Assembler::~xPES_Assembler() { xBufferRelease(); }
+
+xPES_Assembler::xPES_Assembler(xPES_Assembler&& Other) noexcept : xPES_Assembler()
+{
+    *this = std::move(Other);
+}
+
+xPES_Assembler& xPES_Assembler::operator=(xPES_Assembler&& Other) noexcept
+{
+    if (this == &Other) return *this;
+    xBufferRelease();
+    m_PID                   = Other.m_PID;
+    m_Pool                  = Other.m_Pool;
+    m_Block                 = Other.m_Block;
+    m_Size                  = Other.m_Size;
+    m_ScatterGather         = Other.m_ScatterGather;
+    m_Slices                = std::move(Other.m_Slices);
+    m_PESH                  = Other.m_PESH;
+    m_LastContinuityCounter = Other.m_LastContinuityCounter;
+    m_Started               = Other.m_Started;
+    m_Dropped               = Other.m_Dropped;
+    m_Damaged               = Other.m_Damaged;
+    m_LossPolicy            = Other.m_LossPolicy;
+    m_Stats                 = Other.m_Stats;
+    Helper                  = Other.Helper;
+    m_HeaderSize            = Other.m_HeaderSize;
+    std::memcpy(m_Header, Other.m_Header, (size_t)m_HeaderSize);
+    Other.m_Block = xPES_BufferPool::xBlock();
+    Other.m_Size  = 0;
+    return *this;
+}
@@ -1,192 +1,371 @@
-#pragma once
-#include <iostream>
-#include <cstdint>
-#include "tsCommon.h"
-#include <string>
-#include <vector>
-
-/*
-MPEG-TS packet:
-`        3                   2                   1                   0  `
-`      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0  `
-`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
-`   0 |                             Header                            | `
-`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
-`   4 |                  Adaptation field + Payload                   | `
-`     |                                                               | `
-` 184 |                                                               | `
-`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
-
-
-MPEG-TS packet header:
-`        3                   2                   1                   0  `
-`      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0  `
-`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
-`   0 |       SB      |E|S|T|           PID           |TSC|AFC|   CC  | `
-`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
-
-Sync byte                    (SB ) :  8 bits
-Transport error indicator    (E  ) :  1 bit
-Payload unit start indicator (S  ) :  1 bit
-Transport priority           (T  ) :  1 bit
-Packet Identifier            (PID) : 13 bits
-Transport scrambling control (TSC) :  2 bits
-Adaptation field control     (AFC) :  2 bits
-Continuity counter           (CC ) :  4 bits
-*/
-
-//=============================================================================================================================================================================
-// xTS_PacketHeader
-//=============================================================================================================================================================================
-
-class xTS
-{
-public:
-  static constexpr uint32_t TS_PacketLength  = 188;
-  static constexpr uint32_t TS_HeaderLength  = 4;
-  static constexpr uint32_t PES_HeaderLength = 6;
-  static constexpr uint32_t BaseClockFrequency_Hz         =    90000; //Hz
-  static constexpr uint32_t ExtendedClockFrequency_Hz     = 27000000; //Hz
-  static constexpr uint32_t BaseClockFrequency_kHz        =       90; //kHz
-  static constexpr uint32_t ExtendedClockFrequency_kHz    =    27000; //kHz
-  static constexpr uint32_t BaseToExtendedClockMultiplier =      300;
-};
-
-class xTS_PacketHeader
-{
-public:
-  enum class ePID : uint16_t
-  {
-    PAT  = 0x0000,
-    CAT  = 0x0001,
-    TSDT = 0x0002,
-    IPMT = 0x0003,
-    NIT  = 0x0010,
-    SDT  = 0x0011, 
-    NuLL = 0x1FFF,
-  };
-
-  uint32_t SB;
-  uint32_t E;
-  uint32_t S;
-  uint32_t T;
-  uint32_t PID;
-  uint32_t TSC;
-  uint32_t AFC;
-  uint32_t CC;
-
-public:
-  void Reset();
-  int32_t Parse(const uint8_t* Input);
-  void Print() const;
-
-  uint32_t getAFC() const { return AFC; }
-  uint32_t getS() const { return S; }
-  uint32_t getPID() const;
-
-  uint8_t getSyncByte() const { return static_cast<uint8_t>(SB); }
-  bool hasAdaptationField() const { return AFC == 2 || AFC == 3; }
-  bool hasPayload() const { return AFC == 1 || AFC == 3; }
-};
-
-//=============================================================================================================================================================================
-// xTS_AdaptationField
-//=============================================================================================================================================================================
-
-class xTS_AdaptationField
-{
-public:
-  uint8_t AFL; // Adaptation Field Length
-  uint8_t DC;  // Discontinuity Indicator
-  uint8_t RA;  // Random Access Indicator
-  uint8_t SP;  // Elementary Stream Priority Indicator
-  uint8_t PR;  // Program Clock Reference Flag
-  uint8_t OR;  // Original Program Clock Reference Flag
-  uint8_t SF;  // Splicing Point Flag
-  uint8_t TP;  // Transport Private Data Flag
-  uint8_t EX;  // Adaptation Field Extension Flag
-
-  xTS_AdaptationField() { Reset(); }
-
-  void Reset();
-
-  int32_t Parse(const uint8_t* Input, uint8_t AFC);
-  void Print() const;
-};
-
-//=============================================================================================================================================================================
-// xPES_PacketHeader
-//=============================================================================================================================================================================
-
-// Klasa xPES_PacketHeader zarządza nagłówkiem pakietu PES, który rozpoczyna każdy pakiet PES w strumieniu MPEG-TS.
-class xPES_PacketHeader
-{
-public:
-    enum eStreamId : uint8_t
-    {
-        eStreamId_program_stream_map = 0xBC,
-        eStreamId_padding_stream = 0xBE,
-        eStreamId_private_stream_2 = 0xBF,
-        eStreamId_ECM = 0xF0,
-        eStreamId_EMM = 0xF1,
-        eStreamId_program_stream_directory = 0xFF,
-        eStreamId_DSMCC_stream = 0xF2,
-        eStreamId_ITUT_H222_1_type_E = 0xF8,
-    };
-
-    xPES_PacketHeader();
-    void Reset();                        // Resetuje stan nagłówka do stanu początkowego.
-    int32_t Parse(const uint8_t* Input); // Analizuje nagłówek PES z bufora danych.
-    void Print() const;                  // Wyświetla informacje o nagłówku PES.
-    uint32_t getPacketStartCodePrefix() const; // Zwraca prefix startowy pakietu.
-    uint8_t getStreamId() const;               // Zwraca identyfikator strumienia.
-    uint16_t xPES_PacketHeader::getPacketLength() const 
-    {
-    return m_PacketLength;
-    }
-
-
-protected:
-    uint32_t m_PacketStartCodePrefix;          // Prefix startowy, który oznacza początek pakietu PES.
-    uint8_t m_StreamId;                        // Identyfikator strumienia określa typ danych w pakiecie PES.
-    uint16_t m_PacketLength;                   // Długość danych w pakiecie PES, nie licząc tego nagłówka.
-    uint8_t m_HeaderLength;
-};
-
-//=============================================================================================================================================================================
-// xPES_Assembler
-//=============================================================================================================================================================================
-
-class xPES_Assembler
-{
-public:
-    enum class eResult : int32_t
-    {
-        UnexpectedPID = 1, 
-        StreamPacketLost, 
-        AssemblingStarted, 
-        AssemblingContinue,
-        AssemblingFinished, 
-    };
-
-    xPES_Assembler();
-    ~xPES_Assembler();
-    void Init(int32_t PID);
-    // Absorbcja pakietu TS i przetwarzanie go.
-    eResult AbsorbPacket(const uint8_t* TransportStreamPacket, const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField);
-    void PrintPESH() const;            // Wyświetla informacje o skompilowanym nagłówku PES.
-    const uint8_t* getPacket() const;  // Zwraca skompilowany pakiet PES.
-    int32_t getNumPacketBytes() const; // Zwraca liczbę bajtów w skompilowanym pakiecie PES.
-    void Reset();                      // Resetuje stan assemblera.
-    void SavePayloadToFile(const char* filename);
-protected:
-    void xBufferReset();               // Resetuje bufor danych.
-    void xBufferAppend(const uint8_t* Data, int32_t Size); // Dodaje dane do bufora.
-
-    int32_t m_PID;                     // PID strumienia, który jest przetwarzany.
-    std::vector<uint8_t> m_Buffer;     // Bufor na dane pakietu PES.
-    xPES_PacketHeader m_PESH;          // Nagłówek pakietu PES.
-    int8_t m_LastContinuityCounter;    // Ostatnia wartość licznika ciągłości.
-    bool m_Started;                    // Czy składanie pakietu zostało rozpoczęte.
-    int32_t Helper;                    // Zmienna pomocnicza do nagłówka PES
-};
+#pragma once
+#include <iostream>
+#include <cstdint>
+#include "tsCommon.h"
+#include "tsBufferPool.h"
+#include <string>
+#include <vector>
+
+class xTS_StateWriter;
+class xTS_StateReader;
+
+/*
+MPEG-TS packet:
+`        3                   2                   1                   0  `
+`      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0  `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   0 |                             Header                            | `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   4 |                  Adaptation field + Payload                   | `
+`     |                                                               | `
+` 184 |                                                               | `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+
+
+MPEG-TS packet header:
+`        3                   2                   1                   0  `
+`      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0  `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   0 |       SB      |E|S|T|           PID           |TSC|AFC|   CC  | `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+
+Sync byte                    (SB ) :  8 bits
+Transport error indicator    (E  ) :  1 bit
+Payload unit start indicator (S  ) :  1 bit
+Transport priority           (T  ) :  1 bit
+Packet Identifier            (PID) : 13 bits
+Transport scrambling control (TSC) :  2 bits
+Adaptation field control     (AFC) :  2 bits
+Continuity counter           (CC ) :  4 bits
+*/
+
+//=============================================================================================================================================================================
+// xTS_PacketHeader
+//=============================================================================================================================================================================
+
+class xTS
+{
+public:
+  static constexpr uint32_t TS_PacketLength  = 188;
+  static constexpr uint32_t TS_HeaderLength  = 4;
+  static constexpr uint32_t PES_HeaderLength = 6;
+  static constexpr uint32_t BaseClockFrequency_Hz         =    90000; //Hz
+  static constexpr uint32_t ExtendedClockFrequency_Hz     = 27000000; //Hz
+  static constexpr uint32_t BaseClockFrequency_kHz        =       90; //kHz
+  static constexpr uint32_t ExtendedClockFrequency_kHz    =    27000; //kHz
+  static constexpr uint32_t BaseToExtendedClockMultiplier =      300;
+};
+
+class xTS_PacketHeader
+{
+public:
+  enum class ePID : uint16_t
+  {
+    PAT  = 0x0000,
+    CAT  = 0x0001,
+    TSDT = 0x0002,
+    IPMT = 0x0003,
+    NIT  = 0x0010,
+    SDT  = 0x0011, 
+    NuLL = 0x1FFF,
+  };
+
+  uint32_t SB;
+  uint32_t E;
+  uint32_t S;
+  uint32_t T;
+  uint32_t PID;
+  uint32_t TSC;
+  uint32_t AFC;
+  uint32_t CC;
+
+public:
+  void Reset();
+  int32_t Parse(const uint8_t* Input);
+  void Print() const;
+
+  uint32_t getAFC() const { return AFC; }
+  uint32_t getS() const { return S; }
+  uint32_t getPID() const;
+
+  uint8_t getSyncByte() const { return static_cast<uint8_t>(SB); }
+  bool hasAdaptationField() const { return AFC == 2 || AFC == 3; }
+  bool hasPayload() const { return AFC == 1 || AFC == 3; }
+};
+
+//=============================================================================================================================================================================
+// xTS_AdaptationField
+//=============================================================================================================================================================================
+
+class xTS_AdaptationField
+{
+public:
+  static constexpr uint64_t PCR_Modulus = (1ull << 33) * xTS::BaseToExtendedClockMultiplier; // PCR wraps after ~26.5 hours
+
+  uint8_t AFL; // Adaptation Field Length
+  uint8_t DC;  // Discontinuity Indicator
+  uint8_t RA;  // Random Access Indicator
+  uint8_t SP;  // Elementary Stream Priority Indicator
+  uint8_t PR;  // Program Clock Reference Flag
+  uint8_t OR;  // Original Program Clock Reference Flag
+  uint8_t SF;  // Splicing Point Flag
+  uint8_t TP;  // Transport Private Data Flag
+  uint8_t EX;  // Adaptation Field Extension Flag
+
+  // Optional fields - valid only when the matching flag is set
+  uint64_t PCR;               // Program Clock Reference, 27 MHz units (base * 300 + extension)
+  uint64_t OPCR;              // Original Program Clock Reference, 27 MHz units
+  int8_t   SpliceCountdown;   // packets until the splicing point
+  uint8_t  PrivateDataLength; // transport_private_data_length
+  uint8_t  PrivateDataOffset; // offset of transport_private_data from the adaptation_field_length byte
+
+  // Adaptation field extension
+  uint8_t  AFEL;              // Adaptation Field Extension Length
+  uint8_t  LTW;               // Legal Time Window Flag
+  uint8_t  PW;                // Piecewise Rate Flag
+  uint8_t  SS;                // Seamless Splice Flag
+  uint8_t  LTWValid;          // ltw_valid_flag
+  uint16_t LTWOffset;         // ltw_offset, 15 bits
+  uint32_t PiecewiseRate;     // 22 bits, 50 bytes/s units
+  uint8_t  SpliceType;
+  uint64_t DTSNextAU;         // DTS_next_AU, 90 kHz units
+
+  uint8_t  StuffingBytes;     // bytes after the last decoded field
+  bool     Malformed;         // a field announced by its flag does not fit into AFL
+
+  xTS_AdaptationField() { Reset(); }
+
+  void Reset();
+
+  int32_t Parse(const uint8_t* Input, uint8_t AFC);
+  void Print() const;
+
+  // 27 MHz clock difference B - A, taking the PCR wrap-around into account
+  static int64_t PCRDiff(uint64_t A, uint64_t B) { return (int64_t)((B + PCR_Modulus - A) % PCR_Modulus); }
+
+protected:
+  void xResetOptional();
+};
+
+//=============================================================================================================================================================================
+// xPES_PacketHeader
+//=============================================================================================================================================================================
+
+// Klasa xPES_PacketHeader zarządza nagłówkiem pakietu PES, który rozpoczyna każdy pakiet PES w strumieniu MPEG-TS.
+class xPES_PacketHeader
+{
+public:
+    enum eStreamId : uint8_t
+    {
+        eStreamId_program_stream_map = 0xBC,
+        eStreamId_padding_stream = 0xBE,
+        eStreamId_private_stream_2 = 0xBF,
+        eStreamId_ECM = 0xF0,
+        eStreamId_EMM = 0xF1,
+        eStreamId_program_stream_directory = 0xFF,
+        eStreamId_DSMCC_stream = 0xF2,
+        eStreamId_ITUT_H222_1_type_E = 0xF8,
+    };
+
+    static constexpr uint64_t PTS_Modulus = 1ull << 33; // PTS/DTS zawijają się po ~26,5 godziny
+
+    xPES_PacketHeader();
+    void Reset();                        // Resetuje stan nagłówka do stanu początkowego.
+    int32_t Parse(const uint8_t* Input, int32_t Size = xTS::TS_PacketLength - xTS::TS_HeaderLength); // Analizuje nagłówek PES z bufora danych (Size - dostępne bajty).
+    void Print() const;                  // Wyświetla informacje o nagłówku PES.
+    uint32_t getPacketStartCodePrefix() const; // Zwraca prefix startowy pakietu.
+    uint8_t getStreamId() const;               // Zwraca identyfikator strumienia.
+    uint16_t getPacketLength() const
+    {
+    return m_PacketLength;
+    }
+    uint16_t getHeaderLength() const { return m_HeaderLength; } // Długość całego nagłówka PES (6 lub 9 + PES_header_data_length).
+    bool isTruncated() const { return m_Truncated; }           // Nagłówek nie zmieścił się w dostępnych bajtach.
+
+    // Nagłówek opcjonalny (brak dla strumieni takich jak padding_stream czy private_stream_2)
+    bool hasOptionalHeader() const { return m_HasOptionalHeader; }
+    uint8_t getScramblingControl() const { return m_ScramblingControl; }
+    bool isPriority() const { return m_Priority; }
+    bool isDataAligned() const { return m_DataAlignment; }
+    bool isCopyright() const { return m_Copyright; }
+    bool isOriginal() const { return m_Original; }
+    uint8_t getHeaderDataLength() const { return m_HeaderDataLength; }
+
+    bool hasPTS() const { return m_PTSDTSFlags & 0x2; }
+    bool hasDTS() const { return m_PTSDTSFlags == 0x3; }
+    uint64_t getPTS() const { return m_PTS; }  // 90 kHz
+    uint64_t getDTS() const { return m_DTS; }  // 90 kHz, równy PTS gdy DTS nie występuje
+    bool hasESCR() const { return m_ESCRFlag; }
+    uint64_t getESCR() const { return m_ESCR; } // 27 MHz (base * 300 + extension)
+    bool hasESRate() const { return m_ESRateFlag; }
+    uint32_t getESRate() const { return m_ESRate; } // jednostki 50 bajtów/s
+    bool hasTrickMode() const { return m_TrickModeFlag; }
+    uint8_t getTrickMode() const { return m_TrickMode; } // trick_mode_control (3 bity) i pola zależne (5 bitów)
+    bool hasAdditionalCopyInfo() const { return m_AdditionalCopyInfoFlag; }
+    uint8_t getAdditionalCopyInfo() const { return m_AdditionalCopyInfo; }
+    bool hasCRC() const { return m_CRCFlag; }
+    uint16_t getPreviousCRC() const { return m_PreviousCRC; }
+    bool hasExtension() const { return m_ExtensionFlag; }
+    bool hasSequenceCounter() const { return m_SequenceCounterFlag; }
+    uint8_t getSequenceCounter() const { return m_SequenceCounter; } // program_packet_sequence_counter
+    bool hasPSTDBuffer() const { return m_PSTDBufferFlag; }
+    uint32_t getPSTDBufferSize() const { return m_PSTDBufferSize; } // w bajtach
+
+    // Różnica B - A znaczników 90 kHz z uwzględnieniem zawinięcia (wynik w zakresie [-2^32, 2^32)).
+    static int64_t PTSDiff(uint64_t A, uint64_t B)
+    {
+        const int64_t Diff = (int64_t)((B - A) & (PTS_Modulus - 1));
+        return Diff >= (int64_t)(PTS_Modulus / 2) ? Diff - (int64_t)PTS_Modulus : Diff;
+    }
+
+protected:
+    void xParseOptional(const uint8_t* Input, int32_t Size); // Dekoduje pola nagłówka opcjonalnego.
+
+    uint32_t m_PacketStartCodePrefix;          // Prefix startowy, który oznacza początek pakietu PES.
+    uint8_t m_StreamId;                        // Identyfikator strumienia określa typ danych w pakiecie PES.
+    uint16_t m_PacketLength;                   // Długość danych w pakiecie PES, nie licząc tego nagłówka.
+    uint16_t m_HeaderLength;                   // Długość całego nagłówka PES (do 9 + 255 bajtów).
+    bool m_Truncated;                          // Czy nagłówek został obcięty.
+
+    bool m_HasOptionalHeader;                  // Czy występuje nagłówek opcjonalny.
+    uint8_t m_ScramblingControl;               // PES_scrambling_control
+    bool m_Priority;                           // PES_priority
+    bool m_DataAlignment;                      // data_alignment_indicator
+    bool m_Copyright;                          // copyright
+    bool m_Original;                           // original_or_copy
+    uint8_t m_PTSDTSFlags;                     // PTS_DTS_flags
+    bool m_ESCRFlag;
+    bool m_ESRateFlag;
+    bool m_TrickModeFlag;                      // DSM_trick_mode_flag
+    bool m_AdditionalCopyInfoFlag;
+    bool m_CRCFlag;                            // PES_CRC_flag
+    bool m_ExtensionFlag;                      // PES_extension_flag
+    uint8_t m_HeaderDataLength;                // PES_header_data_length
+
+    uint64_t m_PTS;                            // Znacznik czasu prezentacji.
+    uint64_t m_DTS;                            // Znacznik czasu dekodowania.
+    uint64_t m_ESCR;                           // Zegar referencyjny strumienia elementarnego.
+    uint32_t m_ESRate;
+    uint8_t m_TrickMode;
+    uint8_t m_AdditionalCopyInfo;
+    uint16_t m_PreviousCRC;                    // previous_PES_packet_CRC
+    bool m_SequenceCounterFlag;
+    uint8_t m_SequenceCounter;
+    bool m_PSTDBufferFlag;
+    uint32_t m_PSTDBufferSize;
+};
+
+//=============================================================================================================================================================================
+// xPES_Assembler
+//=============================================================================================================================================================================
+
+// Fragment danych PES wskazujący bezpośrednio na bufor źródłowy (tryb scatter-gather).
+struct xPES_Slice
+{
+    const uint8_t* Data;
+    int32_t        Size;
+};
+
+class xPES_Assembler
+{
+public:
+    enum class eResult : int32_t
+    {
+        UnexpectedPID = 1, 
+        StreamPacketLost, 
+        AssemblingStarted, 
+        AssemblingContinue,
+        AssemblingFinished, 
+        PacketDuplicate,    // powtórzony pakiet (ten sam licznik ciągłości) - pomijany
+    };
+
+    // Postępowanie przy utracie pakietów wykrytej przez licznik ciągłości.
+    enum class eLossPolicy : int32_t
+    {
+        Drop,        // pakiet PES jest odrzucany, składanie wznawia następny PUSI (domyślnie)
+        ZeroFill,    // brakujące pakiety są zastępowane zerami (184 bajty na pakiet), PES jest oznaczany jako uszkodzony
+        PassThrough, // brakujące dane są pomijane, PES jest oznaczany jako uszkodzony
+    };
+
+    struct xStats
+    {
+        uint64_t NumLost            = 0; // utracone pakiety - szacowane z przeskoku licznika ciągłości (modulo 16)
+        uint64_t NumDuplicates      = 0; // powtórzone pakiety, pominięte
+        uint64_t NumTEI             = 0; // pakiety z transport_error_indicator, odrzucone
+        uint64_t NumDiscontinuities = 0; // discontinuity_indicator - nowa wartość licznika nie jest błędem
+        uint64_t NumDroppedPES      = 0; // pakiety PES odrzucone z powodu utraty danych (Drop)
+    };
+
+    static constexpr int32_t DefaultBufferSize = 64 * 1024; // początkowy rozmiar bufora, gdy długość PES nie jest znana
+    static constexpr int32_t MaxHeaderLength   = 9 + 255;   // nagłówek PES z najdłuższym polem PES_header_data_length
+
+    xPES_Assembler();
+    ~xPES_Assembler();
+    xPES_Assembler(xPES_Assembler&& Other) noexcept;
+    xPES_Assembler& operator=(xPES_Assembler&& Other) noexcept;
+    xPES_Assembler(const xPES_Assembler&) = delete;
+    xPES_Assembler& operator=(const xPES_Assembler&) = delete;
+
+    void Init(int32_t PID, xPES_BufferPool* Pool = nullptr);
+    // Tryb scatter-gather: zamiast kopiować dane, zapamiętywane są fragmenty wskazujące na bufor źródłowy.
+    // Bufor źródłowy (np. zmapowany plik) musi pozostać ważny do czasu odebrania gotowego pakietu.
+    void setScatterGather(bool Enable) { m_ScatterGather = Enable; }
+    bool isScatterGather() const { return m_ScatterGather; }
+    void setLossPolicy(eLossPolicy Policy) { m_LossPolicy = Policy; }
+    eLossPolicy getLossPolicy() const { return m_LossPolicy; }
+    const xStats& getStats() const { return m_Stats; }
+    // Czy w bieżącym pakiecie PES brakuje danych (ZeroFill - zastąpionych zerami, PassThrough - pominiętych).
+    bool isDamaged() const { return m_Damaged; }
+    // Absorbcja pakietu TS i przetwarzanie go.
+    eResult AbsorbPacket(const uint8_t* TransportStreamPacket, const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField);
+    void PrintPESH() const;            // Wyświetla informacje o skompilowanym nagłówku PES.
+    const uint8_t* getPacket() const;  // Zwraca skompilowany pakiet PES (nullptr w trybie scatter-gather).
+    int32_t getNumPacketBytes() const; // Zwraca liczbę bajtów w skompilowanym pakiecie PES.
+    const std::vector<xPES_Slice>& getSlices() const { return m_Slices; } // Fragmenty pakietu PES w trybie scatter-gather.
+    const xPES_PacketHeader& getPESH() const { return m_PESH; } // Zwraca nagłówek bieżącego pakietu PES.
+    // Czy nagłówek PES rozpoczętego pakietu jest jeszcze niekompletny - jego dalsza część (np. PTS) przyjdzie w kolejnym
+    // pakiecie TS, getPESH() zawiera na razie tylko pola, które już nadeszły.
+    bool isHeaderPending() const { return m_Started && m_PESH.isTruncated(); }
+    int32_t getPID() const { return m_PID; }
+    // Czy składany jest pakiet PES, który kończy dopiero następny PUSI - o nieokreślonej długości (PES_packet_length == 0,
+    // np. wideo) albo niekompletny po utracie pakietów przy polityce ZeroFill / PassThrough.
+    bool isPending() const;
+    // Kończy oczekujący pakiet PES przed pakietem z PUSI (PacketHeader, nullptr na końcu danych). Utrata pakietów tuż
+    // przed PUSI jest obsługiwana zgodnie z polityką. Zwraca true, gdy pakiet PES należy przekazać dalej.
+    bool FinishPending(const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField);
+    void Reset();                      // Resetuje stan assemblera.
+    // Zapis i odtworzenie stanu składania (checkpoint, xTS_Checkpoint): zgromadzone dane, nagłówek PES, licznik ciągłości
+    // i statystyki. Konfiguracja (PID, pula, polityka utraty) nie jest zapisywana - odtwarzany assembler musi mieć ten sam
+    // PID. W trybie scatter-gather stan z danymi nie może zostać odtworzony (fragmenty wskazywałyby na nieważny bufor).
+    void SaveState(xTS_StateWriter& Writer) const;
+    bool LoadState(xTS_StateReader& Reader);
+    void SavePayloadToFile(const char* filename);
+protected:
+    void xBufferReset();               // Resetuje bufor danych.
+    void xBufferReserve(int32_t Size); // Zapewnia miejsce na Size bajtów (blok z puli).
+    void xBufferAppend(const uint8_t* Data, int32_t Size); // Dodaje dane do bufora.
+    void xBufferRelease();             // Zwraca blok do puli.
+    int32_t xExpectedPayloadSize() const; // Oczekiwana długość danych PES lub -1 gdy nieznana.
+    void xStartPES();                  // Rozpoczyna nowy pakiet PES - stan licznika ciągłości jest zachowywany.
+    void xAbsorbHeader(const uint8_t*& Payload, int32_t& PayloadSize); // Pobiera z danych bajty nagłówka PES.
+    int32_t xCheckContinuity(const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField) const; // -1 duplikat, 0 ciągłość, >0 liczba brakujących pakietów
+    bool xOnLoss(int32_t NumMissing, int32_t PayloadSize); // Stosuje politykę utraty, false gdy PES został odrzucony.
+    void xAppendZeros(int32_t Size);   // Dopisuje Size bajtów zerowych.
+
+    int32_t m_PID;                     // PID strumienia, który jest przetwarzany.
+    xPES_BufferPool* m_Pool;           // Pula, z której pobierane są bufory.
+    xPES_BufferPool::xBlock m_Block;   // Bufor na dane pakietu PES.
+    int32_t m_Size;                    // Liczba bajtów danych PES.
+    bool m_ScatterGather;              // Czy dane są zbierane bez kopiowania.
+    std::vector<xPES_Slice> m_Slices;  // Fragmenty danych w trybie scatter-gather.
+    xPES_PacketHeader m_PESH;          // Nagłówek pakietu PES.
+    int8_t m_LastContinuityCounter;    // Ostatnia wartość licznika ciągłości.
+    bool m_Started;                    // Czy składanie pakietu zostało rozpoczęte.
+    bool m_Dropped;                    // Pakiet PES odrzucony po utracie danych - oczekiwanie na PUSI.
+    bool m_Damaged;                    // W pakiecie PES brakuje danych.
+    eLossPolicy m_LossPolicy;          // Postępowanie przy utracie pakietów.
+    xStats m_Stats;                    // Liczniki błędów ciągłości.
+    int32_t Helper;                    // Zmienna pomocnicza do nagłówka PES
+    uint8_t m_Header[MaxHeaderLength]; // Nagłówek PES podzielony między pakiety TS - zebrane dotąd bajty.
+    int32_t m_HeaderSize;              // Liczba bajtów w m_Header (0, gdy nagłówek zmieścił się w pakiecie z PUSI).
+};